@@ -181,6 +181,7 @@ RegionOperate (
     }
     if (srcRgn)
 	RegionDestroy(srcRgn);
+    InvalidatePickIndex(pWin->parent);
     (*pWin->drawable.pScreen->SetShape) (pWin, kind);
     SendShapeNotify (pWin, kind);
     return Success;
@@ -595,6 +596,7 @@ ProcShapeOffset (ClientPtr client)
     if (srcRgn)
     {
         RegionTranslate(srcRgn, stuff->xOff, stuff->yOff);
+        InvalidatePickIndex(pWin->parent);
         (*pWin->drawable.pScreen->SetShape) (pWin, stuff->destKind);
     }
     SendShapeNotify (pWin, (int)stuff->destKind);
@@ -38,6 +38,12 @@ in this Software without prior written authorization from The Open Group.
 #include <sys/shm.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#ifdef SHM_FD_PASSING
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#endif
 #include <X11/X.h>
 #include <X11/Xproto.h>
 #include "misc.h"
@@ -97,6 +103,7 @@ typedef struct _ShmDesc {
     char *addr;
     Bool writable;
     unsigned long size;
+    Bool is_fd;			/* mmap()ed from a passed descriptor */
 } ShmDescRec, *ShmDescPtr;
 
 typedef struct _ShmScrPrivateRec {
@@ -132,7 +139,7 @@ static DevPrivateKeyRec shmScrPrivateKeyRec;
 static DevPrivateKeyRec shmPixmapPrivateKeyRec;
 #define shmPixmapPrivateKey (&shmPixmapPrivateKeyRec)
 static ShmFuncs miFuncs = {NULL, NULL};
-static ShmFuncs fbFuncs = {fbShmCreatePixmap, NULL};
+static ShmFuncs fbFuncs = {fbShmCreatePixmap, fbShmPutImage};
 
 #define ShmGetScreenPriv(s) ((ShmScrPrivateRec *)dixLookupPrivate(&(s)->devPrivates, shmScrPrivateKey))
 
@@ -394,7 +401,7 @@ ProcShmAttach(ClientPtr client)
         return BadValue;
     }
     for (shmdesc = Shmsegs;
-	 shmdesc && (shmdesc->shmid != stuff->shmid);
+	 shmdesc && (shmdesc->is_fd || shmdesc->shmid != stuff->shmid);
 	 shmdesc = shmdesc->next)
 	;
     if (shmdesc)
@@ -427,6 +434,7 @@ ProcShmAttach(ClientPtr client)
 	    return BadAccess;
 	}
 
+	shmdesc->is_fd = FALSE;
 	shmdesc->shmid = stuff->shmid;
 	shmdesc->refcnt = 1;
 	shmdesc->writable = !stuff->readOnly;
@@ -449,7 +457,12 @@ ShmDetachSegment(pointer value, /* must conform to DeleteType */
 
     if (--shmdesc->refcnt)
 	return TRUE;
-    shmdt(shmdesc->addr);
+#ifdef SHM_FD_PASSING
+    if (shmdesc->is_fd)
+	munmap(shmdesc->addr, shmdesc->size);
+    else
+#endif
+	shmdt(shmdesc->addr);
     for (prev = &Shmsegs; *prev != shmdesc; prev = &(*prev)->next)
 	;
     *prev = shmdesc->next;
@@ -457,6 +470,228 @@ ShmDetachSegment(pointer value, /* must conform to DeleteType */
     return Success;
 }
 
+#ifdef SHM_FD_PASSING
+/*
+ * Segments backed by a file descriptor can be truncated underneath us
+ * by the client, after which touching the mapping raises SIGBUS.  When
+ * the fault is inside one of those segments, replace the mapping with
+ * anonymous memory so the request completes with garbage instead of
+ * taking the server down; anything else goes to the previous handler.
+ */
+static struct sigaction ShmOldBusAction;
+static Bool ShmBusHandlerInstalled;
+
+static void
+ShmBusHandler(int sig, siginfo_t *info, void *context)
+{
+    ShmDescPtr shmdesc;
+    char *addr = info->si_addr;
+
+    for (shmdesc = Shmsegs; shmdesc; shmdesc = shmdesc->next)
+    {
+	if (shmdesc->is_fd &&
+	    addr >= shmdesc->addr && addr < shmdesc->addr + shmdesc->size)
+	{
+	    if (mmap(shmdesc->addr, shmdesc->size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) ==
+		MAP_FAILED)
+		break;
+	    return;
+	}
+    }
+
+    if (ShmOldBusAction.sa_flags & SA_SIGINFO)
+	(*ShmOldBusAction.sa_sigaction) (sig, info, context);
+    else if (ShmOldBusAction.sa_handler != SIG_IGN &&
+	     ShmOldBusAction.sa_handler != SIG_DFL)
+	(*ShmOldBusAction.sa_handler) (sig);
+    else
+    {
+	sigaction(SIGBUS, &ShmOldBusAction, NULL);
+	raise(sig);
+    }
+}
+
+static void
+ShmInstallBusHandler(void)
+{
+    struct sigaction act;
+
+    if (ShmBusHandlerInstalled)
+	return;
+    memset(&act, 0, sizeof(act));
+    act.sa_sigaction = ShmBusHandler;
+    act.sa_flags = SA_SIGINFO;
+    sigemptyset(&act.sa_mask);
+    if (sigaction(SIGBUS, &act, &ShmOldBusAction) == 0)
+	ShmBusHandlerInstalled = TRUE;
+}
+
+static int
+ShmAddFdSegment(ClientPtr client, XID shmseg, int fd, unsigned long size,
+		Bool readOnly)
+{
+    ShmDescPtr shmdesc;
+    void *addr;
+
+    addr = mmap(NULL, size, readOnly ? PROT_READ : PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+	return BadAccess;
+
+    shmdesc = malloc(sizeof(ShmDescRec));
+    if (!shmdesc)
+    {
+	munmap(addr, size);
+	return BadAlloc;
+    }
+    shmdesc->is_fd = TRUE;
+    shmdesc->addr = addr;
+    shmdesc->shmid = -1;
+    shmdesc->refcnt = 1;
+    shmdesc->writable = !readOnly;
+    shmdesc->size = size;
+    shmdesc->next = Shmsegs;
+    Shmsegs = shmdesc;
+
+    if (!AddResource(shmseg, ShmSegType, (pointer)shmdesc))
+	return BadAlloc;
+    return Success;
+}
+
+static int
+ProcShmAttachFd(ClientPtr client)
+{
+    struct stat statb;
+    int fd, rc;
+    REQUEST(xShmAttachFdReq);
+
+    /* Take the descriptor off the connection first so that it is not
+     * handed to a later request when this one fails. */
+    fd = ReadFdFromClient(client);
+    if (fd < 0)
+	return BadMatch;
+    if (client->req_len != bytes_to_int32(sizeof(xShmAttachFdReq)))
+    {
+	close(fd);
+	return BadLength;
+    }
+    if (stuff->readOnly != xTrue && stuff->readOnly != xFalse)
+    {
+	close(fd);
+	client->errorValue = stuff->readOnly;
+	return BadValue;
+    }
+    if (!LegalNewID(stuff->shmseg, client))
+    {
+	close(fd);
+	client->errorValue = stuff->shmseg;
+	return BadIDChoice;
+    }
+    if (fstat(fd, &statb) < 0 || statb.st_size == 0)
+    {
+	close(fd);
+	return BadAccess;
+    }
+
+    rc = ShmAddFdSegment(client, stuff->shmseg, fd, statb.st_size,
+			 stuff->readOnly);
+    close(fd);
+    return rc;
+}
+
+static int
+ShmCreateFd(unsigned long size)
+{
+    int fd;
+
+#ifdef HAVE_MEMFD_CREATE
+    fd = memfd_create("xorg-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+#endif
+    {
+	static const char *dirs[] = { "/dev/shm", "/tmp" };
+	char template[PATH_MAX];
+	int i;
+
+	fd = -1;
+	for (i = 0; fd < 0 && i < sizeof(dirs) / sizeof(dirs[0]); i++)
+	{
+	    snprintf(template, sizeof(template), "%s/shmfd-XXXXXX", dirs[i]);
+	    fd = mkstemp(template);
+	    if (fd >= 0)
+	    {
+		unlink(template);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	    }
+	}
+	if (fd < 0)
+	    return -1;
+    }
+
+    if (ftruncate(fd, size) < 0)
+    {
+	close(fd);
+	return -1;
+    }
+#ifdef F_ADD_SEALS
+    /* The server owns the size of this segment; don't let it change. */
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+#endif
+    return fd;
+}
+
+static int
+ProcShmCreateSegment(ClientPtr client)
+{
+    xShmCreateSegmentReply rep;
+    int fd, rc;
+    REQUEST(xShmCreateSegmentReq);
+
+    REQUEST_SIZE_MATCH(xShmCreateSegmentReq);
+    LEGAL_NEW_RESOURCE(stuff->shmseg, client);
+    if (stuff->readOnly != xTrue && stuff->readOnly != xFalse)
+    {
+	client->errorValue = stuff->readOnly;
+	return BadValue;
+    }
+    if (stuff->size == 0)
+    {
+	client->errorValue = 0;
+	return BadValue;
+    }
+
+    fd = ShmCreateFd(stuff->size);
+    if (fd < 0)
+	return BadAlloc;
+
+    rc = ShmAddFdSegment(client, stuff->shmseg, fd, stuff->size,
+			 stuff->readOnly);
+    if (rc != Success)
+    {
+	close(fd);
+	return rc;
+    }
+
+    if (WriteFdToClient(client, fd, TRUE) < 0)
+    {
+	FreeResource(stuff->shmseg, RT_NONE);
+	close(fd);
+	return BadAlloc;
+    }
+
+    memset(&rep, 0, sizeof(rep));
+    rep.type = X_Reply;
+    rep.nfd = 1;
+    rep.sequenceNumber = client->sequence;
+    rep.length = 0;
+    if (client->swapped)
+	swaps(&rep.sequenceNumber);
+    WriteToClient(client, sizeof(xShmCreateSegmentReply), (char *)&rep);
+    return Success;
+}
+#endif /* SHM_FD_PASSING */
+
 static int
 ProcShmDetach(ClientPtr client)
 {
@@ -471,17 +706,30 @@ ProcShmDetach(ClientPtr client)
 
 /*
  * If the given request doesn't exactly match PutImage's constraints,
- * wrap the image in a scratch pixmap header and let CopyArea sort it out.
+ * wrap the image in a scratch pixmap header and let CopyArea (or
+ * CopyPlane, for bitmaps) read it straight out of the segment.  Only
+ * multi-plane XYPixmap images need an intermediate pixmap.
+ *
+ * This is also the fallback for screens whose PutImage hook can't
+ * handle a request.
  */
-static void
-doShmPutImage(DrawablePtr dst, GCPtr pGC,
+void
+fbShmPutImage(DrawablePtr dst, GCPtr pGC,
 	      int depth, unsigned int format,
 	      int w, int h, int sx, int sy, int sw, int sh, int dx, int dy,
 	      char *data)
 {
     PixmapPtr pPixmap;
 
-    if (format == ZPixmap || depth == 1) {
+    if (format == XYBitmap) {
+	pPixmap = GetScratchPixmapHeader(dst->pScreen, w, h, 1, 1,
+					 BitmapBytePad(w), data);
+	if (!pPixmap)
+	    return;
+	(void)(*pGC->ops->CopyPlane)(&pPixmap->drawable, dst, pGC,
+				     sx, sy, sw, sh, dx, dy, 1L);
+	FreeScratchPixmapHeader(pPixmap);
+    } else if (format == ZPixmap || depth == 1) {
 	pPixmap = GetScratchPixmapHeader(dst->pScreen, w, h, depth,
 					 BitsPerPixel(depth),
 					 PixmapBytePad(w, depth),
@@ -504,14 +752,10 @@ doShmPutImage(DrawablePtr dst, GCPtr pGC,
 	}
 	ValidateGC(&pPixmap->drawable, putGC);
 	(*putGC->ops->PutImage)(&pPixmap->drawable, putGC, depth, -sx, -sy, w, h, 0,
-				(format == XYPixmap) ? XYPixmap : ZPixmap, data);
+				XYPixmap, data);
 	FreeScratchGC(putGC);
-	if (format == XYBitmap)
-	    (void)(*pGC->ops->CopyPlane)(&pPixmap->drawable, dst, pGC, 0, 0, sw, sh,
-					 dx, dy, 1L);
-	else
-	    (void)(*pGC->ops->CopyArea)(&pPixmap->drawable, dst, pGC, 0, 0, sw, sh,
-					dx, dy);
+	(void)(*pGC->ops->CopyArea)(&pPixmap->drawable, dst, pGC, 0, 0, sw, sh,
+				    dx, dy);
 	(*pPixmap->drawable.pScreen->DestroyPixmap)(pPixmap);
     }
 }
@@ -601,12 +845,19 @@ ProcShmPutImage(ClientPtr client)
 			       shmdesc->addr + stuff->offset +
 			       (stuff->srcY * length));
     else
-	doShmPutImage(pDraw, pGC, stuff->depth, stuff->format,
-		      stuff->totalWidth, stuff->totalHeight,
-		      stuff->srcX, stuff->srcY,
-		      stuff->srcWidth, stuff->srcHeight,
-		      stuff->dstX, stuff->dstY,
-                      shmdesc->addr + stuff->offset);
+    {
+	ShmScrPrivateRec *screen_priv = ShmGetScreenPriv(pDraw->pScreen);
+	void (*putImage)(XSHM_PUT_IMAGE_ARGS) = screen_priv->shmFuncs->PutImage;
+
+	if (!putImage)
+	    putImage = fbShmPutImage;
+	(*putImage)(pDraw, pGC, stuff->depth, stuff->format,
+		    stuff->totalWidth, stuff->totalHeight,
+		    stuff->srcX, stuff->srcY,
+		    stuff->srcWidth, stuff->srcHeight,
+		    stuff->dstX, stuff->dstY,
+		    shmdesc->addr + stuff->offset);
+    }
 
     if (stuff->sendEvent)
     {
@@ -1139,6 +1390,12 @@ ProcShmDispatch (ClientPtr client)
 	   return ProcPanoramiXShmCreatePixmap(client);
 #endif
 	   return ProcShmCreatePixmap(client);
+#ifdef SHM_FD_PASSING
+    case X_ShmAttachFd:
+	return ProcShmAttachFd(client);
+    case X_ShmCreateSegment:
+	return ProcShmCreateSegment(client);
+#endif
     default:
 	return BadRequest;
     }
@@ -1239,6 +1496,30 @@ SProcShmCreatePixmap(ClientPtr client)
     return ProcShmCreatePixmap(client);
 }
 
+#ifdef SHM_FD_PASSING
+static int
+SProcShmAttachFd(ClientPtr client)
+{
+    REQUEST(xShmAttachFdReq);
+    swaps(&stuff->length);
+    /* the length is checked once the descriptor has been consumed */
+    if (client->req_len == bytes_to_int32(sizeof(xShmAttachFdReq)))
+	swapl(&stuff->shmseg);
+    return ProcShmAttachFd(client);
+}
+
+static int
+SProcShmCreateSegment(ClientPtr client)
+{
+    REQUEST(xShmCreateSegmentReq);
+    swaps(&stuff->length);
+    REQUEST_SIZE_MATCH(xShmCreateSegmentReq);
+    swapl(&stuff->shmseg);
+    swapl(&stuff->size);
+    return ProcShmCreateSegment(client);
+}
+#endif
+
 static int
 SProcShmDispatch (ClientPtr client)
 {
@@ -1257,6 +1538,12 @@ SProcShmDispatch (ClientPtr client)
 	return SProcShmGetImage(client);
     case X_ShmCreatePixmap:
 	return SProcShmCreatePixmap(client);
+#ifdef SHM_FD_PASSING
+    case X_ShmAttachFd:
+	return SProcShmAttachFd(client);
+    case X_ShmCreateSegment:
+	return SProcShmCreateSegment(client);
+#endif
     default:
 	return BadRequest;
     }
@@ -1309,5 +1596,8 @@ ShmExtensionInit(INITARGS)
 	BadShmSegCode = extEntry->errorBase;
 	SetResourceTypeErrorValue(ShmSegType, BadShmSegCode);
 	EventSwapVector[ShmCompletionCode] = (EventSwapPtr) SShmCompletionEvent;
+#ifdef SHM_FD_PASSING
+	ShmInstallBusHandler();
+#endif
     }
 }
@@ -51,6 +51,14 @@
     int		/* depth */, \
     char *	/* addr */
 
+/*
+ * PutImage draws the sw x sh rectangle at (sx, sy) of the w x h image at
+ * data to (dx, dy) in dst, as PutImage through pGC would.  It is called
+ * for the requests that PutImage can't express directly and may read
+ * the segment in place.  A hook that renders without going through
+ * pGC->ops must report the damage itself with DamageDamageRegion, and
+ * can hand anything it doesn't handle to fbShmPutImage.
+ */
 typedef struct _ShmFuncs {
     PixmapPtr	(* CreatePixmap)(XSHM_CREATE_PIXMAP_ARGS);
     void	(* PutImage)(XSHM_PUT_IMAGE_ARGS);
@@ -62,6 +70,9 @@ ShmRegisterFuncs(ScreenPtr pScreen, ShmFuncsPtr funcs);
 extern _X_EXPORT void
 ShmRegisterFbFuncs(ScreenPtr pScreen);
 
+extern _X_EXPORT void
+fbShmPutImage(XSHM_PUT_IMAGE_ARGS);
+
 extern _X_EXPORT RESTYPE ShmSegType;
 extern _X_EXPORT int ShmCompletionCode;
 extern _X_EXPORT int BadShmSegCode;
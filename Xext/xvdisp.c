@@ -995,6 +995,7 @@ typedef struct _ShmDesc {
     char *addr;
     Bool writable;
     unsigned long size;
+    Bool is_fd;
 } ShmDescRec, *ShmDescPtr;
 
 extern RESTYPE ShmSegType;
@@ -327,7 +327,7 @@ compFreeClientWindow (WindowPtr pWin, XID id)
 
     if (pPixmap) {
 	compRestoreWindow (pWin, pPixmap);
-	(*pScreen->DestroyPixmap) (pPixmap);
+	compReleasePixmap (pScreen, pPixmap);
     }
 }
 
@@ -554,21 +554,237 @@ compUnredirectOneSubwindow (WindowPtr pParent, WindowPtr pWin)
     return Success;
 }
 
+/*
+ * Backing pixmaps are recycled through a small per-screen pool rather
+ * than freed and allocated again for every map and resize.
+ *
+ * When pixmaps are plain memory, which is the case when the screen uses
+ * miModifyPixmapHeader, they are allocated rounded up to a size class
+ * and their header is set to the size actually needed.  Any pixmap of the
+ * same size class can then be reused, and a window resized within its
+ * size class keeps its pixmap.  Otherwise only pixmaps of the exact size
+ * are reused.
+ */
+static Bool
+compPixmapsResizable (ScreenPtr pScreen)
+{
+    return pScreen->ModifyPixmapHeader == miModifyPixmapHeader;
+}
+
+/* Rounds up to one of four sizes per power of two */
+static int
+compSizeClass (int size)
+{
+    int	step;
+
+    if (size <= COMP_POOL_GRANULE)
+	return COMP_POOL_GRANULE;
+    for (step = COMP_POOL_GRANULE; step * 8 <= size; step <<= 1)
+	;
+    return min ((size + step - 1) & ~(step - 1), MAXSHORT);
+}
+
+static Bool
+compPixmapFits (PixmapPtr pPixmap, int depth, int w, int h)
+{
+    ScreenPtr	pScreen = pPixmap->drawable.pScreen;
+
+    if (pPixmap->drawable.depth != depth)
+	return FALSE;
+    if (!compPixmapsResizable (pScreen))
+	return pPixmap->drawable.width == w && pPixmap->drawable.height == h;
+    return (compSizeClass (pPixmap->drawable.width) == compSizeClass (w) &&
+	    compSizeClass (pPixmap->drawable.height) == compSizeClass (h) &&
+	    PixmapBytePad (w, depth) <= pPixmap->devKind);
+}
+
+static Bool
+compResizePixmap (PixmapPtr pPixmap, int w, int h)
+{
+    ScreenPtr	pScreen = pPixmap->drawable.pScreen;
+
+    if (pPixmap->drawable.width == w && pPixmap->drawable.height == h)
+	return TRUE;
+    return (*pScreen->ModifyPixmapHeader) (pPixmap, w, h, 0, 0, 0, NULL);
+}
+
+/* Pixels allocated for a backing pixmap, whatever its header says */
+static int
+compPixmapPixels (PixmapPtr pPixmap)
+{
+    int	w = pPixmap->drawable.width;
+    int	h = pPixmap->drawable.height;
+
+    if (compPixmapsResizable (pPixmap->drawable.pScreen))
+	return compSizeClass (w) * compSizeClass (h);
+    return w * h;
+}
+
+/*
+ * Pooled pixmaps go from one client's window to another's, so clear all
+ * of one before it is reused, the part past its current size included.
+ * The parent contents copied in later don't cover what is clipped away.
+ */
+static Bool
+compClearPixmap (PixmapPtr pPixmap, int w, int h)
+{
+    ScreenPtr	pScreen = pPixmap->drawable.pScreen;
+    GCPtr	pGC;
+    ChangeGCVal	val;
+    xRectangle	rect;
+
+    if (compPixmapsResizable (pScreen) &&
+	!compResizePixmap (pPixmap, compSizeClass (w), compSizeClass (h)))
+	return FALSE;
+    if (!(pGC = GetScratchGC (pPixmap->drawable.depth, pScreen)))
+	return FALSE;
+    val.val = 0;
+    ChangeGC (NullClient, pGC, GCForeground, &val);
+    ValidateGC (&pPixmap->drawable, pGC);
+    rect.x = 0;
+    rect.y = 0;
+    rect.width = pPixmap->drawable.width;
+    rect.height = pPixmap->drawable.height;
+    (*pGC->ops->PolyFillRect) (&pPixmap->drawable, pGC, 1, &rect);
+    FreeScratchGC (pGC);
+    return compResizePixmap (pPixmap, w, h);
+}
+
+static void
+compReportPixmapStats (ScreenPtr pScreen)
+{
+    CompScreenPtr	cs = GetCompScreen (pScreen);
+    CompPixmapStatsRec	*stats = &cs->pixmapStats;
+    CARD32		now = GetTimeInMillis ();
+    CARD32		elapsed = now - cs->pixmapStatsTime;
+
+    if (elapsed < 1000)
+	return;
+
+    LogMessageVerb (X_INFO, 4, "composite(%d): backing pixmaps per second: "
+		    "%lu created, %lu reused, %lu resized in place, %lu freed\n",
+		    pScreen->myNum,
+		    stats->created * 1000 / elapsed,
+		    stats->reused * 1000 / elapsed,
+		    stats->resized * 1000 / elapsed,
+		    stats->freed * 1000 / elapsed);
+    memset (stats, 0, sizeof (*stats));
+    cs->pixmapStatsTime = now;
+}
+
+static void
+compPoolRemove (CompScreenPtr cs, int i)
+{
+    cs->poolCount--;
+    memmove (&cs->pool[i], &cs->pool[i + 1],
+	     (cs->poolCount - i) * sizeof (PixmapPtr));
+}
+
+/*
+ * Hand a backing pixmap back once the window no longer uses it; it goes
+ * to the pool unless a client still holds a reference to it.
+ */
+void
+compReleasePixmap (ScreenPtr pScreen, PixmapPtr pPixmap)
+{
+    CompScreenPtr   cs = GetCompScreen (pScreen);
+    int		    pixels, i;
+
+    pixels = compPixmapPixels (pPixmap);
+    if (pPixmap->refcnt == 1 && pixels <= COMP_POOL_PIXELS)
+    {
+	/* Make room by dropping the oldest pixmaps */
+	for (i = 0; i < cs->poolCount; i++)
+	    pixels += compPixmapPixels (cs->pool[i]);
+	while (cs->poolCount == COMP_POOL_SIZE || pixels > COMP_POOL_PIXELS)
+	{
+	    PixmapPtr	pOld = cs->pool[0];
+
+	    pixels -= compPixmapPixels (pOld);
+	    compPoolRemove (cs, 0);
+	    (*pScreen->DestroyPixmap) (pOld);
+	    cs->pixmapStats.freed++;
+	}
+	cs->pool[cs->poolCount++] = pPixmap;
+    }
+    else
+    {
+	(*pScreen->DestroyPixmap) (pPixmap);
+	cs->pixmapStats.freed++;
+    }
+    compReportPixmapStats (pScreen);
+}
+
+void
+compFreePixmapPool (ScreenPtr pScreen)
+{
+    CompScreenPtr   cs = GetCompScreen (pScreen);
+
+    while (cs->poolCount)
+    {
+	(*pScreen->DestroyPixmap) (cs->pool[cs->poolCount - 1]);
+	cs->poolCount--;
+    }
+}
+
 static PixmapPtr
-compNewPixmap (WindowPtr pWin, int x, int y, int w, int h)
+compGetPixmap (ScreenPtr pScreen, int depth, int w, int h)
 {
-    ScreenPtr	    pScreen = pWin->drawable.pScreen;
-    WindowPtr	    pParent = pWin->parent;
+    CompScreenPtr   cs = GetCompScreen (pScreen);
     PixmapPtr	    pPixmap;
+    int		    i;
+
+    /* Most recently released first */
+    for (i = cs->poolCount; --i >= 0;)
+    {
+	pPixmap = cs->pool[i];
+	if (compPixmapFits (pPixmap, depth, w, h))
+	{
+	    compPoolRemove (cs, i);
+	    if (!compClearPixmap (pPixmap, w, h))
+	    {
+		(*pScreen->DestroyPixmap) (pPixmap);
+		cs->pixmapStats.freed++;
+		break;
+	    }
+	    cs->pixmapStats.reused++;
+	    return pPixmap;
+	}
+    }
 
-    pPixmap = (*pScreen->CreatePixmap) (pScreen, w, h, pWin->drawable.depth,
-					CREATE_PIXMAP_USAGE_BACKING_PIXMAP);
+    if (compPixmapsResizable (pScreen))
+    {
+	pPixmap = (*pScreen->CreatePixmap) (pScreen,
+					    compSizeClass (w),
+					    compSizeClass (h), depth,
+					    CREATE_PIXMAP_USAGE_BACKING_PIXMAP);
+	if (pPixmap && !compResizePixmap (pPixmap, w, h))
+	{
+	    (*pScreen->DestroyPixmap) (pPixmap);
+	    pPixmap = NULL;
+	}
+    }
+    else
+	pPixmap = (*pScreen->CreatePixmap) (pScreen, w, h, depth,
+					    CREATE_PIXMAP_USAGE_BACKING_PIXMAP);
 
-    if (!pPixmap)
-	return 0;
-    
-    pPixmap->screen_x = x;
-    pPixmap->screen_y = y;
+    if (pPixmap)
+	cs->pixmapStats.created++;
+    return pPixmap;
+}
+
+/*
+ * Fill part of a backing pixmap with what's currently visible in the
+ * parent at the same place, in screen coordinates.
+ */
+static void
+compCopyFromParent (WindowPtr pWin, PixmapPtr pPixmap,
+		    int x, int y, int w, int h)
+{
+    ScreenPtr	    pScreen = pWin->drawable.pScreen;
+    WindowPtr	    pParent = pWin->parent;
+    int		    dst_x = x - pPixmap->screen_x;
+    int		    dst_y = y - pPixmap->screen_y;
 
     if (pParent->drawable.depth == pWin->drawable.depth)
     {
@@ -585,7 +801,7 @@ compNewPixmap (WindowPtr pWin, int x, int y, int w, int h)
 				   pGC,
 				   x - pParent->drawable.x,
 				   y - pParent->drawable.y,
-				   w, h, 0, 0);
+				   w, h, dst_x, dst_y);
 	    FreeScratchGC (pGC);
 	}
     }
@@ -617,16 +833,64 @@ compNewPixmap (WindowPtr pWin, int x, int y, int w, int h)
 			      pDstPicture,
 			      x - pParent->drawable.x,
 			      y - pParent->drawable.y,
-			      0, 0, 0, 0, w, h);
+			      0, 0, dst_x, dst_y, w, h);
 	}
 	if (pSrcPicture)
 	    FreePicture (pSrcPicture, 0);
 	if (pDstPicture)
 	    FreePicture (pDstPicture, 0);
     }
+}
+
+static PixmapPtr
+compNewPixmap (WindowPtr pWin, int x, int y, int w, int h)
+{
+    ScreenPtr	    pScreen = pWin->drawable.pScreen;
+    PixmapPtr	    pPixmap;
+
+    pPixmap = compGetPixmap (pScreen, pWin->drawable.depth, w, h);
+    compReportPixmapStats (pScreen);
+
+    if (!pPixmap)
+	return 0;
+    
+    pPixmap->screen_x = x;
+    pPixmap->screen_y = y;
+
+    compCopyFromParent (pWin, pPixmap, x, y, w, h);
     return pPixmap;
 }
 
+/*
+ * Resize the window pixmap within its size class.  Only done when the
+ * origin stays put, so the bits already there remain valid; newly
+ * uncovered parts get the parent contents like a new pixmap would.
+ */
+static Bool
+compResizePixmapInPlace (WindowPtr pWin, PixmapPtr pPixmap,
+			 int x, int y, int w, int h)
+{
+    ScreenPtr	    pScreen = pWin->drawable.pScreen;
+    int		    old_w = pPixmap->drawable.width;
+    int		    old_h = pPixmap->drawable.height;
+
+    if (!compPixmapsResizable (pScreen) || pPixmap->refcnt != 1 ||
+	pPixmap->screen_x != x || pPixmap->screen_y != y ||
+	!compPixmapFits (pPixmap, pWin->drawable.depth, w, h) ||
+	!compResizePixmap (pPixmap, w, h))
+	return FALSE;
+
+    if (w > old_w)
+	compCopyFromParent (pWin, pPixmap, x + old_w, y, w - old_w, h);
+    if (h > old_h)
+	compCopyFromParent (pWin, pPixmap, x, y + old_h, min (w, old_w),
+			    h - old_h);
+
+    GetCompScreen (pScreen)->pixmapStats.resized++;
+    compReportPixmapStats (pScreen);
+    return TRUE;
+}
+
 Bool
 compAllocPixmap (WindowPtr pWin)
 {
@@ -690,9 +954,9 @@ compSetParentPixmap (WindowPtr pWin)
 }
 
 /*
- * Make sure the pixmap is the right size and offset.  Allocate a new
- * pixmap to change size, adjust origin to change offset, leaving the
- * old pixmap in cw->pOldPixmap so bits can be recovered
+ * Make sure the pixmap is the right size and offset.  Resize the pixmap
+ * in place or allocate a new one to change size, adjust origin to change
+ * offset, leaving the old pixmap in cw->pOldPixmap so bits can be recovered
  */
 Bool
 compReallocPixmap (WindowPtr pWin, int draw_x, int draw_y,
@@ -712,7 +976,8 @@ compReallocPixmap (WindowPtr pWin, int draw_x, int draw_y,
     pix_y = draw_y - bw;
     pix_w = w + (bw << 1);
     pix_h = h + (bw << 1);
-    if (pix_w != pOld->drawable.width || pix_h != pOld->drawable.height)
+    if ((pix_w != pOld->drawable.width || pix_h != pOld->drawable.height) &&
+	!compResizePixmapInPlace (pWin, pOld, pix_x, pix_y, pix_w, pix_h))
     {
 	pNew = compNewPixmap (pWin, pix_x, pix_y, pix_w, pix_h);
 	if (!pNew)
@@ -59,6 +59,7 @@ compCloseScreen (int index, ScreenPtr pScreen)
     Bool	    ret;
 
     free(cs->alternateVisuals);
+    compFreePixmapPool (pScreen);
 
     pScreen->CloseScreen = cs->CloseScreen;
     pScreen->InstallColormap = cs->InstallColormap;
@@ -348,6 +349,10 @@ compScreenInit (ScreenPtr pScreen)
     cs->numAlternateVisuals = 0;
     cs->alternateVisuals = NULL;
 
+    cs->poolCount = 0;
+    memset(&cs->pixmapStats, 0, sizeof (cs->pixmapStats));
+    cs->pixmapStatsTime = GetTimeInMillis ();
+
     if (!compAddAlternateVisuals (pScreen, cs))
     {
 	free(cs);
@@ -109,6 +109,24 @@ typedef struct _CompSubwindows {
 #define COMP_INCLUDE_RGB24_VISUAL 0
 #endif
 
+/*
+ * Backing pixmaps of unmapped, unredirected and resized windows are kept
+ * for reuse, up to COMP_POOL_SIZE pixmaps of COMP_POOL_PIXELS pixels in
+ * total.  See compalloc.c.
+ */
+#define COMP_POOL_SIZE		8
+#define COMP_POOL_PIXELS	(4 * 1024 * 1024)
+
+/* Smallest size class for backing pixmaps that can be resized in place */
+#define COMP_POOL_GRANULE	64
+
+typedef struct _CompPixmapStats {
+    unsigned long	created;
+    unsigned long	reused;
+    unsigned long	resized;	/* resized without a new pixmap */
+    unsigned long	freed;
+} CompPixmapStatsRec;
+
 typedef struct _CompOverlayClientRec *CompOverlayClientPtr;
 
 typedef struct _CompOverlayClientRec {
@@ -161,6 +179,11 @@ typedef struct _CompScreen {
     
     GetImageProcPtr		GetImage;
     SourceValidateProcPtr	SourceValidate;
+
+    PixmapPtr			pool[COMP_POOL_SIZE];	/* oldest first */
+    int				poolCount;
+    CompPixmapStatsRec		pixmapStats;
+    CARD32			pixmapStatsTime;
 } CompScreenRec, *CompScreenPtr;
 
 extern DevPrivateKeyRec CompScreenPrivateKeyRec;
@@ -224,6 +247,12 @@ Bool
 compReallocPixmap (WindowPtr pWin, int x, int y,
 		   unsigned int w, unsigned int h, int bw);
 
+void
+compReleasePixmap (ScreenPtr pScreen, PixmapPtr pPixmap);
+
+void
+compFreePixmapPool (ScreenPtr pScreen);
+
 /*
  * compext.c
  */
@@ -169,7 +169,7 @@ compCheckRedirect (WindowPtr pWin)
 	    PixmapPtr pPixmap = (*pScreen->GetWindowPixmap) (pWin);
 	    compSetParentPixmap (pWin);
 	    compRestoreWindow (pWin, pPixmap);
-	    (*pScreen->DestroyPixmap) (pPixmap);
+	    compReleasePixmap (pScreen, pPixmap);
 	}
     } else if (should) {
 	if (cw->update == CompositeRedirectAutomatic)
@@ -366,7 +366,7 @@ static void compFreeOldPixmap(WindowPtr pWin)
 	CompWindowPtr	cw = GetCompWindow (pWin);
 	if (cw->pOldPixmap)
 	{
-	    (*pScreen->DestroyPixmap) (cw->pOldPixmap);
+	    compReleasePixmap (pScreen, cw->pOldPixmap);
 	    cw->pOldPixmap = NullPixmap;
 	}
     }
@@ -596,7 +596,7 @@ compDestroyWindow (WindowPtr pWin)
     if (pWin->redirectDraw != RedirectDrawNone) {
 	PixmapPtr pPixmap = (*pScreen->GetWindowPixmap) (pWin);
 	compSetParentPixmap (pWin);
-	(*pScreen->DestroyPixmap) (pPixmap);
+	compReleasePixmap (pScreen, pPixmap);
     }
     ret = (*pScreen->DestroyWindow) (pWin);
     cs->DestroyWindow = pScreen->DestroyWindow;
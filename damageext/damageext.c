@@ -217,6 +217,12 @@ ProcDamageCreate (ClientPtr client)
 	return BadAlloc;
 
     DamageSetReportAfterOp (pDamageExt->pDamage, TRUE);
+    DamageSetReportDeferred (pDamageExt->pDamage, DamageExtDeferReports);
+    /* Clients that only ask for the bounding box or for non-emptiness
+     * fetch the parts themselves, so any covering region will do */
+    if (level == DamageReportBoundingBox || level == DamageReportNonEmpty)
+	DamageSetRegionLimit (pDamageExt->pDamage, DamageRegionTiles,
+			      DamageExtRegionLimit);
     DamageRegister (pDamageExt->pDrawable, pDamageExt->pDamage);
 
     if (pDrawable->type == DRAWABLE_WINDOW)
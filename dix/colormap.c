@@ -268,8 +268,8 @@ CreateColormap (Colormap mid, ScreenPtr pScreen, VisualPtr pVisual,
 
     size = pVisual->ColormapEntries;
     sizebytes = (size * sizeof(Entry)) +
-		(MAXCLIENTS * sizeof(Pixel *)) +
-		(MAXCLIENTS * sizeof(int));
+		(LimitClients * sizeof(Pixel *)) +
+		(LimitClients * sizeof(int));
     if ((class | DynamicClass) == DirectColor)
 	sizebytes *= 3;
     sizebytes += sizeof(ColormapRec);
@@ -291,7 +291,7 @@ CreateColormap (Colormap mid, ScreenPtr pScreen, VisualPtr pVisual,
     sizebytes = size * sizeof(Entry);
     pmap->clientPixelsRed = (Pixel **)((char *)pmap->red + sizebytes);
     pmap->numPixelsRed = (int *)((char *)pmap->clientPixelsRed +
-				 (MAXCLIENTS * sizeof(Pixel *)));
+				 (LimitClients * sizeof(Pixel *)));
     pmap->mid = mid;
     pmap->flags = 0; 	/* start out with all flags clear */
     if(mid == pScreen->defColormap)
@@ -303,8 +303,8 @@ CreateColormap (Colormap mid, ScreenPtr pScreen, VisualPtr pVisual,
 	size = NUMRED(pVisual);
     pmap->freeRed = size;
     memset((char *) pmap->red, 0, (int)sizebytes);
-    memset((char *) pmap->numPixelsRed, 0, MAXCLIENTS * sizeof(int));
-    for (pptr = &pmap->clientPixelsRed[MAXCLIENTS]; --pptr >= pmap->clientPixelsRed; )
+    memset((char *) pmap->numPixelsRed, 0, LimitClients * sizeof(int));
+    for (pptr = &pmap->clientPixelsRed[LimitClients]; --pptr >= pmap->clientPixelsRed; )
 	*pptr = (Pixel *)NULL;
     if (alloc == AllocAll)
     {
@@ -329,28 +329,28 @@ CreateColormap (Colormap mid, ScreenPtr pScreen, VisualPtr pVisual,
     {
 	pmap->freeGreen = NUMGREEN(pVisual);
 	pmap->green = (EntryPtr)((char *)pmap->numPixelsRed +
-				 (MAXCLIENTS * sizeof(int)));
+				 (LimitClients * sizeof(int)));
 	pmap->clientPixelsGreen = (Pixel **)((char *)pmap->green + sizebytes);
 	pmap->numPixelsGreen = (int *)((char *)pmap->clientPixelsGreen +
-				       (MAXCLIENTS * sizeof(Pixel *)));
+				       (LimitClients * sizeof(Pixel *)));
 	pmap->freeBlue = NUMBLUE(pVisual);
 	pmap->blue = (EntryPtr)((char *)pmap->numPixelsGreen +
-				(MAXCLIENTS * sizeof(int)));
+				(LimitClients * sizeof(int)));
 	pmap->clientPixelsBlue = (Pixel **)((char *)pmap->blue + sizebytes);
 	pmap->numPixelsBlue = (int *)((char *)pmap->clientPixelsBlue +
-				      (MAXCLIENTS * sizeof(Pixel *)));
+				      (LimitClients * sizeof(Pixel *)));
 
 	memset((char *) pmap->green, 0, (int)sizebytes);
 	memset((char *) pmap->blue, 0, (int)sizebytes);
 
 	memmove((char *) pmap->clientPixelsGreen,
 		(char *) pmap->clientPixelsRed,
-	      MAXCLIENTS * sizeof(Pixel *));
+	      LimitClients * sizeof(Pixel *));
 	memmove((char *) pmap->clientPixelsBlue,
 		(char *) pmap->clientPixelsRed,
-	      MAXCLIENTS * sizeof(Pixel *));
-	memset((char *) pmap->numPixelsGreen, 0, MAXCLIENTS * sizeof(int));
-	memset((char *) pmap->numPixelsBlue, 0, MAXCLIENTS * sizeof(int));
+	      LimitClients * sizeof(Pixel *));
+	memset((char *) pmap->numPixelsGreen, 0, LimitClients * sizeof(int));
+	memset((char *) pmap->numPixelsBlue, 0, LimitClients * sizeof(int));
 
 	/* If every cell is allocated, mark its refcnt */
 	if (alloc == AllocAll)
@@ -440,7 +440,7 @@ FreeColormap (pointer value, XID mid)
 
     if(pmap->clientPixelsRed)
     {
-	for(i = 0; i < MAXCLIENTS; i++)
+	for(i = 0; i < LimitClients; i++)
 	    free(pmap->clientPixelsRed[i]);
     }
 
@@ -463,7 +463,7 @@ FreeColormap (pointer value, XID mid)
     }
     if((pmap->class | DynamicClass) == DirectColor)
     {
-        for(i = 0; i < MAXCLIENTS; i++)
+        for(i = 0; i < LimitClients; i++)
 	{
             free(pmap->clientPixelsGreen[i]);
             free(pmap->clientPixelsBlue[i]);
@@ -131,6 +131,7 @@ int ProcInitialConnection();
 #include "xkbsrv.h"
 #include "site.h"
 #include "client.h"
+#include "reqstats.h"
 
 #ifdef XSERVER_DTRACE
 #include "registry.h"
@@ -231,8 +232,18 @@ long SmartScheduleInterval = SMART_SCHEDULE_DEFAULT_INTERVAL;
 long SmartScheduleMaxSlice = SMART_SCHEDULE_MAX_SLICE;
 long SmartScheduleTime;
 int SmartScheduleLatencyLimited = 0;
+int SmartSchedulePolicy = SMART_POLICY_PRIORITY;
 static ClientPtr   SmartLastClient;
 static int	   SmartLastIndex[SMART_MAX_PRIORITY-SMART_MIN_PRIORITY+1];
+static int	   SmartLastFairIndex;
+
+typedef struct _SmartWeight {
+    struct _SmartWeight *next;
+    char    *cmd;
+    int	    weight;
+} SmartWeightRec, *SmartWeightPtr;
+
+static SmartWeightPtr SmartWeights;
 
 #ifdef SMART_DEBUG
 long	    SmartLastPrint;
@@ -240,6 +251,170 @@ long	    SmartLastPrint;
 
 void        Dispatch(void);
 
+/*
+ * Parse a -schedWeight argument, "cmd=weight", which gives clients run
+ * as cmd (either the full command or its last path component) weight
+ * shares of the server under the fair share policy.
+ */
+Bool
+SmartScheduleSetWeight(const char *spec)
+{
+    const char *eq = strchr(spec, '=');
+    SmartWeightPtr w;
+    char *end;
+    long weight;
+
+    if (!eq || eq == spec)
+	return FALSE;
+    weight = strtol(eq + 1, &end, 10);
+    if (end == eq + 1 || *end || weight < 1 || weight > SMART_MAX_WEIGHT)
+	return FALSE;
+    w = malloc(sizeof(SmartWeightRec) + (eq - spec) + 1);
+    if (!w)
+	return FALSE;
+    w->cmd = (char *)(w + 1);
+    memcpy(w->cmd, spec, eq - spec);
+    w->cmd[eq - spec] = '\0';
+    w->weight = weight;
+    w->next = SmartWeights;
+    SmartWeights = w;
+    return TRUE;
+}
+
+static int
+SmartClientWeight (ClientPtr pClient)
+{
+    SmartWeightPtr w;
+    const char *cmd, *base;
+
+    if (pClient->smart_weight)
+	return pClient->smart_weight;
+
+    pClient->smart_weight = SMART_DEFAULT_WEIGHT;
+    if (!SmartWeights || !(cmd = GetClientCmdName(pClient)))
+	return pClient->smart_weight;
+    base = strrchr(cmd, '/');
+    base = base ? base + 1 : cmd;
+    for (w = SmartWeights; w; w = w->next)
+    {
+	if (!strcmp(w->cmd, cmd) || !strcmp(w->cmd, base))
+	{
+	    pClient->smart_weight = w->weight;
+	    break;
+	}
+    }
+    return pClient->smart_weight;
+}
+
+static void
+SmartScheduleAdjustSlice (ClientPtr pClient, int nready)
+{
+    long	now = SmartScheduleTime;
+
+    /*
+     * Set current client pointer
+     */
+    if (SmartLastClient != pClient)
+    {
+	pClient->smart_start_tick = now;
+	SmartLastClient = pClient;
+    }
+    /*
+     * Adjust slice
+     */
+    if (nready == 1 && SmartScheduleLatencyLimited == 0)
+    {
+	/*
+	 * If it's been a long time since another client
+	 * has run, bump the slice up to get maximal
+	 * performance from a single client
+	 */
+	if ((now - pClient->smart_start_tick) > 1000 &&
+	    SmartScheduleSlice < SmartScheduleMaxSlice)
+	{
+	    SmartScheduleSlice += SmartScheduleInterval;
+	}
+    }
+    else
+    {
+	SmartScheduleSlice = SmartScheduleInterval;
+    }
+}
+
+/*
+ * Deficit round robin between the ready clients.  Each round credits
+ * every ready client with SmartScheduleInterval worth of CPU time per
+ * unit of weight, Dispatch charges the CPU time it then uses, and
+ * clients with credit left are served round robin.  A round only ends
+ * once none of the ready clients has any credit.
+ */
+static int
+SmartScheduleFairClient (int *clientReady, int nready)
+{
+    ClientPtr	pClient;
+    int		i;
+    int		client;
+    int		best = -1;
+    int		bestRobin = -1, robin;
+    long	now = SmartScheduleTime;
+    long	idle = 2 * SmartScheduleSlice;
+    long	quantum;
+    long	rounds = 0, need;
+
+    for (i = 0; i < nready; i++)
+    {
+	client = clientReady[i];
+	pClient = clients[client];
+	quantum = SmartScheduleInterval * 1000L * SmartClientWeight(pClient);
+	/* Idle clients don't carry debts, nor save up credit */
+	if ((now - pClient->smart_check_tick) >= idle &&
+	    pClient->smart_deficit < 0)
+	    pClient->smart_deficit = 0;
+	if (pClient->smart_deficit > quantum)
+	    pClient->smart_deficit = quantum;
+	pClient->smart_check_tick = now;
+
+	if (pClient->smart_deficit <= 0)
+	{
+	    need = -pClient->smart_deficit / quantum + 1;
+	    if (!rounds || need < rounds)
+		rounds = need;
+	    continue;
+	}
+	robin = (pClient->index - SmartLastFairIndex) & (LimitClients - 1);
+	if (robin > bestRobin)
+	{
+	    bestRobin = robin;
+	    best = client;
+	}
+    }
+
+    if (best < 0)
+    {
+	/* Start as many rounds as it takes for someone to have credit */
+	for (i = 0; i < nready; i++)
+	{
+	    client = clientReady[i];
+	    pClient = clients[client];
+	    quantum = SmartScheduleInterval * 1000L * pClient->smart_weight;
+	    pClient->smart_deficit += rounds * quantum;
+	    if (pClient->smart_deficit <= 0)
+		continue;
+	    robin = (pClient->index - SmartLastFairIndex) & (LimitClients - 1);
+	    if (robin > bestRobin)
+	    {
+		bestRobin = robin;
+		best = client;
+	    }
+	}
+    }
+
+    pClient = clients[best];
+    SmartLastFairIndex = pClient->index;
+    SmartScheduleAdjustSlice(pClient, nready);
+    return best;
+}
+
 static int
 SmartScheduleClient (int *clientReady, int nready)
 {
@@ -267,7 +442,7 @@ SmartScheduleClient (int *clientReady, int nready)
 	pClient->smart_check_tick = now;
 	
 	/* check priority to select best client */
-	robin = (pClient->index - SmartLastIndex[pClient->smart_priority-SMART_MIN_PRIORITY]) & 0xff;
+	robin = (pClient->index - SmartLastIndex[pClient->smart_priority-SMART_MIN_PRIORITY]) & (LimitClients - 1);
 	if (pClient->smart_priority > bestPrio ||
 	    (pClient->smart_priority == bestPrio && robin > bestRobin))
 	{
@@ -289,34 +464,7 @@ SmartScheduleClient (int *clientReady, int nready)
 #endif
     pClient = clients[best];
     SmartLastIndex[bestPrio-SMART_MIN_PRIORITY] = pClient->index;
-    /*
-     * Set current client pointer
-     */
-    if (SmartLastClient != pClient)
-    {
-	pClient->smart_start_tick = now;
-	SmartLastClient = pClient;
-    }
-    /*
-     * Adjust slice
-     */
-    if (nready == 1 && SmartScheduleLatencyLimited == 0)
-    {
-	/*
-	 * If it's been a long time since another client
-	 * has run, bump the slice up to get maximal
-	 * performance from a single client
-	 */
-	if ((now - pClient->smart_start_tick) > 1000 &&
-	    SmartScheduleSlice < SmartScheduleMaxSlice)
-	{
-	    SmartScheduleSlice += SmartScheduleInterval;
-	}
-    }
-    else
-    {
-	SmartScheduleSlice = SmartScheduleInterval;
-    }
+    SmartScheduleAdjustSlice(pClient, nready);
     return best;
 }
 
@@ -348,6 +496,12 @@ Dispatch(void)
     int	nready;
     HWEventQueuePtr* icheck = checkForInput;
     long			start_tick;
+    CARD64			start_cpu, used_cpu;
+    CARD64			req_start, req_end;
+    int				major, minor;
+    CARD32			bytes_in;
+    CARD64			bytes_out;
+    ReqStatsPtr			client_stats;
 
     nextFreeClientID = 1;
     nClients = 0;
@@ -369,7 +523,10 @@ Dispatch(void)
 
 	if (nready && !SmartScheduleDisable)
 	{
-	    clientReady[0] = SmartScheduleClient (clientReady, nready);
+	    if (SmartSchedulePolicy == SMART_POLICY_FAIR)
+		clientReady[0] = SmartScheduleFairClient (clientReady, nready);
+	    else
+		clientReady[0] = SmartScheduleClient (clientReady, nready);
 	    nready = 1;
 	}
        /***************** 
@@ -394,6 +551,10 @@ Dispatch(void)
 	    isItTimeToYield = FALSE;
  
 	    start_tick = SmartScheduleTime;
+	    start_cpu = GetCPUTimeInMicros();
+	    client_stats = ClientRequestStats(client);
+	    if (client_stats)
+		req_start = GetTimeInMicros();
 	    while (!isItTimeToYield)
 	    {
 	        if (*icheck[0] != *icheck[1])
@@ -419,6 +580,12 @@ Dispatch(void)
 	        }
 
 		client->sequence++;
+		major = MAJOROP;
+		minor = major < EXTENSION_BASE ? 0 :
+			((xReq *)client->requestBuffer)->data;
+		bytes_in = result;
+		if (client_stats)
+		    bytes_out = client_stats->bytesOut;
 #ifdef XSERVER_DTRACE
 		XSERVER_REQUEST_START(LookupMajorName(MAJOROP), MAJOROP,
 			      ((xReq *)client->requestBuffer)->length,
@@ -436,6 +603,14 @@ Dispatch(void)
 		XSERVER_REQUEST_DONE(LookupMajorName(MAJOROP), MAJOROP,
 			      client->sequence, client->index, result);
 #endif
+		if (client_stats)
+		{
+		    req_end = GetTimeInMicros();
+		    RecordRequestStats(client, major, minor,
+				       req_end - req_start, bytes_in,
+				       client_stats->bytesOut - bytes_out);
+		    req_start = req_end;
+		}
 
 		if (client->noClientException != Success)
 		{
@@ -450,10 +625,15 @@ Dispatch(void)
 		    break;
 		}
 	    }
+	    used_cpu = GetCPUTimeInMicros() - start_cpu;
 	    FlushAllOutput();
 	    client = clients[clientReady[nready]];
 	    if (client)
+	    {
 		client->smart_stop_tick = SmartScheduleTime;
+		client->smart_cpu_time += used_cpu;
+		client->smart_deficit -= (long)used_cpu;
+	    }
 	}
 	dispatchException &= ~DE_PRIORITYCHANGE;
     }
@@ -2003,6 +2183,8 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
     long		widthBytesLine, length;
     Mask		plane = 0;
     char		*pBuf;
+    char		*pReply = NULL;
+    long		replyBytes = 0;
     xGetImageReply	xgi;
     RegionPtr pVisibleRegion = NULL;
 
@@ -2105,6 +2287,13 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
 	xgi.length = bytes_to_int32(xgi.length);
 	if (widthBytesLine == 0 || height == 0)
 	    linesPerBuf = 0;
+	else if (length <= IMAGE_REPLY_MAX &&
+		 (pReply = calloc(1, length)))
+	{
+	    /* Fetch it whole, then send it without a copy */
+	    replyBytes = length;
+	    linesPerBuf = height;
+	}
 	else if (widthBytesLine >= IMAGE_BUFSIZE)
 	    linesPerBuf = 1;
 	else
@@ -2129,7 +2318,9 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
 		length += widthBytesLine;
 	    }
 	}
-	if(!(pBuf = calloc(1, length)))
+	if (pReply)
+	    pBuf = pReply;
+	else if(!(pBuf = calloc(1, length)))
 	    return BadAlloc;
 	WriteReplyToClient(client, sizeof (xGetImageReply), &xgi);
     }
@@ -2174,10 +2365,9 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
 			       BitsPerPixel (pDraw->depth),
 			       ClientOrder(client));
 
-/* Don't split me, gcc pukes when you do */
-		(void)WriteToClient(client,
-				    (int)(nlines * widthBytesLine),
-				    pBuf);
+		if (!pReply)
+		    (void)WriteToClient(client, (int)(nlines * widthBytesLine),
+					pBuf);
 	    }
 	    linesDone += nlines;
         }
@@ -2208,19 +2398,17 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
 
 		    /* Note: NOT a call to WriteSwappedDataToClient,
 		       as we do NOT byte swap */
-		    if (im_return) {
-			pBuf += nlines * widthBytesLine;
-		    } else {
+		    if (!im_return)
 			ReformatImage (pBuf, 
 				       (int)(nlines * widthBytesLine), 
 				       1,
 				       ClientOrder (client));
-
-/* Don't split me, gcc pukes when you do */
+		    if (im_return || pReply)
+			pBuf += nlines * widthBytesLine;
+		    else
 			(void)WriteToClient(client,
-					(int)(nlines * widthBytesLine),
-					pBuf);
-		    }
+					    (int)(nlines * widthBytesLine),
+					    pBuf);
 		    linesDone += nlines;
 		}
             }
@@ -2228,7 +2416,11 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
     }
     if (pVisibleRegion)
 	RegionDestroy(pVisibleRegion);
-    if (!im_return)
+    /* The whole reply is handed over, the os layer frees it */
+    if (pReply)
+	(void)WriteToClientNoCopy(client, (int)replyBytes, pReply, free,
+				  pReply);
+    else if (!im_return)
 	free(pBuf);
     return Success;
 }
@@ -3521,7 +3713,7 @@ ClientPtr NextAvailableClient(pointer ospriv)
     xReq data;
 
     i = nextFreeClientID;
-    if (i == MAXCLIENTS)
+    if (i == LimitClients)
 	return (ClientPtr)NULL;
     clients[i] = client = dixAllocateObjectWithPrivates(ClientRec, PRIVATE_CLIENT);
     if (!client)
@@ -3542,7 +3734,7 @@ ClientPtr NextAvailableClient(pointer ospriv)
     }
     if (i == currentMaxClients)
 	currentMaxClients++;
-    while ((nextFreeClientID < MAXCLIENTS) && clients[nextFreeClientID])
+    while ((nextFreeClientID < LimitClients) && clients[nextFreeClientID])
 	nextFreeClientID++;
 
     /* Enable client ID tracking. This must be done before
@@ -2819,6 +2819,70 @@ PointInBorderSize(WindowPtr pWin, int x, int y)
     return FALSE;
 }
 
+/**
+ * @returns TRUE if the pointer at x/y is in pWin, taking shapes into
+ * account.
+ */
+static Bool
+PointInPickableWindow(WindowPtr pWin, int x, int y)
+{
+    BoxRec box;
+
+    return (pWin->mapped) &&
+	   (x >= pWin->drawable.x - wBorderWidth (pWin)) &&
+	   (x < pWin->drawable.x + (int)pWin->drawable.width +
+	    wBorderWidth(pWin)) &&
+	   (y >= pWin->drawable.y - wBorderWidth (pWin)) &&
+	   (y < pWin->drawable.y + (int)pWin->drawable.height +
+	    wBorderWidth (pWin))
+	   /* When a window is shaped, a further check
+	    * is made to see if the point is inside
+	    * borderSize
+	    */
+	   && (!wBoundingShape(pWin) || PointInBorderSize(pWin, x, y))
+	   && (!wInputShape(pWin) ||
+	       RegionContainsPoint(wInputShape(pWin),
+				   x - pWin->drawable.x,
+				   y - pWin->drawable.y, &box))
+#ifdef ROOTLESS
+    /* In rootless mode windows may be offscreen, even when
+     * they're in X's stack. (E.g. if the native window system
+     * implements some form of virtual desktop system).
+     */
+	   && !pWin->rootlessUnhittable
+#endif
+	   ;
+}
+
+/**
+ * @returns the topmost child of pParent at x/y, or NullWindow.  Parents
+ * with many children are looked up in their pick index.
+ */
+static WindowPtr
+XYToChild(WindowPtr pParent, int x, int y)
+{
+    WindowPtr pWin, *candidates;
+    int n, nscanned = 0;
+
+    n = LookupPickIndex(pParent, x, y, &candidates);
+    if (n >= 0)
+    {
+	for (; n--; candidates++)
+	    if (PointInPickableWindow(*candidates, x, y))
+		return *candidates;
+	return NullWindow;
+    }
+
+    for (pWin = pParent->firstChild; pWin; pWin = pWin->nextSib)
+    {
+	nscanned++;
+	if (PointInPickableWindow(pWin, x, y))
+	    break;
+    }
+    NotePickScan(pParent, nscanned);
+    return pWin;
+}
+
 /**
  * Traversed from the root window to the window at the position x/y. While
  * traversing, it sets up the traversal history in the spriteTrace array.
@@ -2834,48 +2898,18 @@ WindowPtr
 XYToWindow(SpritePtr pSprite, int x, int y)
 {
     WindowPtr  pWin;
-    BoxRec		box;
 
     pSprite->spriteTraceGood = 1;	/* root window still there */
-    pWin = RootWindow(pSprite)->firstChild;
-    while (pWin)
+    pWin = RootWindow(pSprite);
+    while ((pWin = XYToChild(pWin, x, y)))
     {
-	if ((pWin->mapped) &&
-	    (x >= pWin->drawable.x - wBorderWidth (pWin)) &&
-	    (x < pWin->drawable.x + (int)pWin->drawable.width +
-	     wBorderWidth(pWin)) &&
-	    (y >= pWin->drawable.y - wBorderWidth (pWin)) &&
-	    (y < pWin->drawable.y + (int)pWin->drawable.height +
-	     wBorderWidth (pWin))
-	    /* When a window is shaped, a further check
-	     * is made to see if the point is inside
-	     * borderSize
-	     */
-	    && (!wBoundingShape(pWin) || PointInBorderSize(pWin, x, y))
-	    && (!wInputShape(pWin) ||
-		RegionContainsPoint(wInputShape(pWin),
-				    x - pWin->drawable.x,
-				    y - pWin->drawable.y, &box))
-#ifdef ROOTLESS
-    /* In rootless mode windows may be offscreen, even when
-     * they're in X's stack. (E.g. if the native window system
-     * implements some form of virtual desktop system).
-     */
-		&& !pWin->rootlessUnhittable
-#endif
-	    )
+	if (pSprite->spriteTraceGood >= pSprite->spriteTraceSize)
 	{
-	    if (pSprite->spriteTraceGood >= pSprite->spriteTraceSize)
-	    {
-		pSprite->spriteTraceSize += 10;
-		pSprite->spriteTrace = realloc(pSprite->spriteTrace,
-		                    pSprite->spriteTraceSize*sizeof(WindowPtr));
-	    }
-	    pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
-	    pWin = pWin->firstChild;
+	    pSprite->spriteTraceSize *= 2;
+	    pSprite->spriteTrace = realloc(pSprite->spriteTrace,
+				pSprite->spriteTraceSize*sizeof(WindowPtr));
 	}
-	else
-	    pWin = pWin->nextSib;
+	pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
     }
     return DeepestSpriteWin(pSprite);
 }
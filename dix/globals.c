@@ -78,9 +78,10 @@ PtrCtrl defaultPointerControl = {
 	DEFAULT_PTR_THRESHOLD,
 	0};
 
-ClientPtr  clients[MAXCLIENTS];
+ClientPtr *clients;	  /* LimitClients entries, allocated at startup */
 ClientPtr  serverClient;
 int  currentMaxClients;   /* current size of clients array */
+int  LimitClients = LIMITCLIENTS; /* size of clients, set with -maxclients */
 long maxBigRequestSize = MAX_BIG_REQUEST_SIZE;
 
 unsigned long globalSerialNumber = 0;
@@ -125,6 +126,12 @@ TimeStamp lastDeviceEventTime;
 int defaultColorVisualClass = -1;
 int monitorResolution = 0;
 
+int DamageExtRegionLimit = 0;
+Bool DamageExtDeferReports = FALSE;
+
+int RenderThreads = 1;
+int RenderThreadPixels = 256 * 256;
+
 char *display;
 char *ConnectionInfo;
 
@@ -105,6 +105,7 @@ Equipment Corporation.
 #include "privates.h"
 #include "registry.h"
 #include "client.h"
+#include "reqstats.h"
 #ifdef PANORAMIX
 #include "panoramiXsrv.h"
 #else
@@ -143,10 +144,10 @@ int main(int argc, char *argv[], char *envp[])
 
     CheckUserAuthorization();
 
-    InitConnectionLimits();
-
     ProcessCommandLine(argc, argv);
 
+    InitConnectionLimits();
+
     alwaysCheckForInput[0] = 0;
     alwaysCheckForInput[1] = 1;
     while(1)
@@ -167,8 +168,7 @@ int main(int argc, char *argv[], char *envp[])
 	if(serverGeneration == 1)
 	{
 	    CreateWellKnownSockets();
-	    for (i=1; i<MAXCLIENTS; i++)
-		clients[i] = NullClient;
+	    clients = xnfcalloc(LimitClients, sizeof(ClientPtr));
 	    serverClient = calloc(sizeof(ClientRec), 1);
 	    if (!serverClient)
 		FatalError("couldn't create server client");
@@ -201,6 +201,7 @@ int main(int argc, char *argv[], char *envp[])
 	dixResetRegistry();
 	ResetFontPrivateIndex();
 	InitCallbackManager();
+	InitRequestStats();
 	InitOutput(&screenInfo, argc, argv);
 
 	if (screenInfo.numScreens < 1)
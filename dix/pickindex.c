@@ -0,0 +1,303 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <string.h>
+#include <X11/X.h>
+#include "misc.h"
+#include "windowstr.h"
+#include "window.h"
+
+/*
+ * Spatial index over the mapped children of a window, so that finding
+ * the child under the pointer doesn't have to test every sibling.
+ *
+ * The children's border boxes are binned into a grid of about one cell
+ * per child.  Each cell lists the children overlapping it in stacking
+ * order, top first, so a lookup only tests the windows of one cell.  An
+ * unshaped child that covers a whole cell hides everything below it
+ * there and ends the cell's list, which keeps stacks of large
+ * overlapping windows cheap.  Boxes are kept relative to the parent so
+ * that moving the parent doesn't affect them.
+ *
+ * Parents get an index once their children have been scanned for more
+ * than PICK_INDEX_THRESHOLD entries twice, and InvalidatePickIndex drops
+ * it whenever a child is mapped, unmapped, moved, resized, restacked,
+ * reshaped or removed.  Rebuilding also waits for two long scans without
+ * a change in between, so a window being dragged around doesn't rebuild
+ * its parent's index on every motion.
+ */
+
+#define PICK_INDEX_THRESHOLD	16	/* children scanned before indexing */
+#define PICK_INDEX_SCANS	2	/* long scans before (re)building */
+#define PICK_INDEX_MAX_CELLS	4096
+#define PICK_INDEX_MAX_SPREAD	16	/* entries per child before giving up */
+
+typedef struct _PickIndex {
+    Bool	valid;
+    int		scans;		/* long scans since invalidated */
+    Bool	linear;		/* too many entries, scan the children */
+    int		x1, y1, x2, y2;	/* extents of the indexed children */
+    int		cellWidth, cellHeight;
+    int		cols, rows;
+    int		*cellStart;	/* cols * rows + 1 offsets into cellWindows */
+    WindowPtr	*cellWindows;
+} PickIndexRec;
+
+static PickIndexPtr
+GetPickIndex(WindowPtr pWin)
+{
+    return pWin->optional ? pWin->optional->pickIndex : NULL;
+}
+
+static void
+FreePickIndexCells(PickIndexPtr pIndex)
+{
+    free(pIndex->cellStart);
+    free(pIndex->cellWindows);
+    pIndex->cellStart = NULL;
+    pIndex->cellWindows = NULL;
+}
+
+void
+InvalidatePickIndex(WindowPtr pParent)
+{
+    PickIndexPtr pIndex;
+
+    if (pParent && (pIndex = GetPickIndex(pParent)))
+    {
+	pIndex->valid = FALSE;
+	pIndex->scans = 0;
+    }
+}
+
+void
+FreePickIndex(WindowPtr pWin)
+{
+    PickIndexPtr pIndex = GetPickIndex(pWin);
+
+    if (pIndex)
+    {
+	FreePickIndexCells(pIndex);
+	free(pIndex);
+	pWin->optional->pickIndex = NULL;
+    }
+}
+
+static void
+ChildBox(WindowPtr pChild, int *x1, int *y1, int *x2, int *y2)
+{
+    int bw = wBorderWidth(pChild);
+
+    *x1 = pChild->origin.x - bw;
+    *y1 = pChild->origin.y - bw;
+    *x2 = pChild->origin.x + (int) pChild->drawable.width + bw;
+    *y2 = pChild->origin.y + (int) pChild->drawable.height + bw;
+}
+
+/*
+ * Walks the children top to bottom and bins them.  With cells NULL it
+ * only counts the entries of each cell into count, otherwise it stores
+ * them at cells[count[cell]++].  Returns the total number of entries.
+ */
+static int
+BinChildren(WindowPtr pParent, PickIndexPtr pIndex, char *closed,
+	    int *count, WindowPtr *cells)
+{
+    WindowPtr pChild;
+    int x1, y1, x2, y2, cx1, cy1, cx2, cy2, cx, cy, cell;
+    int cellX1, cellY1, cellX2, cellY2;
+    Bool opaque;
+    int total = 0;
+
+    memset(closed, 0, pIndex->cols * pIndex->rows);
+    for (pChild = pParent->firstChild; pChild; pChild = pChild->nextSib)
+    {
+	if (!pChild->mapped)
+	    continue;
+	ChildBox(pChild, &x1, &y1, &x2, &y2);
+	if (x1 >= x2 || y1 >= y2)
+	    continue;
+	opaque = !wBoundingShape(pChild) && !wInputShape(pChild);
+#ifdef ROOTLESS
+	/* rootlessUnhittable can change without telling us */
+	opaque = FALSE;
+#endif
+	cx1 = (x1 - pIndex->x1) / pIndex->cellWidth;
+	cy1 = (y1 - pIndex->y1) / pIndex->cellHeight;
+	cx2 = (x2 - 1 - pIndex->x1) / pIndex->cellWidth;
+	cy2 = (y2 - 1 - pIndex->y1) / pIndex->cellHeight;
+	for (cy = cy1; cy <= cy2; cy++)
+	{
+	    cellY1 = pIndex->y1 + cy * pIndex->cellHeight;
+	    cellY2 = min(cellY1 + pIndex->cellHeight, pIndex->y2);
+	    for (cx = cx1; cx <= cx2; cx++)
+	    {
+		cell = cy * pIndex->cols + cx;
+		if (closed[cell])
+		    continue;
+		if (cells)
+		    cells[count[cell]++] = pChild;
+		else
+		    count[cell]++;
+		total++;
+		cellX1 = pIndex->x1 + cx * pIndex->cellWidth;
+		cellX2 = min(cellX1 + pIndex->cellWidth, pIndex->x2);
+		if (opaque && x1 <= cellX1 && x2 >= cellX2 &&
+		    y1 <= cellY1 && y2 >= cellY2)
+		    closed[cell] = TRUE;
+	    }
+	}
+    }
+    return total;
+}
+
+static void
+BuildPickIndex(WindowPtr pParent, PickIndexPtr pIndex)
+{
+    WindowPtr pChild;
+    int x1, y1, x2, y2;
+    int nchildren = 0, ncells, total, side, i;
+    char *closed = NULL;
+    int *count = NULL;
+
+    FreePickIndexCells(pIndex);
+    pIndex->valid = TRUE;
+    pIndex->scans = 0;
+    pIndex->linear = TRUE;
+
+    pIndex->x1 = pIndex->y1 = MAXSHORT;
+    pIndex->x2 = pIndex->y2 = MINSHORT;
+    for (pChild = pParent->firstChild; pChild; pChild = pChild->nextSib)
+    {
+	if (!pChild->mapped)
+	    continue;
+	ChildBox(pChild, &x1, &y1, &x2, &y2);
+	pIndex->x1 = min(pIndex->x1, x1);
+	pIndex->y1 = min(pIndex->y1, y1);
+	pIndex->x2 = max(pIndex->x2, x2);
+	pIndex->y2 = max(pIndex->y2, y2);
+	nchildren++;
+    }
+    if (!nchildren)
+    {
+	/* Nothing to hit, an empty grid says so */
+	pIndex->x2 = pIndex->x1;
+	pIndex->y2 = pIndex->y1;
+	pIndex->linear = FALSE;
+	return;
+    }
+
+    for (side = 1; side * side < min(nchildren, PICK_INDEX_MAX_CELLS); side++)
+	;
+    pIndex->cols = pIndex->rows = side;
+    pIndex->cellWidth = (pIndex->x2 - pIndex->x1 + side - 1) / side;
+    pIndex->cellHeight = (pIndex->y2 - pIndex->y1 + side - 1) / side;
+    ncells = side * side;
+
+    closed = malloc(ncells);
+    count = calloc(ncells + 1, sizeof(int));
+    if (!closed || !count)
+	goto bail;
+
+    total = BinChildren(pParent, pIndex, closed, count, NULL);
+    if (total > nchildren * PICK_INDEX_MAX_SPREAD)
+	goto bail;
+
+    /* Turn the counts into start offsets, count[i] becomes the fill
+     * position of cell i and ends up as the start of cell i + 1 */
+    pIndex->cellStart = malloc((ncells + 1) * sizeof(int));
+    pIndex->cellWindows = malloc(max(total, 1) * sizeof(WindowPtr));
+    if (!pIndex->cellStart || !pIndex->cellWindows)
+    {
+	FreePickIndexCells(pIndex);
+	goto bail;
+    }
+    pIndex->cellStart[0] = 0;
+    for (i = 0; i < ncells; i++)
+    {
+	pIndex->cellStart[i + 1] = pIndex->cellStart[i] + count[i];
+	count[i] = pIndex->cellStart[i];
+    }
+    BinChildren(pParent, pIndex, closed, count, pIndex->cellWindows);
+    pIndex->linear = FALSE;
+
+bail:
+    free(closed);
+    free(count);
+}
+
+/*
+ * Finds the children of pParent that may contain the screen position x/y,
+ * in stacking order, top first.  Returns the number of candidates, or -1
+ * if pParent has no usable index and its children have to be scanned.
+ */
+int
+LookupPickIndex(WindowPtr pParent, int x, int y, WindowPtr **pCandidates)
+{
+    PickIndexPtr pIndex = GetPickIndex(pParent);
+    int cell;
+
+    if (!pIndex || !pIndex->valid || pIndex->linear)
+	return -1;
+
+    x -= pParent->drawable.x;
+    y -= pParent->drawable.y;
+    if (x < pIndex->x1 || x >= pIndex->x2 || y < pIndex->y1 || y >= pIndex->y2)
+	return 0;
+
+    cell = ((y - pIndex->y1) / pIndex->cellHeight) * pIndex->cols +
+	   (x - pIndex->x1) / pIndex->cellWidth;
+    *pCandidates = pIndex->cellWindows + pIndex->cellStart[cell];
+    return pIndex->cellStart[cell + 1] - pIndex->cellStart[cell];
+}
+
+/*
+ * Called after scanning nscanned children of pParent because
+ * LookupPickIndex returned -1; builds the index once scans get long.
+ */
+void
+NotePickScan(WindowPtr pParent, int nscanned)
+{
+    PickIndexPtr pIndex;
+
+    if (nscanned <= PICK_INDEX_THRESHOLD)
+	return;
+
+    pIndex = GetPickIndex(pParent);
+    if (!pIndex)
+    {
+	if (!MakeWindowOptional(pParent))
+	    return;
+	pIndex = calloc(1, sizeof(PickIndexRec));
+	if (!pIndex)
+	    return;
+	pParent->optional->pickIndex = pIndex;
+    }
+    if (!pIndex->valid && ++pIndex->scans >= PICK_INDEX_SCANS)
+	BuildPickIndex(pParent, pIndex);
+}
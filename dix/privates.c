@@ -66,6 +66,7 @@ from The Open Group.
 static struct {
     DevPrivateKey	key;
     unsigned		offset;
+    unsigned		hot;		/* end of the hot privates */
     int			created;
     int			allocated;
 } keys[PRIVATE_LAST];
@@ -86,10 +87,10 @@ static const Bool xselinux_private[PRIVATE_LAST] = {
     [PRIVATE_GLYPHSET] = TRUE,
 };
 
-typedef Bool (*FixupFunc)(PrivatePtr *privates, int offset, unsigned bytes);
+typedef Bool (*FixupFunc)(PrivatePtr *privates, int offset, unsigned start, unsigned bytes);
 
 static Bool
-dixReallocPrivates(PrivatePtr *privates, int old_offset, unsigned bytes)
+dixReallocPrivates(PrivatePtr *privates, int old_offset, unsigned start, unsigned bytes)
 {
     void	*new_privates;
 
@@ -101,58 +102,60 @@ dixReallocPrivates(PrivatePtr *privates, int old_offset, unsigned bytes)
     return TRUE;
 }
 
+/* Open a hole of bytes at start, moving up everything above it */
 static Bool
-dixMovePrivates(PrivatePtr *privates, int new_offset, unsigned bytes)
+dixMovePrivates(PrivatePtr *privates, int new_offset, unsigned start, unsigned bytes)
 {
-    memmove((char *) *privates + bytes, *privates, new_offset - bytes);
-    memset(*privates, '\0', bytes);
+    memmove((char *) *privates + start + bytes, (char *) *privates + start,
+	    new_offset - bytes - start);
+    memset((char *) *privates + start, '\0', bytes);
     return TRUE;
 }
 
 static Bool
-fixupScreens(FixupFunc fixup, unsigned bytes)
+fixupScreens(FixupFunc fixup, unsigned start, unsigned bytes)
 {
     int s;
     for (s = 0; s < screenInfo.numScreens; s++)
-	if (!fixup(&screenInfo.screens[s]->devPrivates, keys[PRIVATE_SCREEN].offset, bytes))
+	if (!fixup(&screenInfo.screens[s]->devPrivates, keys[PRIVATE_SCREEN].offset, start, bytes))
 	    return FALSE;
     return TRUE;
 }
 
 static Bool
-fixupServerClient(FixupFunc fixup, unsigned bytes)
+fixupServerClient(FixupFunc fixup, unsigned start, unsigned bytes)
 {
     if (serverClient)
-	return fixup(&serverClient->devPrivates, keys[PRIVATE_CLIENT].offset, bytes);
+	return fixup(&serverClient->devPrivates, keys[PRIVATE_CLIENT].offset, start, bytes);
     return TRUE;
 }
 
 static Bool
-fixupExtensions(FixupFunc fixup, unsigned bytes)
+fixupExtensions(FixupFunc fixup, unsigned start, unsigned bytes)
 {
     unsigned char 	major;
     ExtensionEntry	*extension;
     for (major = EXTENSION_BASE; (extension = GetExtensionEntry(major)); major++)
-	if (!fixup(&extension->devPrivates, keys[PRIVATE_EXTENSION].offset, bytes))
+	if (!fixup(&extension->devPrivates, keys[PRIVATE_EXTENSION].offset, start, bytes))
 	    return FALSE;
     return TRUE;
 }
 
 static Bool
-fixupDefaultColormaps(FixupFunc fixup, unsigned bytes)
+fixupDefaultColormaps(FixupFunc fixup, unsigned start, unsigned bytes)
 {
     int s;
     for (s = 0; s < screenInfo.numScreens; s++) {
 	ColormapPtr cmap;
 	dixLookupResourceByType((pointer *) &cmap, screenInfo.screens[s]->defColormap,
 	                        RT_COLORMAP, serverClient, DixCreateAccess);
-	if (cmap && !fixup(&cmap->devPrivates, keys[PRIVATE_COLORMAP].offset, bytes))
+	if (cmap && !fixup(&cmap->devPrivates, keys[PRIVATE_COLORMAP].offset, start, bytes))
 	    return FALSE;
     }
     return TRUE;
 }
 
-static Bool (* const allocated_early[PRIVATE_LAST])(FixupFunc, unsigned) = {
+static Bool (* const allocated_early[PRIVATE_LAST])(FixupFunc, unsigned, unsigned) = {
     [PRIVATE_SCREEN] = fixupScreens,
     [PRIVATE_CLIENT] = fixupServerClient,
     [PRIVATE_EXTENSION] = fixupExtensions,
@@ -166,11 +169,17 @@ static Bool (* const allocated_early[PRIVATE_LAST])(FixupFunc, unsigned) = {
  * non-zero, then the specified amount of space will be allocated in
  * the private storage. Otherwise, space for a single pointer will
  * be allocated which can be set with dixSetPrivate
+ *
+ * The storage for each type starts with the XSELinux privates,
+ * followed by the hot ones in the order they were registered, then
+ * the rest.
  */
 Bool
-dixRegisterPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size)
+dixRegisterPrivateKeyHint(DevPrivateKey key, DevPrivateType type,
+			  unsigned size, DevPrivateHint hint)
 {
     DevPrivateType	t;
+    DevPrivateKey	k;
     int			offset;
     unsigned		bytes;
 
@@ -189,15 +198,13 @@ dixRegisterPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size)
 
     /* Update offsets for all affected keys */
     if (type == PRIVATE_XSELINUX) {
-	DevPrivateKey	k;
-
 	/* Resize if we can, or make sure nothing's allocated if we can't
 	 */
 	for (t = PRIVATE_XSELINUX; t < PRIVATE_LAST; t++)
 	    if (xselinux_private[t]) {
 		if (!allocated_early[t])
 		    assert (!keys[t].created);
-		else if (!allocated_early[t](dixReallocPrivates, bytes))
+		else if (!allocated_early[t](dixReallocPrivates, 0, bytes))
 		    return FALSE;
 	    }
 
@@ -209,8 +216,9 @@ dixRegisterPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size)
 		for (k = keys[t].key; k; k = k->next)
 		    k->offset += bytes;
 		keys[t].offset += bytes;
+		keys[t].hot += bytes;
 		if (allocated_early[t])
-		    allocated_early[t](dixMovePrivates, bytes);
+		    allocated_early[t](dixMovePrivates, 0, bytes);
 	    }
 	}
 
@@ -219,10 +227,23 @@ dixRegisterPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size)
 	/* Resize if we can, or make sure nothing's allocated if we can't */
 	if (!allocated_early[type])
 	    assert(!keys[type].created);
-	else if (!allocated_early[type](dixReallocPrivates, bytes))
+	else if (!allocated_early[type](dixReallocPrivates, 0, bytes))
 	    return FALSE;
-	offset = keys[type].offset;
-	keys[type].offset += bytes;
+
+	if (hint == PRIVATE_HINT_HOT) {
+	    /* Move the cold keys up to make room after the hot ones */
+	    offset = keys[type].hot;
+	    for (k = keys[type].key; k; k = k->next)
+		if (k->offset >= offset)
+		    k->offset += bytes;
+	    keys[type].offset += bytes;
+	    keys[type].hot += bytes;
+	    if (allocated_early[type])
+		allocated_early[type](dixMovePrivates, offset, bytes);
+	} else {
+	    offset = keys[type].offset;
+	    keys[type].offset += bytes;
+	}
     }
 
     /* Setup this key */
@@ -237,6 +258,12 @@ dixRegisterPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size)
     return TRUE;
 }
 
+Bool
+dixRegisterPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size)
+{
+    return dixRegisterPrivateKeyHint(key, type, size, PRIVATE_HINT_COLD);
+}
+
 Bool
 dixRegisterScreenPrivateKey(DevScreenPrivateKey screenKey, ScreenPtr pScreen, DevPrivateType type, unsigned size)
 {
@@ -460,9 +487,14 @@ dixPrivateUsage(void)
 
     for (t = PRIVATE_XSELINUX + 1; t < PRIVATE_LAST; t++) {
 	if (keys[t].offset) {
-	    ErrorF("%s: %d objects of %d bytes = %d total bytes %d private allocs\n",
-		   key_names[t], keys[t].created, keys[t].offset, keys[t].created * keys[t].offset,
-		   keys[t].allocated);
+	    DevPrivateKey k;
+	    int nkeys = 0;
+
+	    for (k = keys[t].key; k; k = k->next)
+		nkeys++;
+	    ErrorF("%s: %d objects of %d bytes (%d keys, %d bytes hot) = %d total bytes %d private allocs\n",
+		   key_names[t], keys[t].created, keys[t].offset, nkeys, keys[t].hot,
+		   keys[t].created * keys[t].offset, keys[t].allocated);
 	    bytes += keys[t].created * keys[t].offset;
 	    objects += keys[t].created;
 	    alloc += keys[t].allocated;
@@ -496,6 +528,7 @@ dixResetPrivates(void)
 	}
 	keys[t].key = NULL;
 	keys[t].offset = 0;
+	keys[t].hot = 0;
 	keys[t].created = 0;
 	keys[t].allocated = 0;
     }
@@ -545,7 +545,14 @@ ProcGetProperty(ClientPtr client)
 	deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp->propertyName);
 
     WriteReplyToClient(client, sizeof(xGenericReply), &reply);
-    if (len)
+    if (len && stuff->delete && (reply.bytesAfter == 0) && !client->swapped)
+    {
+	/* The property is going away, so its data can be sent as is */
+	WriteToClientNoCopy(client, len, (char *)pProp->data + ind,
+			    free, pProp->data);
+	pProp->data = NULL;
+    }
+    else if (len)
     {
 	switch (reply.format) {
 	case 32: client->pSwapReplyFunc = (ReplySwapPtr)CopySwap32Write; break;
@@ -392,6 +392,39 @@ RegionRectAlloc(RegionPtr pRgn, int n)
  *
  *-----------------------------------------------------------------------
  */
+/*
+ * Boxes are four shorts, so the x coordinates of two boxes can be compared
+ * as a single 64 bit word with the y coordinates masked off.  Bands that
+ * are candidates for coalescing differ in y by definition.
+ */
+static const union {
+    BoxRec	box;
+    uint64_t	bits;
+} RegionXMask = { { -1, 0, -1, 0 } };
+
+_X_INLINE static Bool
+RegionBandsMatch (BoxPtr a, BoxPtr b, int n)
+{
+    uint64_t	mask = RegionXMask.bits;
+    uint64_t	a0, a1, b0, b1;
+
+    for (; n >= 2; n -= 2, a += 2, b += 2) {
+	memcpy(&a0, a, sizeof (a0));
+	memcpy(&a1, a + 1, sizeof (a1));
+	memcpy(&b0, b, sizeof (b0));
+	memcpy(&b1, b + 1, sizeof (b1));
+	if (((a0 ^ b0) | (a1 ^ b1)) & mask)
+	    return FALSE;
+    }
+    if (n) {
+	memcpy(&a0, a, sizeof (a0));
+	memcpy(&b0, b, sizeof (b0));
+	if ((a0 ^ b0) & mask)
+	    return FALSE;
+    }
+    return TRUE;
+}
+
 _X_INLINE static int
 RegionCoalesce (
     RegionPtr	pReg,	    	/* Region to coalesce		     */
@@ -424,26 +457,18 @@ RegionCoalesce (
      * cover the most area possible. I.e. two boxes in a band must
      * have some horizontal space between them.
      */
-    y2 = pCurBox->y2;
-
-    do {
-	if ((pPrevBox->x1 != pCurBox->x1) || (pPrevBox->x2 != pCurBox->x2)) {
-	    return curStart;
-	}
-	pPrevBox++;
-	pCurBox++;
-	numRects--;
-    } while (numRects);
+    if (!RegionBandsMatch(pPrevBox, pCurBox, numRects))
+	return curStart;
 
     /*
      * The bands may be merged, so set the bottom y of each box
      * in the previous band to the bottom y of the current band.
      */
-    numRects = curStart - prevStart;
+    y2 = pCurBox->y2;
     pReg->data->numRects -= numRects;
     do {
-	pPrevBox--;
 	pPrevBox->y2 = y2;
+	pPrevBox++;
 	numRects--;
     } while (numRects);
     return prevStart;
@@ -951,6 +976,244 @@ RegionUnionO (
     return TRUE;
 }
 
+/*======================================================================
+ *	    Fast paths for RegionIntersect and RegionUnion
+ *====================================================================*/
+
+/*-
+ *-----------------------------------------------------------------------
+ * RegionIntersectBox --
+ *	Clip a region to a single box.  This is what nearly every clip
+ *	list computation and damage report does, and it only needs one
+ *	pass over the bands that overlap the box, coalescing as it goes,
+ *	instead of the general banded merge.
+ *
+ * Results:
+ *	TRUE if successful.
+ *
+ * Side Effects:
+ *	newReg is overwritten.  newReg may be reg, or the region that
+ *	box belongs to.
+ *
+ *-----------------------------------------------------------------------
+ */
+Bool
+RegionIntersectBox(RegionPtr newReg, RegionPtr reg, BoxPtr box)
+{
+    BoxRec	clip = *box;
+    BoxPtr	r, rEnd;
+    BoxPtr	out, base, prevBand, curBand, pBox;
+    int		numRects, n;
+    int		bandY1, y1, y2, x1, x2;
+    int		extX1, extX2;
+
+    if (RegionNar(reg))
+	return RegionBreak (newReg);
+    if (clip.x1 >= clip.x2 || clip.y1 >= clip.y2 ||
+	!EXTENTCHECK(&reg->extents, &clip))
+    {
+	RegionEmpty(newReg);
+	return TRUE;
+    }
+    if (SUBSUMES(&clip, &reg->extents))
+	return newReg == reg || RegionCopy(newReg, reg);
+    if (!reg->data)
+    {
+	clip.x1 = max(clip.x1, reg->extents.x1);
+	clip.y1 = max(clip.y1, reg->extents.y1);
+	clip.x2 = min(clip.x2, reg->extents.x2);
+	clip.y2 = min(clip.y2, reg->extents.y2);
+	xfreeData(newReg);
+	newReg->extents = clip;
+	newReg->data = NULL;
+	return TRUE;
+    }
+
+    numRects = RegionNumRects(reg);
+    r = RegionRects(reg);
+    rEnd = r + numRects;
+
+    /* Boxes are only ever written at or before the one being read, so
+     * clipping in place is safe */
+    if (newReg != reg && (!newReg->data || newReg->data->size < numRects))
+    {
+	xfreeData(newReg);
+	newReg->data = xallocData(numRects);
+	if (!newReg->data)
+	    return RegionBreak (newReg);
+	newReg->data->size = numRects;
+    }
+    base = out = RegionBoxptr(newReg);
+    prevBand = NULL;
+    extX1 = MAXSHORT;
+    extX2 = MINSHORT;
+
+    while (r != rEnd && r->y2 <= clip.y1)
+	r++;
+    while (r != rEnd && r->y1 < clip.y2)
+    {
+	bandY1 = r->y1;
+	y1 = max(r->y1, clip.y1);
+	y2 = min(r->y2, clip.y2);
+	curBand = out;
+	do {
+	    x1 = max(r->x1, clip.x1);
+	    x2 = min(r->x2, clip.x2);
+	    r++;
+	    if (x1 < x2)
+		ADDRECT(out, x1, y1, x2, y2);
+	} while (r != rEnd && r->y1 == bandY1);
+
+	if (out == curBand)
+	    continue;
+	if (curBand->x1 < extX1)
+	    extX1 = curBand->x1;
+	if (out[-1].x2 > extX2)
+	    extX2 = out[-1].x2;
+	if (prevBand && prevBand->y2 == y1 &&
+	    curBand - prevBand == out - curBand &&
+	    RegionBandsMatch(prevBand, curBand, out - curBand))
+	{
+	    for (pBox = prevBand; pBox != curBand; pBox++)
+		pBox->y2 = y2;
+	    out = curBand;
+	}
+	else
+	    prevBand = curBand;
+    }
+
+    n = out - base;
+    if (!n)
+    {
+	xfreeData(newReg);
+	newReg->extents = RegionEmptyBox;
+	newReg->data = &RegionEmptyData;
+    }
+    else if (n == 1)
+    {
+	newReg->extents = *base;
+	xfreeData(newReg);
+	newReg->data = NULL;
+    }
+    else
+    {
+	newReg->extents.x1 = extX1;
+	newReg->extents.y1 = base->y1;
+	newReg->extents.x2 = extX2;
+	newReg->extents.y2 = out[-1].y2;
+	newReg->data->numRects = n;
+	DOWNSIZE(newReg, n);
+    }
+    good(newReg);
+    return TRUE;
+}
+
+/*-
+ *-----------------------------------------------------------------------
+ * RegionUnionBands --
+ *	Union two regions that do not share any scanlines, which is how
+ *	damage and exposures usually accumulate.  The result is the boxes
+ *	of the upper region followed by those of the lower one, with the
+ *	two bands that meet coalesced if they line up.
+ *
+ * Results:
+ *	TRUE if successful.
+ *
+ * Side Effects:
+ *	newReg is overwritten.  newReg may be either source region.
+ *
+ *-----------------------------------------------------------------------
+ */
+Bool
+RegionUnionBands(RegionPtr newReg, RegionPtr reg1, RegionPtr reg2)
+{
+    RegionPtr	top, bot;
+    BoxPtr	topBox, botBox, band, out;
+    RegDataPtr	data;
+    int		nTop, nBot, nBand, n;
+    Bool	coalesce;
+    BoxRec	extents;
+
+    if (RegionNar(reg1) || RegionNar(reg2))
+	return RegionBreak (newReg);
+    if (reg1->extents.x1 >= reg1->extents.x2 ||
+	reg2->extents.x1 >= reg2->extents.x2)
+	return pixman_region_union (newReg, reg1, reg2);
+    if (reg1->extents.y1 < reg2->extents.y1)
+    {
+	top = reg1;
+	bot = reg2;
+    }
+    else
+    {
+	top = reg2;
+	bot = reg1;
+    }
+    assert(top->extents.y2 <= bot->extents.y1);
+
+    nTop = RegionNumRects(top);
+    topBox = RegionRects(top);
+    nBot = RegionNumRects(bot);
+    botBox = RegionRects(bot);
+
+    extents.x1 = min(top->extents.x1, bot->extents.x1);
+    extents.y1 = top->extents.y1;
+    extents.x2 = max(top->extents.x2, bot->extents.x2);
+    extents.y2 = bot->extents.y2;
+
+    /* Find the last band of the upper region */
+    band = topBox + nTop - 1;
+    while (band != topBox && band[-1].y1 == band->y1)
+	band--;
+    nBand = topBox + nTop - band;
+
+    coalesce = (band->y2 == botBox->y1 &&
+		nBand <= nBot &&
+		botBox[nBand - 1].y1 == botBox->y1 &&
+		(nBand == nBot || botBox[nBand].y1 != botBox->y1) &&
+		RegionBandsMatch(band, botBox, nBand));
+    n = nTop + nBot - (coalesce ? nBand : 0);
+
+    if (n == 1)
+    {
+	xfreeData(newReg);
+	newReg->extents = extents;
+	newReg->data = NULL;
+	return TRUE;
+    }
+
+    if (newReg != reg1 && newReg != reg2 &&
+	newReg->data && newReg->data->size >= n)
+	data = newReg->data;
+    else
+    {
+	data = xallocData(n);
+	if (!data)
+	    return RegionBreak (newReg);
+	data->size = n;
+    }
+    out = (BoxPtr) (data + 1);
+    memmove(out, topBox, nTop * sizeof (BoxRec));
+    if (coalesce)
+    {
+	for (band = out + nTop - nBand; band != out + nTop; band++)
+	    band->y2 = botBox->y2;
+	botBox += nBand;
+	nBot -= nBand;
+    }
+    memmove(out + nTop, botBox, nBot * sizeof (BoxRec));
+    data->numRects = n;
+
+    if (data != newReg->data)
+    {
+	xfreeData(newReg);
+	newReg->data = data;
+    }
+    newReg->extents = extents;
+    good(newReg);
+    return TRUE;
+}
+
 /*======================================================================
  *	    Batch Rectangle Union
  *====================================================================*/
@@ -1208,8 +1471,15 @@ RegionValidate(RegionPtr badreg, Bool *pOverlap)
 	return TRUE;
     }
 
-    /* Step 1: Sort the rects array into ascending (y1, x1) order */
-    QuickSortRects(RegionBoxptr(badreg), numRects);
+    /* Step 1: Sort the rects array into ascending (y1, x1) order.  Callers
+       that append rectangles top to bottom already have them that way. */
+    box = RegionBoxptr(badreg);
+    for (i = 1; i < numRects; i++)
+	if (box[i].y1 < box[i-1].y1 ||
+	    (box[i].y1 == box[i-1].y1 && box[i].x1 < box[i-1].x1))
+	    break;
+    if (i < numRects)
+	QuickSortRects(box, numRects);
 
     /* Step 2: Scatter the sorted array into the minimum number of regions */
 
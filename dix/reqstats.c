@@ -0,0 +1,285 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "extnsionst.h"
+#include "registry.h"
+#include "privates.h"
+#include "reqstats.h"
+#include "mi.h"
+
+/* Core requests by major opcode, extension requests by major and minor
+ * opcode, allocated as each extension is first used. */
+static ReqStatsRec CoreStats[EXTENSION_BASE];
+static ReqStatsPtr ExtensionStats[MAXEXTENSIONS];
+
+Bool RequestStatsEnabled;	/* -reqstats given */
+int RequestStatsInterval;	/* seconds between dumps, 0 for none */
+
+/* Only registered, and so only taking space in each client, when the
+ * statistics are kept */
+DevPrivateKeyRec RequestStatsClientPrivateKeyRec;
+
+/* Set by SIGUSR2, the dump itself is left to the block handler */
+static volatile sig_atomic_t RequestStatsDumpPending;
+
+static int
+RequestStatsBucket(CARD32 usec)
+{
+    int bucket = 0;
+
+    while (usec && bucket < REQ_STATS_BUCKETS - 1)
+    {
+	usec >>= 1;
+	bucket++;
+    }
+    return bucket;
+}
+
+static void
+AddRequestStats(ReqStatsPtr stats, CARD32 usec, int bucket,
+		CARD32 bytesIn, CARD32 bytesOut)
+{
+    stats->count++;
+    stats->time += usec;
+    stats->bytesIn += bytesIn;
+    stats->bytesOut += bytesOut;
+    stats->histogram[bucket]++;
+}
+
+void
+RecordRequestStats(ClientPtr client, int major, int minor, CARD32 usec,
+		   CARD32 bytesIn, CARD32 bytesOut)
+{
+    int bucket = RequestStatsBucket(usec);
+    ReqStatsPtr stats = ClientRequestStats(client);
+
+    if (!stats)
+	return;
+
+    /* The client's bytesOut is counted as output is written */
+    stats->count++;
+    stats->time += usec;
+    stats->bytesIn += bytesIn;
+    stats->histogram[bucket]++;
+
+    if (major < EXTENSION_BASE)
+	stats = &CoreStats[major];
+    else
+    {
+	stats = ExtensionStats[major - EXTENSION_BASE];
+	if (!stats)
+	{
+	    stats = calloc(256, sizeof(ReqStatsRec));
+	    if (!stats)
+		return;
+	    ExtensionStats[major - EXTENSION_BASE] = stats;
+	}
+	stats += minor & 0xff;
+    }
+    AddRequestStats(stats, usec, bucket, bytesIn, bytesOut);
+}
+
+ReqStatsPtr
+GetRequestStats(int major, int minor)
+{
+    ReqStatsPtr stats;
+
+    if (major < 0 || major > 255 || minor < 0 || minor > 255)
+	return NULL;
+    if (major < EXTENSION_BASE)
+	stats = &CoreStats[major];
+    else if (!(stats = ExtensionStats[major - EXTENSION_BASE]))
+	return NULL;
+    else
+	stats += minor;
+    return stats->count ? stats : NULL;
+}
+
+CARD32
+RequestStatsPercentile(ReqStatsPtr stats, int percent)
+{
+    CARD64 want = (stats->count * percent + 99) / 100;
+    CARD64 seen = 0;
+    int i;
+
+    for (i = 0; i < REQ_STATS_BUCKETS - 1; i++)
+    {
+	seen += stats->histogram[i];
+	if (seen >= want)
+	    break;
+    }
+    return (CARD32)1 << i;
+}
+
+static void
+DumpOneRequestStats(const char *name, ReqStatsPtr stats)
+{
+    ErrorF("%-40s %10llu %10llu %8llu %8u %8u %12llu %12llu\n", name,
+	   (unsigned long long)stats->count,
+	   (unsigned long long)(stats->time / 1000),
+	   (unsigned long long)(stats->time / stats->count),
+	   (unsigned int)RequestStatsPercentile(stats, 50),
+	   (unsigned int)RequestStatsPercentile(stats, 99),
+	   (unsigned long long)stats->bytesIn,
+	   (unsigned long long)stats->bytesOut);
+}
+
+static void
+DumpServerStats(void)
+{
+    OsBufferStatsRec buffers;
+    mieqStatsRec input;
+
+    GetOsBufferStats(&buffers);
+    ErrorF("Connection buffer pool: %lu requests, %lu mallocs, %lu frees, "
+	   "%lu buffers (%lu bytes) pooled\n", buffers.requests,
+	   buffers.mallocs, buffers.frees, buffers.pooled,
+	   buffers.pooledBytes);
+
+    mieqGetStats(&input);
+    ErrorF("Input queue: %lu events, %lu coalesced, %lu dropped, %d slots, "
+	   "at most %d pending, latency mean %llu max %llu usec\n",
+	   input.enqueued, input.coalesced, input.dropped, input.size,
+	   input.maxPending,
+	   (unsigned long long)(input.processed ?
+				input.latencyTotal / input.processed : 0),
+	   (unsigned long long)input.latencyMax);
+}
+
+void
+DumpRequestStats(void)
+{
+    char name[64];
+    const char *cmd;
+    ReqStatsPtr stats;
+    ClientPtr pClient;
+    int major, minor, i;
+
+    ErrorF("Request statistics (times in usec, p50/p99 are upper bounds):\n");
+    ErrorF("%-40s %10s %10s %8s %8s %8s %12s %12s\n", "request", "count",
+	   "total ms", "mean", "p50", "p99", "bytes in", "bytes out");
+    for (major = 0; major < 256; major++)
+    {
+	for (minor = 0; minor < (major < EXTENSION_BASE ? 1 : 256); minor++)
+	{
+	    if (!(stats = GetRequestStats(major, minor)))
+		continue;
+	    if (strcmp(LookupRequestName(major, minor), XREGISTRY_UNKNOWN))
+		strlcpy(name, LookupRequestName(major, minor), sizeof(name));
+	    else
+		snprintf(name, sizeof(name), "%d.%d", major, minor);
+	    DumpOneRequestStats(name, stats);
+	}
+    }
+
+    ErrorF("%-40s %10s %10s %8s %8s %8s %12s %12s\n", "client", "count",
+	   "total ms", "mean", "p50", "p99", "bytes in", "bytes out");
+    for (i = 1; i < currentMaxClients; i++)
+    {
+	if (!clients[i] || !(stats = ClientRequestStats(clients[i])) ||
+	    !stats->count)
+	    continue;
+	cmd = GetClientCmdName(clients[i]);
+	snprintf(name, sizeof(name), "%d %s", i, cmd ? cmd : "");
+	DumpOneRequestStats(name, stats);
+    }
+
+    ErrorF("%-40s %10s %10s\n", "client", "cpu ms", "weight");
+    for (i = 1; i < currentMaxClients; i++)
+    {
+	if (!(pClient = clients[i]))
+	    continue;
+	cmd = GetClientCmdName(pClient);
+	snprintf(name, sizeof(name), "%d %s", i, cmd ? cmd : "");
+	ErrorF("%-40s %10llu %10d\n", name,
+	       (unsigned long long)(pClient->smart_cpu_time / 1000),
+	       pClient->smart_weight ? pClient->smart_weight :
+				       SMART_DEFAULT_WEIGHT);
+    }
+
+    DumpServerStats();
+    dixPrivateUsage();
+}
+
+static CARD32
+RequestStatsTimer(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    DumpRequestStats();
+    return RequestStatsInterval * 1000;
+}
+
+static void
+RequestStatsSignal(int sig)
+{
+    RequestStatsDumpPending = TRUE;
+}
+
+static void
+RequestStatsBlockHandler(pointer data, struct timeval **wt, pointer readmask)
+{
+    if (RequestStatsDumpPending)
+    {
+	RequestStatsDumpPending = FALSE;
+	DumpRequestStats();
+    }
+}
+
+static void
+RequestStatsWakeupHandler(pointer data, int result, pointer readmask)
+{
+}
+
+void
+InitRequestStats(void)
+{
+    if (!RequestStatsEnabled)
+	return;
+
+    /* Privates, timers and block handlers all went with the previous
+     * generation */
+    if (!dixRegisterPrivateKey(&RequestStatsClientPrivateKeyRec,
+			       PRIVATE_CLIENT, sizeof(ReqStatsRec)))
+	FatalError("failed to register request statistics private\n");
+    if (RequestStatsInterval > 0)
+	TimerSet(NULL, 0, RequestStatsInterval * 1000, RequestStatsTimer,
+		 NULL);
+
+    /* A signal landing just before the server blocks waits for the next
+     * wakeup to be dumped */
+    RegisterBlockAndWakeupHandlers(RequestStatsBlockHandler,
+				   RequestStatsWakeupHandler, NULL);
+    OsSignal(SIGUSR2, RequestStatsSignal);
+}
@@ -104,10 +104,13 @@ Equipment Corporation.
 
 /* 
  *      A resource ID is a 32 bit quantity, the upper 2 bits of which are
- *	off-limits for client-visible resources.  The next 8 bits are
- *      used as client ID, and the low 22 bits come from the client.
- *	A resource ID is "hashed" by extracting and xoring subfields
- *      (varying with the size of the hash table).
+ *	off-limits for client-visible resources.  The next
+ *	RESOURCE_CLIENT_BITS bits are used as client ID (8 by default,
+ *	up to 11 with -maxclients), and the remaining low bits come from
+ *	the client.
+ *	A resource ID is hashed by multiplying it with a large odd
+ *	constant and keeping the top bits of the product, which spreads
+ *	the sequential IDs clients allocate evenly over the table.
  *
  *      It is sometimes necessary for the server to create an ID that looks
  *      like it belongs to a client.  This ID, however,  must not be one
@@ -151,32 +154,57 @@ typedef const char *string;
 #define TypeNameString(t) LookupResourceName(t)
 #endif
 
-static void RebuildTable(
-    int /*client*/
-);
-
 #define SERVER_MINID 32
 
 #define INITBUCKETS 64
 #define INITHASHSIZE 6
-#define MAXHASHSIZE 11
+
+/*
+ * Each client's resources live in an open addressed hash table using
+ * linear probing.  A slot holds the most recently added resource for an
+ * id, and older resources with the same id hang off its next pointer,
+ * so resources sharing an id are still freed newest first.  Freed slots
+ * are marked with DeletedSlot to keep probe sequences intact until the
+ * table is next rebuilt.  The table has no size limit; it is rebuilt
+ * whenever more than 3/4 of the slots are occupied or deleted.
+ *
+ * Every resource is also on a per-type list, newest first, so walking
+ * the resources of one type, or all of them, costs time proportional to
+ * the number of resources rather than to the size of the table.
+ */
 
 typedef struct _Resource {
-    struct _Resource	*next;
+    struct _Resource	*next;		/* older resource with the same id */
     XID			id;
     RESTYPE		type;
     pointer		value;
+    struct _Resource	*typeNext;	/* older resource of the same type */
+    struct _Resource	**typePrev;	/* pointer pointing to this one */
 } ResourceRec, *ResourcePtr;
 
 typedef struct _ClientResource {
     ResourcePtr *resources;
-    int		elements;
-    int		buckets;
+    int		elements;	/* resources in the table */
+    int		ids;		/* distinct ids, i.e. occupied slots */
+    int		used;		/* occupied and deleted slots */
+    int		buckets;	/* 0 if the client is not in use */
     int		hashsize;	/* log(2)(buckets) */
+    ResourcePtr	lastLookup;	/* last hit of dixLookupResourceByType */
+    ResourcePtr	*byType;	/* per-type lists, by type & TypeMask */
+    int		numTypes;
     XID		fakeID;
     XID		endFakeID;
 } ClientResourceRec;
 
+/* An id no resource can have; used for the markers below */
+#define MARKER_ID (~(XID)0)
+
+/* never matches a real id, so probing simply steps over it */
+static ResourceRec deletedSlot = { NULL, MARKER_ID, RT_NONE, NULL };
+
+#define DeletedSlot (&deletedSlot)
+#define SlotInUse(res) ((res) && (res) != DeletedSlot)
+
 RESTYPE lastResourceType;
 static RESTYPE lastResourceClass;
 RESTYPE TypeMask;
@@ -282,7 +310,39 @@ CreateNewResourceClass(void)
     return next;
 }
 
-static ClientResourceRec clientTable[MAXCLIENTS];
+static ClientResourceRec *clientTable;	/* LimitClients entries */
+
+static int
+ilog2(int val)
+{
+    int bits;
+
+    if (val <= 0)
+	return 0;
+    for (bits = 0; val != 0; bits++)
+	val >>= 1;
+    return bits - 1;
+}
+
+/*****************
+ * ResourceClientBits
+ *    Returns the number of bits reserved in each XID for the client
+ *    index, which is enough to address LimitClients clients.
+ *****************/
+
+unsigned int
+ResourceClientBits(void)
+{
+    static int limit;
+    static unsigned int bits;
+
+    if (limit != LimitClients)
+    {
+	limit = LimitClients;
+	bits = ilog2(LimitClients);
+    }
+    return bits;
+}
 
 /*****************
  * InitClientResources
@@ -293,7 +353,7 @@ static ClientResourceRec clientTable[MAXCLIENTS];
 Bool
 InitClientResources(ClientPtr client)
 {
-    int i, j;
+    int i;
  
     if (client == serverClient)
     {
@@ -305,14 +365,31 @@ InitClientResources(ClientPtr client)
 	if (!resourceTypes)
 	    return FALSE;
 	memcpy(resourceTypes, predefTypes, sizeof(predefTypes));
+	/* LimitClients cannot change once the server is running */
+	if (!clientTable)
+	    clientTable = calloc(LimitClients, sizeof(ClientResourceRec));
+	if (!clientTable)
+	    return FALSE;
     }
     clientTable[i = client->index].resources =
-	malloc(INITBUCKETS*sizeof(ResourcePtr));
+	calloc(INITBUCKETS, sizeof(ResourcePtr));
     if (!clientTable[i].resources)
 	return FALSE;
     clientTable[i].buckets = INITBUCKETS;
     clientTable[i].elements = 0;
+    clientTable[i].ids = 0;
+    clientTable[i].used = 0;
     clientTable[i].hashsize = INITHASHSIZE;
+    clientTable[i].lastLookup = NULL;
+    clientTable[i].numTypes = lastResourceType + 1;
+    clientTable[i].byType = calloc(clientTable[i].numTypes, sizeof(ResourcePtr));
+    if (!clientTable[i].byType)
+    {
+	free(clientTable[i].resources);
+	clientTable[i].resources = NULL;
+	clientTable[i].buckets = 0;
+	return FALSE;
+    }
     /* Many IDs allocated from the server client are visible to clients,
      * so we don't use the SERVER_BIT for them, but we have to start
      * past the magic value constants used in the protocol.  For normal
@@ -321,34 +398,200 @@ InitClientResources(ClientPtr client)
     clientTable[i].fakeID = client->clientAsMask |
 			    (client->index ? SERVER_BIT : SERVER_MINID);
     clientTable[i].endFakeID = (clientTable[i].fakeID | RESOURCE_ID_MASK) + 1;
-    for (j=0; j<INITBUCKETS; j++) 
+    return TRUE;
+}
+
+
+static _X_INLINE int
+Hash(ClientResourceRec *rrec, XID id)
+{
+    return (int)((CARD32)((CARD32)id * 0x9e3779b1U) >> (32 - rrec->hashsize));
+}
+
+/*
+ * Returns the slot holding the resources for id, or NULL if there are
+ * none.  There is always at least one empty slot, which ends the probe.
+ */
+static ResourcePtr *
+FindSlot(ClientResourceRec *rrec, XID id)
+{
+    int mask = rrec->buckets - 1;
+    int i = Hash(rrec, id);
+    ResourcePtr res;
+
+    while ((res = rrec->resources[i]))
+    {
+	if (res->id == id)
+	    return &rrec->resources[i];
+	i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+/*
+ * Like FindSlot, but if id has no resources yet return the first empty
+ * or deleted slot a new resource for it can be stored in.
+ */
+static ResourcePtr *
+InsertSlot(ClientResourceRec *rrec, XID id)
+{
+    int mask = rrec->buckets - 1;
+    int i = Hash(rrec, id);
+    ResourcePtr res, *avail = NULL;
+
+    while ((res = rrec->resources[i]))
+    {
+	if (res->id == id)
+	    return &rrec->resources[i];
+	if (res == DeletedSlot && !avail)
+	    avail = &rrec->resources[i];
+	i = (i + 1) & mask;
+    }
+    return avail ? avail : &rrec->resources[i];
+}
+
+/*
+ * Rehash into a table in which the live ids fill at most half of the
+ * slots, dropping all deleted slots.  When deleted slots are what made
+ * the table crowded this rebuilds it at the same size, or even smaller.
+ */
+static Bool
+RebuildTable(ClientResourceRec *rrec)
+{
+    ResourcePtr *resources, *old = rrec->resources;
+    int oldbuckets = rrec->buckets;
+    int buckets = INITBUCKETS, hashsize = INITHASHSIZE;
+    int i, j;
+
+    while ((rrec->ids + 1) * 2 > buckets)
+    {
+	buckets *= 2;
+	hashsize++;
+    }
+    resources = calloc(buckets, sizeof(ResourcePtr));
+    if (!resources)
+	return FALSE;
+
+    rrec->resources = resources;
+    rrec->buckets = buckets;
+    rrec->hashsize = hashsize;
+    rrec->used = rrec->ids;
+    for (i = 0; i < oldbuckets; i++)
     {
-        clientTable[i].resources[j] = NULL;
+	if (!SlotInUse(old[i]))
+	    continue;
+	for (j = Hash(rrec, old[i]->id); resources[j]; j = (j + 1) & (buckets - 1))
+	    ;
+	resources[j] = old[i];
     }
+    free(old);
     return TRUE;
 }
 
+static void
+LinkType(ResourcePtr *head, ResourcePtr res)
+{
+    if ((res->typeNext = *head))
+	res->typeNext->typePrev = &res->typeNext;
+    res->typePrev = head;
+    *head = res;
+}
 
-static int
-Hash(int client, XID id)
+static void
+UnlinkType(ResourcePtr res)
+{
+    if ((*res->typePrev = res->typeNext))
+	res->typeNext->typePrev = res->typePrev;
+}
+
+/* Make room for the list of type index, which may be a type created
+ * after the client connected. */
+static Bool
+GrowTypeLists(ClientResourceRec *rrec, int index)
+{
+    ResourcePtr *byType;
+    int i, num = max(index, (int)lastResourceType) + 1;
+
+    byType = realloc(rrec->byType, num * sizeof(ResourcePtr));
+    if (!byType)
+	return FALSE;
+    memset(byType + rrec->numTypes, 0,
+	   (num - rrec->numTypes) * sizeof(ResourcePtr));
+    /* the first resource of each list points back into the array */
+    for (i = 0; i < rrec->numTypes; i++)
+	if (byType[i])
+	    byType[i]->typePrev = &byType[i];
+    rrec->byType = byType;
+    rrec->numTypes = num;
+    return TRUE;
+}
+
+/*
+ * Iterating over a type list keeps a marker resource, the cursor, right
+ * after the resource last returned, so the caller may free any resource
+ * in between, including that one.  Resources added meanwhile go to the
+ * front of the list and are not visited.  Markers of other iterations
+ * in progress are skipped.
+ */
+static void
+StartTypeIteration(ClientResourceRec *rrec, int index, ResourcePtr cursor)
+{
+    cursor->id = MARKER_ID;
+    cursor->type = RT_NONE;
+    LinkType(&rrec->byType[index], cursor);
+}
+
+/* Returns NULL, with the cursor unlinked, at the end of the list */
+static ResourcePtr
+NextTypeResource(ResourcePtr cursor)
+{
+    ResourcePtr res;
+
+    for (res = cursor->typeNext; res && res->id == MARKER_ID; res = res->typeNext)
+	;
+    UnlinkType(cursor);
+    if (res)
+	LinkType(&res->typeNext, cursor);
+    return res;
+}
+
+/*
+ * Remove the resource *prev from the chain starting at *slot.  The caller
+ * frees it.
+ */
+static void
+UnlinkResource(ClientResourceRec *rrec, ResourcePtr *slot, ResourcePtr *prev)
 {
-    id &= RESOURCE_ID_MASK;
-    switch (clientTable[client].hashsize)
+    ResourcePtr res = *prev;
+
+    *prev = res->next;
+    UnlinkType(res);
+    if (!*slot)
     {
-	case 6:
-	    return ((int)(0x03F & (id ^ (id>>6) ^ (id>>12))));
-	case 7:
-	    return ((int)(0x07F & (id ^ (id>>7) ^ (id>>13))));
-	case 8:
-	    return ((int)(0x0FF & (id ^ (id>>8) ^ (id>>16))));
-	case 9:
-	    return ((int)(0x1FF & (id ^ (id>>9))));
-	case 10:
-	    return ((int)(0x3FF & (id ^ (id>>10))));
-	case 11:
-	    return ((int)(0x7FF & (id ^ (id>>11))));
-    }
-    return -1;
+	int next = (slot - rrec->resources + 1) & (rrec->buckets - 1);
+
+	/* only needs a marker if some probe sequence runs through it */
+	if (rrec->resources[next])
+	    *slot = DeletedSlot;
+	else
+	    rrec->used--;
+	rrec->ids--;
+    }
+    rrec->elements--;
+    if (rrec->lastLookup == res)
+	rrec->lastLookup = NULL;
+}
+
+/* Like UnlinkResource, for a resource found through its type list */
+static void
+RemoveResource(ClientResourceRec *rrec, ResourcePtr res)
+{
+    ResourcePtr *slot = FindSlot(rrec, res->id);
+    ResourcePtr *prev;
+
+    for (prev = slot; *prev != res; prev = &(*prev)->next)
+	;
+    UnlinkResource(rrec, slot, prev);
 }
 
 static XID
@@ -358,16 +601,11 @@ AvailableID(
     XID maxid,
     XID goodid)
 {
-    ResourcePtr res;
-
     if ((goodid >= id) && (goodid <= maxid))
 	return goodid;
     for (; id <= maxid; id++)
     {
-	res = clientTable[client].resources[Hash(client, id)];
-	while (res && (res->id != id))
-	    res = res->next;
-	if (!res)
+	if (!FindSlot(&clientTable[client], id))
 	    return id;
     }
     return 0;
@@ -390,17 +628,17 @@ GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
     for (resp = clientTable[client].resources, i = clientTable[client].buckets;
 	 --i >= 0;)
     {
-	for (res = *resp++; res; res = res->next)
-	{
-	    if ((res->id < id) || (res->id > maxid))
-		continue;
-	    if (((res->id - id) >= (maxid - res->id)) ?
-		(goodid = AvailableID(client, id, res->id - 1, goodid)) :
-		!(goodid = AvailableID(client, res->id + 1, maxid, goodid)))
-		maxid = res->id - 1;
-	    else
-		id = res->id + 1;
-	}
+	res = *resp++;
+	if (!SlotInUse(res))
+	    continue;
+	if ((res->id < id) || (res->id > maxid))
+	    continue;
+	if (((res->id - id) >= (maxid - res->id)) ?
+	    (goodid = AvailableID(client, id, res->id - 1, goodid)) :
+	    !(goodid = AvailableID(client, res->id + 1, maxid, goodid)))
+	    maxid = res->id - 1;
+	else
+	    id = res->id + 1;
     }
     if (id > maxid)
 	id = maxid = 0;
@@ -480,7 +718,7 @@ AddResource(XID id, RESTYPE type, pointer value)
 {
     int client;
     ClientResourceRec *rrec;
-    ResourcePtr res, *head;
+    ResourcePtr res, *slot;
     	
 #ifdef XSERVER_DTRACE
     XSERVER_RESOURCE_ALLOC(id, type, value, TypeNameString(type));
@@ -493,75 +731,45 @@ AddResource(XID id, RESTYPE type, pointer value)
 		(unsigned long)id, type, (unsigned long)value, client);
         FatalError("client not in use\n");
     }
-    if ((rrec->elements >= 4*rrec->buckets) &&
-	(rrec->hashsize < MAXHASHSIZE))
-	RebuildTable(client);
-    head = &rrec->resources[Hash(client, id)];
-    res = malloc(sizeof(ResourceRec));
+    /* a failed rebuild is fine as long as an empty slot is left */
+    if (((rrec->used + 1) * 4 > rrec->buckets * 3) &&
+	!RebuildTable(rrec) && (rrec->used + 1 >= rrec->buckets))
+	res = NULL;
+    else if ((type & TypeMask) >= rrec->numTypes &&
+	     !GrowTypeLists(rrec, type & TypeMask))
+	res = NULL;
+    else
+	res = malloc(sizeof(ResourceRec));
     if (!res)
     {
 	(*resourceTypes[type & TypeMask].deleteFunc)(value, id);
 	return FALSE;
     }
-    res->next = *head;
+    slot = InsertSlot(rrec, id);
+    if (SlotInUse(*slot))
+    {
+	res->next = *slot;
+	/* the new resource may now be the one a lookup should find */
+	if (rrec->lastLookup && rrec->lastLookup->id == id)
+	    rrec->lastLookup = NULL;
+    }
+    else
+    {
+	if (!*slot)
+	    rrec->used++;
+	rrec->ids++;
+	res->next = NULL;
+    }
     res->id = id;
     res->type = type;
     res->value = value;
-    *head = res;
+    *slot = res;
+    LinkType(&rrec->byType[type & TypeMask], res);
     rrec->elements++;
     CallResourceStateCallback(ResourceStateAdding, res);
     return TRUE;
 }
 
-static void
-RebuildTable(int client)
-{
-    int j;
-    ResourcePtr res, next;
-    ResourcePtr **tails, *resources;
-    ResourcePtr **tptr, *rptr;
-
-    /*
-     * For now, preserve insertion order, since some ddx layers depend
-     * on resources being free in the opposite order they are added.
-     */
-
-    j = 2 * clientTable[client].buckets;
-    tails = malloc(j * sizeof(ResourcePtr *));
-    if (!tails)
-	return;
-    resources = malloc(j * sizeof(ResourcePtr));
-    if (!resources)
-    {
-	free(tails);
-	return;
-    }
-    for (rptr = resources, tptr = tails; --j >= 0; rptr++, tptr++)
-    {
-	*rptr = NULL;
-	*tptr = rptr;
-    }
-    clientTable[client].hashsize++;
-    for (j = clientTable[client].buckets,
-	 rptr = clientTable[client].resources;
-	 --j >= 0;
-	 rptr++)
-    {
-	for (res = *rptr; res; res = next)
-	{
-	    next = res->next;
-	    res->next = NULL;
-	    tptr = &tails[Hash(client, res->id)];
-	    **tptr = res;
-	    *tptr = &res->next;
-	}
-    }
-    free(tails);
-    clientTable[client].buckets *= 2;
-    free(clientTable[client].resources);
-    clientTable[client].resources = resources;
-}
-
 static void
 doFreeResource(ResourcePtr res, Bool skip)
 {
@@ -577,38 +785,30 @@ void
 FreeResource(XID id, RESTYPE skipDeleteFuncType)
 {
     int		cid;
+    ClientResourceRec *rrec;
     ResourcePtr res;
-    ResourcePtr *prev, *head;
-    int *eltptr;
-    int		elements;
+    ResourcePtr *slot;
 
-    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].buckets)
+    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].buckets)
     {
-	head = &clientTable[cid].resources[Hash(cid, id)];
-	eltptr = &clientTable[cid].elements;
+	rrec = &clientTable[cid];
 
-	prev = head;
-	while ( (res = *prev) )
+	/* delete functions may add or free other resources and so move
+	 * this id to another slot, hence look it up again every time */
+	while (rrec->buckets && (slot = FindSlot(rrec, id)))
 	{
-	    if (res->id == id)
-	    {
-		RESTYPE rtype = res->type;
+	    RESTYPE rtype;
 
+	    res = *slot;
+	    rtype = res->type;
 #ifdef XSERVER_DTRACE
-		XSERVER_RESOURCE_FREE(res->id, res->type,
-			      res->value, TypeNameString(res->type));
+	    XSERVER_RESOURCE_FREE(res->id, res->type,
+			  res->value, TypeNameString(res->type));
 #endif		    
-		*prev = res->next;
-		elements = --*eltptr;
-
-		doFreeResource(res, rtype == skipDeleteFuncType);
+	    UnlinkResource(rrec, slot, slot);
 
-		if (*eltptr != elements)
-		    prev = head; /* prev may no longer be valid */
-	    }
-	    else
-		prev = &res->next;
-        }
+	    doFreeResource(res, rtype == skipDeleteFuncType);
+	}
     }
 }
 
@@ -616,23 +816,26 @@ void
 FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
 {
     int		cid;
+    ClientResourceRec *rrec;
     ResourcePtr res;
-    ResourcePtr *prev, *head;
-    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].buckets)
+    ResourcePtr *prev, *slot;
+
+    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].buckets)
     {
-	head = &clientTable[cid].resources[Hash(cid, id)];
+	rrec = &clientTable[cid];
+	if (!(slot = FindSlot(rrec, id)))
+	    return;
 
-	prev = head;
+	prev = slot;
 	while ( (res = *prev) )
 	{
-	    if (res->id == id && res->type == type)
+	    if (res->type == type)
 	    {
 #ifdef XSERVER_DTRACE
 		XSERVER_RESOURCE_FREE(res->id, res->type,
 			      res->value, TypeNameString(res->type));
 #endif		    		    
-		*prev = res->next;
-		clientTable[cid].elements--;
+		UnlinkResource(rrec, slot, prev);
 
 		doFreeResource(res, skipFree);
 
@@ -654,14 +857,13 @@ Bool
 ChangeResourceValue (XID id, RESTYPE rtype, pointer value)
 {
     int    cid;
-    ResourcePtr res;
+    ResourcePtr res, *slot;
 
-    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].buckets)
+    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].buckets &&
+	(slot = FindSlot(&clientTable[cid], id)))
     {
-	res = clientTable[cid].resources[Hash(cid, id)];
-
-	for (; res; res = res->next)
-	    if ((res->id == id) && (res->type == rtype))
+	for (res = *slot; res; res = res->next)
+	    if (res->type == rtype)
 	    {
 		res->value = value;
 		return TRUE;
@@ -670,10 +872,8 @@ ChangeResourceValue (XID id, RESTYPE rtype, pointer value)
     return FALSE;
 }
 
-/* Note: if func adds or deletes resources, then func can get called
- * more than once for some resources.  If func adds new resources,
- * func might or might not get called for them.  func cannot both
- * add and delete an equal number of resources!
+/* Note: func may add or free resources, including the one it is called
+ * for.  Resources it adds are not visited.
  */
 
 void
@@ -683,27 +883,32 @@ FindClientResourcesByType(
     FindResType func,
     pointer cdata
 ){
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    int i, elements;
-    int *eltptr;
+    ClientResourceRec *rrec;
+    ResourceRec cursor;
+    ResourcePtr this;
+    int i, last;
 
     if (!client)
 	client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (i = 0; i < clientTable[client->index].buckets; i++) 
+    rrec = &clientTable[client->index];
+    if (type)
     {
-        for (this = resources[i]; this; this = next)
+	i = type & TypeMask;
+	last = min(i, rrec->numTypes - 1);
+    }
+    else
+    {
+	i = 0;
+	last = rrec->numTypes - 1;
+    }
+    for (; i <= last; i++)
+    {
+	StartTypeIteration(rrec, i, &cursor);
+	while ((this = NextTypeResource(&cursor)))
 	{
-	    next = this->next;
-	    if (!type || this->type == type) {
-		elements = *eltptr;
+	    if (!type || this->type == type)
 		(*func)(this->value, this->id, cdata);
-		if (*eltptr != elements)
-		    next = resources[i]; /* start over */
-	    }
 	}
     }
 }
@@ -714,26 +919,20 @@ FindAllClientResources(
     FindAllRes func,
     pointer cdata
 ){
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    int i, elements;
-    int *eltptr;
+    ClientResourceRec *rrec;
+    ResourceRec cursor;
+    ResourcePtr this;
+    int i;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (i = 0; i < clientTable[client->index].buckets; i++)
+    rrec = &clientTable[client->index];
+    for (i = 0; i < rrec->numTypes; i++)
     {
-        for (this = resources[i]; this; this = next)
-        {
-            next = this->next;
-            elements = *eltptr;
+        StartTypeIteration(rrec, i, &cursor);
+        while ((this = NextTypeResource(&cursor)))
             (*func)(this->value, this->id, this->type, cdata);
-            if (*eltptr != elements)
-                next = resources[i]; /* start over */
-        }
     }
 }
 
@@ -745,23 +944,36 @@ LookupClientResourceComplex(
     FindComplexResType func,
     pointer cdata
 ){
-    ResourcePtr *resources;
-    ResourcePtr this, next;
+    ClientResourceRec *rrec;
+    ResourceRec cursor;
+    ResourcePtr this;
     pointer value;
-    int i;
+    int i, last;
 
     if (!client)
 	client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-	    next = this->next;
+    rrec = &clientTable[client->index];
+    if (type)
+    {
+	i = type & TypeMask;
+	last = min(i, rrec->numTypes - 1);
+    }
+    else
+    {
+	i = 0;
+	last = rrec->numTypes - 1;
+    }
+    for (; i <= last; i++) {
+	StartTypeIteration(rrec, i, &cursor);
+	while ((this = NextTypeResource(&cursor))) {
 	    if (!type || this->type == type) {
 		/* workaround func freeing the type as DRI1 does */
 		value = this->value;
-		if((*func)(value, this->id, cdata))
+		if((*func)(value, this->id, cdata)) {
+		    UnlinkType(&cursor);
 		    return value;
+		}
 	    }
 	}
     }
@@ -772,40 +984,30 @@ LookupClientResourceComplex(
 void
 FreeClientNeverRetainResources(ClientPtr client)
 {
-    ResourcePtr *resources;
+    ClientResourceRec *rrec;
+    ResourceRec cursor;
     ResourcePtr this;
-    ResourcePtr *prev;
-    int j, elements;
-    int *eltptr;
+    int i;
 
     if (!client)
 	return;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (j=0; j < clientTable[client->index].buckets; j++) 
+    rrec = &clientTable[client->index];
+    for (i = 0; i < rrec->numTypes; i++)
     {
-	prev = &resources[j];
-        while ( (this = *prev) )
+	StartTypeIteration(rrec, i, &cursor);
+	while ((this = NextTypeResource(&cursor)))
 	{
-	    RESTYPE rtype = this->type;
-	    if (rtype & RC_NEVERRETAIN)
+	    if (this->type & RC_NEVERRETAIN)
 	    {
 #ifdef XSERVER_DTRACE
 		XSERVER_RESOURCE_FREE(this->id, this->type,
 			      this->value, TypeNameString(this->type));
 #endif		    
-		*prev = this->next;
-		clientTable[client->index].elements--;
-		elements = *eltptr;
+		RemoveResource(rrec, this);
 
 		doFreeResource(this, FALSE);
-
-		if (*eltptr != elements)
-		    prev = &resources[j]; /* prev may no longer be valid */
 	    }
-	    else
-		prev = &this->next;
 	}
     }
 }
@@ -813,9 +1015,9 @@ FreeClientNeverRetainResources(ClientPtr client)
 void
 FreeClientResources(ClientPtr client)
 {
-    ResourcePtr *resources;
+    ClientResourceRec *rrec;
     ResourcePtr this;
-    int j;
+    int i;
 
     /* This routine shouldn't be called with a null client, but just in
 	case ... */
@@ -825,37 +1027,41 @@ FreeClientResources(ClientPtr client)
 
     HandleSaveSet(client);
 
-    resources = clientTable[client->index].resources;
-    for (j=0; j < clientTable[client->index].buckets; j++) 
+    rrec = &clientTable[client->index];
+    /* Resources are removed from the table one at a time, rather than
+     * throwing it away at the end, because some resource deletion
+     * functions, "FreeClientPixels" for one, do a LookupID on another
+     * resource of the client.
+     *
+     * Types are freed last created first, since extension resources
+     * tend to refer to core ones, and newest first within a type.  A
+     * delete function may add resources, so go on until none are left.
+     */
+    while (rrec->elements)
     {
-        /* It may seem silly to update the head of this resource list as
-	we delete the members, since the entire list will be deleted any way, 
-	but there are some resource deletion functions "FreeClientPixels" for 
-	one which do a LookupID on another resource id (a Colormap id in this
-	case), so the resource list must be kept valid up to the point that
-	it is deleted, so every time we delete a resource, we must update the
-	head, just like in FreeResource. I hope that this doesn't slow down
-	mass deletion appreciably. PRH */
-
-	ResourcePtr *head;
-
-	head = &resources[j];
-
-        for (this = *head; this; this = *head)
+	for (i = rrec->numTypes; --i >= 0; )
 	{
+	    while ((this = rrec->byType[i]))
+	    {
 #ifdef XSERVER_DTRACE
-	    XSERVER_RESOURCE_FREE(this->id, this->type,
-			  this->value, TypeNameString(this->type));
+		XSERVER_RESOURCE_FREE(this->id, this->type,
+			      this->value, TypeNameString(this->type));
 #endif		    
-	    *head = this->next;
-	    clientTable[client->index].elements--;
+		RemoveResource(rrec, this);
 
-	    doFreeResource(this, FALSE);
+		doFreeResource(this, FALSE);
+	    }
 	}
     }
-    free(clientTable[client->index].resources);
-    clientTable[client->index].resources = NULL;
-    clientTable[client->index].buckets = 0;
+    free(rrec->resources);
+    rrec->resources = NULL;
+    rrec->buckets = 0;
+    rrec->ids = 0;
+    rrec->used = 0;
+    rrec->lastLookup = NULL;
+    free(rrec->byType);
+    rrec->byType = NULL;
+    rrec->numTypes = 0;
 }
 
 void
@@ -907,12 +1113,21 @@ dixLookupResourceByType(pointer *result, XID id, RESTYPE rtype,
     if ((rtype & TypeMask) > lastResourceType)
 	return BadImplementation;
 
-    if ((cid < MAXCLIENTS) && clientTable[cid].buckets) {
-	res = clientTable[cid].resources[Hash(cid, id)];
-
-	for (; res; res = res->next)
-	    if (res->id == id && res->type == rtype)
-		break;
+    if ((cid < LimitClients) && clientTable[cid].buckets) {
+	ClientResourceRec *rrec = &clientTable[cid];
+	ResourcePtr *slot;
+
+	/* requests often name the same drawable or GC over and over */
+	res = rrec->lastLookup;
+	if (!res || res->id != id || res->type != rtype) {
+	    res = NULL;
+	    if ((slot = FindSlot(rrec, id)))
+		for (res = *slot; res; res = res->next)
+		    if (res->type == rtype)
+			break;
+	    if (res)
+		rrec->lastLookup = res;
+	}
     }
     if (!res)
 	return resourceTypes[rtype & TypeMask].errorValue;
@@ -940,12 +1155,15 @@ dixLookupResourceByClass(pointer *result, XID id, RESTYPE rclass,
 
     *result = NULL;
 
-    if ((cid < MAXCLIENTS) && clientTable[cid].buckets) {
-	res = clientTable[cid].resources[Hash(cid, id)];
+    if ((cid < LimitClients) && clientTable[cid].buckets) {
+	ResourcePtr *slot = FindSlot(&clientTable[cid], id);
 
-	for (; res; res = res->next)
-	    if (res->id == id && (res->type & rclass))
-		break;
+	/* not cached: an older resource of a matching class could be
+	 * cached while a newer one with the same id also matches */
+	if (slot)
+	    for (res = *slot; res; res = res->next)
+		if (res->type & rclass)
+		    break;
     }
     if (!res)
 	return BadValue;
@@ -497,6 +497,7 @@ CreateRootWindow(ScreenPtr pScreen)
     pWin->optional->inputShape = NULL;
     pWin->optional->inputMasks = NULL;
     pWin->optional->deviceCursors = NULL;
+    pWin->optional->pickIndex = NULL;
     pWin->optional->colormap = pScreen->defColormap;
     pWin->optional->visual = pScreen->rootVisual;
 
@@ -909,6 +910,7 @@ DisposeWindowOptional (WindowPtr pWin)
         pWin->optional->deviceCursors = NULL;
     }
 
+    FreePickIndex(pWin);
     free(pWin->optional);
     pWin->optional = NULL;
 }
@@ -951,6 +953,7 @@ CrushTree(WindowPtr pWin)
 
     if (!(pChild = pWin->firstChild))
 	return;
+    InvalidatePickIndex(pWin);
     UnrealizeWindow = pWin->drawable.pScreen->UnrealizeWindow;
     while (1)
     {
@@ -1027,6 +1030,7 @@ DeleteWindow(pointer value, XID wid)
 	    pWin->nextSib->prevSib = pWin->prevSib;
 	if (pWin->prevSib)
 	    pWin->prevSib->nextSib = pWin->nextSib;
+	InvalidatePickIndex(pParent);
     }
     else
 	pWin->drawable.pScreen->root = NULL;
@@ -1608,6 +1612,8 @@ MoveWindowInStack(WindowPtr pWin, WindowPtr pNextSib)
     {
 	WindowPtr pOldNextSib = pWin->nextSib;
 
+	InvalidatePickIndex(pParent);
+
 	if (!pNextSib)	      /* move to bottom */
 	{
 	    if (pParent->firstChild == pWin)
@@ -2451,6 +2457,15 @@ ActuallyDoSomething:
 	else
 	    pWin->borderWidth = bw;
     }
+    /* The screen hooks look up the sprite window once the geometry has
+     * changed, so the old index must be gone by then */
+    if (action != RESTACK_WIN)
+    {
+	InvalidatePickIndex(pParent);
+	/* win gravity may move the children */
+	if (action == RESIZE_WIN)
+	    InvalidatePickIndex(pWin);
+    }
     if (action == MOVE_WIN)
 	(*pWin->drawable.pScreen->MoveWindow)(pWin, x, y, pSib,
 		   (mask & CWBorderWidth) ? VTOther : VTMove);
@@ -2597,6 +2612,7 @@ ReparentWindow(WindowPtr pWin, WindowPtr pParent,
 	pWin->nextSib->prevSib = pWin->prevSib;
     if (pWin->prevSib)
 	pWin->prevSib->nextSib = pWin->nextSib;
+    InvalidatePickIndex(pPriorParent);
 
     /* insert at begining of pParent */
     pWin->parent = pParent;
@@ -2742,6 +2758,7 @@ MapWindow(WindowPtr pWin, ClientPtr client)
 	}
 
 	pWin->mapped = TRUE;
+	InvalidatePickIndex(pParent);
 	if (SubStrSend(pWin, pParent) && MapUnmapEventsEnabled(pWin))
 	{
 	    memset(&event, 0, sizeof(xEvent));
@@ -2830,6 +2847,7 @@ MapSubwindows(WindowPtr pParent, ClientPtr client)
 	    }
     
 	    pWin->mapped = TRUE;
+	    InvalidatePickIndex(pParent);
 	    if (parentNotify || StrSend(pWin))
 	    {
 		memset(&event, 0, sizeof(xEvent));
@@ -2959,6 +2977,7 @@ UnmapWindow(WindowPtr pWin, Bool fromConfigure)
 	(*pScreen->MarkWindow)(pLayerWin->parent);
     }
     pWin->mapped = FALSE;
+    InvalidatePickIndex(pParent);
     if (wasRealized)
 	UnrealizeTree(pWin, fromConfigure);
     if (wasViewable)
@@ -3019,6 +3038,7 @@ UnmapSubwindows(WindowPtr pWin)
 		anyMarked = TRUE;
 	    }
 	    pChild->mapped = FALSE;
+	    InvalidatePickIndex(pWin);
 	    if (pChild->realized)
 		UnrealizeTree(pChild, FALSE);
 	    if (wasViewable)
@@ -3093,7 +3113,10 @@ HandleSaveSet(ClientPtr client)
 			       pWin->drawable.y - wBorderWidth (pWin) - pParent->drawable.y,
 			       client);
 		if(!pWin->realized && pWin->mapped)
+		{
 		    pWin->mapped = FALSE;
+		    InvalidatePickIndex(pWin->parent);
+		}
 	    }
 #ifdef XFIXES
 	    if (SaveSetShouldMap (client->saveSet[j]))
@@ -3496,6 +3519,8 @@ CheckWindowOptionalNeed (WindowPtr w)
 	return;
     if (optional->inputMasks != NULL)
 	return;
+    if (optional->pickIndex != NULL)
+	return;
     if (optional->deviceCursors != NULL)
     {
         DevCursNodePtr pNode = optional->deviceCursors;
@@ -3549,6 +3574,7 @@ MakeWindowOptional (WindowPtr pWin)
     optional->inputShape = NULL;
     optional->inputMasks = NULL;
     optional->deviceCursors = NULL;
+    optional->pickIndex = NULL;
 
     parentOptional = FindWindowWithOptional(pWin)->optional;
     optional->visual = parentOptional->visual;
@@ -42,7 +42,7 @@ DevPrivateKeyRec exaPixmapPrivateKeyRec;
 DevPrivateKeyRec exaGCPrivateKeyRec;
 
 #ifdef MITSHM
-static ShmFuncs exaShmFuncs = { NULL, NULL };
+static ShmFuncs exaShmFuncs = { NULL, exaShmPutImage };
 #endif
 
 /**
@@ -734,12 +734,17 @@ ExaBlockHandler(int screenNum, pointer blockData, pointer pTimeout,
 
     /* Try and keep the offscreen memory area tidy every now and then (at most 
      * once per second) when the server has been idle for at least 100ms.
+     * A pass that ran out of its copy budget is resumed after the next
+     * 100ms of idle time.
      */
     if (pExaScr->numOffscreenAvailable > 1) {
 	CARD32 now = GetTimeInMillis();
 
-	pExaScr->nextDefragment = now +
-	    max(100, (INT32)(pExaScr->lastDefragment + 1000 - now));
+	if (pExaScr->defragmentIncomplete)
+	    pExaScr->nextDefragment = now + 100;
+	else
+	    pExaScr->nextDefragment = now +
+		max(100, (INT32)(pExaScr->lastDefragment + 1000 - now));
 	AdjustWaitForDelay(pTimeout, pExaScr->nextDefragment - now);
     }
 }
@@ -930,7 +935,8 @@ exaDriverInit (ScreenPtr		pScreen,
 
     exaDDXDriverInit(pScreen);
 
-    if (!dixRegisterPrivateKey(&exaGCPrivateKeyRec, PRIVATE_GC, sizeof(ExaGCPrivRec))) {
+    if (!dixRegisterPrivateKeyHint(&exaGCPrivateKeyRec, PRIVATE_GC,
+				   sizeof(ExaGCPrivRec), PRIVATE_HINT_HOT)) {
 	LogMessage(X_WARNING,
 	       "EXA(%d): Failed to allocate GC private\n",
 	       pScreen->myNum);
@@ -970,7 +976,7 @@ exaDriverInit (ScreenPtr		pScreen,
 
 #ifdef MITSHM
     /*
-     * Don't allow shared pixmaps.
+     * Don't allow shared pixmaps, but upload ShmPutImage directly.
      */
     ShmRegisterFuncs(pScreen, &exaShmFuncs);
 #endif
@@ -979,7 +985,8 @@ exaDriverInit (ScreenPtr		pScreen,
      */
     if (pExaScr->info->flags & EXA_OFFSCREEN_PIXMAPS)
     {
-	if (!dixRegisterPrivateKey(&exaPixmapPrivateKeyRec, PRIVATE_PIXMAP, sizeof(ExaPixmapPrivRec))) {
+	if (!dixRegisterPrivateKeyHint(&exaPixmapPrivateKeyRec, PRIVATE_PIXMAP,
+				       sizeof(ExaPixmapPrivRec), PRIVATE_HINT_HOT)) {
             LogMessage(X_WARNING,
 		       "EXA(%d): Failed to allocate pixmap private\n",
 		       pScreen->myNum);
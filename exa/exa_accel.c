@@ -233,6 +233,51 @@ exaDoPutImage (DrawablePtr pDrawable, GCPtr pGC, int depth, int x, int y,
     return ret;
 }
 
+#ifdef MITSHM
+/**
+ * Uploads a subrectangle of a ZPixmap in a shared memory segment straight
+ * from the segment, using the pitch of the whole image.  This isn't called
+ * through the GC ops, so the damage they would have reported is reported
+ * here, before the upload as they would, so that the software cursor is
+ * out of the way and migration sees the region being drawn.
+ */
+void
+exaShmPutImage (DrawablePtr pDrawable, GCPtr pGC, int depth,
+		unsigned int format, int w, int h, int sx, int sy,
+		int sw, int sh, int dx, int dy, char *data)
+{
+    int src_stride = PixmapBytePad(w, depth);
+    int bpp = pDrawable->bitsPerPixel;
+    RegionRec region;
+    BoxRec box;
+
+    if (format == ZPixmap && depth == pDrawable->depth &&
+	BitsPerPixel(depth) == bpp && bpp >= 8)
+    {
+	box.x1 = pDrawable->x + dx;
+	box.y1 = pDrawable->y + dy;
+	box.x2 = box.x1 + sw;
+	box.y2 = box.y1 + sh;
+	RegionInit(&region, &box, 1);
+	RegionIntersect(&region, &region, fbGetCompositeClip(pGC));
+	DamageRegionAppend(pDrawable, &region);
+	RegionUninit(&region);
+
+	if (exaDoPutImage(pDrawable, pGC, depth, dx, dy, sw, sh, format,
+			  data + sy * src_stride + sx * (bpp / 8), src_stride))
+	{
+	    DamageRegionProcessPending(pDrawable);
+	    return;
+	}
+	/* The GC ops below report the damage themselves */
+	DamageRegionDropPending(pDrawable);
+    }
+
+    fbShmPutImage(pDrawable, pGC, depth, format, w, h, sx, sy, sw, sh,
+		  dx, dy, data);
+}
+#endif
+
 static void
 exaPutImage (DrawablePtr pDrawable, GCPtr pGC, int depth, int x, int y,
 	     int w, int h, int leftPad, int format, char *bits)
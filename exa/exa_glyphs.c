@@ -62,6 +62,20 @@
  */
 #define CACHE_PICTURE_WIDTH 1024
 
+/* The cache pixmaps start out this tall and double in height while they
+ * fill up, up to CACHE_PICTURE_MAX_HEIGHT.
+ */
+#define CACHE_PICTURE_INITIAL_HEIGHT 128
+#define CACHE_PICTURE_MAX_HEIGHT 1024
+
+/* Glyphs larger than this in either dimension aren't cached */
+#define CACHE_MAX_GLYPH_SIZE 64
+
+/* Number of least recently used glyphs looked at for one in a shelf of the
+ * right size before a whole shelf is reused for the new size.
+ */
+#define CACHE_EVICT_SCAN 64
+
 /* Maximum number of glyphs we buffer on the stack before flushing
  * rendering to the mask or destination surface.
  */
@@ -83,111 +97,75 @@ void
 exaGlyphsInit(ScreenPtr pScreen)
 {
     ExaScreenPriv(pScreen);
-    int i = 0;
+    int i;
 
     memset(pExaScr->glyphCaches, 0, sizeof(pExaScr->glyphCaches));
 
-    pExaScr->glyphCaches[i].format = PICT_a8;
-    pExaScr->glyphCaches[i].glyphWidth = pExaScr->glyphCaches[i].glyphHeight = 16;
-    i++;
-    pExaScr->glyphCaches[i].format = PICT_a8;
-    pExaScr->glyphCaches[i].glyphWidth = pExaScr->glyphCaches[i].glyphHeight = 32;
-    i++;
-    pExaScr->glyphCaches[i].format = PICT_a8r8g8b8;
-    pExaScr->glyphCaches[i].glyphWidth = pExaScr->glyphCaches[i].glyphHeight = 16;
-    i++;
-    pExaScr->glyphCaches[i].format = PICT_a8r8g8b8;
-    pExaScr->glyphCaches[i].glyphWidth = pExaScr->glyphCaches[i].glyphHeight = 32;
-    i++;
-
-    assert(i == EXA_NUM_GLYPH_CACHES);
-    
+    pExaScr->glyphCaches[0].format = PICT_a8;
+    pExaScr->glyphCaches[1].format = PICT_a8r8g8b8;
+
     for (i = 0; i < EXA_NUM_GLYPH_CACHES; i++) {
-	pExaScr->glyphCaches[i].columns = CACHE_PICTURE_WIDTH / pExaScr->glyphCaches[i].glyphWidth;
-	pExaScr->glyphCaches[i].size = 256;
-	pExaScr->glyphCaches[i].hashSize = 557;
+	ExaGlyphCachePtr cache = &pExaScr->glyphCaches[i];
+
+	cache->width = CACHE_PICTURE_WIDTH;
+	cache->height = CACHE_PICTURE_INITIAL_HEIGHT;
+	cache->maxHeight = CACHE_PICTURE_MAX_HEIGHT;
+	cache->hashSize = 557;
+	cache->freeEntry = cache->lruHead = cache->lruTail = -1;
     }
 }
 
 static void
-exaUnrealizeGlyphCaches(ScreenPtr    pScreen,
-			unsigned int format)
+exaUnrealizeGlyphCache(ExaGlyphCachePtr cache)
 {
-    ExaScreenPriv(pScreen);
     int i;
 
-    for (i = 0; i < EXA_NUM_GLYPH_CACHES; i++) {
-	ExaGlyphCachePtr cache = &pExaScr->glyphCaches[i];
-	
-	if (cache->format != format)
-	    continue;
-
-	if (cache->picture) {
-	    FreePicture ((pointer) cache->picture, (XID) 0);
-	    cache->picture = NULL;
-	}
-
-	free(cache->hashEntries);
-	cache->hashEntries = NULL;
-	
-	free(cache->glyphs);
-	cache->glyphs = NULL;
-	cache->glyphCount = 0;
+    if (cache->picture) {
+	FreePicture ((pointer) cache->picture, (XID) 0);
+	cache->picture = NULL;
     }
+
+    free(cache->hashEntries);
+    cache->hashEntries = NULL;
+    cache->hashSize = 557;
+
+    free(cache->glyphs);
+    cache->glyphs = NULL;
+    cache->glyphCount = cache->glyphsAlloc = 0;
+    cache->freeEntry = cache->lruHead = cache->lruTail = -1;
+
+    for (i = 0; i < cache->numShelves; i++)
+	free(cache->shelves[i].slots);
+    free(cache->shelves);
+    cache->shelves = NULL;
+    cache->numShelves = 0;
+    cache->shelfTop = 0;
+    cache->height = CACHE_PICTURE_INITIAL_HEIGHT;
 }
 
 #define NeedsComponent(f) (PICT_FORMAT_A(f) != 0 && PICT_FORMAT_RGB(f) != 0)
 
-/* All caches for a single format share a single pixmap for glyph storage,
- * allowing mixing glyphs of different sizes without paying a penalty
- * for switching between mask pixmaps. (Note that for a size of font
- * right at the border between two sizes, we might be switching for almost
- * every glyph.)
- *
- * This function allocates the storage pixmap, and then fills in the
- * rest of the allocated structures for all caches with the given format.
- */
-static Bool
-exaRealizeGlyphCaches(ScreenPtr    pScreen,
-		      unsigned int format)
+static PicturePtr
+exaGlyphCacheCreatePicture(ScreenPtr        pScreen,
+			   ExaGlyphCachePtr cache,
+			   int              height)
 {
-    ExaScreenPriv(pScreen);
-
-    int depth = PIXMAN_FORMAT_DEPTH(format);
+    int depth = PIXMAN_FORMAT_DEPTH(cache->format);
     PictFormatPtr pPictFormat;
     PixmapPtr pPixmap;
     PicturePtr pPicture;
     CARD32 component_alpha;
-    int height;
-    int i;
     int	error;
 
-    pPictFormat = PictureMatchFormat(pScreen, depth, format);
+    pPictFormat = PictureMatchFormat(pScreen, depth, cache->format);
     if (!pPictFormat)
-	return FALSE;
-    
-    /* Compute the total vertical size needed for the format */
+	return NULL;
 
-    height = 0;
-    for (i = 0; i < EXA_NUM_GLYPH_CACHES; i++) {
-	ExaGlyphCachePtr cache = &pExaScr->glyphCaches[i];
-	int rows;
-
-	if (cache->format != format)
-	    continue;
-
-	cache->yOffset = height;
-
-	rows = (cache->size + cache->columns - 1) / cache->columns;
-	height += rows * cache->glyphHeight;
-    }
-
-    /* Now allocate the pixmap and picture */
     pPixmap = (*pScreen->CreatePixmap) (pScreen,
-					CACHE_PICTURE_WIDTH,
+					cache->width,
 					height, depth, 0);
     if (!pPixmap)
-	return FALSE;
+	return NULL;
 
     component_alpha = NeedsComponent(pPictFormat->format);
     pPicture = CreatePicture(0, &pPixmap->drawable, pPictFormat,
@@ -196,39 +174,74 @@ exaRealizeGlyphCaches(ScreenPtr    pScreen,
 
     (*pScreen->DestroyPixmap) (pPixmap); /* picture holds a refcount */
 
-    if (!pPicture)
+    return pPicture;
+}
+
+/* Allocates the storage picture and the hash table of a cache.  Shelves
+ * and glyph entries are allocated as glyphs get added.
+ */
+static Bool
+exaRealizeGlyphCache(ScreenPtr        pScreen,
+		     ExaGlyphCachePtr cache)
+{
+    int i;
+
+    cache->picture = exaGlyphCacheCreatePicture(pScreen, cache, cache->height);
+    if (!cache->picture)
 	return FALSE;
 
-    /* And store the picture in all the caches for the format */
-    for (i = 0; i < EXA_NUM_GLYPH_CACHES; i++) {
-	ExaGlyphCachePtr cache = &pExaScr->glyphCaches[i];
-	int j;
+    cache->hashEntries = malloc(sizeof(int) * cache->hashSize);
+    if (!cache->hashEntries) {
+	exaUnrealizeGlyphCache(cache);
+	return FALSE;
+    }
 
-	if (cache->format != format)
-	    continue;
+    for (i = 0; i < cache->hashSize; i++)
+	cache->hashEntries[i] = -1;
 
-	cache->picture = pPicture;
-	cache->picture->refcnt++;
-	cache->hashEntries = malloc(sizeof(int) * cache->hashSize);
-	cache->glyphs = malloc(sizeof(ExaCachedGlyphRec) * cache->size);
-	cache->glyphCount = 0;
+    return TRUE;
+}
 
-	if (!cache->hashEntries || !cache->glyphs)
-	    goto bail;
+/* Doubles the height of the cache picture, keeping the glyphs already
+ * stored at the same place.  Must not be called while glyphs from the
+ * old picture are buffered.
+ */
+static Bool
+exaGlyphCacheGrow(ScreenPtr        pScreen,
+		  ExaGlyphCachePtr cache)
+{
+    int height = min(cache->height * 2, cache->maxHeight);
+    PicturePtr pPicture;
 
-	for (j = 0; j < cache->hashSize; j++)
-	    cache->hashEntries[j] = -1;
-	
-	cache->evictionPosition = rand() % cache->size;
+    pPicture = exaGlyphCacheCreatePicture(pScreen, cache, height);
+    if (!pPicture) {
+	/* Don't try again, make do with what we have */
+	cache->maxHeight = cache->height;
+	return FALSE;
     }
 
-    /* Each cache references the picture individually */
-    FreePicture ((pointer) pPicture, (XID) 0);
-    return TRUE;
+    if (cache->shelfTop) {
+	CompositePicture (PictOpSrc,
+			  cache->picture,
+			  None,
+			  pPicture,
+			  0, 0,
+			  0, 0,
+			  0, 0,
+			  cache->width,
+			  cache->shelfTop);
+	exaPixmapDirty ((PixmapPtr)pPicture->pDrawable,
+			0, 0, cache->width, cache->shelfTop);
+    }
 
-bail:
-    exaUnrealizeGlyphCaches(pScreen, format);
-    return FALSE;
+    FreePicture ((pointer) cache->picture, (XID) 0);
+    cache->picture = pPicture;
+    cache->height = height;
+    cache->stats.grows++;
+
+    DBG_GLYPH_CACHE(("(%s): cache grown to %d rows\n",
+		     cache->format == PICT_a8 ? "A" : "ARGB", height));
+    return TRUE;
 }
 
 void
@@ -240,8 +253,17 @@ exaGlyphsFini (ScreenPtr pScreen)
     for (i = 0; i < EXA_NUM_GLYPH_CACHES; i++) {
 	ExaGlyphCachePtr cache = &pExaScr->glyphCaches[i];
 
+	if (cache->stats.hits || cache->stats.misses)
+	    LogMessageVerb(X_INFO, 3, "EXA(%d): %s glyph cache: %lu hits, "
+			   "%lu misses, %lu evictions, %lu shelves reused, "
+			   "grown %lu times\n", pScreen->myNum,
+			   cache->format == PICT_a8 ? "A8" : "ARGB",
+			   cache->stats.hits, cache->stats.misses,
+			   cache->stats.evictions, cache->stats.shelfReuses,
+			   cache->stats.grows);
+
 	if (cache->picture)
-	    exaUnrealizeGlyphCaches(pScreen, cache->format);
+	    exaUnrealizeGlyphCache(cache);
     }
 }
 
@@ -343,8 +365,379 @@ exaGlyphCacheHashRemove(ExaGlyphCachePtr cache,
     }
 }
 
-#define CACHE_X(pos) (((pos) % cache->columns) * cache->glyphWidth)
-#define CACHE_Y(pos) (cache->yOffset + ((pos) / cache->columns) * cache->glyphHeight)
+/* Keeps the hash table at least twice as large as the number of glyphs */
+static Bool
+exaGlyphCacheHashReserve(ExaGlyphCachePtr cache)
+{
+    int *oldEntries = cache->hashEntries;
+    int oldSize = cache->hashSize;
+    int i;
+
+    if ((cache->glyphCount + 1) * 2 <= cache->hashSize)
+	return TRUE;
+
+    cache->hashEntries = malloc(sizeof(int) * (oldSize * 2 + 1));
+    if (!cache->hashEntries) {
+	cache->hashEntries = oldEntries;
+	return FALSE;
+    }
+    cache->hashSize = oldSize * 2 + 1;
+
+    for (i = 0; i < cache->hashSize; i++)
+	cache->hashEntries[i] = -1;
+    for (i = 0; i < oldSize; i++) {
+	int pos = oldEntries[i];
+	int slot;
+
+	if (pos == -1)
+	    continue;
+
+	slot = (*(CARD32 *) cache->glyphs[pos].sha1) % cache->hashSize;
+	while (cache->hashEntries[slot] != -1) {
+	    slot--;
+	    if (slot < 0)
+		slot = cache->hashSize - 1;
+	}
+	cache->hashEntries[slot] = pos;
+    }
+
+    free(oldEntries);
+    return TRUE;
+}
+
+static void
+exaGlyphCacheLruRemove(ExaGlyphCachePtr cache,
+		       int              pos)
+{
+    ExaCachedGlyphPtr glyph = &cache->glyphs[pos];
+
+    if (glyph->lruPrev != -1)
+	cache->glyphs[glyph->lruPrev].lruNext = glyph->lruNext;
+    else
+	cache->lruHead = glyph->lruNext;
+    if (glyph->lruNext != -1)
+	cache->glyphs[glyph->lruNext].lruPrev = glyph->lruPrev;
+    else
+	cache->lruTail = glyph->lruPrev;
+}
+
+static void
+exaGlyphCacheLruPush(ExaGlyphCachePtr cache,
+		     int              pos)
+{
+    ExaCachedGlyphPtr glyph = &cache->glyphs[pos];
+
+    glyph->lruPrev = -1;
+    glyph->lruNext = cache->lruHead;
+    if (cache->lruHead != -1)
+	cache->glyphs[cache->lruHead].lruPrev = pos;
+    else
+	cache->lruTail = pos;
+    cache->lruHead = pos;
+}
+
+/* Returns an unused glyph entry, or -1 */
+static int
+exaGlyphCacheEntryAlloc(ExaGlyphCachePtr cache)
+{
+    int pos;
+
+    if (cache->freeEntry == -1) {
+	int n = cache->glyphsAlloc ? cache->glyphsAlloc * 2 : 256;
+	ExaCachedGlyphPtr glyphs;
+
+	glyphs = realloc(cache->glyphs, sizeof(ExaCachedGlyphRec) * n);
+	if (!glyphs)
+	    return -1;
+
+	cache->glyphs = glyphs;
+	for (pos = n - 1; pos >= cache->glyphsAlloc; pos--) {
+	    glyphs[pos].shelf = -1;
+	    glyphs[pos].lruNext = cache->freeEntry;
+	    cache->freeEntry = pos;
+	}
+	cache->glyphsAlloc = n;
+    }
+
+    pos = cache->freeEntry;
+    cache->freeEntry = cache->glyphs[pos].lruNext;
+    return pos;
+}
+
+/* Drops a glyph from the cache, leaving its slot empty */
+static void
+exaGlyphCacheEvict(ExaGlyphCachePtr cache,
+		   int              pos)
+{
+    ExaCachedGlyphPtr glyph = &cache->glyphs[pos];
+    ExaGlyphShelfPtr shelf = &cache->shelves[glyph->shelf];
+
+    DBG_GLYPH_CACHE(("  evicting glyph at %d,%d\n",
+		     glyph->slot * shelf->slotWidth, shelf->y));
+
+    exaGlyphCacheHashRemove(cache, pos);
+    exaGlyphCacheLruRemove(cache, pos);
+
+    shelf->slots[glyph->slot] = -1;
+    shelf->used--;
+
+    glyph->shelf = -1;
+    glyph->lruNext = cache->freeEntry;
+    cache->freeEntry = pos;
+    cache->glyphCount--;
+    cache->stats.evictions++;
+}
+
+/* Returns TRUE if a glyph in the buffer is read from the given area of the
+ * cache picture */
+static Bool
+exaGlyphBufferUsesArea(ExaGlyphBufferPtr buffer,
+		       PicturePtr        pSrc,
+		       int               x,
+		       int               y,
+		       int               width,
+		       int               height)
+{
+    int i;
+
+    for (i = 0; i < buffer->count; i++) {
+	int rx = pSrc ? buffer->rects[i].xMask : buffer->rects[i].xSrc;
+	int ry = pSrc ? buffer->rects[i].yMask : buffer->rects[i].ySrc;
+
+	if (rx >= x && rx < x + width && ry >= y && ry < y + height)
+	    return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Shelves are used for glyphs at least half their slot size */
+#define SHELF_FITS(shelf, w, h) \
+    ((shelf)->slotWidth >= (w) && (shelf)->slotWidth <= 2 * (w) && \
+     (shelf)->height >= (h) && (shelf)->height <= 2 * (h))
+
+/* Rounds glyph dimensions up to the slot sizes used by the shelves; a few
+ * size classes per font are enough to get good reuse of evicted slots.
+ */
+static void
+exaGlyphCacheSizeClass(int  width,
+		       int  height,
+		       int *slotWidth,
+		       int *slotHeight)
+{
+    if (width <= 16)
+	*slotWidth = (width + 3) & ~3;
+    else if (width <= 32)
+	*slotWidth = (width + 7) & ~7;
+    else
+	*slotWidth = (width + 15) & ~15;
+    *slotHeight = (height + 3) & ~3;
+}
+
+static void
+exaGlyphCacheEmptyShelf(ExaGlyphCachePtr cache,
+			ExaGlyphShelfPtr shelf)
+{
+    int i;
+
+    for (i = 0; i < shelf->numSlots; i++)
+	if (shelf->slots[i] != -1)
+	    exaGlyphCacheEvict(cache, shelf->slots[i]);
+}
+
+/* Reuses a whole shelf for a new slot size, evicting all its glyphs */
+static void
+exaGlyphCacheReuseShelf(ExaGlyphCachePtr cache,
+			ExaGlyphShelfPtr shelf,
+			int              slotWidth)
+{
+    int *slots;
+    int i;
+
+    exaGlyphCacheEmptyShelf(cache, shelf);
+
+    slots = realloc(shelf->slots, sizeof(int) * (cache->width / slotWidth));
+    if (slots) {
+	shelf->slots = slots;
+	shelf->numSlots = cache->width / slotWidth;
+    } else {
+	/* Make do with the slots we have */
+	shelf->numSlots = min(shelf->numSlots, cache->width / slotWidth);
+    }
+    shelf->slotWidth = slotWidth;
+    for (i = 0; i < shelf->numSlots; i++)
+	shelf->slots[i] = -1;
+
+    cache->stats.shelfReuses++;
+}
+
+/* Adds a new shelf at the bottom of the used part of the picture */
+static ExaGlyphShelfPtr
+exaGlyphCacheAddShelf(ExaGlyphCachePtr cache,
+		      int              slotWidth,
+		      int              slotHeight)
+{
+    ExaGlyphShelfPtr shelves, shelf;
+    int i;
+
+    shelves = realloc(cache->shelves,
+		      sizeof(ExaGlyphShelfRec) * (cache->numShelves + 1));
+    if (!shelves)
+	return NULL;
+    cache->shelves = shelves;
+
+    shelf = &cache->shelves[cache->numShelves];
+    shelf->slots = malloc(sizeof(int) * (cache->width / slotWidth));
+    if (!shelf->slots)
+	return NULL;
+
+    shelf->y = cache->shelfTop;
+    shelf->height = slotHeight;
+    shelf->slotWidth = slotWidth;
+    shelf->numSlots = cache->width / slotWidth;
+    shelf->used = 0;
+    for (i = 0; i < shelf->numSlots; i++)
+	shelf->slots[i] = -1;
+
+    cache->numShelves++;
+    cache->shelfTop += slotHeight;
+    return shelf;
+}
+
+/* Finds room for a glyph of the given size, in order of preference:
+ *
+ *  - an empty slot of a shelf for that size
+ *  - a new shelf, growing the picture if needed
+ *  - the slot of the least recently used glyph of that size
+ *  - a whole shelf from the least recently used glyphs, reused for the size
+ *  - the space of the shelves at the bottom of the picture, if none of the
+ *    shelves is tall enough
+ */
+static ExaGlyphCacheResult
+exaGlyphCacheAllocSlot(ScreenPtr         pScreen,
+		       ExaGlyphCachePtr  cache,
+		       ExaGlyphBufferPtr buffer,
+		       PicturePtr        pSrc,
+		       int               width,
+		       int               height,
+		       int              *shelfIndex,
+		       int              *slot)
+{
+    ExaGlyphShelfPtr shelf, best = NULL;
+    int slotWidth, slotHeight;
+    int pos, i, n;
+
+    exaGlyphCacheSizeClass(width, height, &slotWidth, &slotHeight);
+
+    for (i = 0; i < cache->numShelves; i++) {
+	shelf = &cache->shelves[i];
+	if (SHELF_FITS(shelf, slotWidth, slotHeight) &&
+	    shelf->used < shelf->numSlots &&
+	    (!best || shelf->height * shelf->slotWidth <
+		      best->height * best->slotWidth))
+	    best = shelf;
+    }
+
+    if (!best) {
+	while (cache->shelfTop + slotHeight > cache->height &&
+	       cache->height < cache->maxHeight)
+	{
+	    if (buffer->count)
+		return ExaGlyphNeedFlush;
+	    if (!exaGlyphCacheGrow(pScreen, cache))
+		break;
+	}
+	if (cache->shelfTop + slotHeight <= cache->height)
+	    best = exaGlyphCacheAddShelf(cache, slotWidth, slotHeight);
+    }
+
+    if (best) {
+	for (i = 0; best->slots[i] != -1; i++)
+	    ;
+	*shelfIndex = best - cache->shelves;
+	*slot = i;
+	return ExaGlyphSuccess;
+    }
+
+    /* No room left, evict the least recently used glyph of the same size */
+    for (pos = cache->lruTail, n = 0;
+	 pos != -1 && n < CACHE_EVICT_SCAN;
+	 pos = cache->glyphs[pos].lruPrev, n++)
+    {
+	ExaCachedGlyphPtr glyph = &cache->glyphs[pos];
+
+	shelf = &cache->shelves[glyph->shelf];
+	if (!SHELF_FITS(shelf, slotWidth, slotHeight))
+	    continue;
+
+	if (exaGlyphBufferUsesArea(buffer, pSrc,
+				   glyph->slot * shelf->slotWidth, shelf->y,
+				   shelf->slotWidth, shelf->height))
+	    return ExaGlyphNeedFlush;
+
+	*shelfIndex = glyph->shelf;
+	*slot = glyph->slot;
+	exaGlyphCacheEvict(cache, pos);
+	return ExaGlyphSuccess;
+    }
+
+    /* The font sizes in use have changed; take over the shelf of the least
+     * recently used glyph that is tall enough, preferring one that doesn't
+     * waste much height */
+    best = NULL;
+    for (pos = cache->lruTail, n = 0;
+	 pos != -1;
+	 pos = cache->glyphs[pos].lruPrev, n++)
+    {
+	shelf = &cache->shelves[cache->glyphs[pos].shelf];
+	if (shelf->height < slotHeight)
+	    continue;
+	if (!best)
+	    best = shelf;
+	if (shelf->height <= 2 * slotHeight) {
+	    best = shelf;
+	    break;
+	}
+	if (best && n >= CACHE_EVICT_SCAN)
+	    break;
+    }
+
+    if (!best) {
+	int top = cache->shelfTop;
+
+	for (n = cache->numShelves; top + slotHeight > cache->height; n--)
+	    top = cache->shelves[n - 1].y;
+
+	if (exaGlyphBufferUsesArea(buffer, pSrc, 0, top,
+				   cache->width, cache->shelfTop - top))
+	    return ExaGlyphNeedFlush;
+
+	while (cache->numShelves > n) {
+	    shelf = &cache->shelves[cache->numShelves - 1];
+	    exaGlyphCacheEmptyShelf(cache, shelf);
+	    free(shelf->slots);
+	    cache->numShelves--;
+	}
+	cache->shelfTop = top;
+	cache->stats.shelfReuses++;
+
+	best = exaGlyphCacheAddShelf(cache, slotWidth, slotHeight);
+	if (!best)
+	    return ExaGlyphFail;
+	*shelfIndex = best - cache->shelves;
+	*slot = 0;
+	return ExaGlyphSuccess;
+    }
+
+    if (exaGlyphBufferUsesArea(buffer, pSrc, 0, best->y,
+			       cache->width, best->height))
+	return ExaGlyphNeedFlush;
+
+    exaGlyphCacheReuseShelf(cache, best, slotWidth);
+    *shelfIndex = best - cache->shelves;
+    *slot = 0;
+    return ExaGlyphSuccess;
+}
 
 /* The most efficient thing to way to upload the glyph to the screen
  * is to use the UploadToScreen() driver hook; this allows us to
@@ -423,8 +816,8 @@ damage:
     exaPixmapDirty (pCachePixmap,
 		    x,
 		    y,
-		    x + cache->glyphWidth,
-		    y + cache->glyphHeight);
+		    x + pGlyph->info.width,
+		    y + pGlyph->info.height);
 }
 
 static ExaGlyphCacheResult
@@ -442,66 +835,62 @@ exaGlyphCacheBufferGlyph(ScreenPtr         pScreen,
 			 INT16             yDst)
 {
     ExaCompositeRectPtr rect;
-    int pos;
+    ExaGlyphCacheResult result;
+    ExaGlyphShelfPtr shelf;
+    int pos, shelfIndex, slot;
     int x, y;
     
     if (buffer->mask && buffer->mask != cache->picture)
 	return ExaGlyphNeedFlush;
 
     if (!cache->picture) {
-	if (!exaRealizeGlyphCaches(pScreen, cache->format))
+	if (!exaRealizeGlyphCache(pScreen, cache))
 	    return ExaGlyphFail;
     }
 
-    DBG_GLYPH_CACHE(("(%d,%d,%s): buffering glyph %lx\n",
-		     cache->glyphWidth, cache->glyphHeight, cache->format == PICT_a8 ? "A" : "ARGB",
+    DBG_GLYPH_CACHE(("(%dx%d,%s): buffering glyph %lx\n",
+		     pGlyph->info.width, pGlyph->info.height,
+		     cache->format == PICT_a8 ? "A" : "ARGB",
 		     (long)*(CARD32 *) pGlyph->sha1));
    
     pos = exaGlyphCacheHashLookup(cache, pGlyph);
     if (pos != -1) {
-	DBG_GLYPH_CACHE(("  found existing glyph at %d\n", pos));
-	x = CACHE_X(pos);
-	y = CACHE_Y(pos);
+	shelf = &cache->shelves[cache->glyphs[pos].shelf];
+	x = cache->glyphs[pos].slot * shelf->slotWidth;
+	y = shelf->y;
+	DBG_GLYPH_CACHE(("  found existing glyph at %d,%d\n", x, y));
+	exaGlyphCacheLruRemove(cache, pos);
+	exaGlyphCacheLruPush(cache, pos);
+	cache->stats.hits++;
     } else {
-	if (cache->glyphCount < cache->size) {
-	    /* Space remaining; we fill from the start */
-	    pos = cache->glyphCount;
-	    x = CACHE_X(pos);
-	    y = CACHE_Y(pos);
-	    cache->glyphCount++;
-	    DBG_GLYPH_CACHE(("  storing glyph in free space at %d\n", pos));
-
-	    exaGlyphCacheHashInsert(cache, pGlyph, pos);
-
-	} else {
-	    /* Need to evict an entry. We have to see if any glyphs
-	     * already in the output buffer were at this position in
-	     * the cache
-	     */
-	    pos = cache->evictionPosition;
-	    x = CACHE_X(pos);
-	    y = CACHE_Y(pos);
-	    DBG_GLYPH_CACHE(("  evicting glyph at %d\n", pos));
-	    if (buffer->count) {
-		int i;
-
-		for (i = 0; i < buffer->count; i++) {
-		    if (pSrc ?
-			(buffer->rects[i].xMask == x && buffer->rects[i].yMask == y) :
-			(buffer->rects[i].xSrc == x && buffer->rects[i].ySrc == y)) {
-			DBG_GLYPH_CACHE(("  must flush buffer\n"));
-			return ExaGlyphNeedFlush;
-		    }
-		}
-	    }
+	if (!exaGlyphCacheHashReserve(cache))
+	    return ExaGlyphFail;
 
-	    /* OK, we're all set, swap in the new glyph */
-	    exaGlyphCacheHashRemove(cache, pos);
-	    exaGlyphCacheHashInsert(cache, pGlyph, pos);
+	result = exaGlyphCacheAllocSlot(pScreen, cache, buffer, pSrc,
+					pGlyph->info.width,
+					pGlyph->info.height,
+					&shelfIndex, &slot);
+	if (result != ExaGlyphSuccess)
+	    return result;
 
-	    /* And pick a new eviction position */
-	    cache->evictionPosition = rand() % cache->size;
-	}
+	/* Evicting may have freed an entry, so allocate it afterwards */
+	pos = exaGlyphCacheEntryAlloc(cache);
+	if (pos == -1)
+	    return ExaGlyphFail;
+
+	shelf = &cache->shelves[shelfIndex];
+	shelf->slots[slot] = pos;
+	shelf->used++;
+	cache->glyphs[pos].shelf = shelfIndex;
+	cache->glyphs[pos].slot = slot;
+	exaGlyphCacheHashInsert(cache, pGlyph, pos);
+	exaGlyphCacheLruPush(cache, pos);
+	cache->glyphCount++;
+	cache->stats.misses++;
+
+	x = slot * shelf->slotWidth;
+	y = shelf->y;
+	DBG_GLYPH_CACHE(("  storing glyph at %d,%d\n", x, y));
 
 	exaGlyphCacheUploadGlyph(pScreen, cache, x, y, pGlyph);
     }
@@ -536,9 +925,6 @@ exaGlyphCacheBufferGlyph(ScreenPtr         pScreen,
     return ExaGlyphSuccess;
 }
 
-#undef CACHE_X
-#undef CACHE_Y
-
 static ExaGlyphCacheResult
 exaBufferGlyph(ScreenPtr         pScreen,
 	       ExaGlyphBufferPtr buffer,
@@ -570,8 +956,8 @@ exaBufferGlyph(ScreenPtr         pScreen,
 	ExaGlyphCachePtr cache = &pExaScr->glyphCaches[i];
 
 	if (format == cache->format &&
-	    width <= cache->glyphWidth &&
-	    height <= cache->glyphHeight) {
+	    width <= CACHE_MAX_GLYPH_SIZE &&
+	    height <= CACHE_MAX_GLYPH_SIZE) {
 	    ExaGlyphCacheResult result = exaGlyphCacheBufferGlyph(pScreen,
 								  &pExaScr->glyphCaches[i],
 								  buffer,
@@ -637,59 +1023,6 @@ exaGlyphsToDst(PicturePtr	 pSrc,
     buffer->mask = NULL;
 }
 
-/* Cut and paste from render/glyph.c - probably should export it instead */
-static void
-GlyphExtents (int		nlist,
-	      GlyphListPtr	list,
-	      GlyphPtr	       *glyphs,
-	      BoxPtr		extents)
-{
-    int		x1, x2, y1, y2;
-    int		n;
-    GlyphPtr	glyph;
-    int		x, y;
-    
-    x = 0;
-    y = 0;
-    extents->x1 = MAXSHORT;
-    extents->x2 = MINSHORT;
-    extents->y1 = MAXSHORT;
-    extents->y2 = MINSHORT;
-    while (nlist--)
-    {
-	x += list->xOff;
-	y += list->yOff;
-	n = list->len;
-	list++;
-	while (n--)
-	{
-	    glyph = *glyphs++;
-	    x1 = x - glyph->info.x;
-	    if (x1 < MINSHORT)
-		x1 = MINSHORT;
-	    y1 = y - glyph->info.y;
-	    if (y1 < MINSHORT)
-		y1 = MINSHORT;
-	    x2 = x1 + glyph->info.width;
-	    if (x2 > MAXSHORT)
-		x2 = MAXSHORT;
-	    y2 = y1 + glyph->info.height;
-	    if (y2 > MAXSHORT)
-		y2 = MAXSHORT;
-	    if (x1 < extents->x1)
-		extents->x1 = x1;
-	    if (x2 > extents->x2)
-		extents->x2 = x2;
-	    if (y1 < extents->y1)
-		extents->y1 = y1;
-	    if (y2 > extents->y2)
-		extents->y2 = y2;
-	    x += glyph->info.xOff;
-	    y += glyph->info.yOff;
-	}
-    }
-}
-
 void
 exaGlyphs (CARD8 	 op,
 	   PicturePtr	 pSrc,
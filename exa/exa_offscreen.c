@@ -61,40 +61,186 @@ ExaOffscreenValidate (ScreenPtr pScreen)
 #define ExaOffscreenValidate(s)
 #endif
 
+/* Areas from the top of the heap tried by exaFindAreaToEvict before a
+ * full scan: the top four levels */
+#define EXA_EVICTION_CANDIDATES 15
+
+/* Most pixmaps moved by each pass of ExaOffscreenDefragment */
+#define EXA_DEFRAGMENT_COPIES 32
+
+static int
+ExaOffscreenBin (int size)
+{
+    int bin;
+
+    for (bin = 0; bin < EXA_OFFSCREEN_BINS - 1; bin++)
+	if (size < (EXA_OFFSCREEN_MIN_BIN << (bin + 1)))
+	    break;
+    return bin;
+}
+
+static void
+ExaOffscreenFreeListAdd (ExaScreenPrivPtr pExaScr, ExaOffscreenArea *area)
+{
+    ExaOffscreenArea **head = &pExaScr->offScreenFree[ExaOffscreenBin (area->size)];
+    ExaOffscreenAreaPrivPtr priv = ExaOffscreenAreaPriv (area);
+
+    priv->free_prev = NULL;
+    priv->free_next = *head;
+    if (*head)
+	ExaOffscreenAreaPriv (*head)->free_prev = area;
+    *head = area;
+}
+
+/* Must be called before the size of a free area changes */
+static void
+ExaOffscreenFreeListRemove (ExaScreenPrivPtr pExaScr, ExaOffscreenArea *area)
+{
+    ExaOffscreenAreaPrivPtr priv = ExaOffscreenAreaPriv (area);
+
+    if (priv->free_prev)
+	ExaOffscreenAreaPriv (priv->free_prev)->free_next = priv->free_next;
+    else
+	pExaScr->offScreenFree[ExaOffscreenBin (area->size)] = priv->free_next;
+    if (priv->free_next)
+	ExaOffscreenAreaPriv (priv->free_next)->free_prev = priv->free_prev;
+    priv->free_next = priv->free_prev = NULL;
+}
+
+/*
+ * Removable areas are kept in a binary heap with the least recently used
+ * one on top, so eviction can start from the oldest areas instead of
+ * scanning all of offscreen memory.
+ */
+static Bool
+ExaOffscreenOlder (ExaOffscreenArea *a, ExaOffscreenArea *b)
+{
+    return (int) (a->last_use - b->last_use) < 0;
+}
+
+static void
+ExaOffscreenHeapSet (ExaScreenPrivPtr pExaScr, int i, ExaOffscreenArea *area)
+{
+    pExaScr->offScreenHeap[i] = area;
+    ExaOffscreenAreaPriv (area)->heap_index = i;
+}
+
+static void
+ExaOffscreenHeapUp (ExaScreenPrivPtr pExaScr, int i)
+{
+    ExaOffscreenArea **heap = pExaScr->offScreenHeap;
+    ExaOffscreenArea *area = heap[i];
+
+    while (i > 0 && ExaOffscreenOlder (area, heap[(i - 1) / 2]))
+    {
+	ExaOffscreenHeapSet (pExaScr, i, heap[(i - 1) / 2]);
+	i = (i - 1) / 2;
+    }
+    ExaOffscreenHeapSet (pExaScr, i, area);
+}
+
+static void
+ExaOffscreenHeapDown (ExaScreenPrivPtr pExaScr, int i)
+{
+    ExaOffscreenArea **heap = pExaScr->offScreenHeap;
+    ExaOffscreenArea *area = heap[i];
+    int n = pExaScr->offScreenHeapSize;
+    int child;
+
+    while ((child = 2 * i + 1) < n)
+    {
+	if (child + 1 < n && ExaOffscreenOlder (heap[child + 1], heap[child]))
+	    child++;
+	if (!ExaOffscreenOlder (heap[child], area))
+	    break;
+	ExaOffscreenHeapSet (pExaScr, i, heap[child]);
+	i = child;
+    }
+    ExaOffscreenHeapSet (pExaScr, i, area);
+}
+
+static void
+ExaOffscreenHeapInsert (ExaScreenPrivPtr pExaScr, ExaOffscreenArea *area)
+{
+    if (pExaScr->offScreenHeapSize == pExaScr->offScreenHeapAlloc)
+    {
+	int n = pExaScr->offScreenHeapAlloc ? pExaScr->offScreenHeapAlloc * 2 : 64;
+	ExaOffscreenArea **heap;
+
+	heap = realloc(pExaScr->offScreenHeap, n * sizeof (ExaOffscreenArea *));
+	if (!heap)
+	{
+	    /* Still found by the full scan in exaFindAreaToEvict */
+	    ExaOffscreenAreaPriv (area)->heap_index = -1;
+	    return;
+	}
+	pExaScr->offScreenHeap = heap;
+	pExaScr->offScreenHeapAlloc = n;
+    }
+    ExaOffscreenHeapSet (pExaScr, pExaScr->offScreenHeapSize++, area);
+    ExaOffscreenHeapUp (pExaScr, ExaOffscreenAreaPriv (area)->heap_index);
+}
+
+static void
+ExaOffscreenHeapRemove (ExaScreenPrivPtr pExaScr, ExaOffscreenArea *area)
+{
+    int i = ExaOffscreenAreaPriv (area)->heap_index;
+    ExaOffscreenArea *last;
+
+    if (i < 0)
+	return;
+    ExaOffscreenAreaPriv (area)->heap_index = -1;
+    last = pExaScr->offScreenHeap[--pExaScr->offScreenHeapSize];
+    if (last == area)
+	return;
+    ExaOffscreenHeapSet (pExaScr, i, last);
+    ExaOffscreenHeapUp (pExaScr, i);
+    ExaOffscreenHeapDown (pExaScr, ExaOffscreenAreaPriv (last)->heap_index);
+}
+
 static ExaOffscreenArea *
 ExaOffscreenKickOut (ScreenPtr pScreen, ExaOffscreenArea *area)
 {
+    ExaScreenPriv (pScreen);
+
+    pExaScr->offScreenStats.evictions++;
+    pExaScr->offScreenStats.evictedBytes += area->size;
     if (area->save)
 	(*area->save) (pScreen, area);
     return exaOffscreenFree (pScreen, area);
 }
 
 static void
-exaUpdateEvictionCost(ExaOffscreenArea *area, unsigned offScreenCounter)
+exaUpdateEvictionCost(ExaScreenPrivPtr pExaScr, ExaOffscreenArea *area)
 {
     unsigned age;
 
     if (area->state == ExaOffscreenAvail)
 	return;
 
-    age = offScreenCounter - area->last_use;
+    age = pExaScr->offScreenCounter - area->last_use;
 
     /* This is unlikely to happen, but could result in a division by zero... */
     if (age > (UINT_MAX / 2)) {
 	age = UINT_MAX / 2;
-	area->last_use = offScreenCounter - age;
+	area->last_use = pExaScr->offScreenCounter - age;
+	/* Now older than it was, so it may have to move towards the top */
+	if (ExaOffscreenAreaPriv (area)->heap_index >= 0)
+	    ExaOffscreenHeapUp (pExaScr, ExaOffscreenAreaPriv (area)->heap_index);
     }
 
     area->eviction_cost = area->size / age;
 }
 
+/* Finds the cheapest run of areas to evict by looking at all of them */
 static ExaOffscreenArea *
-exaFindAreaToEvict(ExaScreenPrivPtr pExaScr, int size, int align)
+exaScanAreaToEvict(ExaScreenPrivPtr pExaScr, int size, int align)
 {
     ExaOffscreenArea *begin, *end, *best;
     unsigned cost, best_cost;
     int avail, real_size;
 
+    pExaScr->offScreenStats.fullScans++;
     best_cost = UINT_MAX;
     begin = end = pExaScr->info->offScreenAreas;
     avail = 0;
@@ -123,7 +269,7 @@ exaFindAreaToEvict(ExaScreenPrivPtr pExaScr, int size, int align)
 		goto restart;
 	    }
 	    avail += end->size;
-	    exaUpdateEvictionCost(end, pExaScr->offScreenCounter);
+	    exaUpdateEvictionCost(pExaScr, end);
 	    cost += end->eviction_cost;
 	    end = end->next;
 	}
@@ -142,6 +288,63 @@ exaFindAreaToEvict(ExaScreenPrivPtr pExaScr, int size, int align)
     return best;
 }
 
+/*
+ * Grows a run of unlocked areas around each of the areas at the top of
+ * the heap until it is large enough, and returns the start of the
+ * cheapest one.  Only when none of them can grow large enough is all of
+ * offscreen memory scanned.
+ *
+ * The candidates are only roughly the least recently used areas: the
+ * first is the oldest, each of the others is merely older than the areas
+ * below it in the heap.  They are copied out first, since updating the
+ * eviction costs can reorder the heap.
+ */
+static ExaOffscreenArea *
+exaFindAreaToEvict(ExaScreenPrivPtr pExaScr, int size, int align)
+{
+    ExaOffscreenArea *first = pExaScr->info->offScreenAreas;
+    ExaOffscreenArea *candidates[EXA_EVICTION_CANDIDATES];
+    ExaOffscreenArea *begin, *end, *best = NULL;
+    unsigned cost, best_cost = UINT_MAX;
+    int avail, i, n;
+    int needed = size + align - 1;
+
+    n = min(pExaScr->offScreenHeapSize, EXA_EVICTION_CANDIDATES);
+    memcpy(candidates, pExaScr->offScreenHeap, n * sizeof (ExaOffscreenArea *));
+    for (i = 0; i < n; i++)
+    {
+	begin = end = candidates[i];
+	avail = 0;
+	cost = 0;
+
+	while (avail < needed && end && end->state != ExaOffscreenLocked)
+	{
+	    exaUpdateEvictionCost(pExaScr, end);
+	    avail += end->size;
+	    cost += end->eviction_cost;
+	    end = end->next;
+	}
+	while (avail < needed && begin != first &&
+	       begin->prev->state != ExaOffscreenLocked)
+	{
+	    begin = begin->prev;
+	    exaUpdateEvictionCost(pExaScr, begin);
+	    avail += begin->size;
+	    cost += begin->eviction_cost;
+	}
+
+	if (avail >= needed && cost < best_cost)
+	{
+	    best = begin;
+	    best_cost = cost;
+	}
+    }
+
+    if (best)
+	return best;
+    return exaScanAreaToEvict(pExaScr, size, align);
+}
+
 /**
  * exaOffscreenAlloc allocates offscreen memory
  *
@@ -169,7 +372,7 @@ exaOffscreenAlloc (ScreenPtr pScreen, int size, int align,
 {
     ExaOffscreenArea *area;
     ExaScreenPriv (pScreen);
-    int real_size = 0, largest_avail = 0;
+    int real_size = 0, bin;
 #if DEBUG_OFFSCREEN
     static int number = 0;
     ErrorF("================= ============ allocating a new pixmap %d\n", ++number);
@@ -194,22 +397,22 @@ exaOffscreenAlloc (ScreenPtr pScreen, int size, int align,
 	return NULL;
     }
 
-    /* Try to find a free space that'll fit. */
-    for (area = pExaScr->info->offScreenAreas; area; area = area->next)
+    /* Try to find a free space that'll fit, starting with the size class
+     * of the request.  Any area in a larger class fits unless alignment
+     * gets in the way. */
+    area = NULL;
+    for (bin = ExaOffscreenBin (size); bin < EXA_OFFSCREEN_BINS && !area; bin++)
     {
-	/* skip allocated areas */
-	if (area->state != ExaOffscreenAvail)
-	    continue;
-
-	/* adjust size to match alignment requirement */
-	real_size = size + (area->base_offset + area->size - size) % align;
-
-	/* does it fit? */
-	if (real_size <= area->size)
-	    break;
+	for (area = pExaScr->offScreenFree[bin]; area;
+	     area = ExaOffscreenAreaPriv (area)->free_next)
+	{
+	    /* adjust size to match alignment requirement */
+	    real_size = size + (area->base_offset + area->size - size) % align;
 
-	if (area->size > largest_avail)
-	    largest_avail = area->size;
+	    /* does it fit? */
+	    if (real_size <= area->size)
+		break;
+	}
     }
 
     if (!area)
@@ -219,6 +422,7 @@ exaOffscreenAlloc (ScreenPtr pScreen, int size, int align,
 	if (!area)
 	{
 	    DBG_OFFSCREEN (("Alloc 0x%x -> NOSPACE\n", size));
+	    pExaScr->offScreenStats.failures++;
 	    /* Could not allocate memory */
 	    ExaOffscreenValidate (pScreen);
 	    return NULL;
@@ -245,9 +449,10 @@ exaOffscreenAlloc (ScreenPtr pScreen, int size, int align,
     /* save extra space in new area */
     if (real_size < area->size)
     {
-	ExaOffscreenArea   *new_area = malloc(sizeof (ExaOffscreenArea));
+	ExaOffscreenArea   *new_area = malloc(sizeof (ExaOffscreenAreaPrivRec));
 	if (!new_area)
 	    return NULL;
+	ExaOffscreenFreeListRemove (pExaScr, area);
 	new_area->base_offset = area->base_offset;
 
 	new_area->offset = new_area->base_offset;
@@ -266,8 +471,12 @@ exaOffscreenAlloc (ScreenPtr pScreen, int size, int align,
 	area->prev = new_area;
 	area->base_offset = new_area->base_offset + new_area->size;
 	area->size = real_size;
-    } else
+	ExaOffscreenAreaPriv (new_area)->heap_index = -1;
+	ExaOffscreenFreeListAdd (pExaScr, new_area);
+    } else {
+	ExaOffscreenFreeListRemove (pExaScr, area);
 	pExaScr->numOffscreenAvailable--;
+    }
 
     /*
      * Mark this area as in use
@@ -282,6 +491,13 @@ exaOffscreenAlloc (ScreenPtr pScreen, int size, int align,
     area->offset = (area->base_offset + align - 1);
     area->offset -= area->offset % align;
     area->align = align;
+    if (!locked)
+	ExaOffscreenHeapInsert (pExaScr, area);
+
+    pExaScr->offScreenStats.allocs++;
+    pExaScr->offScreenStats.used += area->size;
+    if (pExaScr->offScreenStats.used > pExaScr->offScreenStats.peakUsed)
+	pExaScr->offScreenStats.peakUsed = pExaScr->offScreenStats.used;
 
     ExaOffscreenValidate (pScreen);
 
@@ -400,6 +616,9 @@ ExaOffscreenMerge (ExaScreenPrivPtr pExaScr, ExaOffscreenArea *area)
 {
     ExaOffscreenArea	*next = area->next;
 
+    ExaOffscreenFreeListRemove (pExaScr, area);
+    ExaOffscreenFreeListRemove (pExaScr, next);
+
     /* account for space */
     area->size += next->size;
     /* frob pointer */
@@ -410,6 +629,7 @@ ExaOffscreenMerge (ExaScreenPrivPtr pExaScr, ExaOffscreenArea *area)
 	pExaScr->info->offScreenAreas->prev = area;
     free(next);
 
+    ExaOffscreenFreeListAdd (pExaScr, area);
     pExaScr->numOffscreenAvailable--;
 }
 
@@ -437,10 +657,15 @@ exaOffscreenFree (ScreenPtr pScreen, ExaOffscreenArea *area)
 		    area->base_offset, area->offset));
     ExaOffscreenValidate (pScreen);
 
+    pExaScr->offScreenStats.frees++;
+    pExaScr->offScreenStats.used -= area->size;
+    ExaOffscreenHeapRemove (pExaScr, area);
+
     area->state = ExaOffscreenAvail;
     area->save = NULL;
     area->last_use = 0;
     area->eviction_cost = 0;
+    ExaOffscreenFreeListAdd (pExaScr, area);
     /*
      * Find previous area
      */
@@ -477,22 +702,30 @@ ExaOffscreenMarkUsed (PixmapPtr pPixmap)
 	return;
 
     pExaPixmap->area->last_use = pExaScr->offScreenCounter++;
+    if (ExaOffscreenAreaPriv (pExaPixmap->area)->heap_index >= 0)
+	ExaOffscreenHeapDown (pExaScr,
+			      ExaOffscreenAreaPriv (pExaPixmap->area)->heap_index);
 }
 
 /**
  * Defragment offscreen memory by compacting allocated areas at the end of it,
  * leaving the total amount of memory available as a single area at the
  * beginning (when there are no pinned allocations).
+ *
+ * At most EXA_DEFRAGMENT_COPIES pixmaps are moved per call, so the work is
+ * spread over several block handler runs; defragmentIncomplete is set when
+ * the pass stopped early.
  */
 _X_HIDDEN ExaOffscreenArea*
 ExaOffscreenDefragment (ScreenPtr pScreen)
 {
     ExaScreenPriv (pScreen);
     ExaOffscreenArea *area, *largest_available = NULL;
-    int largest_size = 0;
+    int largest_size = 0, copies = 0;
     PixmapPtr pDstPix;
     ExaPixmapPrivPtr pExaDstPix;
 
+    pExaScr->defragmentIncomplete = FALSE;
     pDstPix = (*pScreen->CreatePixmap) (pScreen, 0, 0, 0, 0);
 
     if (!pDstPix)
@@ -511,6 +744,11 @@ ExaOffscreenDefragment (ScreenPtr pScreen)
 	Bool save_use_gpu_copy;
 	int save_pitch;
 
+	if (copies == EXA_DEFRAGMENT_COPIES) {
+	    pExaScr->defragmentIncomplete = TRUE;
+	    break;
+	}
+
 	if (area->state != ExaOffscreenAvail ||
 	    prev->state == ExaOffscreenLocked ||
 	    (prev->state == ExaOffscreenRemovable &&
@@ -576,12 +814,16 @@ ExaOffscreenDefragment (ScreenPtr pScreen)
 			     pDstPix->drawable.height);
 	pExaScr->info->DoneCopy (pDstPix);
 	exaMarkSync (pScreen);
+	copies++;
+	pExaScr->offScreenStats.defragmentCopies++;
 
 	DBG_OFFSCREEN(("Before swap: prev=0x%08x-0x%08x-0x%08x area=0x%08x-0x%08x-0x%08x\n",
 		       prev->base_offset, prev->offset, prev->base_offset + prev->size,
 		       area->base_offset, area->offset, area->base_offset + area->size));
 
 	/* Calculate swapped area offsets and sizes */
+	ExaOffscreenFreeListRemove (pExaScr, area);
+	pExaScr->offScreenStats.used -= prev->size;
 	area->base_offset = prev->base_offset;
 	area->offset = area->base_offset;
 	prev->offset += pExaDstPix->fb_ptr - pExaSrcPix->fb_ptr;
@@ -593,6 +835,8 @@ ExaOffscreenDefragment (ScreenPtr pScreen)
 	else
 	    prev->size = pExaScr->info->memorySize - prev->base_offset;
 	area->size = prev->base_offset - area->base_offset;
+	pExaScr->offScreenStats.used += prev->size;
+	ExaOffscreenFreeListAdd (pExaScr, area);
 
 	DBG_OFFSCREEN(("After swap: area=0x%08x-0x%08x-0x%08x prev=0x%08x-0x%08x-0x%08x\n",
 		       area->base_offset, area->offset, area->base_offset + area->size,
@@ -655,7 +899,7 @@ exaOffscreenInit (ScreenPtr pScreen)
     ExaOffscreenArea *area;
 
     /* Allocate a big free area */
-    area = malloc(sizeof (ExaOffscreenArea));
+    area = malloc(sizeof (ExaOffscreenAreaPrivRec));
 
     if (!area)
 	return FALSE;
@@ -670,8 +914,12 @@ exaOffscreenInit (ScreenPtr pScreen)
     area->prev = area;
     area->last_use = 0;
     area->eviction_cost = 0;
+    ExaOffscreenAreaPriv (area)->heap_index = -1;
 
     /* Add it to the free areas */
+    memset(pExaScr->offScreenFree, 0, sizeof (pExaScr->offScreenFree));
+    ExaOffscreenFreeListAdd (pExaScr, area);
+    pExaScr->offScreenHeapSize = 0;
     pExaScr->info->offScreenAreas = area;
     pExaScr->offScreenCounter = 1;
     pExaScr->numOffscreenAvailable = 1;
@@ -686,6 +934,16 @@ ExaOffscreenFini (ScreenPtr pScreen)
 {
     ExaScreenPriv (pScreen);
     ExaOffscreenArea *area;
+    ExaOffscreenStatsRec *stats = &pExaScr->offScreenStats;
+
+    LogMessageVerb(X_INFO, 3, "EXA(%d): offscreen: %lu allocations, "
+		   "%lu frees, %lu failures, peak %lu bytes in use\n",
+		   pScreen->myNum, stats->allocs, stats->frees,
+		   stats->failures, stats->peakUsed);
+    LogMessageVerb(X_INFO, 3, "EXA(%d): offscreen: %lu evictions "
+		   "(%lu bytes), %lu full scans, %lu defragment copies\n",
+		   pScreen->myNum, stats->evictions, stats->evictedBytes,
+		   stats->fullScans, stats->defragmentCopies);
 
     /* just free all of the area records */
     while ((area = pExaScr->info->offScreenAreas))
@@ -693,4 +951,9 @@ ExaOffscreenFini (ScreenPtr pScreen)
 	pExaScr->info->offScreenAreas = area->next;
 	free(area);
     }
+
+    free(pExaScr->offScreenHeap);
+    pExaScr->offScreenHeap = NULL;
+    pExaScr->offScreenHeapSize = pExaScr->offScreenHeapAlloc = 0;
+    memset(pExaScr->offScreenFree, 0, sizeof (pExaScr->offScreenFree));
 }
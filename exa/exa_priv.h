@@ -107,35 +107,97 @@ enum ExaMigrationHeuristic {
 
 typedef struct {
     unsigned char sha1[20];
+    int shelf;   /* shelf holding the glyph, -1 if the entry is unused */
+    int slot;    /* position within the shelf */
+    int lruPrev; /* neighbours in the LRU list; unused entries are chained */
+    int lruNext; /* through lruNext */
 } ExaCachedGlyphRec, *ExaCachedGlyphPtr;
 
+/* A row of the cache picture holding glyphs of one size class side by side */
+typedef struct {
+    int y;
+    int height;    /* height of the row, a multiple of 4 */
+    int slotWidth; /* width of each glyph slot */
+    int numSlots;
+    int used;      /* number of occupied slots */
+    int *slots;    /* glyph entry stored in each slot, or -1 */
+} ExaGlyphShelfRec, *ExaGlyphShelfPtr;
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long shelfReuses;
+    unsigned long grows;
+} ExaGlyphCacheStatsRec;
+
 typedef struct {
     /* The identity of the cache, statically configured at initialization */
     unsigned int format;
-    int glyphWidth;
-    int glyphHeight;
-
-    int size; /* Size of cache; eventually this should be dynamically determined */
 
     /* Hash table mapping from glyph sha1 to position in the glyph; we use
-     * open addressing with a hash table size determined based on size and large
-     * enough so that we always have a good amount of free space, so we can
-     * use linear probing. (Linear probing is preferrable to double hashing
-     * here because it allows us to easily remove entries.)
+     * open addressing with a hash table size kept at least twice the
+     * number of glyphs, so we always have a good amount of free space and
+     * can use linear probing. (Linear probing is preferrable to double
+     * hashing here because it allows us to easily remove entries.)
      */
     int *hashEntries;
     int hashSize;
     
     ExaCachedGlyphPtr glyphs;
-    int glyphCount; /* Current number of glyphs */
-    
-    PicturePtr picture;   /* Where the glyphs of the cache are stored */
-    int yOffset;          /* y location within the picture where the cache starts */
-    int columns;          /* Number of columns the glyphs are layed out in */
-    int evictionPosition; /* Next random position to evict a glyph */
+    int glyphCount;  /* Current number of glyphs */
+    int glyphsAlloc; /* Number of entries allocated in glyphs */
+    int freeEntry;   /* First unused entry, or -1 */
+    int lruHead;     /* Most recently used glyph */
+    int lruTail;     /* Least recently used glyph */
+
+    /* Glyphs are packed into shelves, which are created on demand for
+     * the glyph sizes actually seen.  The picture starts small and grows
+     * while there's room for more shelves; after that the least recently
+     * used glyphs are evicted.
+     */
+    PicturePtr picture; /* Where the glyphs of the cache are stored */
+    int width;
+    int height;
+    int maxHeight;
+    int shelfTop;       /* First row not used by a shelf */
+    ExaGlyphShelfPtr shelves;
+    int numShelves;
+
+    ExaGlyphCacheStatsRec stats;
 } ExaGlyphCacheRec, *ExaGlyphCachePtr;
 
-#define EXA_NUM_GLYPH_CACHES 4
+/* One cache for a8 glyphs, one for argb and component alpha glyphs */
+#define EXA_NUM_GLYPH_CACHES 2
+
+/* Free offscreen areas are kept in power of two size classes, the first
+ * holding everything below 2 * EXA_OFFSCREEN_MIN_BIN bytes */
+#define EXA_OFFSCREEN_BINS 19
+#define EXA_OFFSCREEN_MIN_BIN 4096
+
+/* The allocator's bookkeeping for an offscreen area.  exa_offscreen.c
+ * allocates every area with room for it, behind the ExaOffscreenArea
+ * drivers see. */
+typedef struct {
+    ExaOffscreenArea	 area;
+    ExaOffscreenArea	*free_next;	/* free list for this size class */
+    ExaOffscreenArea	*free_prev;
+    int			 heap_index;	/* position in the eviction heap */
+} ExaOffscreenAreaPrivRec, *ExaOffscreenAreaPrivPtr;
+
+#define ExaOffscreenAreaPriv(a) ((ExaOffscreenAreaPrivPtr) (a))
+
+typedef struct {
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long failures;
+    unsigned long evictions;
+    unsigned long evictedBytes;
+    unsigned long fullScans;
+    unsigned long defragmentCopies;
+    unsigned long used;
+    unsigned long peakUsed;
+} ExaOffscreenStatsRec;
 
 #define EXA_FALLBACK_COPYWINDOW (1 << 0)
 #define EXA_ACCEL_COPYWINDOW (1 << 1)
@@ -184,6 +246,12 @@ typedef struct {
     unsigned			 numOffscreenAvailable;
     CARD32			 lastDefragment;
     CARD32			 nextDefragment;
+    Bool			 defragmentIncomplete;
+    ExaOffscreenArea		*offScreenFree[EXA_OFFSCREEN_BINS];
+    ExaOffscreenArea		**offScreenHeap; /* removable areas by last use */
+    int				 offScreenHeapSize;
+    int				 offScreenHeapAlloc;
+    ExaOffscreenStatsRec	 offScreenStats;
     PixmapPtr			 deferred_mixed_pixmap;
 
     /* Reference counting for accessed pixmaps */
@@ -468,6 +536,13 @@ void
 exaGetImage (DrawablePtr pDrawable, int x, int y, int w, int h,
 	     unsigned int format, unsigned long planeMask, char *d);
 
+#ifdef MITSHM
+void
+exaShmPutImage (DrawablePtr pDrawable, GCPtr pGC, int depth,
+		unsigned int format, int w, int h, int sx, int sy,
+		int sw, int sh, int dx, int dy, char *data);
+#endif
+
 RegionPtr
 exaCopyArea(DrawablePtr pSrcDrawable, DrawablePtr pDstDrawable, GCPtr pGC,
 	    int srcx, int srcy, int width, int height, int dstx, int dsty);
@@ -1988,6 +1988,19 @@ fbTile (FbBits	    *dst,
 	int	    xRot,
 	int	    yRot);
 
+/*
+ * fbthread.c
+ */
+
+typedef void (*FbBandProcPtr) (void *closure, int y1, int y2);
+
+extern _X_EXPORT void
+fbBands (int		y1,
+	 int		y2,
+	 int		width,
+	 FbBandProcPtr	band,
+	 void		*closure);
+
 /*
  * fbutil.c
  */
@@ -44,11 +44,13 @@ fbAllocatePrivates(ScreenPtr pScreen, DevPrivateKey *pGCKey)
     if (pGCKey)
 	*pGCKey = &fbGCPrivateKeyRec;
     
-    if (!dixRegisterPrivateKey(&fbGCPrivateKeyRec, PRIVATE_GC, sizeof(FbGCPrivRec)))
+    if (!dixRegisterPrivateKeyHint(&fbGCPrivateKeyRec, PRIVATE_GC, sizeof(FbGCPrivRec),
+				   PRIVATE_HINT_HOT))
 	return FALSE;
     if (!dixRegisterPrivateKey(&fbScreenPrivateKeyRec, PRIVATE_SCREEN, sizeof (FbScreenPrivRec)))
 	return FALSE;
-    if (!dixRegisterPrivateKey(&fbWinPrivateKeyRec, PRIVATE_WINDOW, 0))
+    if (!dixRegisterPrivateKeyHint(&fbWinPrivateKeyRec, PRIVATE_WINDOW, 0,
+				   PRIVATE_HINT_HOT))
 	return FALSE;
 
     return TRUE;
@@ -61,6 +61,56 @@ fbDoCopy (DrawablePtr  pSrcDrawable,
     return miDoCopy(pSrcDrawable, pDstDrawable, pGC, xIn, yIn, widthSrc, heightSrc, xOut, yOut, copyProc, bitPlane, closure);
 }
 
+typedef struct {
+    FbBits	*src, *dst;
+    FbStride	srcStride, dstStride;
+    int		srcBpp, dstBpp;
+    int		srcXoff, srcYoff;
+    int		dstXoff, dstYoff;
+    int		dx, dy;
+    CARD8	alu;
+    FbBits	pm;
+    Bool	reverse, upsidedown;
+    int		x1, x2;
+} FbCopyBandRec;
+
+static void
+fbCopyNtoNBand (void *closure, int y1, int y2)
+{
+    FbCopyBandRec   *c = closure;
+
+#ifndef FB_ACCESS_WRAPPER /* pixman_blt() doesn't support accessors yet */
+    if (c->pm == FB_ALLONES && c->alu == GXcopy && !c->reverse &&
+	!c->upsidedown &&
+	pixman_blt ((uint32_t *)c->src, (uint32_t *)c->dst,
+		    c->srcStride, c->dstStride, c->srcBpp, c->dstBpp,
+		    (c->x1 + c->dx + c->srcXoff),
+		    (y1 + c->dy + c->srcYoff),
+		    (c->x1 + c->dstXoff),
+		    (y1 + c->dstYoff),
+		    (c->x2 - c->x1),
+		    (y2 - y1)))
+	return;
+#endif
+    fbBlt (c->src + (y1 + c->dy + c->srcYoff) * c->srcStride,
+	   c->srcStride,
+	   (c->x1 + c->dx + c->srcXoff) * c->srcBpp,
+
+	   c->dst + (y1 + c->dstYoff) * c->dstStride,
+	   c->dstStride,
+	   (c->x1 + c->dstXoff) * c->dstBpp,
+
+	   (c->x2 - c->x1) * c->dstBpp,
+	   (y2 - y1),
+
+	   c->alu,
+	   c->pm,
+	   c->dstBpp,
+
+	   c->reverse,
+	   c->upsidedown);
+}
+
 void
 fbCopyNtoN (DrawablePtr	pSrcDrawable,
 	    DrawablePtr	pDstDrawable,
@@ -74,59 +124,28 @@ fbCopyNtoN (DrawablePtr	pSrcDrawable,
 	    Pixel	bitplane,
 	    void	*closure)
 {
-    CARD8	alu = pGC ? pGC->alu : GXcopy;
-    FbBits	pm = pGC ? fbGetGCPrivate(pGC)->pm : FB_ALLONES;
-    FbBits	*src;
-    FbStride	srcStride;
-    int		srcBpp;
-    int		srcXoff, srcYoff;
-    FbBits	*dst;
-    FbStride	dstStride;
-    int		dstBpp;
-    int		dstXoff, dstYoff;
-    
-    fbGetDrawable (pSrcDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
-    fbGetDrawable (pDstDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
+    FbCopyBandRec   c;
+
+    c.alu = pGC ? pGC->alu : GXcopy;
+    c.pm = pGC ? fbGetGCPrivate(pGC)->pm : FB_ALLONES;
+    c.dx = dx;
+    c.dy = dy;
+    c.reverse = reverse;
+    c.upsidedown = upsidedown;
+
+    fbGetDrawable (pSrcDrawable, c.src, c.srcStride, c.srcBpp, c.srcXoff, c.srcYoff);
+    fbGetDrawable (pDstDrawable, c.dst, c.dstStride, c.dstBpp, c.dstXoff, c.dstYoff);
 
     while (nbox--)
     {
-#ifndef FB_ACCESS_WRAPPER /* pixman_blt() doesn't support accessors yet */
-	if (pm == FB_ALLONES && alu == GXcopy && !reverse &&
-	    !upsidedown)
-	{
-	    if (!pixman_blt ((uint32_t *)src, (uint32_t *)dst, srcStride, dstStride, srcBpp, dstBpp,
-			     (pbox->x1 + dx + srcXoff),
-			     (pbox->y1 + dy + srcYoff),
-			     (pbox->x1 + dstXoff),
-			     (pbox->y1 + dstYoff),
-			     (pbox->x2 - pbox->x1),
-			     (pbox->y2 - pbox->y1)))
-		goto fallback;
-	    else
-		goto next;
-	}
-    fallback:
-#endif
-	fbBlt (src + (pbox->y1 + dy + srcYoff) * srcStride,
-	       srcStride,
-	       (pbox->x1 + dx + srcXoff) * srcBpp,
-	       
-	       dst + (pbox->y1 + dstYoff) * dstStride,
-	       dstStride,
-	       (pbox->x1 + dstXoff) * dstBpp,
-	       
-	       (pbox->x2 - pbox->x1) * dstBpp,
-	       (pbox->y2 - pbox->y1),
-	       
-	       alu,
-	       pm,
-	       dstBpp,
-	       
-	       reverse,
-	       upsidedown);
-#ifndef FB_ACCESS_WRAPPER
-    next:
-#endif
+	c.x1 = pbox->x1;
+	c.x2 = pbox->x2;
+	/* Rows may only be copied out of order between separate pixmaps */
+	if (c.src != c.dst)
+	    fbBands (pbox->y1, pbox->y2, pbox->x2 - pbox->x1,
+		     fbCopyNtoNBand, &c);
+	else
+	    fbCopyNtoNBand (&c, pbox->y1, pbox->y2);
 	pbox++;
     }    
     fbFinishAccess (pDstDrawable);
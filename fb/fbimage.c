@@ -110,6 +110,38 @@ fbPutImage (DrawablePtr	pDrawable,
     }
 }
 
+typedef struct {
+    FbStip	*src, *dst;
+    FbStride	srcStride, dstStride;
+    int		dstBpp;
+    int		dstXoff, dstYoff;
+    int		x, y;
+    int		x1, x2;
+    int		alu;
+    FbBits	pm;
+} FbPutZImageBandRec;
+
+static void
+fbPutZImageBand (void *closure, int y1, int y2)
+{
+    FbPutZImageBandRec	*c = closure;
+
+    fbBltStip (c->src + (y1 - c->y) * c->srcStride,
+	       c->srcStride,
+	       (c->x1 - c->x) * c->dstBpp,
+
+	       c->dst + (y1 + c->dstYoff) * c->dstStride,
+	       c->dstStride,
+	       (c->x1 + c->dstXoff) * c->dstBpp,
+
+	       (c->x2 - c->x1) * c->dstBpp,
+	       (y2 - y1),
+
+	       c->alu,
+	       c->pm,
+	       c->dstBpp);
+}
+
 void
 fbPutZImage (DrawablePtr	pDrawable,
 	     RegionPtr		pClip,
@@ -129,9 +161,22 @@ fbPutZImage (DrawablePtr	pDrawable,
     int		nbox;
     BoxPtr	pbox;
     int		x1, y1, x2, y2;
+    FbPutZImageBandRec	c;
 
     fbGetStipDrawable (pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
 
+    c.src = src;
+    c.srcStride = srcStride;
+    c.dst = dst;
+    c.dstStride = dstStride;
+    c.dstBpp = dstBpp;
+    c.dstXoff = dstXoff;
+    c.dstYoff = dstYoff;
+    c.x = x;
+    c.y = y;
+    c.alu = alu;
+    c.pm = pm;
+
     for (nbox = RegionNumRects (pClip),
 	 pbox = RegionRects(pClip);
 	 nbox--;
@@ -151,20 +196,9 @@ fbPutZImage (DrawablePtr	pDrawable,
 	    y2 = pbox->y2;
 	if (x1 >= x2 || y1 >= y2)
 	    continue;
-	fbBltStip (src + (y1 - y) * srcStride,
-		   srcStride,
-		   (x1 - x) * dstBpp,
-
-		   dst + (y1 + dstYoff) * dstStride,
-		   dstStride,
-		   (x1 + dstXoff) * dstBpp,
-
-		   (x2 - x1) * dstBpp,
-		   (y2 - y1),
-
-		   alu,
-		   pm,
-		   dstBpp);
+	c.x1 = x1;
+	c.x2 = x2;
+	fbBands (y1, y2, x2 - x1, fbPutZImageBand, &c);
     }
 
     fbFinishAccess (pDrawable);
@@ -35,6 +35,66 @@
 #include "mipict.h"
 #include "fbpict.h"
 
+typedef struct _FbPictScreen {
+    FbGlyphAtlasRec		atlas[2];	/* alpha-only and ARGB glyphs */
+    CARD8			*mask;		/* glyph mask bits */
+    size_t			maskSize;
+    CloseScreenProcPtr		CloseScreen;
+    ValidatePictureProcPtr	ValidatePicture;
+} FbPictScreenRec, *FbPictScreenPtr;
+
+static DevPrivateKeyRec fbPictScreenPrivateKeyRec;
+#define fbPictScreenPrivateKey (&fbPictScreenPrivateKeyRec)
+
+#define fbGetPictScreen(pScreen) ((FbPictScreenPtr) \
+    dixLookupPrivate(&(pScreen)->devPrivates, fbPictScreenPrivateKey))
+
+/*
+ * The pixman images built for a picture are kept in a picture private and
+ * reused by later requests.  Pictures with a drawable drop them whenever
+ * they are revalidated, which covers changes to the clip, transform,
+ * filter, repeat and alpha map as well as the drawable moving.  Source
+ * pictures are never validated; for those the change bit that ChangePicture
+ * and friends set in serialNumber is checked instead.  The backing pixmap
+ * is compared on each use as it can be swapped without a validation.
+ */
+typedef struct _FbPictImage {
+    pixman_image_t	*image;
+    pointer		bits;
+    int			stride;
+    int			width, height;
+    int			pix_xoff, pix_yoff;	/* drawable offset in the pixmap */
+    int			xoff, yoff;		/* returned along with the image */
+} FbPictImageRec, *FbPictImagePtr;
+
+static DevPrivateKeyRec fbPictImagePrivateKeyRec;
+#define fbPictImagePrivateKey (&fbPictImagePrivateKeyRec)
+
+/* Separate images for use with and without the composite clip */
+#define fbGetPictImages(pict) ((FbPictImagePtr) \
+    dixGetPrivateAddr(&(pict)->devPrivates, fbPictImagePrivateKey))
+
+typedef struct {
+    CARD8	    op;
+    pixman_image_t  *src, *mask, *dest;
+    int		    xSrc, ySrc;
+    int		    xMask, yMask;
+    int		    xDst, yDst;
+    int		    width;
+} FbCompositeBandRec;
+
+static void
+fbCompositeBand (void *closure, int y1, int y2)
+{
+    FbCompositeBandRec	*c = closure;
+
+    pixman_image_composite (c->op, c->src, c->mask, c->dest,
+			    c->xSrc, c->ySrc + y1,
+			    c->xMask, c->yMask + y1,
+			    c->xDst, c->yDst + y1,
+			    c->width, y2 - y1);
+}
+
 void
 fbComposite (CARD8      op,
 	     PicturePtr pSrc,
@@ -64,11 +124,27 @@ fbComposite (CARD8      op,
 
     if (src && dest && !(pMask && !mask))
     {
-	pixman_image_composite (op, src, mask, dest,
-				xSrc + src_xoff, ySrc + src_yoff,
-				xMask + msk_xoff, yMask + msk_yoff,
-				xDst + dst_xoff, yDst + dst_yoff,
-				width, height);
+	FbCompositeBandRec  c;
+	uint32_t	    *bits;
+
+	c.op = op;
+	c.src = src;
+	c.mask = mask;
+	c.dest = dest;
+	c.xSrc = xSrc + src_xoff;
+	c.ySrc = ySrc + src_yoff;
+	c.xMask = xMask + msk_xoff;
+	c.yMask = yMask + msk_yoff;
+	c.xDst = xDst + dst_xoff;
+	c.yDst = yDst + dst_yoff;
+	c.width = width;
+	bits = pixman_image_get_data (dest);
+	/* Rows may only be composited out of order between separate pixmaps */
+	if (pixman_image_get_data (src) != bits &&
+	    !(mask && pixman_image_get_data (mask) == bits))
+	    fbBands (0, height, width, fbCompositeBand, &c);
+	else
+	    fbCompositeBand (&c, 0, height);
     }
 
     free_pixman_pict (pSrc, src);
@@ -340,19 +416,509 @@ image_from_pict_internal (PicturePtr pict, Bool has_clip, int *xoff, int *yoff,
     return image;
 }
 
+static Bool
+picture_is_cached (PicturePtr pict)
+{
+    /* Alpha maps are separate pictures which might change underneath */
+    return dixPrivateKeyRegistered (fbPictImagePrivateKey) && !pict->alphaMap;
+}
+
+static void
+flush_picture_images (PicturePtr pict)
+{
+    FbPictImagePtr  images = fbGetPictImages (pict);
+    int		    i;
+
+    for (i = 0; i < 2; i++)
+    {
+	if (images[i].image)
+	{
+	    pixman_image_unref (images[i].image);
+	    images[i].image = NULL;
+	}
+    }
+}
+
 pixman_image_t *
 image_from_pict (PicturePtr pict, Bool has_clip, int *xoff, int *yoff)
 {
-    return image_from_pict_internal (pict, has_clip, xoff, yoff, FALSE);
+    FbPictImagePtr  cache;
+    pixman_image_t  *image;
+    PixmapPtr	    pixmap = NULL;
+    int		    pix_xoff = 0, pix_yoff = 0;
+
+    if (!pict || !picture_is_cached (pict))
+	return image_from_pict_internal (pict, has_clip, xoff, yoff, FALSE);
+
+    cache = &fbGetPictImages (pict)[has_clip != 0];
+    if (pict->pDrawable)
+    {
+	if (pict->pDrawable->type != DRAWABLE_PIXMAP)
+	{
+	    pixmap = fbGetWindowPixmap (pict->pDrawable);
+	    pix_xoff = __fbPixOffXWin (pixmap);
+	    pix_yoff = __fbPixOffYWin (pixmap);
+	}
+	else
+	{
+	    pixmap = (PixmapPtr) pict->pDrawable;
+	    pix_xoff = __fbPixOffXPix (pixmap);
+	    pix_yoff = __fbPixOffYPix (pixmap);
+	}
+    }
+    else if (pict->serialNumber & GC_CHANGE_SERIAL_BIT)
+    {
+	flush_picture_images (pict);
+	pict->serialNumber &= ~GC_CHANGE_SERIAL_BIT;
+    }
+
+    if (cache->image &&
+	(!pixmap || (cache->bits == pixmap->devPrivate.ptr &&
+		     cache->stride == pixmap->devKind &&
+		     cache->width == pixmap->drawable.width &&
+		     cache->height == pixmap->drawable.height &&
+		     cache->pix_xoff == pix_xoff &&
+		     cache->pix_yoff == pix_yoff)))
+    {
+	if (pict->pDrawable)
+	    fbPrepareAccess (pict->pDrawable);
+	*xoff = cache->xoff;
+	*yoff = cache->yoff;
+	return pixman_image_ref (cache->image);
+    }
+
+    image = image_from_pict_internal (pict, has_clip, xoff, yoff, FALSE);
+    if (!image)
+	return NULL;
+
+    if (cache->image)
+	pixman_image_unref (cache->image);
+    cache->image = pixman_image_ref (image);
+    if (pixmap)
+    {
+	cache->bits = pixmap->devPrivate.ptr;
+	cache->stride = pixmap->devKind;
+	cache->width = pixmap->drawable.width;
+	cache->height = pixmap->drawable.height;
+	cache->pix_xoff = pix_xoff;
+	cache->pix_yoff = pix_yoff;
+    }
+    cache->xoff = *xoff;
+    cache->yoff = *yoff;
+    return image;
 }
 
 void
 free_pixman_pict (PicturePtr pict, pixman_image_t *image)
 {
-    if (image && pixman_image_unref (image) && pict->pDrawable)
+    FbPictImagePtr  images;
+
+    if (!image)
+	return;
+
+    /* Access to images held by the cache ends with every use */
+    if (picture_is_cached (pict))
+    {
+	images = fbGetPictImages (pict);
+	if (image == images[0].image || image == images[1].image)
+	{
+	    pixman_image_unref (image);
+	    if (pict->pDrawable)
+		fbFinishAccess (pict->pDrawable);
+	    return;
+	}
+    }
+
+    if (pixman_image_unref (image) && pict->pDrawable)
 	fbFinishAccess (pict->pDrawable);
 }
 
+/*
+ * Glyph rendering.
+ *
+ * miGlyphs builds a scratch mask pixmap and Picture for every request and
+ * then goes through CompositePicture, and so image_from_pict, once per
+ * glyph.  fbGlyphs instead copies each glyph once into a per-screen atlas
+ * of pixman images, remembering its position in a glyph private.  A run
+ * is then drawn by ADDing the glyphs from the atlas into a mask buffer
+ * that is kept around between requests, followed by a single composite
+ * to the destination.  Since glyphs are shared by SHA1, the atlas is
+ * effectively keyed by the glyph contents.
+ */
+
+void
+fbGlyphAtlasInit (FbGlyphAtlasPtr atlas, pixman_format_code_t format)
+{
+    memset (atlas, 0, sizeof (*atlas));
+    atlas->format = format;
+    /* Force the first upload to start a new page */
+    atlas->page = FB_GLYPH_ATLAS_PAGES - 1;
+    atlas->y = FB_GLYPH_ATLAS_SIZE;
+}
+
+void
+fbGlyphAtlasFini (FbGlyphAtlasPtr atlas)
+{
+    int	i;
+
+    for (i = 0; i < FB_GLYPH_ATLAS_PAGES; i++)
+	if (atlas->pages[i].image)
+	    pixman_image_unref (atlas->pages[i].image);
+    fbGlyphAtlasInit (atlas, atlas->format);
+}
+
+pixman_image_t *
+fbGlyphAtlasLookup (FbGlyphAtlasPtr	    atlas,
+		    FbGlyphAtlasEntryPtr    entry,
+		    int			    *x,
+		    int			    *y)
+{
+    FbGlyphAtlasPagePtr	page;
+
+    if (!entry->serial)
+	return NULL;
+    page = &atlas->pages[entry->page];
+    if (page->serial != entry->serial)
+	return NULL;
+    *x = entry->x;
+    *y = entry->y;
+    return page->image;
+}
+
+/*
+ * Start filling the next page.  Pages are recycled round robin once
+ * they have all been used, which drops every glyph they were holding.
+ */
+static Bool
+fbGlyphAtlasNextPage (FbGlyphAtlasPtr atlas)
+{
+    int			    i = (atlas->page + 1) % FB_GLYPH_ATLAS_PAGES;
+    FbGlyphAtlasPagePtr	    page = &atlas->pages[i];
+
+    if (!page->image)
+    {
+	page->image = pixman_image_create_bits (atlas->format,
+						FB_GLYPH_ATLAS_SIZE,
+						FB_GLYPH_ATLAS_SIZE,
+						NULL, 0);
+	if (!page->image)
+	    return FALSE;
+    }
+    else
+	atlas->recycled++;
+    page->serial = ++atlas->serial;
+    atlas->page = i;
+    atlas->x = 0;
+    atlas->y = 0;
+    atlas->shelf = 0;
+    return TRUE;
+}
+
+pixman_image_t *
+fbGlyphAtlasAdd (FbGlyphAtlasPtr	atlas,
+		 FbGlyphAtlasEntryPtr	entry,
+		 pixman_image_t		*src,
+		 int			src_x,
+		 int			src_y,
+		 int			width,
+		 int			height,
+		 int			*x,
+		 int			*y)
+{
+    FbGlyphAtlasPagePtr	page;
+
+    if (width > FB_GLYPH_ATLAS_MAX || height > FB_GLYPH_ATLAS_MAX)
+	return NULL;
+
+    /* Glyphs are packed left to right on shelves as tall as the
+     * tallest glyph placed on them so far */
+    if (atlas->x + width > FB_GLYPH_ATLAS_SIZE)
+    {
+	atlas->x = 0;
+	atlas->y += atlas->shelf;
+	atlas->shelf = 0;
+    }
+    if (atlas->y + height > FB_GLYPH_ATLAS_SIZE)
+	if (!fbGlyphAtlasNextPage (atlas))
+	    return NULL;
+
+    page = &atlas->pages[atlas->page];
+    pixman_image_composite (PIXMAN_OP_SRC, src, NULL, page->image,
+			    src_x, src_y, 0, 0,
+			    atlas->x, atlas->y, width, height);
+
+    entry->serial = page->serial;
+    entry->page = atlas->page;
+    entry->x = atlas->x;
+    entry->y = atlas->y;
+    *x = atlas->x;
+    *y = atlas->y;
+
+    atlas->x += width;
+    if (height > atlas->shelf)
+	atlas->shelf = height;
+    return page->image;
+}
+
+#define NeedsComponent(f) (PICT_FORMAT_A(f) != 0 && PICT_FORMAT_RGB(f) != 0)
+
+/* Larger masks are freed again after use instead of being kept */
+#define FB_GLYPH_MASK_KEEP  (256 * 1024)
+
+static DevScreenPrivateKeyRec fbGlyphPrivateKeyRec;
+#define fbGlyphPrivateKey (&fbGlyphPrivateKeyRec)
+
+/*
+ * Returns an image holding the glyph at (*x, *y).  This is normally an
+ * atlas page; glyphs which don't fit in the atlas get an image of their
+ * own, which the caller must release with free_pixman_pict.
+ */
+static pixman_image_t *
+fbGlyphImage (ScreenPtr		pScreen,
+	      FbPictScreenPtr	fps,
+	      GlyphPtr		glyph,
+	      PicturePtr	pPicture,
+	      int		*x,
+	      int		*y,
+	      Bool		*own)
+{
+    FbGlyphAtlasEntryPtr    entry;
+    FbGlyphAtlasPtr	    atlas;
+    pixman_image_t	    *image, *src;
+
+    entry = dixGetScreenPrivateAddr (&glyph->devPrivates,
+				     fbGlyphPrivateKey, pScreen);
+    atlas = &fps->atlas[PICT_FORMAT_RGB (pPicture->format) != 0];
+    *own = FALSE;
+
+    image = fbGlyphAtlasLookup (atlas, entry, x, y);
+    if (image)
+	return image;
+
+    src = image_from_pict (pPicture, FALSE, x, y);
+    if (!src)
+	return NULL;
+    image = fbGlyphAtlasAdd (atlas, entry, src, *x, *y,
+			     glyph->info.width, glyph->info.height, x, y);
+    if (image)
+    {
+	free_pixman_pict (pPicture, src);
+	return image;
+    }
+    *own = TRUE;
+    return src;
+}
+
+void
+fbGlyphs (CARD8		op,
+	  PicturePtr	pSrc,
+	  PicturePtr	pDst,
+	  PictFormatPtr	maskFormat,
+	  INT16		xSrc,
+	  INT16		ySrc,
+	  int		nlist,
+	  GlyphListPtr	list,
+	  GlyphPtr	*glyphs)
+{
+    ScreenPtr	    pScreen = pDst->pDrawable->pScreen;
+    FbPictScreenPtr fps = fbGetPictScreen (pScreen);
+    pixman_image_t  *src, *dst, *mask = NULL, *image;
+    int		    src_xoff, src_yoff, dst_xoff, dst_yoff;
+    int		    xDst = list->xOff, yDst = list->yOff;
+    int		    x, y, gx, gy, n;
+    int		    width = 0, height = 0, stride = 0;
+    BoxRec	    extents;
+    PicturePtr	    pPicture;
+    GlyphPtr	    glyph;
+    Bool	    own;
+
+    if (maskFormat && maskFormat->format != PICT_a8 &&
+	maskFormat->format != PICT_a8r8g8b8)
+    {
+	miGlyphs (op, pSrc, pDst, maskFormat, xSrc, ySrc, nlist, list, glyphs);
+	return;
+    }
+
+    if (maskFormat)
+    {
+	size_t	size;
+
+	GlyphExtents (nlist, list, glyphs, &extents);
+	if (extents.x2 <= extents.x1 || extents.y2 <= extents.y1)
+	    return;
+	width = extents.x2 - extents.x1;
+	height = extents.y2 - extents.y1;
+	stride = (width * PIXMAN_FORMAT_BPP (maskFormat->format) / 8 + 3) & ~3;
+	size = (size_t) stride * height;
+	if (size > fps->maskSize)
+	{
+	    free (fps->mask);
+	    fps->mask = malloc (size);
+	    fps->maskSize = fps->mask ? size : 0;
+	    if (!fps->mask)
+		return;
+	}
+	memset (fps->mask, 0, size);
+	mask = pixman_image_create_bits (maskFormat->format, width, height,
+					 (uint32_t *) fps->mask, stride);
+	if (!mask)
+	    return;
+	if (NeedsComponent (maskFormat->format))
+	    pixman_image_set_component_alpha (mask, TRUE);
+    }
+
+    miCompositeSourceValidate (pSrc);
+    src = image_from_pict (pSrc, FALSE, &src_xoff, &src_yoff);
+    dst = image_from_pict (pDst, TRUE, &dst_xoff, &dst_yoff);
+    if (!src || !dst)
+	goto bail;
+
+    if (mask)
+    {
+	x = -extents.x1;
+	y = -extents.y1;
+    }
+    else
+    {
+	x = 0;
+	y = 0;
+    }
+    while (nlist--)
+    {
+	x += list->xOff;
+	y += list->yOff;
+	n = list->len;
+	while (n--)
+	{
+	    glyph = *glyphs++;
+	    pPicture = GlyphPicture (glyph)[pScreen->myNum];
+
+	    if (pPicture && glyph->info.width && glyph->info.height &&
+		(image = fbGlyphImage (pScreen, fps, glyph, pPicture,
+				       &gx, &gy, &own)))
+	    {
+		if (mask)
+		    pixman_image_composite (PIXMAN_OP_ADD, image, NULL, mask,
+					    gx, gy, 0, 0,
+					    x - glyph->info.x,
+					    y - glyph->info.y,
+					    glyph->info.width,
+					    glyph->info.height);
+		else
+		{
+		    if (!own)
+			pixman_image_set_component_alpha (image,
+			    NeedsComponent (pPicture->format));
+		    pixman_image_composite (op, src, image, dst,
+					    xSrc + src_xoff + (x - glyph->info.x) - xDst,
+					    ySrc + src_yoff + (y - glyph->info.y) - yDst,
+					    gx, gy,
+					    x - glyph->info.x + dst_xoff,
+					    y - glyph->info.y + dst_yoff,
+					    glyph->info.width,
+					    glyph->info.height);
+		}
+		if (own)
+		    free_pixman_pict (pPicture, image);
+	    }
+
+	    x += glyph->info.xOff;
+	    y += glyph->info.yOff;
+	}
+	list++;
+    }
+
+    if (mask)
+	pixman_image_composite (op, src, mask, dst,
+				xSrc + src_xoff + extents.x1 - xDst,
+				ySrc + src_yoff + extents.y1 - yDst,
+				0, 0,
+				extents.x1 + dst_xoff, extents.y1 + dst_yoff,
+				width, height);
+
+bail:
+    free_pixman_pict (pSrc, src);
+    free_pixman_pict (pDst, dst);
+    if (mask)
+    {
+	pixman_image_unref (mask);
+	if (fps->maskSize > FB_GLYPH_MASK_KEEP)
+	{
+	    free (fps->mask);
+	    fps->mask = NULL;
+	    fps->maskSize = 0;
+	}
+    }
+}
+
+static Bool
+fbPictCloseScreen (int index, ScreenPtr pScreen)
+{
+    FbPictScreenPtr	fps = fbGetPictScreen (pScreen);
+    PictureScreenPtr	ps = GetPictureScreen (pScreen);
+
+    pScreen->CloseScreen = fps->CloseScreen;
+    ps->ValidatePicture = fps->ValidatePicture;
+    fbGlyphAtlasFini (&fps->atlas[0]);
+    fbGlyphAtlasFini (&fps->atlas[1]);
+    free (fps->mask);
+    free (fps);
+    dixSetPrivate (&pScreen->devPrivates, fbPictScreenPrivateKey, NULL);
+    return (*pScreen->CloseScreen) (index, pScreen);
+}
+
+static void
+fbValidatePicture (PicturePtr pPicture, unsigned int mask)
+{
+    FbPictScreenPtr	fps = fbGetPictScreen (pPicture->pDrawable->pScreen);
+
+    flush_picture_images (pPicture);
+    (*fps->ValidatePicture) (pPicture, mask);
+}
+
+static void
+fbDestroyPictureCallback (CallbackListPtr *pcbl, pointer closure, pointer data)
+{
+    flush_picture_images ((PicturePtr) data);
+}
+
+static unsigned long fbPictureGeneration;
+
+static Bool
+fbPictScreenInit (ScreenPtr pScreen)
+{
+    PictureScreenPtr	ps = GetPictureScreen (pScreen);
+    FbPictScreenPtr	fps;
+
+    if (!dixRegisterPrivateKey (fbPictScreenPrivateKey, PRIVATE_SCREEN, 0))
+	return FALSE;
+    if (!dixRegisterPrivateKeyHint (fbPictImagePrivateKey, PRIVATE_PICTURE,
+				    2 * sizeof (FbPictImageRec),
+				    PRIVATE_HINT_HOT))
+	return FALSE;
+    if (!dixRegisterScreenPrivateKey (fbGlyphPrivateKey, pScreen, PRIVATE_GLYPH,
+				      sizeof (FbGlyphAtlasEntryRec)))
+	return FALSE;
+    if (fbPictureGeneration != serverGeneration)
+    {
+	if (!AddCallback (&DestroyPictureCallback, fbDestroyPictureCallback, 0))
+	    return FALSE;
+	fbPictureGeneration = serverGeneration;
+    }
+
+    fps = calloc (1, sizeof (FbPictScreenRec));
+    if (!fps)
+	return FALSE;
+    fbGlyphAtlasInit (&fps->atlas[0], PIXMAN_a8);
+    fbGlyphAtlasInit (&fps->atlas[1], PIXMAN_a8r8g8b8);
+    fps->CloseScreen = pScreen->CloseScreen;
+    pScreen->CloseScreen = fbPictCloseScreen;
+    fps->ValidatePicture = ps->ValidatePicture;
+    ps->ValidatePicture = fbValidatePicture;
+    dixSetPrivate (&pScreen->devPrivates, fbPictScreenPrivateKey, fps);
+    return TRUE;
+}
+
 Bool
 fbPictureInit (ScreenPtr pScreen, PictFormatPtr formats, int nformats)
 {
@@ -363,7 +929,7 @@ fbPictureInit (ScreenPtr pScreen, PictFormatPtr formats, int nformats)
 	return FALSE;
     ps = GetPictureScreen(pScreen);
     ps->Composite = fbComposite;
-    ps->Glyphs = miGlyphs;
+    ps->Glyphs = fbGlyphs;
     ps->CompositeRects = miCompositeRects;
     ps->RasterizeTrapezoid = fbRasterizeTrapezoid;
     ps->Trapezoids = fbTrapezoids;
@@ -371,5 +937,8 @@ fbPictureInit (ScreenPtr pScreen, PictFormatPtr formats, int nformats)
     ps->AddTriangles = fbAddTriangles;
     ps->Triangles = fbTriangles;
 
+    if (!fbPictScreenInit (pScreen))
+	return FALSE;
+
     return TRUE;
 }
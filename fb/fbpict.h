@@ -85,4 +85,70 @@ fbTriangles (CARD8	    op,
 	     int	    ntris,
 	     xTriangle     *tris);
 
+/*
+ * Per-screen glyph atlas used by fbGlyphs.  Glyphs are copied into one of
+ * a few fixed size pages; recycling a page bumps its serial, which
+ * invalidates the entries of all glyphs it held.
+ */
+#define FB_GLYPH_ATLAS_SIZE	512	/* width and height of a page */
+#define FB_GLYPH_ATLAS_PAGES	4
+#define FB_GLYPH_ATLAS_MAX	128	/* larger glyphs are not cached */
+
+typedef struct _FbGlyphAtlasPage {
+    pixman_image_t	*image;
+    CARD32		serial;
+} FbGlyphAtlasPageRec, *FbGlyphAtlasPagePtr;
+
+typedef struct _FbGlyphAtlas {
+    pixman_format_code_t format;
+    FbGlyphAtlasPageRec	pages[FB_GLYPH_ATLAS_PAGES];
+    int			page;		/* page being filled */
+    int			x, y;		/* next free spot on the current shelf */
+    int			shelf;		/* height of the current shelf */
+    CARD32		serial;
+    unsigned long	recycled;	/* number of pages thrown away */
+} FbGlyphAtlasRec, *FbGlyphAtlasPtr;
+
+/* Where a glyph lives in the atlas, zero-initialized means nowhere */
+typedef struct _FbGlyphAtlasEntry {
+    CARD32		serial;
+    CARD16		x, y;
+    CARD8		page;
+} FbGlyphAtlasEntryRec, *FbGlyphAtlasEntryPtr;
+
+extern _X_EXPORT void
+fbGlyphAtlasInit (FbGlyphAtlasPtr	atlas,
+		  pixman_format_code_t	format);
+
+extern _X_EXPORT void
+fbGlyphAtlasFini (FbGlyphAtlasPtr	atlas);
+
+extern _X_EXPORT pixman_image_t *
+fbGlyphAtlasLookup (FbGlyphAtlasPtr	    atlas,
+		    FbGlyphAtlasEntryPtr    entry,
+		    int			    *x,
+		    int			    *y);
+
+extern _X_EXPORT pixman_image_t *
+fbGlyphAtlasAdd (FbGlyphAtlasPtr	atlas,
+		 FbGlyphAtlasEntryPtr	entry,
+		 pixman_image_t		*src,
+		 int			src_x,
+		 int			src_y,
+		 int			width,
+		 int			height,
+		 int			*x,
+		 int			*y);
+
+extern _X_EXPORT void
+fbGlyphs (CARD8		op,
+	  PicturePtr	pSrc,
+	  PicturePtr	pDst,
+	  PictFormatPtr	maskFormat,
+	  INT16		xSrc,
+	  INT16		ySrc,
+	  int		nlist,
+	  GlyphListPtr	list,
+	  GlyphPtr	*glyphs);
+
 #endif /* _FBPICT_H_ */
@@ -0,0 +1,194 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include "fb.h"
+#include "globals.h"
+
+/*
+ * Splitting large operations into horizontal bands drawn by a pool of
+ * worker threads (-renderthreads).  Each band touches a disjoint set of
+ * destination rows, so the result is the same as drawing them in order
+ * on one thread.  fbBands returns once every band is done.
+ *
+ * The pool is not used through the access wrappers, whose driver hooks
+ * expect to be called on the server thread.
+ */
+
+#if defined(RENDER_THREADS) && !defined(FB_ACCESS_WRAPPER)
+#define FB_BAND_THREADS
+#endif
+
+#ifdef FB_BAND_THREADS
+
+#include <pthread.h>
+#include <signal.h>
+
+#define FB_BAND_MAX_THREADS	64
+#define FB_BAND_MIN_ROWS	8	/* bands aren't made thinner than this */
+
+static struct {
+    pthread_mutex_t	lock;
+    pthread_cond_t	work;		/* a new job was posted */
+    pthread_cond_t	done;		/* the last band of a job finished */
+    int			nthreads;
+    Bool		started;
+    unsigned long	serial;		/* bumped for every job */
+    FbBandProcPtr	band;
+    void		*closure;
+    int			y1, y2, rows;
+    int			next;		/* next band to hand out */
+    int			nbands;
+    int			pending;	/* bands not finished yet */
+} pool = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+};
+
+/* Called and returns with the lock held */
+static Bool
+fbRunBand (void)
+{
+    FbBandProcPtr   band = pool.band;
+    void	    *closure = pool.closure;
+    int		    y1, y2;
+
+    if (pool.next >= pool.nbands)
+	return FALSE;
+    y1 = pool.y1 + pool.next++ * pool.rows;
+    y2 = y1 + pool.rows;
+    if (y2 > pool.y2)
+	y2 = pool.y2;
+
+    pthread_mutex_unlock (&pool.lock);
+    (*band) (closure, y1, y2);
+    pthread_mutex_lock (&pool.lock);
+
+    if (--pool.pending == 0)
+	pthread_cond_signal (&pool.done);
+    return TRUE;
+}
+
+static void *
+fbBandWorker (void *arg)
+{
+    unsigned long   serial = 0;
+
+    pthread_mutex_lock (&pool.lock);
+    for (;;)
+    {
+	while (pool.serial == serial)
+	    pthread_cond_wait (&pool.work, &pool.lock);
+	serial = pool.serial;
+	while (fbRunBand ())
+	    ;
+    }
+    return NULL;
+}
+
+static void
+fbStartBandWorkers (void)
+{
+    sigset_t	    all, saved;
+    pthread_t	    thread;
+    int		    n = RenderThreads - 1;
+
+    pool.started = TRUE;
+    if (n > FB_BAND_MAX_THREADS)
+	n = FB_BAND_MAX_THREADS;
+
+    /* Signals are left to the server thread */
+    sigfillset (&all);
+    pthread_sigmask (SIG_SETMASK, &all, &saved);
+    while (pool.nthreads < n)
+    {
+	if (pthread_create (&thread, NULL, fbBandWorker, NULL) != 0)
+	{
+	    LogMessageVerb (X_WARNING, 0,
+			    "fb: only %d of %d rendering threads started\n",
+			    pool.nthreads + 1, n + 1);
+	    break;
+	}
+	pthread_detach (thread);
+	pool.nthreads++;
+    }
+    pthread_sigmask (SIG_SETMASK, &saved, NULL);
+}
+
+#endif /* FB_BAND_THREADS */
+
+void
+fbBands (int		y1,
+	 int		y2,
+	 int		width,
+	 FbBandProcPtr	band,
+	 void		*closure)
+{
+#ifdef FB_BAND_THREADS
+    int	    nbands, rows;
+
+    if (RenderThreads > 1 && y2 - y1 > FB_BAND_MIN_ROWS &&
+	(CARD64) (y2 - y1) * width >= RenderThreadPixels)
+    {
+	if (!pool.started)
+	    fbStartBandWorkers ();
+	if (pool.nthreads)
+	{
+	    /* The first row is drawn alone, so that any state the drawing
+	     * code computes lazily (pixman validates images on first use)
+	     * is settled before the threads share it */
+	    (*band) (closure, y1, y1 + 1);
+	    y1++;
+
+	    nbands = pool.nthreads + 1;
+	    rows = (y2 - y1 + nbands - 1) / nbands;
+	    if (rows < FB_BAND_MIN_ROWS)
+		rows = FB_BAND_MIN_ROWS;
+
+	    pthread_mutex_lock (&pool.lock);
+	    pool.band = band;
+	    pool.closure = closure;
+	    pool.y1 = y1;
+	    pool.y2 = y2;
+	    pool.rows = rows;
+	    pool.next = 0;
+	    pool.nbands = pool.pending = (y2 - y1 + rows - 1) / rows;
+	    pool.serial++;
+	    pthread_cond_broadcast (&pool.work);
+
+	    while (fbRunBand ())
+		;
+	    while (pool.pending)
+		pthread_cond_wait (&pool.done, &pool.lock);
+	    pthread_mutex_unlock (&pool.lock);
+	    return;
+	}
+    }
+#endif
+    (*band) (closure, y1, y2);
+}
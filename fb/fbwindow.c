@@ -180,50 +180,67 @@ fbChangeWindowAttributes(WindowPtr pWin, unsigned long mask)
     return TRUE;
 }
 
-void
-fbFillRegionSolid (DrawablePtr	pDrawable,
-		   RegionPtr	pRegion,
-		   FbBits	and,
-		   FbBits	xor)
-{
+typedef struct {
     FbBits	*dst;
     FbStride	dstStride;
     int		dstBpp;
     int		dstXoff, dstYoff;
-    int		n = RegionNumRects(pRegion);
-    BoxPtr	pbox = RegionRects(pRegion);
+    FbBits	and, xor;
+    BoxPtr	pbox;
+    int		nbox;
+} FbFillBandRec;
 
-#ifndef FB_ACCESS_WRAPPER
-    int try_mmx = 0;
-    if (!and)
-        try_mmx = 1;
-#endif
+static void
+fbFillRegionBand (void *closure, int y1, int y2)
+{
+    FbFillBandRec   *c = closure;
+    BoxPtr	    pbox = c->pbox;
+    int		    n = c->nbox;
+    int		    by1, by2;
 
-    fbGetDrawable (pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
-    
-    while (n--)
+    for (; n--; pbox++)
     {
+	by1 = max (pbox->y1, y1);
+	by2 = min (pbox->y2, y2);
+	if (by1 >= by2)
+	    continue;
 #ifndef FB_ACCESS_WRAPPER
-	if (!try_mmx || !pixman_fill ((uint32_t *)dst, dstStride, dstBpp,
-				      pbox->x1 + dstXoff, pbox->y1 + dstYoff,
-				      (pbox->x2 - pbox->x1),
-				      (pbox->y2 - pbox->y1),
-				      xor))
-	{
-#endif
-	    fbSolid (dst + (pbox->y1 + dstYoff) * dstStride,
-		     dstStride,
-		     (pbox->x1 + dstXoff) * dstBpp,
-		     dstBpp,
-		     (pbox->x2 - pbox->x1) * dstBpp,
-		     pbox->y2 - pbox->y1,
-		     and, xor);
-#ifndef FB_ACCESS_WRAPPER
-	}
+	if (c->and || !pixman_fill ((uint32_t *)c->dst, c->dstStride, c->dstBpp,
+				    pbox->x1 + c->dstXoff, by1 + c->dstYoff,
+				    (pbox->x2 - pbox->x1),
+				    (by2 - by1),
+				    c->xor))
 #endif
-	fbValidateDrawable (pDrawable);
-	pbox++;
+	    fbSolid (c->dst + (by1 + c->dstYoff) * c->dstStride,
+		     c->dstStride,
+		     (pbox->x1 + c->dstXoff) * c->dstBpp,
+		     c->dstBpp,
+		     (pbox->x2 - pbox->x1) * c->dstBpp,
+		     by2 - by1,
+		     c->and, c->xor);
     }
+}
+
+void
+fbFillRegionSolid (DrawablePtr	pDrawable,
+		   RegionPtr	pRegion,
+		   FbBits	and,
+		   FbBits	xor)
+{
+    FbFillBandRec   c;
+    BoxPtr	    pextents = RegionExtents(pRegion);
+
+    c.nbox = RegionNumRects(pRegion);
+    c.pbox = RegionRects(pRegion);
+    c.and = and;
+    c.xor = xor;
+
+    fbGetDrawable (pDrawable, c.dst, c.dstStride, c.dstBpp, c.dstXoff, c.dstYoff);
+
+    if (c.nbox)
+	fbBands (pextents->y1, pextents->y2, pextents->x2 - pextents->x1,
+		 fbFillRegionBand, &c);
+    fbValidateDrawable (pDrawable);
     
     fbFinishAccess (pDrawable);
 }
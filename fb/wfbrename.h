@@ -16,6 +16,7 @@
 #define fbArc24 wfbArc24
 #define fbArc32 wfbArc32
 #define fbArc8 wfbArc8
+#define fbBands wfbBands
 #define fbBlt wfbBlt
 #define fbBlt24 wfbBlt24
 #define fbBltOne wfbBltOne
@@ -82,7 +83,12 @@
 #define fbGlyph24 wfbGlyph24
 #define fbGlyph32 wfbGlyph32
 #define fbGlyph8 wfbGlyph8
+#define fbGlyphAtlasAdd wfbGlyphAtlasAdd
+#define fbGlyphAtlasFini wfbGlyphAtlasFini
+#define fbGlyphAtlasInit wfbGlyphAtlasInit
+#define fbGlyphAtlasLookup wfbGlyphAtlasLookup
 #define fbGlyphIn wfbGlyphIn
+#define fbGlyphs wfbGlyphs
 #define fbHasVisualTypes wfbHasVisualTypes
 #define fbImageGlyphBlt wfbImageGlyphBlt
 #define fbIn wfbIn
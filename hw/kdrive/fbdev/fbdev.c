@@ -439,7 +439,11 @@ fbdevSetShadow (ScreenPtr pScreen)
 	    update = shadowUpdateRotatePacked;
     else
 	update = shadowUpdatePacked;
-    return KdShadowSet (pScreen, scrpriv->randr, update, window);
+    if (!KdShadowSet (pScreen, scrpriv->randr, update, window))
+	return FALSE;
+    /* The framebuffer is mapped linearly, so bands can be updated at once */
+    shadowSetThreaded (pScreen, TRUE);
+    return TRUE;
 }
 
 
@@ -66,6 +66,8 @@ from The Open Group.
 #endif /* HAS_SHM */
 #include "dix.h"
 #include "miline.h"
+#include "damage.h"
+#include "vfbdamage.h"
 
 #define VFB_DEFAULT_WIDTH      1280
 #define VFB_DEFAULT_HEIGHT     1024
@@ -93,13 +95,22 @@ typedef struct
     unsigned int lineBias;
     CloseScreenProcPtr closeScreen;
 
+    vfbDamageRingPtr pDamageRing;
+    size_t damageRingSize;
+    DamagePtr pDamage;
+    RegionRec lastDamage;
+    Bool damageFull;
+
 #ifdef HAS_MMAP
     int mmap_fd;
     char mmap_file[MAXPATHLEN];
+    int damage_fd;
+    char damage_file[MAXPATHLEN];
 #endif
 
 #ifdef HAS_SHM
     int shmid;
+    int damage_shmid;
 #endif
 } vfbScreenInfo, *vfbScreenInfoPtr;
 
@@ -121,6 +132,10 @@ typedef enum { NORMAL_MEMORY_FB, SHARED_MEMORY_FB, MMAPPED_FILE_FB } fbMemType;
 static fbMemType fbmemtype = NORMAL_MEMORY_FB;
 static char needswap = 0;
 static Bool Render = TRUE;
+static int vfbDamageSlots = 0;
+static Bool vfbDamageSnapshots = FALSE;
+
+static void vfbFreeDamageRing(vfbScreenInfoPtr pvfb);
 
 #define swapcopy16(_dst, _src) \
     if (needswap) { CARD16 _s = _src; cpswaps(_s, _dst); } \
@@ -154,6 +169,9 @@ ddxGiveUp(enum ExitCode error)
 {
     int i;
 
+    for (i = 0; i < vfbNumScreens; i++)
+	vfbFreeDamageRing(&vfbScreens[i]);
+
     /* clean up the framebuffers */
 
     switch (fbmemtype)
@@ -240,6 +258,8 @@ ddxUseMsg(void)
     ErrorF("-linebias n            adjust thin line pixelization\n");
     ErrorF("-blackpixel n          pixel value for black\n");
     ErrorF("-whitepixel n          pixel value for white\n");
+    ErrorF("-damagering slots      publish damage in a ring next to the framebuffer\n");
+    ErrorF("-damagesnapshot        keep double-buffered framebuffer copies in the ring\n");
 
 #ifdef HAS_MMAP
     ErrorF("-fbdir directory       put framebuffers in mmap'ed files in directory\n");
@@ -368,6 +388,26 @@ ddxProcessArgument(int argc, char *argv[], int i)
 	return 2;
     }
 
+    if (strcmp (argv[i], "-damagering") == 0)	/* -damagering slots */
+    {
+	CHECK_FOR_REQUIRED_ARGUMENTS(1);
+	vfbDamageSlots = atoi(argv[++i]);
+	if (vfbDamageSlots < 1)
+	{
+	    ErrorF("Invalid number of damage ring slots %d\n", vfbDamageSlots);
+	    UseMsg();
+	    FatalError("Invalid number of damage ring slots %d passed to "
+		       "-damagering\n", vfbDamageSlots);
+	}
+	return 2;
+    }
+
+    if (strcmp (argv[i], "-damagesnapshot") == 0)	/* -damagesnapshot */
+    {
+	vfbDamageSnapshots = TRUE;
+	return 1;
+    }
+
 #ifdef HAS_MMAP
     if (strcmp (argv[i], "-fbdir") == 0)	/* -fbdir directory */
     {
@@ -698,6 +738,271 @@ vfbAllocateFramebufferMemory(vfbScreenInfoPtr pvfb)
 	return NULL;
 }
 
+/*
+ * Damage ring (-damagering), see vfbdamage.h for the layout readers see.
+ */
+
+#if defined(__GNUC__)
+#define vfbDamageBarrier()	__sync_synchronize()
+#else
+#define vfbDamageBarrier()
+#endif
+
+static size_t
+vfbDamageRingSize(vfbScreenInfoPtr pvfb, CARD32 *snapshot_offset)
+{
+    size_t size = (sizeof(vfbDamageRingRec) + 63) & ~63;
+
+    size += vfbDamageSlots * sizeof(vfbDamageSlotRec);
+    if (vfbDamageSnapshots)
+    {
+	size = (size + 63) & ~63;
+	snapshot_offset[0] = size;
+	size += pvfb->paddedBytesWidth * pvfb->height;
+	snapshot_offset[1] = size;
+	size += pvfb->paddedBytesWidth * pvfb->height;
+    }
+    else
+	snapshot_offset[0] = snapshot_offset[1] = 0;
+    return size;
+}
+
+static void
+vfbAllocateDamageRing(vfbScreenInfoPtr pvfb)
+{
+    vfbDamageRingPtr ring = NULL;
+    CARD32 snapshot_offset[2];
+    size_t size;
+    int i;
+
+    if (!vfbDamageSlots || pvfb->pDamageRing)
+	return;
+
+    size = vfbDamageRingSize(pvfb, snapshot_offset);
+    switch (fbmemtype)
+    {
+#ifdef HAS_MMAP
+    case MMAPPED_FILE_FB:
+	sprintf(pvfb->damage_file, "%s/Xvfb_screen%d.damage", pfbdir,
+		(int) (pvfb - vfbScreens));
+	pvfb->damage_fd = open(pvfb->damage_file, O_CREAT|O_RDWR|O_TRUNC, 0666);
+	if (pvfb->damage_fd == -1)
+	{
+	    ErrorF("creating %s failed, %s\n", pvfb->damage_file,
+		   strerror(errno));
+	    return;
+	}
+	if (ftruncate(pvfb->damage_fd, size) == -1 ||
+	    (ring = mmap(NULL, size, PROT_READ|PROT_WRITE,
+			 MAP_FILE|MAP_SHARED, pvfb->damage_fd, 0)) == MAP_FAILED)
+	{
+	    ErrorF("mapping %s failed, %s\n", pvfb->damage_file,
+		   strerror(errno));
+	    close(pvfb->damage_fd);
+	    unlink(pvfb->damage_file);
+	    return;
+	}
+	break;
+#endif
+#ifdef HAS_SHM
+    case SHARED_MEMORY_FB:
+	pvfb->damage_shmid = shmget(IPC_PRIVATE, size, IPC_CREAT|0777);
+	if (pvfb->damage_shmid < 0)
+	{
+	    ErrorF("shmget %lu bytes failed, %s\n", (unsigned long) size,
+		   strerror(errno));
+	    return;
+	}
+	ring = shmat(pvfb->damage_shmid, 0, 0);
+	if (ring == (void *) -1)
+	{
+	    ErrorF("shmat failed, %s\n", strerror(errno));
+	    shmctl(pvfb->damage_shmid, IPC_RMID, NULL);
+	    return;
+	}
+	ErrorF("screen %d damage shmid %d\n", (int) (pvfb - vfbScreens),
+	       pvfb->damage_shmid);
+	break;
+#endif
+    default:
+	ErrorF("-damagering needs -fbdir or -shmem, ignoring it\n");
+	return;
+    }
+
+    memset(ring, 0, sizeof(vfbDamageRingRec));
+    ring->magic = VFB_DAMAGE_MAGIC;
+    ring->version = VFB_DAMAGE_VERSION;
+    ring->flags = vfbDamageSnapshots ? VFB_DAMAGE_SNAPSHOTS : 0;
+    ring->nslots = vfbDamageSlots;
+    ring->slot_offset = (sizeof(vfbDamageRingRec) + 63) & ~63;
+    ring->slot_size = sizeof(vfbDamageSlotRec);
+    ring->width = pvfb->width;
+    ring->height = pvfb->height;
+    ring->bits_per_pixel = pvfb->bitsPerPixel;
+    ring->bytes_per_line = pvfb->paddedBytesWidth;
+    ring->snapshot_offset[0] = snapshot_offset[0];
+    ring->snapshot_offset[1] = snapshot_offset[1];
+    for (i = 0; i < vfbDamageSlots; i++)
+	VFB_DAMAGE_SLOT(ring, i)->seq = 0;
+    RegionNull(&pvfb->lastDamage);
+    pvfb->pDamageRing = ring;
+    pvfb->damageRingSize = size;
+}
+
+static void
+vfbFreeDamageRing(vfbScreenInfoPtr pvfb)
+{
+    if (!pvfb->pDamageRing)
+	return;
+    switch (fbmemtype)
+    {
+#ifdef HAS_MMAP
+    case MMAPPED_FILE_FB:
+	munmap((void *) pvfb->pDamageRing, pvfb->damageRingSize);
+	close(pvfb->damage_fd);
+	unlink(pvfb->damage_file);
+	break;
+#endif
+#ifdef HAS_SHM
+    case SHARED_MEMORY_FB:
+	shmdt((void *) pvfb->pDamageRing);
+	break;
+#endif
+    default:
+	break;
+    }
+    pvfb->pDamageRing = NULL;
+}
+
+static void
+vfbDamageDestroy(DamagePtr pDamage, void *closure)
+{
+    vfbScreenInfoPtr pvfb = closure;
+
+    pvfb->pDamage = NULL;
+}
+
+/* Copies the given boxes from the framebuffer into a snapshot */
+static void
+vfbCopyToSnapshot(vfbScreenInfoPtr pvfb, int snapshot, BoxPtr pbox, int nbox)
+{
+    vfbDamageRingPtr ring = pvfb->pDamageRing;
+    char *dst = (char *) ring + ring->snapshot_offset[snapshot];
+    int stride = pvfb->paddedBytesWidth;
+    int x1, x2, y;
+
+    for (; nbox--; pbox++)
+    {
+	/* whole bytes, so that depths under 8 work too */
+	x1 = pbox->x1 * pvfb->bitsPerPixel / 8;
+	x2 = (pbox->x2 * pvfb->bitsPerPixel + 7) / 8;
+	for (y = pbox->y1; y < pbox->y2; y++)
+	    memcpy(dst + y * stride + x1, pvfb->pfbMemory + y * stride + x1,
+		   x2 - x1);
+    }
+}
+
+static void
+vfbPublishDamage(ScreenPtr pScreen, vfbScreenInfoPtr pvfb)
+{
+    vfbDamageRingPtr ring = pvfb->pDamageRing;
+    vfbDamageSlotPtr slot;
+    RegionPtr pRegion;
+    RegionRec full, copy;
+    BoxRec box;
+    BoxPtr pbox;
+    CARD32 seq;
+    int nbox, i;
+
+    if (!pvfb->pDamage)
+    {
+	if (!pScreen->root)
+	    return;
+	pvfb->pDamage = DamageCreate(NULL, vfbDamageDestroy, DamageReportNone,
+				     TRUE, pScreen, pvfb);
+	if (!pvfb->pDamage)
+	    return;
+	/* Include the cursor and anything else drawn internally */
+	DamageRegister(&pScreen->root->drawable, pvfb->pDamage);
+	/* Whatever was drawn before counts as changed */
+	pvfb->damageFull = TRUE;
+    }
+
+    box.x1 = box.y1 = 0;
+    box.x2 = pvfb->width;
+    box.y2 = pvfb->height;
+    RegionInit(&full, &box, 1);
+    pRegion = DamageRegion(pvfb->pDamage);
+    if (pvfb->damageFull)
+	pRegion = &full;
+    else if (!RegionNotEmpty(pRegion))
+    {
+	RegionUninit(&full);
+	return;
+    }
+
+    seq = ring->seq + 1;
+    if (!seq)
+	seq = 2;	/* 0 means none, and 2 keeps the snapshots alternating */
+    ring->pending = seq;
+    slot = VFB_DAMAGE_SLOT(ring, seq % ring->nslots);
+    slot->seq = 0;
+    vfbDamageBarrier();
+
+    nbox = RegionNumRects(pRegion);
+    pbox = RegionRects(pRegion);
+    if (nbox > VFB_DAMAGE_MAX_BOXES)
+    {
+	nbox = 1;
+	pbox = RegionExtents(pRegion);
+    }
+    for (i = 0; i < nbox; i++)
+    {
+	slot->boxes[i].x1 = pbox[i].x1;
+	slot->boxes[i].y1 = pbox[i].y1;
+	slot->boxes[i].x2 = pbox[i].x2;
+	slot->boxes[i].y2 = pbox[i].y2;
+    }
+    slot->nboxes = nbox;
+    slot->snapshot = seq & 1;
+
+    if (ring->flags & VFB_DAMAGE_SNAPSHOTS)
+    {
+	/* The snapshot was last brought up to date two frames ago, so it
+	 * needs the previous frame's changes as well as this one's */
+	RegionNull(&copy);
+	RegionUnion(&copy, pRegion, &pvfb->lastDamage);
+	vfbCopyToSnapshot(pvfb, seq & 1, RegionRects(&copy),
+			  RegionNumRects(&copy));
+	RegionUninit(&copy);
+	RegionCopy(&pvfb->lastDamage, pRegion);
+    }
+
+    vfbDamageBarrier();
+    slot->seq = seq;
+    vfbDamageBarrier();
+    ring->seq = seq;
+    vfbDamageBarrier();
+    ring->pending = 0;
+
+    RegionUninit(&full);
+    pvfb->damageFull = FALSE;
+    DamageEmpty(pvfb->pDamage);
+}
+
+static void
+vfbDamageBlockHandler(pointer blockData, OSTimePtr pTimeout, pointer pReadmask)
+{
+    ScreenPtr pScreen = blockData;
+
+    vfbPublishDamage(pScreen, &vfbScreens[pScreen->myNum]);
+}
+
+static void
+vfbDamageWakeupHandler(pointer blockData, int result, pointer pReadmask)
+{
+}
+
 
 static void
 vfbWriteXWDFileHeader(ScreenPtr pScreen)
@@ -827,6 +1132,7 @@ vfbScreenInit(int index, ScreenPtr pScreen, int argc, char **argv)
 	pvfb->paddedWidth = pvfb->paddedBytesWidth * 8;
     pbits = vfbAllocateFramebufferMemory(pvfb);
     if (!pbits) return FALSE;
+    vfbAllocateDamageRing(pvfb);
 
     switch (pvfb->depth) {
     case 8:
@@ -895,6 +1201,14 @@ vfbScreenInit(int index, ScreenPtr pScreen, int argc, char **argv)
     pvfb->closeScreen = pScreen->CloseScreen;
     pScreen->CloseScreen = vfbCloseScreen;
 
+    if (pvfb->pDamageRing)
+    {
+	pvfb->pDamage = NULL;
+	if (!RegisterBlockAndWakeupHandlers(vfbDamageBlockHandler,
+					    vfbDamageWakeupHandler, pScreen))
+	    return FALSE;
+    }
+
     return ret;
 
 } /* end vfbScreenInit */
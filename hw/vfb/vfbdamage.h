@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _VFBDAMAGE_H_
+#define _VFBDAMAGE_H_
+
+#include <X11/Xmd.h>
+
+/*
+ * Layout of the damage ring Xvfb publishes next to each screen's
+ * framebuffer with -damagering.  It lives in
+ * <framebuffer-directory>/Xvfb_screen<n>.damage with -fbdir, or in the
+ * shared memory segment whose id is printed at startup with -shmem.
+ *
+ * Every time something was drawn, the server publishes a frame: it stores
+ * the new frame number in pending, picks the slot (frame % nslots), clears
+ * the slot's seq, fills in the boxes that changed since the previous
+ * frame, stores the frame number in the slot, bumps the ring's seq and
+ * finally clears pending.  Frame numbers start at 1 and wrap from
+ * 0xffffffff to 2, so 0 never names a frame.  The first frame after
+ * startup or a server reset covers the whole screen.
+ *
+ * A reader remembers the last frame it handled.  For each newer frame f up
+ * to the ring's seq it copies slot (f % nslots) and then checks that the
+ * slot's seq still equals f.  If it doesn't, the reader fell more than
+ * nslots frames behind and must treat the whole screen as changed.  None
+ * of this takes locks or X requests.
+ *
+ * With -damagesnapshot the segment also holds two copies of the
+ * framebuffer.  Frame f is complete in snapshot (f % 2), which is left
+ * alone until the server starts on frame f + 2, so a reader can copy
+ * changed boxes out of it while the server keeps drawing.  After copying,
+ * the reader reads pending and then seq; if pending is f + 2 or seq is
+ * f + 2 or later, the copy may be torn and must be redone.
+ */
+
+#define VFB_DAMAGE_MAGIC	0x58564644	/* 'XVFD' */
+#define VFB_DAMAGE_VERSION	1
+
+#define VFB_DAMAGE_MAX_BOXES	256	/* more are merged into their extents */
+
+#define VFB_DAMAGE_SNAPSHOTS	(1 << 0)	/* ring flags */
+
+typedef struct {
+    CARD16	x1, y1, x2, y2;		/* x2 and y2 are exclusive */
+} vfbDamageBoxRec;
+
+typedef struct {
+    volatile CARD32	seq;		/* frame stored here, 0 while written */
+    CARD32		nboxes;
+    CARD32		snapshot;	/* snapshot holding the frame */
+    CARD32		pad;
+    vfbDamageBoxRec	boxes[VFB_DAMAGE_MAX_BOXES];
+} vfbDamageSlotRec, *vfbDamageSlotPtr;
+
+typedef struct {
+    CARD32		magic;
+    CARD32		version;
+    CARD32		flags;
+    CARD32		nslots;
+    CARD32		slot_offset;	/* of slot 0, from the ring */
+    CARD32		slot_size;
+    CARD32		width;
+    CARD32		height;
+    CARD32		bits_per_pixel;
+    CARD32		bytes_per_line;
+    CARD32		snapshot_offset[2];	/* from the ring, 0 if none */
+    volatile CARD32	seq;		/* newest complete frame, 0 if none */
+    volatile CARD32	pending;	/* frame being written, 0 if none */
+} vfbDamageRingRec, *vfbDamageRingPtr;
+
+#define VFB_DAMAGE_SLOT(ring, i) \
+    ((vfbDamageSlotPtr) ((char *) (ring) + (ring)->slot_offset + \
+			 (i) * (ring)->slot_size))
+
+#endif /* _VFBDAMAGE_H_ */
@@ -82,9 +82,9 @@ typedef enum {
  * mask is 0xFFFF0000.
  */
 #define ABI_ANSIC_VERSION	SET_ABI_VERSION(0, 4)
-#define ABI_VIDEODRV_VERSION	SET_ABI_VERSION(12, 0)
+#define ABI_VIDEODRV_VERSION	SET_ABI_VERSION(12, 2)
 #define ABI_XINPUT_VERSION	SET_ABI_VERSION(14, 0)
-#define ABI_EXTENSION_VERSION	SET_ABI_VERSION(6, 0)
+#define ABI_EXTENSION_VERSION	SET_ABI_VERSION(6, 1)
 #define ABI_FONT_VERSION	SET_ABI_VERSION(0, 6)
 
 #define MODINFOSTRING1	0xef23fdc5
@@ -14,6 +14,7 @@
 #include <xkbsrv.h>
 
 #include "dixgrabs.h"
+#include "reqstats.h"
 #include "os.h"
 #include "xf86.h"
 
@@ -44,6 +45,8 @@ XkbDDXPrivate(DeviceIntPtr dev,KeyCode key,XkbAction *act)
             UngrabAllDevices(TRUE);
         else if (strcasecmp(msgbuf, "prwins")==0)
             PrintWindowTree();
+        else if (strcasecmp(msgbuf, "prstat")==0)
+            DumpRequestStats();
     }
 
     return 0;
@@ -121,9 +121,10 @@ typedef struct _Client *ClientPtr; /* also in misc.h */
 
 typedef struct _WorkQueue	*WorkQueuePtr;
 
-extern _X_EXPORT ClientPtr clients[MAXCLIENTS];
+extern _X_EXPORT ClientPtr *clients;
 extern _X_EXPORT ClientPtr serverClient;
 extern _X_EXPORT int currentMaxClients;
+extern _X_EXPORT int LimitClients;
 extern _X_EXPORT char dispatchExceptionAtReset;
 
 typedef int HWEventQueueType;
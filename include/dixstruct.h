@@ -122,6 +122,11 @@ typedef struct _Client {
     
     DeviceIntPtr clientPtr;
     ClientIdPtr  clientIds;
+
+    /* fair share scheduling, appended to keep the fields above in place */
+    int	    smart_weight;	/* fair share weight, 0 until looked up */
+    long    smart_deficit;	/* fair share credit, usec of CPU time */
+    CARD64  smart_cpu_time;	/* CPU time spent on this client, usec */
 }           ClientRec;
 
 /*
@@ -137,6 +142,15 @@ extern _X_EXPORT void SmartScheduleStopTimer(void);
 #define SMART_MAX_PRIORITY  (20)
 #define SMART_MIN_PRIORITY  (-20)
 
+/* How SmartScheduleClient picks among ready clients */
+#define SMART_POLICY_PRIORITY	0	/* favour clients that use less time */
+#define SMART_POLICY_FAIR	1	/* weighted CPU time shares */
+extern _X_EXPORT int SmartSchedulePolicy;
+
+#define SMART_DEFAULT_WEIGHT	(10)
+#define SMART_MAX_WEIGHT	(1000)
+extern _X_EXPORT Bool SmartScheduleSetWeight(const char * /* spec */);
+
 extern _X_EXPORT void SmartScheduleInit(void);
 
 
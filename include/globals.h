@@ -24,6 +24,16 @@ extern _X_EXPORT Bool noTestExtensions;
 extern _X_EXPORT char *SeatId;
 extern _X_EXPORT char *ConnectionInfo;
 
+/* Rectangles kept in DAMAGE extension regions before they are coarsened */
+extern _X_EXPORT int DamageExtRegionLimit;
+/* Send DAMAGE extension reports once per dispatch cycle */
+extern _X_EXPORT Bool DamageExtDeferReports;
+
+/* Worker threads used by fb for large operations, and the size from
+ * which an operation is split between them */
+extern _X_EXPORT int RenderThreads;
+extern _X_EXPORT int RenderThreadPixels;
+
 #ifdef DPMSExtension
 extern _X_EXPORT CARD32 DPMSStandbyTime;
 extern _X_EXPORT CARD32 DPMSSuspendTime;
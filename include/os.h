@@ -113,8 +113,35 @@ extern _X_EXPORT void SetCriticalOutputPending(void);
 
 extern _X_EXPORT int WriteToClient(ClientPtr /*who*/, int /*count*/, const void* /*buf*/);
 
+/* Returns the next file descriptor passed by the client, or -1 */
+extern _X_EXPORT int ReadFdFromClient(ClientPtr /*client*/);
+
+/* Queues a file descriptor to be sent with the next output to the
+ * client, closing it once sent if do_close is set.  Returns -1 if the
+ * connection can't pass file descriptors. */
+extern _X_EXPORT int WriteFdToClient(ClientPtr /*client*/, int /*fd*/, Bool /*do_close*/);
+
+typedef void (*ClientWriteReleaseProcPtr)(pointer /*closure*/);
+
+extern _X_EXPORT int WriteToClientNoCopy(
+    ClientPtr /*who*/,
+    int /*count*/,
+    const void* /*buf*/,
+    ClientWriteReleaseProcPtr /*release*/,
+    pointer /*closure*/);
+
 extern _X_EXPORT void ResetOsBuffers(void);
 
+typedef struct _OsBufferStats {
+    unsigned long requests;	/* connection buffers handed out */
+    unsigned long mallocs;	/* ... that had to come from malloc */
+    unsigned long frees;	/* buffers given back to the system */
+    unsigned long pooled;	/* buffers currently kept for reuse */
+    unsigned long pooledBytes;
+} OsBufferStatsRec, *OsBufferStatsPtr;
+
+extern _X_EXPORT void GetOsBufferStats(OsBufferStatsPtr /*stats*/);
+
 extern _X_EXPORT void InitConnectionLimits(void);
 
 extern _X_EXPORT void NotifyParentProcess(void);
@@ -168,6 +195,10 @@ extern void ListenOnOpenFD(int /* fd */, int /* noxauth */);
 
 extern _X_EXPORT CARD32 GetTimeInMillis(void);
 
+extern _X_EXPORT CARD64 GetTimeInMicros(void);
+
+extern _X_EXPORT CARD64 GetCPUTimeInMicros(void);
+
 extern _X_EXPORT void AdjustWaitForDelay(
     pointer /*waitTime*/,
     unsigned long /*newdelay*/);
@@ -57,6 +57,16 @@ typedef enum {
     PRIVATE_LAST,
 } DevPrivateType;
 
+/*
+ * Placement hint for a private.  Hot privates are laid out ahead of the
+ * others, right behind the object they belong to, so that the privates
+ * used on every operation share cache lines with the object itself.
+ */
+typedef enum {
+    PRIVATE_HINT_COLD,		/* the default */
+    PRIVATE_HINT_HOT,		/* used on most operations on the object */
+} DevPrivateHint;
+
 typedef struct _DevPrivateKeyRec {
     int			offset;
     int			size;
@@ -76,6 +86,7 @@ typedef struct _DevScreenPrivateKeyRec {
 
 #define HAS_DEVPRIVATEKEYREC		1
 #define HAS_DIXREGISTERPRIVATEKEY	1
+#define HAS_DIXREGISTERPRIVATEKEYHINT	1
 
 /*
  * Register a new private index for the private type.
@@ -95,6 +106,15 @@ typedef struct _DevScreenPrivateKeyRec {
 extern _X_EXPORT Bool
 dixRegisterPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size);
 
+/*
+ * Like dixRegisterPrivateKey, with a hint on where to place the private
+ * storage.  Only the placement differs, which is also why registering
+ * a key a second time with a different hint is allowed.
+ */
+extern _X_EXPORT Bool
+dixRegisterPrivateKeyHint(DevPrivateKey key, DevPrivateType type,
+			  unsigned size, DevPrivateHint hint);
+
 /*
  * Check whether a private key has been registered
  */
@@ -266,7 +286,8 @@ extern _X_EXPORT int
 dixPrivatesSize(DevPrivateType type);
 
 /*
- * Dump out private stats to ErrorF
+ * Dump out private stats to ErrorF: for each type, the number of objects,
+ * keys and bytes of private storage, and how much of it is hot
  */
 extern void
 dixPrivateUsage(void);
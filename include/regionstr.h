@@ -194,6 +194,16 @@ RegionCopy(RegionPtr dst, RegionPtr src)
     return pixman_region_copy (dst, src);
 }
 
+extern _X_EXPORT Bool RegionIntersectBox(
+    RegionPtr /*newReg*/,
+    RegionPtr /*reg*/,
+    BoxPtr /*box*/);
+
+extern _X_EXPORT Bool RegionUnionBands(
+    RegionPtr /*newReg*/,
+    RegionPtr /*reg1*/,
+    RegionPtr /*reg2*/);
+
 static inline Bool
 RegionIntersect(
     RegionPtr	newReg,     /* destination Region */
@@ -201,6 +211,11 @@ RegionIntersect(
     RegionPtr	reg2        /* source regions     */
     )
 {
+    /* Clipping a complex region to a single box is the common case */
+    if (!reg2->data && reg1->data && reg1->data->numRects > 1)
+	return RegionIntersectBox (newReg, reg1, &reg2->extents);
+    if (!reg1->data && reg2->data && reg2->data->numRects > 1)
+	return RegionIntersectBox (newReg, reg2, &reg1->extents);
     return pixman_region_intersect (newReg, reg1, reg2);
 }
 
@@ -211,6 +226,11 @@ RegionUnion(
     RegionPtr	reg2             /* source regions     */
     )
 {
+    /* Regions that share no scanlines just need their boxes concatenated */
+    if (!RegionNil(reg1) && !RegionNil(reg2) &&
+	(reg1->extents.y2 <= reg2->extents.y1 ||
+	 reg2->extents.y2 <= reg1->extents.y1))
+	return RegionUnionBands (newReg, reg1, reg2);
     return pixman_region_union (newReg, reg1, reg2);
 }
 
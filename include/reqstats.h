@@ -0,0 +1,94 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef REQSTATS_H
+#define REQSTATS_H
+
+#include <X11/Xmd.h>
+#include "dixstruct.h"
+#include "privates.h"
+
+/*
+ * Request profiling.  Dispatch records the count, latency and bytes in
+ * and out of every request, both against its major and minor opcode
+ * and against the client that sent it.  The latency of a request is
+ * measured from the end of the previous one in the same time slice,
+ * so it includes reading the request.  Nothing is recorded unless the
+ * server was started with -reqstats.
+ */
+
+/* Bucket 0 counts latencies under 1 usec, bucket n those under 2^n
+ * usec, and the last bucket everything from 2^(n-1) usec up. */
+#define REQ_STATS_BUCKETS	24
+
+typedef struct _ReqStats {
+    CARD64	count;
+    CARD64	time;		/* total latency, usec */
+    CARD64	bytesIn;
+    CARD64	bytesOut;
+    CARD32	histogram[REQ_STATS_BUCKETS];
+} ReqStatsRec, *ReqStatsPtr;
+
+/* Set by -reqstats, along with the seconds between periodic dumps to
+ * the log (0 for dumps on SIGUSR2 only) */
+extern _X_EXPORT Bool RequestStatsEnabled;
+extern _X_EXPORT int RequestStatsInterval;
+
+/* Each client's totals, registered by InitRequestStats */
+extern _X_EXPORT DevPrivateKeyRec RequestStatsClientPrivateKeyRec;
+
+/* Returns NULL unless request statistics are being kept */
+static inline ReqStatsPtr
+ClientRequestStats(ClientPtr client)
+{
+    if (!dixPrivateKeyRegistered(&RequestStatsClientPrivateKeyRec))
+	return NULL;
+    return dixLookupPrivate(&client->devPrivates,
+			    &RequestStatsClientPrivateKeyRec);
+}
+
+extern _X_EXPORT void InitRequestStats(void);
+
+extern _X_EXPORT void RecordRequestStats(ClientPtr /* client */,
+					 int /* major */,
+					 int /* minor */,
+					 CARD32 /* usec */,
+					 CARD32 /* bytesIn */,
+					 CARD32 /* bytesOut */);
+
+/* Returns NULL if the request was never seen */
+extern _X_EXPORT ReqStatsPtr GetRequestStats(int /* major */,
+					     int /* minor */);
+
+/* Upper bound in usec of the latency below which the given fraction of
+ * requests (in percent) completed */
+extern _X_EXPORT CARD32 RequestStatsPercentile(ReqStatsPtr /* stats */,
+					       int /* percent */);
+
+/* Writes the global and per client statistics to the log, along with
+ * the connection buffer, input queue and private storage counters.  Done
+ * every RequestStatsInterval seconds, on SIGUSR2, and by the Xorg prstat
+ * action. */
+extern _X_EXPORT void DumpRequestStats(void);
+
+#endif /* REQSTATS_H */
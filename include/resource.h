@@ -88,18 +88,9 @@ typedef uint32_t RESTYPE;
 
 /* bits and fields within a resource id */
 #define RESOURCE_AND_CLIENT_COUNT   29			/* 29 bits for XIDs */
-#if MAXCLIENTS == 64
-#define RESOURCE_CLIENT_BITS	6
-#endif
-#if MAXCLIENTS == 128
-#define RESOURCE_CLIENT_BITS	7
-#endif
-#if MAXCLIENTS == 256
-#define RESOURCE_CLIENT_BITS	8
-#endif
-#if MAXCLIENTS == 512
-#define RESOURCE_CLIENT_BITS	9
-#endif
+/* bits of the XID that name the client, derived from LimitClients */
+extern _X_EXPORT unsigned int ResourceClientBits(void);
+#define RESOURCE_CLIENT_BITS	ResourceClientBits()
 /* client field offset */
 #define CLIENTOFFSET	    (RESOURCE_AND_CLIENT_COUNT - RESOURCE_CLIENT_BITS)
 /* resource field */
@@ -298,6 +298,14 @@ SOFTWARE.
 #define IMAGE_BUFSIZE		(64*1024)
 #endif
 
+/* GetImage replies up to this size in bytes are fetched into a single
+ * buffer which is then sent without being copied; larger ones are sent
+ * in bands of IMAGE_BUFSIZE.
+ */
+#ifndef IMAGE_REPLY_MAX
+#define IMAGE_REPLY_MAX		(4*1024*1024)
+#endif
+
 /* pad scanline to a longword */
 #ifndef BITMAP_SCANLINE_UNIT
 #define BITMAP_SCANLINE_UNIT	32
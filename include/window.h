@@ -72,6 +72,7 @@ struct _Cursor;
 
 typedef struct _BackingStore *BackingStorePtr;
 typedef struct _Window *WindowPtr;
+typedef struct _PickIndex *PickIndexPtr;
 
 typedef int (*VisitWindowProcPtr)(
     WindowPtr /*pWin*/,
@@ -267,6 +268,25 @@ extern _X_EXPORT void EnableMapUnmapEvents(
     WindowPtr /* pWin */ );
 
 extern _X_EXPORT void SetRootClip(ScreenPtr pScreen, Bool enable);
+
+/* pickindex.c: must be called when a child of pParent is mapped, unmapped,
+ * moved, resized, restacked, reshaped or removed */
+extern _X_EXPORT void InvalidatePickIndex(
+    WindowPtr /* pParent */ );
+
+extern void FreePickIndex(
+    WindowPtr /* pWin */ );
+
+extern int LookupPickIndex(
+    WindowPtr /* pParent */,
+    int /* x */,
+    int /* y */,
+    WindowPtr ** /* pCandidates */ );
+
+extern void NotePickScan(
+    WindowPtr /* pParent */,
+    int /* nscanned */ );
+
 extern _X_EXPORT void PrintWindowTree(void);
 
 #endif /* WINDOW_H */
@@ -219,6 +219,21 @@ extern _X_EXPORT void mieqProcessInputEvents(
     void
 );
 
+typedef struct _mieqStats {
+    unsigned long enqueued;	/* events added to the queue */
+    unsigned long coalesced;	/* merged into an event already queued */
+    unsigned long dropped;	/* lost because the queue was full */
+    unsigned long processed;	/* taken off the queue */
+    int size;			/* slots in the queue */
+    int maxPending;		/* most events ever waiting at once */
+    CARD64 latencyTotal;	/* usec from enqueueing to processing, */
+    CARD64 latencyMax;		/* summed over and max of all events */
+} mieqStatsRec, *mieqStatsPtr;
+
+extern _X_EXPORT void mieqGetStats(
+    mieqStatsPtr /* stats */
+);
+
 extern DeviceIntPtr CopyGetMasterEvent(
     DeviceIntPtr /* sdev */,
     InternalEvent* /* original */,
@@ -59,7 +59,14 @@ in this Software without prior written authorization from The Open Group.
 # include <X11/extensions/dpmsconst.h>
 #endif
 
-#define QUEUE_SIZE  512
+/*
+ * The queue starts out with QUEUE_INITIAL_SIZE slots.  mieqEnqueue runs
+ * in signal handlers and cannot allocate, so the queue is grown from
+ * mieqProcessInputEvents instead, once it has been found half full or
+ * has dropped events, up to QUEUE_MAXIMUM_SIZE slots.
+ */
+#define QUEUE_INITIAL_SIZE	512
+#define QUEUE_MAXIMUM_SIZE	4096
 
 #define EnqueueScreen(dev) dev->spriteInfo->sprite->pEnqueueScreen
 #define DequeueScreen(dev) dev->spriteInfo->sprite->pDequeueScreen
@@ -68,14 +75,17 @@ typedef struct _Event {
     InternalEvent*  events;
     ScreenPtr	    pScreen;
     DeviceIntPtr    pDev; /* device this event _originated_ from */
+    CARD64	    enqueued; /* GetTimeInMicros() when first queued */
 } EventRec, *EventPtr;
 
 typedef struct _EventQueue {
     HWEventQueueType head, tail;         /* long for SetInputCheck */
     CARD32           lastEventTime;      /* to avoid time running backwards */
     int              lastMotion;         /* device ID if last event motion? */
-    EventRec         events[QUEUE_SIZE]; /* static allocation for signals */
+    EventRec        *events;             /* preallocated for signals */
+    int              nevents;
     mieqHandler      handlers[128];      /* custom event handler */
+    mieqStatsRec     stats;
 } EventQueueRec, *EventQueuePtr;
 
 static EventQueueRec miEventQueue;
@@ -107,9 +117,17 @@ mieqInit(void)
     miEventQueue.head = miEventQueue.tail = 0;
     miEventQueue.lastEventTime = GetTimeInMillis ();
     miEventQueue.lastMotion = FALSE;
+    memset(&miEventQueue.stats, 0, sizeof(miEventQueue.stats));
     for (i = 0; i < 128; i++)
         miEventQueue.handlers[i] = NULL;
-    for (i = 0; i < QUEUE_SIZE; i++)
+    if (!miEventQueue.events)
+    {
+        miEventQueue.events = calloc(QUEUE_INITIAL_SIZE, sizeof(EventRec));
+        if (!miEventQueue.events)
+            FatalError("Could not allocate event queue.\n");
+        miEventQueue.nevents = QUEUE_INITIAL_SIZE;
+    }
+    for (i = 0; i < miEventQueue.nevents; i++)
     {
 	if (miEventQueue.events[i].events == NULL) {
 	    InternalEvent* evlist = InitEventList(1);
@@ -118,6 +136,7 @@ mieqInit(void)
 	    miEventQueue.events[i].events = evlist;
 	}
     }
+    miEventQueue.stats.size = miEventQueue.nevents;
 
     SetInputCheck(&miEventQueue.head, &miEventQueue.tail);
     return TRUE;
@@ -127,13 +146,142 @@ void
 mieqFini(void)
 {
     int i;
-    for (i = 0; i < QUEUE_SIZE; i++)
+    for (i = 0; i < miEventQueue.nevents; i++)
     {
 	if (miEventQueue.events[i].events != NULL) {
 	    FreeEventList(miEventQueue.events[i].events, 1);
 	    miEventQueue.events[i].events = NULL;
 	}
     }
+    free(miEventQueue.events);
+    miEventQueue.events = NULL;
+    miEventQueue.nevents = 0;
+}
+
+static int
+mieqNumEnqueued(EventQueuePtr eventQueue)
+{
+    int n_enqueued = eventQueue->tail - eventQueue->head;
+
+    if (n_enqueued < 0)
+        n_enqueued += eventQueue->nevents;
+    return n_enqueued;
+}
+
+/*
+ * Double the size of the queue, keeping the queued events in order.
+ * Must not run while events are being enqueued.
+ */
+static Bool
+mieqGrowQueue(EventQueuePtr eventQueue)
+{
+    int i, n_enqueued, old_nevents = eventQueue->nevents;
+    int new_nevents = old_nevents * 2;
+    EventRec *new_events;
+
+    new_events = calloc(new_nevents, sizeof(EventRec));
+    if (!new_events)
+        return FALSE;
+    for (i = old_nevents; i < new_nevents; i++)
+    {
+        new_events[i].events = InitEventList(1);
+        if (!new_events[i].events)
+        {
+            while (--i >= old_nevents)
+                FreeEventList(new_events[i].events, 1);
+            free(new_events);
+            return FALSE;
+        }
+    }
+
+    /* Keep SIGIO from queueing events while the slots move around */
+    OsBlockSignals();
+    n_enqueued = mieqNumEnqueued(eventQueue);
+    for (i = 0; i < old_nevents; i++)
+        new_events[i] = eventQueue->events[(eventQueue->head + i) % old_nevents];
+    free(eventQueue->events);
+    eventQueue->events = new_events;
+    eventQueue->nevents = new_nevents;
+    eventQueue->head = 0;
+    eventQueue->tail = n_enqueued;
+    eventQueue->stats.size = new_nevents;
+    OsReleaseSignals();
+
+    return TRUE;
+}
+
+/*
+ * The slot at the head of the queue may be in the middle of being
+ * copied out by an interrupted mieqProcessInputEvents, so only events
+ * behind it are ever modified in place.
+ */
+static EventPtr
+mieqQueuedEvent(EventQueuePtr eventQueue, int back)
+{
+    if (mieqNumEnqueued(eventQueue) <= back)
+        return NULL;
+    return &eventQueue->events[(eventQueue->tail - back + eventQueue->nevents) %
+                               eventQueue->nevents];
+}
+
+/* Fold motion event e into the queued motion event of the same device */
+static void
+mieqCoalesceMotion(DeviceEvent *queued, DeviceEvent *e)
+{
+    DeviceEvent old = *queued;
+    int i;
+
+    /* The new event wins, except for axes only the queued one moved */
+    memcpy(queued, e, e->length);
+    for (i = 0; i < MAX_VALUATORS; i++)
+    {
+        if (BitIsOn(old.valuators.mask, i) && !BitIsOn(e->valuators.mask, i))
+        {
+            SetBit(queued->valuators.mask, i);
+            if (BitIsOn(old.valuators.mode, i))
+                SetBit(queued->valuators.mode, i);
+            queued->valuators.data[i] = old.valuators.data[i];
+        }
+    }
+}
+
+/*
+ * Relative pointer motion arrives as a raw event followed by a motion
+ * event.  If the last two queued events are such a pair from the same
+ * device, add the deltas of raw event e to the queued raw event.  The
+ * motion event that follows then replaces the queued one, as the last
+ * queued event is still a motion event of the device.
+ */
+static Bool
+mieqCoalesceRaw(EventQueuePtr eventQueue, DeviceIntPtr pDev, RawDeviceEvent *e)
+{
+    EventPtr raw = mieqQueuedEvent(eventQueue, 2);
+    EventPtr motion = mieqQueuedEvent(eventQueue, 1);
+    RawDeviceEvent *queued;
+    int i;
+
+    if (!raw || !motion || raw->pDev != pDev || motion->pDev != pDev ||
+        eventQueue->lastMotion != pDev->id ||
+        raw->events->any.type != ET_RawMotion ||
+        !pDev->valuator || valuator_get_mode(pDev, 0) != Relative)
+        return FALSE;
+
+    queued = &raw->events->raw_event;
+    for (i = 0; i < MAX_VALUATORS; i++)
+    {
+        if (!BitIsOn(e->valuators.mask, i))
+            continue;
+        if (BitIsOn(queued->valuators.mask, i) &&
+            valuator_get_mode(pDev, i) == Relative)
+            queued->valuators.data_raw[i] += e->valuators.data_raw[i];
+        else
+            queued->valuators.data_raw[i] = e->valuators.data_raw[i];
+        /* data holds the resulting position, not a delta */
+        queued->valuators.data[i] = e->valuators.data[i];
+        SetBit(queued->valuators.mask, i);
+    }
+    queued->time = e->time;
+    return TRUE;
 }
 
 /*
@@ -148,6 +296,7 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
 {
     unsigned int           oldtail = miEventQueue.tail;
     InternalEvent*         evt;
+    EventPtr               queued;
     int                    isMotion = 0;
     int                    evlen;
     Time                   time;
@@ -163,16 +312,32 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
     if (e->any.type == ET_Motion)
         isMotion = pDev->id;
 
+    if (e->any.type == ET_RawMotion && pDev &&
+        mieqCoalesceRaw(&miEventQueue, pDev, &e->raw_event)) {
+        miEventQueue.stats.coalesced++;
+#ifdef XQUARTZ
+        pthread_mutex_unlock(&miEventQueueMutex);
+#endif
+        return;
+    }
+
     if (isMotion && isMotion == miEventQueue.lastMotion &&
-        oldtail != miEventQueue.head) {
-        oldtail = (oldtail - 1) % QUEUE_SIZE;
+        (queued = mieqQueuedEvent(&miEventQueue, 1)) && queued->pDev == pDev &&
+        queued->events->any.type == ET_Motion) {
+        mieqCoalesceMotion(&queued->events->device_event, &e->device_event);
+        miEventQueue.stats.coalesced++;
+#ifdef XQUARTZ
+        pthread_mutex_unlock(&miEventQueueMutex);
+#endif
+        return;
     }
     else {
         static int stuck = 0;
         /* Toss events which come in late.  Usually this means your server's
          * stuck in an infinite loop somewhere, but SIGIO is still getting
          * handled. */
-        if (((oldtail + 1) % QUEUE_SIZE) == miEventQueue.head) {
+        if (((oldtail + 1) % miEventQueue.nevents) == miEventQueue.head) {
+            miEventQueue.stats.dropped++;
             if (!stuck) {
                 ErrorF("[mi] EQ overflowing. The server is probably stuck "
                         "in an infinite loop.\n");
@@ -201,9 +366,13 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
     miEventQueue.lastEventTime = evt->any.time;
     miEventQueue.events[oldtail].pScreen = pDev ? EnqueueScreen(pDev) : NULL;
     miEventQueue.events[oldtail].pDev = pDev;
+    miEventQueue.events[oldtail].enqueued = GetTimeInMicros();
 
     miEventQueue.lastMotion = isMotion;
-    miEventQueue.tail = (oldtail + 1) % QUEUE_SIZE;
+    miEventQueue.tail = (oldtail + 1) % miEventQueue.nevents;
+    miEventQueue.stats.enqueued++;
+    if (mieqNumEnqueued(&miEventQueue) > miEventQueue.stats.maxPending)
+        miEventQueue.stats.maxPending = mieqNumEnqueued(&miEventQueue);
 #ifdef XQUARTZ
     pthread_mutex_unlock(&miEventQueueMutex);
 #endif
@@ -435,12 +604,20 @@ mieqProcessInputEvents(void)
     EventRec *e = NULL;
     ScreenPtr screen;
     static InternalEvent event;
+    static unsigned long dropped;
     DeviceIntPtr dev = NULL,
                  master = NULL;
+    CARD64 latency;
 
 #ifdef XQUARTZ
     pthread_mutex_lock(&miEventQueueMutex);
 #endif
+
+    if (miEventQueue.nevents < QUEUE_MAXIMUM_SIZE &&
+        (miEventQueue.stats.dropped != dropped ||
+         mieqNumEnqueued(&miEventQueue) >= miEventQueue.nevents / 2))
+        mieqGrowQueue(&miEventQueue);
+    dropped = miEventQueue.stats.dropped;
     
     while (miEventQueue.head != miEventQueue.tail) {
         e = &miEventQueue.events[miEventQueue.head];
@@ -449,7 +626,13 @@ mieqProcessInputEvents(void)
         dev     = e->pDev;
         screen  = e->pScreen;
 
-        miEventQueue.head = (miEventQueue.head + 1) % QUEUE_SIZE;
+        latency = GetTimeInMicros() - e->enqueued;
+        miEventQueue.stats.processed++;
+        miEventQueue.stats.latencyTotal += latency;
+        if (latency > miEventQueue.stats.latencyMax)
+            miEventQueue.stats.latencyMax = latency;
+
+        miEventQueue.head = (miEventQueue.head + 1) % miEventQueue.nevents;
 
 #ifdef XQUARTZ
         pthread_mutex_unlock(&miEventQueueMutex);
@@ -482,3 +665,8 @@ mieqProcessInputEvents(void)
 #endif
 }
 
+void
+mieqGetStats(mieqStatsPtr stats)
+{
+    *stats = miEventQueue.stats;
+}
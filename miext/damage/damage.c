@@ -38,6 +38,7 @@
 #include    "gcstruct.h"
 #include    "damage.h"
 #include    "damagestr.h"
+#include    "list.h"
 #ifdef COMPOSITE
 #include    "cw.h"
 #endif
@@ -79,6 +80,11 @@ static DevPrivateKeyRec damageGCPrivateKeyRec;
 static DevPrivateKeyRec damageWinPrivateKeyRec;
 #define damageWinPrivateKey (&damageWinPrivateKeyRec)
 
+/* Damage with deferred reports that has accumulated something since the
+ * last flush */
+static struct list damageDeferred;
+static unsigned long damageGeneration;
+
 static DamagePtr *
 getDrawableDamageRef (DrawablePtr pDrawable)
 {
@@ -120,6 +126,136 @@ getDrawableDamageRef (DrawablePtr pDrawable)
     DamagePtr	*pPrev = (DamagePtr *) \
 	dixLookupPrivateAddr(&(pWindow)->devPrivates, damageWinPrivateKey)
 
+/*
+ * Clip a region in the coordinates of the damaged drawable to the area
+ * damage is tracked over: the border clip of a window, or the bounds of
+ * a pixmap.
+ */
+static void
+damageClipToDrawable (DamagePtr pDamage, RegionPtr pRegion)
+{
+    DrawablePtr	pDrawable = pDamage->pDrawable;
+    RegionRec	pixmapClip;
+    BoxRec	box;
+
+    if (!pDrawable)
+	return;
+    if (pDrawable->type == DRAWABLE_WINDOW)
+    {
+	RegionTranslate(pRegion, pDrawable->x, pDrawable->y);
+	RegionIntersect(pRegion, pRegion,
+			&((WindowPtr) pDrawable)->borderClip);
+	RegionTranslate(pRegion, -pDrawable->x, -pDrawable->y);
+    }
+    else
+    {
+	box.x1 = 0;
+	box.y1 = 0;
+	box.x2 = pDrawable->width;
+	box.y2 = pDrawable->height;
+	RegionInit(&pixmapClip, &box, 1);
+	RegionIntersect(pRegion, pRegion, &pixmapClip);
+	RegionUninit(&pixmapClip);
+    }
+}
+
+/*
+ * Replace a region holding more rectangles than the damage allows with a
+ * coarser one covering it.  If pAdded is not NULL the area the region grew
+ * by is added to it, so delta reports still cover everything the damage
+ * now claims.
+ */
+static void
+damageLimitRegion (DamagePtr pDamage, RegionPtr pRegion, RegionPtr pAdded)
+{
+    RegionRec	before, tiles;
+    BoxPtr	pBox, pEnd, pTile;
+    BoxRec	box;
+    Bool	overlap;
+    int		mask = DAMAGE_TILE_SIZE - 1;
+    int		n = RegionNumRects(pRegion);
+
+    if (pDamage->regionPolicy == DamageRegionExact ||
+	!pDamage->regionLimit || n <= pDamage->regionLimit)
+	return;
+
+    if (pAdded)
+    {
+	RegionNull(&before);
+	RegionCopy(&before, pRegion);
+    }
+
+    if (pDamage->regionPolicy == DamageRegionTiles)
+    {
+	RegionNull(&tiles);
+	if (RegionRectAlloc(&tiles, n))
+	{
+	    pBox = RegionRects(pRegion);
+	    pEnd = pBox + n;
+	    pTile = RegionBoxptr(&tiles);
+	    for (; pBox != pEnd; pBox++, pTile++)
+	    {
+		pTile->x1 = pBox->x1 & ~mask;
+		pTile->y1 = pBox->y1 & ~mask;
+		pTile->x2 = min((pBox->x2 + mask) & ~mask, MAXSHORT);
+		pTile->y2 = min((pBox->y2 + mask) & ~mask, MAXSHORT);
+	    }
+	    tiles.data->numRects = n;
+	    tiles.extents.x1 = tiles.extents.x2 = 0;
+	    RegionValidate(&tiles, &overlap);
+	    RegionUninit(pRegion);
+	    *pRegion = tiles;
+	    /* Tiles along the edges may reach past the drawable */
+	    damageClipToDrawable(pDamage, pRegion);
+	}
+    }
+
+    if (RegionNumRects(pRegion) > pDamage->regionLimit)
+    {
+	box = *RegionExtents(pRegion);
+	RegionReset(pRegion, &box);
+    }
+
+    if (pAdded)
+    {
+	RegionSubtract(&before, pRegion, &before);
+	RegionUnion(pAdded, pAdded, &before);
+	RegionUninit(&before);
+    }
+}
+
+/*
+ * Report everything a deferred damage accumulated since its last flush.
+ */
+static void
+damageFlushDeferred (DamagePtr pDamage)
+{
+    if (list_is_empty(&pDamage->deferred))
+	return;
+    list_del(&pDamage->deferred);
+    list_init(&pDamage->deferred);
+
+    if (pDamage->damageReport)
+	DamageReportDamage (pDamage, &pDamage->pendingDamage);
+    else {
+	RegionUnion(&pDamage->damage, &pDamage->damage,
+		    &pDamage->pendingDamage);
+	damageLimitRegion(pDamage, &pDamage->damage, NULL);
+    }
+    RegionEmpty(&pDamage->pendingDamage);
+}
+
+static void
+damageBlockHandler (pointer data, OSTimePtr pTimeout, pointer pRead)
+{
+    DamageFlushDeferred ();
+}
+
+static void
+damageWakeupHandler (pointer data, int result, pointer pRead)
+{
+}
+
 static void
 damageReportDamagePostRendering (DamagePtr pDamage, RegionPtr pOldDamage, RegionPtr pDamageRegion)
 {
@@ -301,21 +437,30 @@ damageRegionAppend (DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
 	    RegionTranslate(pDamageRegion, -draw_x, -draw_y);
 
 	/* Store damage region if needed after submission. */
-	if (pDamage->reportAfter || pDamage->damageMarker)
+	if (pDamage->reportAfter || pDamage->damageMarker ||
+	    pDamage->reportDeferred) {
 	    RegionUnion(&pDamage->pendingDamage,
 			 &pDamage->pendingDamage, pDamageRegion);
+	    damageLimitRegion(pDamage, &pDamage->pendingDamage, NULL);
+	}
+
+	/* Queue deferred reports for the block handler. */
+	if (pDamage->reportDeferred && list_is_empty(&pDamage->deferred))
+	    list_add(&pDamage->deferred, &damageDeferred);
 
 	/* Duplicate current damage if needed. */
 	if (pDamage->damageMarker)
 	    RegionCopy(&pDamage->backupDamage, &pDamage->damage);
 
 	/* Report damage now, if desired. */
-	if (!pDamage->reportAfter) {
+	if (!pDamage->reportAfter && !pDamage->reportDeferred) {
 	    if (pDamage->damageReport)
 		DamageReportDamage (pDamage, pDamageRegion);
-	    else
+	    else {
 		RegionUnion(&pDamage->damage,
 			 &pDamage->damage, pDamageRegion);
+		damageLimitRegion(pDamage, &pDamage->damage, NULL);
+	    }
 	}
 
 	/*
@@ -339,6 +484,9 @@ damageRegionProcessPending (DrawablePtr pDrawable)
 
     for (; pDamage != NULL; pDamage = pDamage->pNext)
     {
+	if (pDamage->reportDeferred)
+	    continue;
+
 	/* submit damage marker whenever possible. */
 	if (pDamage->damageMarker)
 	    (*pDamage->damageMarker) (pDrawable, pDamage, &pDamage->backupDamage, &pDamage->pendingDamage, pDamage->closure);
@@ -346,9 +494,11 @@ damageRegionProcessPending (DrawablePtr pDrawable)
 	    /* It's possible that there is only interest in postRendering reporting. */
 	    if (pDamage->damageReport)
 		DamageReportDamage (pDamage, &pDamage->pendingDamage);
-	    else
+	    else {
 		RegionUnion(&pDamage->damage, &pDamage->damage,
 			&pDamage->pendingDamage);
+		damageLimitRegion(pDamage, &pDamage->damage, NULL);
+	    }
 	}
 
 	if (pDamage->reportAfter || pDamage->damageMarker)
@@ -1797,15 +1947,27 @@ DamageSetup (ScreenPtr pScreen)
     if (dixLookupPrivate(&pScreen->devPrivates, damageScrPrivateKey))
 	return TRUE;
 
-    if (!dixRegisterPrivateKey(&damageGCPrivateKeyRec, PRIVATE_GC, sizeof(DamageGCPrivRec)))
+    if (!dixRegisterPrivateKeyHint(&damageGCPrivateKeyRec, PRIVATE_GC,
+				   sizeof(DamageGCPrivRec), PRIVATE_HINT_HOT))
 	return FALSE;
 
-    if (!dixRegisterPrivateKey(&damagePixPrivateKeyRec, PRIVATE_PIXMAP, 0))
+    if (!dixRegisterPrivateKeyHint(&damagePixPrivateKeyRec, PRIVATE_PIXMAP, 0,
+				   PRIVATE_HINT_HOT))
 	return FALSE;
 
-    if (!dixRegisterPrivateKey(&damageWinPrivateKeyRec, PRIVATE_WINDOW, 0))
+    if (!dixRegisterPrivateKeyHint(&damageWinPrivateKeyRec, PRIVATE_WINDOW, 0,
+				   PRIVATE_HINT_HOT))
 	return FALSE;
 
+    if (damageGeneration != serverGeneration)
+    {
+	if (!RegisterBlockAndWakeupHandlers (damageBlockHandler,
+					     damageWakeupHandler, NULL))
+	    return FALSE;
+	list_init(&damageDeferred);
+	damageGeneration = serverGeneration;
+    }
+
     pScrPriv = malloc(sizeof (DamageScrPrivRec));
     if (!pScrPriv)
 	return FALSE;
@@ -1856,6 +2018,10 @@ DamageCreate (DamageReportFunc  damageReport,
     pDamage->isWindow = FALSE;
     pDamage->pDrawable = 0;
     pDamage->reportAfter = FALSE;
+    pDamage->reportDeferred = FALSE;
+    list_init(&pDamage->deferred);
+    pDamage->regionPolicy = DamageRegionExact;
+    pDamage->regionLimit = 0;
 
     pDamage->damageReport = damageReport;
     pDamage->damageReportPostRendering = NULL;
@@ -1923,6 +2089,7 @@ DamageUnregister (DrawablePtr	    pDrawable,
     ScreenPtr pScreen = pDrawable->pScreen;
     damageScrPriv(pScreen);
 
+    damageFlushDeferred (pDamage);
     (*pScrPriv->funcs.Unregister) (pDrawable, pDamage);
 
     if (pDrawable->type == DRAWABLE_WINDOW)
@@ -1962,6 +2129,8 @@ DamageDestroy (DamagePtr    pDamage)
     ScreenPtr pScreen = pDamage->pScreen;
     damageScrPriv(pScreen);
 
+    if (!list_is_empty(&pDamage->deferred))
+	list_del(&pDamage->deferred);
     if (pDamage->damageDestroy)
 	(*pDamage->damageDestroy) (pDamage, pDamage->closure);
     (*pScrPriv->funcs.Destroy) (pDamage);
@@ -1978,6 +2147,7 @@ DamageSubtract (DamagePtr	    pDamage,
     RegionRec	pixmapClip;
     DrawablePtr	pDrawable = pDamage->pDrawable;
     
+    damageFlushDeferred (pDamage);
     RegionSubtract(&pDamage->damage, &pDamage->damage, pRegion);
     if (pDrawable)
     {
@@ -2006,12 +2176,14 @@ DamageSubtract (DamagePtr	    pDamage,
 void
 DamageEmpty (DamagePtr	    pDamage)
 {
+    damageFlushDeferred (pDamage);
     RegionEmpty(&pDamage->damage);
 }
 
 RegionPtr
 DamageRegion (DamagePtr		    pDamage)
 {
+    damageFlushDeferred (pDamage);
     return &pDamage->damage;
 }
 
@@ -2033,6 +2205,23 @@ DamageRegionProcessPending (DrawablePtr pDrawable)
     damageRegionProcessPending (pDrawable);
 }
 
+void
+DamageRegionDropPending (DrawablePtr pDrawable)
+{
+    drawableDamage(pDrawable);
+
+    for (; pDamage != NULL; pDamage = pDamage->pNext)
+    {
+	/* Deferred damage accumulates a whole frame in pendingDamage */
+	if (pDamage->reportDeferred)
+	    continue;
+	if (pDamage->reportAfter || pDamage->damageMarker)
+	    RegionEmpty(&pDamage->pendingDamage);
+	if (pDamage->damageMarker)
+	    RegionEmpty(&pDamage->backupDamage);
+    }
+}
+
 /* If a damage marker is provided, then this function must be called after rendering is done. */
 /* Please do call back so any future enhancements can assume this function is called. */
 /* There are no strict timing requirements for calling this function, just as soon as (is cheaply) possible. */
@@ -2063,14 +2252,44 @@ DamageSetReportAfterOp (DamagePtr pDamage, Bool reportAfter)
     pDamage->reportAfter = reportAfter;
 }
 
+void
+DamageSetReportDeferred (DamagePtr pDamage, Bool deferred)
+{
+    /* Damage markers need the pending region after every operation */
+    if (pDamage->damageMarker)
+	deferred = FALSE;
+    if (!deferred)
+	damageFlushDeferred (pDamage);
+    pDamage->reportDeferred = deferred;
+}
+
+void
+DamageFlushDeferred (void)
+{
+    while (!list_is_empty(&damageDeferred))
+	damageFlushDeferred (list_first_entry(&damageDeferred,
+					      DamageRec, deferred));
+}
+
 void
 DamageSetPostRenderingFunctions(DamagePtr pDamage, DamageReportFunc damageReportPostRendering,
 				DamageMarkerFunc damageMarker)
 {
+    /* A marker runs after every operation, so report what was deferred */
+    if (damageMarker)
+	DamageSetReportDeferred (pDamage, FALSE);
     pDamage->damageReportPostRendering = damageReportPostRendering;
     pDamage->damageMarker = damageMarker;
 }
 
+void
+DamageSetRegionLimit (DamagePtr pDamage, DamageRegionPolicy policy, int limit)
+{
+    pDamage->regionPolicy = policy;
+    pDamage->regionLimit = limit;
+    damageLimitRegion(pDamage, &pDamage->damage, NULL);
+}
+
 DamageScreenFuncsPtr
 DamageGetScreenFuncs (ScreenPtr pScreen)
 {
@@ -2089,6 +2308,7 @@ DamageReportDamage (DamagePtr pDamage, RegionPtr pDamageRegion)
     case DamageReportRawRegion:
 	RegionUnion(&pDamage->damage, &pDamage->damage,
 			 pDamageRegion);
+	damageLimitRegion(pDamage, &pDamage->damage, NULL);
 	(*pDamage->damageReport) (pDamage, pDamageRegion, pDamage->closure);
 	break;
     case DamageReportDeltaRegion:
@@ -2097,6 +2317,7 @@ DamageReportDamage (DamagePtr pDamage, RegionPtr pDamageRegion)
 	if (RegionNotEmpty(&tmpRegion)) {
 	    RegionUnion(&pDamage->damage, &pDamage->damage,
 			 pDamageRegion);
+	    damageLimitRegion(pDamage, &pDamage->damage, &tmpRegion);
 	    (*pDamage->damageReport) (pDamage, &tmpRegion, pDamage->closure);
 	}
 	RegionUninit(&tmpRegion);
@@ -2105,6 +2326,7 @@ DamageReportDamage (DamagePtr pDamage, RegionPtr pDamageRegion)
 	tmpBox = *RegionExtents(&pDamage->damage);
 	RegionUnion(&pDamage->damage, &pDamage->damage,
 		     pDamageRegion);
+	damageLimitRegion(pDamage, &pDamage->damage, NULL);
 	if (!BOX_SAME (&tmpBox, RegionExtents(&pDamage->damage))) {
 	    (*pDamage->damageReport) (pDamage, &pDamage->damage,
 				      pDamage->closure);
@@ -2114,6 +2336,7 @@ DamageReportDamage (DamagePtr pDamage, RegionPtr pDamageRegion)
 	was_empty = !RegionNotEmpty(&pDamage->damage);
 	RegionUnion(&pDamage->damage, &pDamage->damage,
 		     pDamageRegion);
+	damageLimitRegion(pDamage, &pDamage->damage, NULL);
 	if (was_empty && RegionNotEmpty(&pDamage->damage)) {
 	    (*pDamage->damageReport) (pDamage, &pDamage->damage,
 				      pDamage->closure);
@@ -2122,6 +2345,7 @@ DamageReportDamage (DamagePtr pDamage, RegionPtr pDamageRegion)
     case DamageReportNone:
 	RegionUnion(&pDamage->damage, &pDamage->damage,
 		     pDamageRegion);
+	damageLimitRegion(pDamage, &pDamage->damage, NULL);
 	break;
     }
 }
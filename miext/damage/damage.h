@@ -37,6 +37,19 @@ typedef enum _damageReportLevel {
     DamageReportNone
 } DamageReportLevel;
 
+/*
+ * What to do with the accumulated damage once it holds more rectangles
+ * than the limit set with DamageSetRegionLimit.  The coarser region
+ * always covers everything that was damaged.
+ */
+typedef enum _damageRegionPolicy {
+    DamageRegionExact,		/* keep every rectangle */
+    DamageRegionBoundingBox,	/* collapse to the bounding box */
+    DamageRegionTiles		/* round out to DAMAGE_TILE_SIZE tiles */
+} DamageRegionPolicy;
+
+#define DAMAGE_TILE_SIZE	64
+
 typedef void (*DamageReportFunc) (DamagePtr pDamage, RegionPtr pRegion, void *closure);
 typedef void (*DamageDestroyFunc) (DamagePtr pDamage, void *closure);
 /* It's the responsibility of the driver to duplicate both regions. */
@@ -106,6 +119,11 @@ DamageRegionAppend (DrawablePtr pDrawable, RegionPtr pRegion);
 extern _X_EXPORT void
 DamageRegionProcessPending (DrawablePtr pDrawable);
 
+/* Call this instead of DamageRegionProcessPending when the rendering was not
+ * submitted after all, and whatever draws instead reports its own damage. */
+extern _X_EXPORT void
+DamageRegionDropPending (DrawablePtr pDrawable);
+
 /* Call this some time after rendering is done, only relevant when a damageMarker is provided. */
 extern _X_EXPORT void
 DamageRegionRendered (DrawablePtr pDrawable, DamagePtr pDamage, RegionPtr pOldDamage, RegionPtr pRegion);
@@ -122,10 +140,24 @@ DamageDamageRegion (DrawablePtr	    pDrawable,
 extern _X_EXPORT void
 DamageSetReportAfterOp (DamagePtr pDamage, Bool reportAfter);
 
+/* Accumulate damage and report it once from the block handler, or when the
+ * damage region is next looked at, instead of after every operation. */
+extern _X_EXPORT void
+DamageSetReportDeferred (DamagePtr pDamage, Bool deferred);
+
+/* Report all deferred damage now. */
+extern _X_EXPORT void
+DamageFlushDeferred (void);
+
+/* Installing a damage marker stops deferred reporting. */
 extern _X_EXPORT void
 DamageSetPostRenderingFunctions(DamagePtr pDamage, DamageReportFunc damageReportPostRendering,
 				DamageMarkerFunc damageMarker);
 
+/* Bound the number of rectangles kept in the damage region. */
+extern _X_EXPORT void
+DamageSetRegionLimit (DamagePtr pDamage, DamageRegionPolicy policy, int limit);
+
 extern _X_EXPORT DamageScreenFuncsPtr
 DamageGetScreenFuncs (ScreenPtr);
 
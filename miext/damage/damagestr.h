@@ -30,6 +30,7 @@
 #include "damage.h"
 #include "gcstruct.h"
 #include "privates.h"
+#include "list.h"
 # include "picturestr.h"
 
 typedef struct _damage {
@@ -51,6 +52,10 @@ typedef struct _damage {
     Bool		reportAfter;
     RegionRec		pendingDamage; /* will be flushed post submission at the latest */
     RegionRec		backupDamage; /* for use with damageMarker */
+    Bool		reportDeferred; /* report from the block handler */
+    struct list		deferred; /* on the list of damage to report */
+    DamageRegionPolicy	regionPolicy;
+    int			regionLimit; /* max rectangles in damage, 0 for none */
     ScreenPtr		pScreen;
     PrivateRec		*devPrivates;
 } DamageRec;
@@ -35,6 +35,7 @@
 #include    "globals.h"
 #include    "gcstruct.h"
 #include    "shadow.h"
+#include    "fb.h"
 
 static DevPrivateKeyRec shadowScrPrivateKeyRec;
 #define shadowScrPrivateKey (&shadowScrPrivateKeyRec)
@@ -48,6 +49,207 @@ static DevPrivateKeyRec shadowScrPrivateKeyRec;
     real->mem = priv->mem; \
 }
 
+/*
+ * Damage to the shadow pixmap is recorded in a grid of tiles rather than
+ * accumulated in a region, which costs a union against an ever more
+ * complex region for every drawing operation.  Marking tiles is a few
+ * memsets, and the region handed to the update proc is rebuilt from the
+ * grid once per redisplay, rounded out to tile boundaries.  Rows of tiles
+ * are independent, so large updates can be split into bands of rows and
+ * converted on several threads.
+ */
+
+#define SHADOW_TILE_SHIFT	5
+#define SHADOW_TILE_SIZE	(1 << SHADOW_TILE_SHIFT)
+
+static void
+shadowFreeTiles(shadowBufPtr pBuf)
+{
+    free(pBuf->tiles);
+    pBuf->tiles = NULL;
+    pBuf->tileCols = pBuf->tileRows = 0;
+    pBuf->tileRow1 = pBuf->tileRow2 = 0;
+}
+
+static void
+shadowAllocTiles(shadowBufPtr pBuf)
+{
+    DrawablePtr pDrawable = &pBuf->pPixmap->drawable;
+
+    shadowFreeTiles(pBuf);
+    pBuf->tileCols = (pDrawable->width + SHADOW_TILE_SIZE - 1) >> SHADOW_TILE_SHIFT;
+    pBuf->tileRows = (pDrawable->height + SHADOW_TILE_SIZE - 1) >> SHADOW_TILE_SHIFT;
+    if (pBuf->tileCols && pBuf->tileRows)
+	pBuf->tiles = calloc(pBuf->tileRows, pBuf->tileCols);
+    if (!pBuf->tiles)
+	pBuf->tileCols = pBuf->tileRows = 0;
+}
+
+/* Whether the pixmap was resized (ModifyPixmapHeader) since the grid
+ * was allocated */
+static Bool
+shadowTilesResized(shadowBufPtr pBuf)
+{
+    DrawablePtr pDrawable = &pBuf->pPixmap->drawable;
+
+    return pBuf->tileCols !=
+	   (pDrawable->width + SHADOW_TILE_SIZE - 1) >> SHADOW_TILE_SHIFT ||
+	   pBuf->tileRows !=
+	   (pDrawable->height + SHADOW_TILE_SIZE - 1) >> SHADOW_TILE_SHIFT;
+}
+
+static void
+shadowMarkTiles(shadowBufPtr pBuf, RegionPtr pRegion)
+{
+    int		nbox = RegionNumRects(pRegion);
+    BoxPtr	pbox = RegionRects(pRegion);
+    int		x1, y1, x2, y2, row;
+
+    /* Clipped to the grid, whatever size the pixmap has by now */
+    for (; nbox--; pbox++) {
+	x1 = max(pbox->x1, 0);
+	y1 = max(pbox->y1, 0);
+	x2 = min(pbox->x2, pBuf->tileCols << SHADOW_TILE_SHIFT);
+	y2 = min(pbox->y2, pBuf->tileRows << SHADOW_TILE_SHIFT);
+	if (x1 >= x2 || y1 >= y2)
+	    continue;
+	x1 >>= SHADOW_TILE_SHIFT;
+	y1 >>= SHADOW_TILE_SHIFT;
+	x2 = (x2 - 1) >> SHADOW_TILE_SHIFT;
+	y2 = (y2 - 1) >> SHADOW_TILE_SHIFT;
+	for (row = y1; row <= y2; row++)
+	    memset(pBuf->tiles + row * pBuf->tileCols + x1, 1, x2 - x1 + 1);
+	if (pBuf->tileRow1 == pBuf->tileRow2) {
+	    pBuf->tileRow1 = y1;
+	    pBuf->tileRow2 = y2 + 1;
+	} else {
+	    pBuf->tileRow1 = min(pBuf->tileRow1, y1);
+	    pBuf->tileRow2 = max(pBuf->tileRow2, y2 + 1);
+	}
+    }
+}
+
+/*
+ * Builds the region covered by the dirty tiles in rows [row1, row2).
+ * Runs of dirty tiles become boxes; a row with the same runs as the band
+ * above it extends that band instead of starting a new one, so the boxes
+ * come out as a valid y-x banded region.
+ */
+static void
+shadowTileRegion(shadowBufPtr pBuf, int row1, int row2, RegionPtr pRegion)
+{
+    DrawablePtr pDrawable = &pBuf->pPixmap->drawable;
+    int		cols = pBuf->tileCols;
+    BoxPtr	boxes, band = NULL;
+    int		nbox = 0, nband = 0;
+    int		row, col, start, n, y1, y2;
+    CARD8	*tiles;
+
+    boxes = malloc((row2 - row1) * ((cols + 1) / 2) * sizeof(BoxRec));
+    if (!boxes) {
+	/* Redraw the dirty rows entirely */
+	BoxRec	box;
+
+	box.x1 = 0;
+	box.x2 = pDrawable->width;
+	box.y1 = row1 << SHADOW_TILE_SHIFT;
+	box.y2 = min(row2 << SHADOW_TILE_SHIFT, pDrawable->height);
+	RegionInit(pRegion, &box, 1);
+	return;
+    }
+
+    for (row = row1; row < row2; row++) {
+	BoxPtr	rowBoxes = boxes + nbox;
+	int	nrow = 0;
+
+	tiles = pBuf->tiles + row * cols;
+	y1 = row << SHADOW_TILE_SHIFT;
+	y2 = min(y1 + SHADOW_TILE_SIZE, pDrawable->height);
+	for (col = 0; col < cols; ) {
+	    if (!tiles[col]) {
+		col++;
+		continue;
+	    }
+	    for (start = col; col < cols && tiles[col]; col++)
+		;
+	    rowBoxes[nrow].x1 = start << SHADOW_TILE_SHIFT;
+	    rowBoxes[nrow].x2 = min(col << SHADOW_TILE_SHIFT, pDrawable->width);
+	    rowBoxes[nrow].y1 = y1;
+	    rowBoxes[nrow].y2 = y2;
+	    nrow++;
+	}
+	if (!nrow) {
+	    band = NULL;
+	    continue;
+	}
+	if (band && nband == nrow && band->y2 == y1) {
+	    for (n = 0; n < nrow; n++)
+		if (band[n].x1 != rowBoxes[n].x1 || band[n].x2 != rowBoxes[n].x2)
+		    break;
+	    if (n == nrow) {
+		for (n = 0; n < nband; n++)
+		    band[n].y2 = y2;
+		continue;
+	    }
+	}
+	band = rowBoxes;
+	nband = nrow;
+	nbox += nrow;
+    }
+
+    RegionInitBoxes(pRegion, boxes, nbox);
+    free(boxes);
+}
+
+static void
+shadowClearTiles(shadowBufPtr pBuf)
+{
+    memset(pBuf->tiles + pBuf->tileRow1 * pBuf->tileCols, 0,
+	   (pBuf->tileRow2 - pBuf->tileRow1) * pBuf->tileCols);
+    pBuf->tileRow1 = pBuf->tileRow2 = 0;
+}
+
+/* Moves the dirty tiles into the damage region */
+static void
+shadowFlushTiles(shadowBufPtr pBuf)
+{
+    RegionRec	region;
+
+    if (pBuf->tileRow1 == pBuf->tileRow2)
+	return;
+    shadowTileRegion(pBuf, pBuf->tileRow1, pBuf->tileRow2, &region);
+    RegionUnion(&pBuf->pDamage->damage, &pBuf->pDamage->damage, &region);
+    RegionUninit(&region);
+    shadowClearTiles(pBuf);
+}
+
+typedef struct {
+    ScreenPtr	    pScreen;
+    shadowBufPtr    pBuf;
+} ShadowBandRec;
+
+/*
+ * Runs the update proc for the tiles in rows [row1, row2).  Update procs
+ * find their damage through pBuf->pDamage, so each band gets copies of
+ * both with the damage region replaced by that of the band.
+ */
+static void
+shadowUpdateBand(void *closure, int row1, int row2)
+{
+    ShadowBandRec   *c = closure;
+    shadowBufRec    buf = *c->pBuf;
+    DamageRec	    damage = *c->pBuf->pDamage;
+
+    /* The copy must not look like it is queued for a deferred report */
+    list_init(&damage.deferred);
+    shadowTileRegion(c->pBuf, row1, row2, &damage.damage);
+    if (RegionNotEmpty(&damage.damage)) {
+	buf.pDamage = &damage;
+	(*buf.update)(c->pScreen, &buf);
+    }
+    RegionUninit(&damage.damage);
+}
+
 static void
 shadowRedisplay(ScreenPtr pScreen)
 {
@@ -57,6 +259,19 @@ shadowRedisplay(ScreenPtr pScreen)
     if (!pBuf || !pBuf->pDamage || !pBuf->update)
 	return;
     pRegion = DamageRegion(pBuf->pDamage);
+    if (pBuf->threaded && !RegionNotEmpty(pRegion) &&
+	pBuf->tileRow1 != pBuf->tileRow2) {
+	ShadowBandRec	c;
+
+	c.pScreen = pScreen;
+	c.pBuf = pBuf;
+	fbBands(pBuf->tileRow1, pBuf->tileRow2,
+		pBuf->tileCols << (2 * SHADOW_TILE_SHIFT),
+		shadowUpdateBand, &c);
+	shadowClearTiles(pBuf);
+	return;
+    }
+    shadowFlushTiles(pBuf);
     if (RegionNotEmpty(pRegion)) {
 	(*pBuf->update)(pScreen, pBuf);
 	DamageEmpty(pBuf->pDamage);
@@ -118,10 +333,23 @@ shadowReportFunc(DamagePtr pDamage, RegionPtr pRegion, void *closure)
     ScreenPtr pScreen = closure;
     shadowBufPtr pBuf = (shadowBufPtr)
 	dixLookupPrivate(&pScreen->devPrivates, shadowScrPrivateKey);
-
-    /* Register the damaged region, use DamageReportNone below when we
-     * want to break BC below... */
-    RegionUnion(&pDamage->damage, &pDamage->damage, pRegion);
+    RegionPtr pMark;
+
+    /* Damage has added pRegion to pDamage->damage already.  Move it to
+     * the tile map, if there is one, so that the region stays small. */
+    if (pBuf->tiles) {
+	pMark = pRegion;
+	if (shadowTilesResized(pBuf)) {
+	    /* Carry the pending tiles over to a grid of the new size */
+	    shadowFlushTiles(pBuf);
+	    shadowAllocTiles(pBuf);
+	    pMark = &pDamage->damage;
+	}
+	if (pBuf->tiles) {
+	    shadowMarkTiles(pBuf, pMark);
+	    RegionEmpty(&pDamage->damage);
+	}
+    }
 
     /*
      * BC hack.  In 7.0 and earlier several drivers would inspect the
@@ -168,6 +396,10 @@ shadowSetup(ScreenPtr pScreen)
     pBuf->pPixmap = 0;
     pBuf->closure = 0;
     pBuf->randr = 0;
+    pBuf->tiles = NULL;
+    pBuf->tileCols = pBuf->tileRows = 0;
+    pBuf->tileRow1 = pBuf->tileRow2 = 0;
+    pBuf->threaded = FALSE;
 #ifdef BACKWARDS_COMPATIBILITY
     RegionNull(&pBuf->damage); /* bc */
 #endif
@@ -209,6 +441,7 @@ shadowAdd(ScreenPtr pScreen, PixmapPtr pPixmap, ShadowUpdateProc update,
     pBuf->randr = randr;
     pBuf->closure = closure;
     pBuf->pPixmap = pPixmap;
+    shadowAllocTiles(pBuf);
     DamageRegister(&pPixmap->drawable, pBuf->pDamage);
     return TRUE;
 }
@@ -220,6 +453,10 @@ shadowRemove(ScreenPtr pScreen, PixmapPtr pPixmap)
 
     if (pBuf->pPixmap) {
 	DamageUnregister(&pBuf->pPixmap->drawable, pBuf->pDamage);
+	/* Keep what hasn't been redisplayed yet */
+	if (pBuf->tiles)
+	    shadowFlushTiles(pBuf);
+	shadowFreeTiles(pBuf);
 	pBuf->update = 0;
 	pBuf->window = 0;
 	pBuf->randr = 0;
@@ -231,6 +468,14 @@ shadowRemove(ScreenPtr pScreen, PixmapPtr pPixmap)
 				 (pointer) pScreen);
 }
 
+void
+shadowSetThreaded(ScreenPtr pScreen, Bool threaded)
+{
+    shadowBuf(pScreen);
+
+    pBuf->threaded = threaded;
+}
+
 Bool
 shadowInit(ScreenPtr pScreen, ShadowUpdateProc update, ShadowWindowProc window)
 {
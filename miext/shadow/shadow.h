@@ -59,6 +59,13 @@ typedef struct _shadowBuf {
     /* screen wrappers */
     GetImageProcPtr     GetImage;
     CloseScreenProcPtr  CloseScreen;
+
+    /* dirty tile map, see shadow.c */
+    CARD8		*tiles;
+    int			tileCols;
+    int			tileRows;
+    int			tileRow1, tileRow2;	/* dirty rows */
+    Bool		threaded;
 } shadowBufRec;
 
 /* Match defines from randr extension */
@@ -96,6 +103,14 @@ shadowRemove (ScreenPtr pScreen, PixmapPtr pPixmap);
 extern _X_EXPORT Bool
 shadowInit (ScreenPtr pScreen, ShadowUpdateProc update, ShadowWindowProc window);
 
+/*
+ * Declares that the update and window procs may be run for disjoint parts
+ * of the screen on several threads at once, which lets large updates be
+ * split across the -renderthreads workers.
+ */
+extern _X_EXPORT void
+shadowSetThreaded (ScreenPtr pScreen, Bool threaded);
+
 extern _X_EXPORT void *
 shadowAlloc (int width, int height, int bpp);
 
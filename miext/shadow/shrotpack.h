@@ -170,6 +170,11 @@ FUNC (ScreenPtr	    pScreen,
 #if(DANDEBUG > 5)
 		ErrorF ("   |   |   |-> Writing Line - Metrics: win=%x, sha=%x\n", win, sha);
 #endif
+#ifndef ROTATE
+		/* Unrotated spans are contiguous on both sides */
+		memcpy (win, sha, i * sizeof (Data));
+		sha += i;
+#else
                 while (i--)
                 {
 #if(DANDEBUG > 6)
@@ -178,6 +183,7 @@ FUNC (ScreenPtr	    pScreen,
                     *win++ = *sha;
                     sha += SHASTEPX(shaStride);
                 } /*  i */
+#endif
             } /*  width */
             shaLine += SHASTEPY(shaStride);
             NEXTY(x,y,w,h);
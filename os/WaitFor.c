@@ -126,6 +126,18 @@ static void DoTimer(OsTimerPtr timer, CARD32 now, OsTimerPtr *prev);
 static void CheckAllTimers(void);
 static OsTimerPtr timers = NULL;
 
+/* Convert the block handlers' timeval to ospoll_wait milliseconds */
+static int
+WaitTimeout(struct timeval *wt)
+{
+    if (!wt)
+	return -1;
+    if (wt->tv_sec >= INT_MAX / MILLI_PER_SECOND)
+	return INT_MAX;
+    /* round up, waking early would just spin */
+    return wt->tv_sec * MILLI_PER_SECOND + (wt->tv_usec + 999) / 1000;
+}
+
 /*****************
  * WaitForSomething:
  *     Make the server suspend until there is
@@ -138,9 +150,15 @@ static OsTimerPtr timers = NULL;
  *     If the time between INPUT events is
  *     greater than ScreenSaverTime, the display is turned off (or
  *     saved, depending on the hardware).  So, WaitForSomething()
- *     has to handle this also (that's why the select() has a timeout.
- *     For more info on ClientsWithInput, see ReadRequestFromClient().
+ *     has to handle this also (that's why the poll has a timeout.
+ *     For more info on ReadyClients, see ReadRequestFromClient().
  *     pClientsReady is an array to store ready client->index values into.
+ *
+ *     server_poll calls back for every descriptor that is ready: clients
+ *     go on ReadyClients, listeners queue EstablishNewConnections and
+ *     general sockets are set in LastSelectMask for the wakeup handlers.
+ *     A wakeup costs as much as the ready descriptors, however many
+ *     connections there are.
  *****************/
 
 int
@@ -149,16 +167,13 @@ WaitForSomething(int *pClientsReady)
     int i;
     struct timeval waittime, *wt;
     INT32 timeout = 0;
-    fd_set clientsReadable;
-    fd_set clientsWritable;
-    int curclient;
-    int selecterr;
+    int pollerr;
     static int nready;
-    fd_set devicesReadable;
     CARD32 now = 0;
     Bool    someReady = FALSE;
-
-    FD_ZERO(&clientsReadable);
+    Bool    devicesReady;
+    OsCommPtr oc;
+    int highest_priority = 0;
 
     if (nready)
         SmartScheduleStopTimer();
@@ -171,30 +186,20 @@ WaitForSomething(int *pClientsReady)
 	/* deal with any blocked jobs */
 	if (workQueue)
 	    ProcessWorkQueue();
-	if (XFD_ANYSET (&ClientsWithInput))
+	wt = NULL;
+	if (AnyClientsReady())
 	{
-	    if (!SmartScheduleDisable)
-	    {
-		someReady = TRUE;
-		waittime.tv_sec = 0;
-		waittime.tv_usec = 0;
-		wt = &waittime;
-	    }
-	    else
-	    {
-		XFD_COPYSET (&ClientsWithInput, &clientsReadable);
+	    if (SmartScheduleDisable)
 		break;
-	    }
+	    someReady = TRUE;
 	}
 	if (someReady)
 	{
-	    XFD_COPYSET(&AllSockets, &LastSelectMask);
-	    XFD_UNSET(&LastSelectMask, &ClientsWithInput);
+	    waittime.tv_sec = 0;
+	    waittime.tv_usec = 0;
+	    wt = &waittime;
 	}
-	else
-	{
-        wt = NULL;
-	if (timers)
+	else if (timers)
         {
             now = GetTimeInMillis();
 	    timeout = timers->expires - now;
@@ -213,47 +218,40 @@ WaitForSomething(int *pClientsReady)
 		wt = &waittime;
 	    }
 	}
-	XFD_COPYSET(&AllSockets, &LastSelectMask);
-	}
 
 	BlockHandler((pointer)&wt, (pointer)&LastSelectMask);
 	if (NewOutputPending)
 	    FlushAllOutput();
-	/* keep this check close to select() call to minimize race */
+	/* keep this check close to the poll to minimize race */
 	if (dispatchException)
 	    i = -1;
-	else if (AnyClientsWriteBlocked)
-	{
-	    XFD_COPYSET(&ClientsWriteBlocked, &clientsWritable);
-	    i = Select (MaxClients, &LastSelectMask, &clientsWritable, NULL, wt);
-	}
-	else 
-	{
-	    i = Select (MaxClients, &LastSelectMask, NULL, NULL, wt);
-	}
-	selecterr = GetErrno();
+	else
+	    i = ospoll_wait(server_poll, WaitTimeout(wt));
+	pollerr = GetErrno();
 	WakeupHandler(i, (pointer)&LastSelectMask);
+	devicesReady = i > 0 && AnyDevicesReadable;
+	ResetReadySockets();
 	if (i <= 0) /* An error or timeout occurred */
 	{
 	    if (dispatchException)
 		return 0;
 	    if (i < 0) 
 	    {
-		if (selecterr == EBADF)    /* Some client disconnected */
+		if (pollerr == EBADF)    /* Some client disconnected */
 		{
 		    CheckConnections ();
-		    if (! XFD_ANYSET (&AllClients))
+		    if (!NumClientConnections)
 			return 0;
 		}
-		else if (selecterr == EINVAL)
+		else if (pollerr == EINVAL)
 		{
-		    FatalError("WaitForSomething(): select: %s\n",
-			strerror(selecterr));
+		    FatalError("WaitForSomething(): poll: %s\n",
+			strerror(pollerr));
             }
-		else if (selecterr != EINTR && selecterr != EAGAIN)
+		else if (pollerr != EINTR && pollerr != EAGAIN)
 		{
-		    ErrorF("WaitForSomething(): select: %s\n",
-			strerror(selecterr));
+		    ErrorF("WaitForSomething(): poll: %s\n",
+			strerror(pollerr));
 		}
 	    }
 	    else if (someReady)
@@ -261,8 +259,6 @@ WaitForSomething(int *pClientsReady)
 		/*
 		 * If no-one else is home, bail quickly
 		 */
-		XFD_COPYSET(&ClientsWithInput, &LastSelectMask);
-		XFD_COPYSET(&ClientsWithInput, &clientsReadable);
 		break;
 	    }
 	    if (*checkForInput[0] != *checkForInput[1])
@@ -284,8 +280,6 @@ WaitForSomething(int *pClientsReady)
 	}
 	else
 	{
-	    fd_set tmp_set;
-
 	    if (*checkForInput[0] == *checkForInput[1]) {
 	        if (timers)
 	        {
@@ -301,25 +295,8 @@ WaitForSomething(int *pClientsReady)
                         return 0;
 	        }
 	    }
-	    if (someReady)
-		XFD_ORSET(&LastSelectMask, &ClientsWithInput, &LastSelectMask);
-	    if (AnyClientsWriteBlocked && XFD_ANYSET (&clientsWritable))
-	    {
-		NewOutputPending = TRUE;
-		XFD_ORSET(&OutputPending, &clientsWritable, &OutputPending);
-		XFD_UNSET(&ClientsWriteBlocked, &clientsWritable);
-		if (! XFD_ANYSET(&ClientsWriteBlocked))
-		    AnyClientsWriteBlocked = FALSE;
-	    }
-
-	    XFD_ANDSET(&devicesReadable, &LastSelectMask, &EnabledDevices);
-	    XFD_ANDSET(&clientsReadable, &LastSelectMask, &AllClients); 
-	    XFD_ANDSET(&tmp_set, &LastSelectMask, &WellKnownConnections);
-	    if (XFD_ANYSET(&tmp_set))
-		QueueWorkProc(EstablishNewConnections, NULL,
-			      (pointer)&LastSelectMask);
 
-	    if (XFD_ANYSET (&devicesReadable) || XFD_ANYSET (&clientsReadable))
+	    if (devicesReady || AnyClientsReady())
 		break;
 	    /* check here for DDXes that queue events during Block/Wakeup */
 	    if (*checkForInput[0] != *checkForInput[1])
@@ -328,66 +305,41 @@ WaitForSomething(int *pClientsReady)
     }
 
     nready = 0;
-    if (XFD_ANYSET (&clientsReadable))
+    list_for_each_entry(oc, &ReadyClients, ready)
     {
-#ifndef WIN32
-	for (i=0; i<howmany(XFD_SETSIZE, NFDBITS); i++)
+	int client_priority, client_index;
+
+	if (!ListeningToClient(oc->client))
+	    continue;
+	client_index = oc->client->index;
+	/*  We implement "strict" priorities.
+	 *  Only the highest priority client is returned to
+	 *  dix.  If multiple clients at the same priority are
+	 *  ready, they are all returned.  This means that an
+	 *  aggressive client could take over the server.
+	 *  This was not considered a big problem because
+	 *  aggressive clients can hose the server in so many 
+	 *  other ways :)
+	 */
+	client_priority = oc->client->priority;
+	if (nready == 0 || client_priority > highest_priority)
 	{
-	    int highest_priority = 0;
-
-	    while (clientsReadable.fds_bits[i])
-	    {
-	        int client_priority, client_index;
-
-		curclient = mffs (clientsReadable.fds_bits[i]) - 1;
-		client_index = /* raphael: modified */
-			ConnectionTranslation[curclient + (i * (sizeof(fd_mask) * 8))];
-#else
-	int highest_priority = 0;
-	fd_set savedClientsReadable;
-	XFD_COPYSET(&clientsReadable, &savedClientsReadable);
-	for (i = 0; i < XFD_SETCOUNT(&savedClientsReadable); i++)
+	    /*  Either we found the first client, or we found
+	     *  a client whose priority is greater than all others
+	     *  that have been found so far.  Either way, we want 
+	     *  to initialize the list of clients to contain just
+	     *  this client.
+	     */
+	    pClientsReady[0] = client_index;
+	    highest_priority = client_priority;
+	    nready = 1;
+	}
+	/*  the following if makes sure that multiple same-priority 
+	 *  clients get batched together
+	 */
+	else if (client_priority == highest_priority)
 	{
-	    int client_priority, client_index;
-
-	    curclient = XFD_FD(&savedClientsReadable, i);
-	    client_index = GetConnectionTranslation(curclient);
-#endif
-		/*  We implement "strict" priorities.
-		 *  Only the highest priority client is returned to
-		 *  dix.  If multiple clients at the same priority are
-		 *  ready, they are all returned.  This means that an
-		 *  aggressive client could take over the server.
-		 *  This was not considered a big problem because
-		 *  aggressive clients can hose the server in so many 
-		 *  other ways :)
-		 */
-		client_priority = clients[client_index]->priority;
-		if (nready == 0 || client_priority > highest_priority)
-		{
-		    /*  Either we found the first client, or we found
-		     *  a client whose priority is greater than all others
-		     *  that have been found so far.  Either way, we want 
-		     *  to initialize the list of clients to contain just
-		     *  this client.
-		     */
-		    pClientsReady[0] = client_index;
-		    highest_priority = client_priority;
-		    nready = 1;
-		}
-		/*  the following if makes sure that multiple same-priority 
-		 *  clients get batched together
-		 */
-		else if (client_priority == highest_priority)
-		{
-		    pClientsReady[nready++] = client_index;
-		}
-#ifndef WIN32
-		clientsReadable.fds_bits[i] &= ~(((fd_mask)1L) << curclient);
-	    }
-#else
-	    FD_CLR(curclient, &clientsReadable);
-#endif
+	    pClientsReady[nready++] = client_index;
 	}
     }
 
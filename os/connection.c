@@ -102,6 +102,9 @@ SOFTWARE.
 #endif
 
 #include <sys/uio.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #endif /* WIN32 */
 #include "misc.h"		/* for typedef of pointer */
@@ -130,17 +133,20 @@ typedef const char *string;
 
 static int lastfdesc;		/* maximum file descriptor */
 
-fd_set WellKnownConnections;	/* Listener mask */
 fd_set EnabledDevices;		/* mask for input devices that are on */
-fd_set AllSockets;		/* select on this */
-fd_set AllClients;		/* available clients */
-fd_set LastSelectMask;		/* mask returned from last select call */
-fd_set ClientsWithInput;	/* clients with FULL requests in buffer */
-fd_set ClientsWriteBlocked;	/* clients who cannot receive output */
-fd_set OutputPending;		/* clients with reply/event data ready to go */
+fd_set LastSelectMask;		/* general sockets that are readable */
+Bool AnyDevicesReadable;	/* some of them are EnabledDevices */
+struct ospoll *server_poll;	/* everything WaitForSomething waits for */
+struct list ReadyClients = { &ReadyClients, &ReadyClients };
+int NumClientConnections;	/* open client connections */
 int MaxClients = 0;
 Bool NewOutputPending;		/* not yet attempted to write some new output */
-Bool AnyClientsWriteBlocked;	/* true if some client blocked on write */
+
+static fd_set GeneralSockets;	/* added with AddGeneralSocket */
+static int NumGeneralSockets;
+static int *ReadySockets;	/* general sockets set in LastSelectMask */
+static int NumReadySockets;
+static int SizeReadySockets;
 
 static Bool RunFromSmartParent;	/* send SIGUSR1 to parent process */
 Bool RunFromSigStopParent;	/* send SIGSTOP to our own process; Upstart (or
@@ -150,11 +156,6 @@ static Pid_t ParentProcess;
 
 static Bool debug_conns = FALSE;
 
-fd_set IgnoredClientsWithInput;
-static fd_set GrabImperviousClients;
-static fd_set SavedAllClients;
-static fd_set SavedAllSockets;
-static fd_set SavedClientsWithInput;
 int GrabInProgress = 0;
 
 #if !defined(WIN32)
@@ -255,18 +256,136 @@ static int		ListenTransCount;
 
 static void ErrorConnMax(XtransConnInfo /* trans_conn */);
 
-static XtransConnInfo
-lookup_trans_conn (int fd)
+/*
+ * A client is read from unless it is ignored or shut out by another
+ * client's grab.  Its connection is only in the read interest set of
+ * server_poll while that holds.
+ */
+Bool
+ListeningToClient(ClientPtr client)
+{
+    OsCommPtr oc = (OsCommPtr)client->osPrivate;
+
+    if (client->ignoreCount)
+	return FALSE;
+    if (!GrabInProgress || GrabInProgress == client->index)
+	return TRUE;
+    return oc && (oc->flags & OS_COMM_GRAB_IMPERVIOUS);
+}
+
+static void
+SetClientPollInterest(ClientPtr client)
 {
-    if (ListenTransFds)
+    OsCommPtr oc = (OsCommPtr)client->osPrivate;
+
+    if (!oc || !server_poll)
+	return;
+    if (ListeningToClient(client))
+	ospoll_listen(server_poll, oc->fd, X_NOTIFY_READ);
+    else
+	ospoll_mute(server_poll, oc->fd, X_NOTIFY_READ);
+}
+
+/* Resync every client connection when a grab starts or ends */
+static void
+SetClientsPollInterest(void)
+{
+    int i;
+
+    for (i = 1; i < currentMaxClients; i++)
+	if (clients[i])
+	    SetClientPollInterest(clients[i]);
+}
+
+/*
+ * A client stays on ReadyClients while it is ignored or shut out by a
+ * grab, so that it is picked up again as soon as it is listened to.
+ */
+void
+MarkClientReady(OsCommPtr oc)
+{
+    if (oc->flags & OS_COMM_READY)
+	return;
+    list_add(&oc->ready, &ReadyClients);
+    oc->flags |= OS_COMM_READY;
+}
+
+void
+MarkClientNotReady(OsCommPtr oc)
+{
+    if (!(oc->flags & OS_COMM_READY))
+	return;
+    list_del(&oc->ready);
+    oc->flags &= ~OS_COMM_READY;
+}
+
+Bool
+AnyClientsReady(void)
+{
+    OsCommPtr oc;
+
+    list_for_each_entry(oc, &ReadyClients, ready)
+	if (ListeningToClient(oc->client))
+	    return TRUE;
+    return FALSE;
+}
+
+static void
+ClientSocketReady(int fd, int xevents, void *data)
+{
+    OsCommPtr oc = data;
+
+    if ((xevents & X_NOTIFY_WRITE) && (oc->flags & OS_COMM_WRITE_BLOCKED))
     {
-	int i;
-	for (i = 0; i < ListenTransCount; i++)
-	    if (ListenTransFds[i] == fd)
-		return ListenTransConns[i];
+	oc->flags &= ~OS_COMM_WRITE_BLOCKED;
+	ospoll_mute(server_poll, fd, X_NOTIFY_WRITE);
+	MarkOutputPending(oc);
     }
+    if (xevents & X_NOTIFY_READ)
+	MarkClientReady(oc);
+}
 
-    return NULL;
+/*ARGSUSED*/
+static void
+ListenerReady(int fd, int xevents, void *data)
+{
+    QueueWorkProc(EstablishNewConnections, NULL, (pointer)(intptr_t)fd);
+}
+
+static void
+AddListener(int fd)
+{
+    if (ospoll_add(server_poll, fd, ospoll_trigger_level,
+		   ListenerReady, NULL))
+	ospoll_listen(server_poll, fd, X_NOTIFY_READ);
+}
+
+/*
+ * General sockets are reported to the wakeup handlers in LastSelectMask,
+ * which is why they have to stay below FD_SETSIZE.  Only the ones that
+ * were set are cleared again afterwards.
+ */
+/*ARGSUSED*/
+static void
+GeneralSocketReady(int fd, int xevents, void *data)
+{
+    if (FD_ISSET(fd, &LastSelectMask))
+	return;
+    FD_SET(fd, &LastSelectMask);
+    ReadySockets[NumReadySockets++] = fd;
+    if (FD_ISSET(fd, &EnabledDevices))
+	AnyDevicesReadable = TRUE;
+}
+
+void
+ResetReadySockets(void)
+{
+    int i;
+
+    for (i = 0; i < NumReadySockets; i++)
+	FD_CLR(ReadySockets[i], &LastSelectMask);
+    NumReadySockets = 0;
+    AnyDevicesReadable = FALSE;
 }
 
 /* Set MaxClients and lastfdesc, and allocate ConnectionTranslation */
@@ -276,6 +395,24 @@ InitConnectionLimits(void)
 {
     lastfdesc = -1;
 
+#if defined(RLIMIT_NOFILE) && !defined(WIN32)
+    /* Every client needs a descriptor, so make room for -maxclients
+     * as far as the hard limit lets us. */
+    {
+	struct rlimit rlim;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 &&
+	    rlim.rlim_cur != RLIM_INFINITY &&
+	    rlim.rlim_cur < LimitClients + RESERVED_FDS)
+	{
+	    rlim.rlim_cur = LimitClients + RESERVED_FDS;
+	    if (rlim.rlim_max != RLIM_INFINITY && rlim.rlim_cur > rlim.rlim_max)
+		rlim.rlim_cur = rlim.rlim_max;
+	    (void) setrlimit(RLIMIT_NOFILE, &rlim);
+	}
+    }
+#endif
+
 #ifndef __CYGWIN__
 
 #if !defined(XNO_SYSCONF) && defined(_SC_OPEN_MAX)
@@ -298,14 +435,25 @@ InitConnectionLimits(void)
     if (lastfdesc < 0)
 	lastfdesc = MAXSOCKS;
 
+#if defined(WIN32) || !defined(HAVE_EPOLL_CREATE1)
+    /* Only the select backend is there to wait for clients */
     if (lastfdesc > MAXSELECT)
 	lastfdesc = MAXSELECT;
+#endif
 
-    if (lastfdesc > MAXCLIENTS)
+    /* Only an explicit -maxclients may ask for more than we can have.
+     * Client descriptors come after the ones the server opens itself. */
+    if (LimitClients != LIMITCLIENTS &&
+	lastfdesc + 1 < LimitClients + RESERVED_FDS)
+	FatalError("maxclients %d needs %d file descriptors, only %d are "
+		   "available\n", LimitClients, LimitClients + RESERVED_FDS,
+		   lastfdesc + 1);
+
+    if (lastfdesc > LimitClients + RESERVED_FDS)
     {
-	lastfdesc = MAXCLIENTS;
+	lastfdesc = LimitClients + RESERVED_FDS;
 	if (debug_conns)
-	    ErrorF( "REACHED MAXIMUM CLIENTS LIMIT %d\n", MAXCLIENTS);
+	    ErrorF( "REACHED MAXIMUM CLIENTS LIMIT %d\n", LimitClients);
     }
     MaxClients = lastfdesc;
 
@@ -373,18 +521,14 @@ CreateWellKnownSockets(void)
     int		partial;
     char 	port[20];
 
-    FD_ZERO(&AllSockets);
-    FD_ZERO(&AllClients);
-    FD_ZERO(&LastSelectMask);
-    FD_ZERO(&ClientsWithInput);
-
 #if !defined(WIN32)
     for (i=0; i<MaxClients; i++) ConnectionTranslation[i] = 0;
 #else
     ClearConnectionTranslation();
 #endif
 
-    FD_ZERO (&WellKnownConnections);
+    if (!server_poll && !(server_poll = ospoll_create(NULL)))
+	FatalError ("Cannot initialize the connection poll set");
 
     sprintf (port, "%d", atoi (display));
 
@@ -405,7 +549,6 @@ CreateWellKnownSockets(void)
 		int fd = _XSERVTransGetConnectionNumber (ListenTransConns[i]);
 		
 		ListenTransFds[i] = fd;
-		FD_SET (fd, &WellKnownConnections);
 
 		if (!_XSERVTransIsLocal (ListenTransConns[i]))
 		{
@@ -415,7 +558,7 @@ CreateWellKnownSockets(void)
 	}
     }
 
-    if (!XFD_ANYSET (&WellKnownConnections))
+    if (ListenTransCount < 1)
         FatalError ("Cannot establish any listening sockets - Make sure an X server isn't already running");
 #if !defined(WIN32)
     OsSignal (SIGPIPE, SIG_IGN);
@@ -423,7 +566,8 @@ CreateWellKnownSockets(void)
 #endif
     OsSignal (SIGINT, GiveUp);
     OsSignal (SIGTERM, GiveUp);
-    XFD_COPYSET (&WellKnownConnections, &AllSockets);
+    for (i = 0; i < ListenTransCount; i++)
+	AddListener(ListenTransFds[i]);
     ResetHosts(display);
 
     InitParentProcess();
@@ -453,7 +597,7 @@ ResetWellKnownSockets (void)
 		 * Remove it from out list.
 		 */
 
-		FD_CLR (ListenTransFds[i], &WellKnownConnections);
+		ospoll_remove(server_poll, ListenTransFds[i]);
 		ListenTransFds[i] = ListenTransFds[ListenTransCount - 1];
 		ListenTransConns[i] = ListenTransConns[ListenTransCount - 1];
 		ListenTransCount -= 1;
@@ -467,9 +611,9 @@ ResetWellKnownSockets (void)
 
 		int newfd = _XSERVTransGetConnectionNumber (ListenTransConns[i]);
 
-		FD_CLR (ListenTransFds[i], &WellKnownConnections);
+		ospoll_remove(server_poll, ListenTransFds[i]);
 		ListenTransFds[i] = newfd;
-		FD_SET(newfd, &WellKnownConnections);
+		AddListener(newfd);
 	    }
 	}
     }
@@ -718,6 +862,22 @@ ClientAuthorized(ClientPtr client,
     return((char *)NULL);
 }
 
+#ifdef FD_PASSING
+/*
+ * Descriptors can only be passed over unix domain sockets.
+ */
+static Bool
+ConnectionPassesFds(int fd)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+
+    if (getsockname(fd, (struct sockaddr *) &addr, &len) < 0)
+	return FALSE;
+    return addr.ss_family == AF_UNIX;
+}
+#endif
+
 static ClientPtr
 AllocNewConnection (XtransConnInfo trans_conn, int fd, CARD32 conn_time)
 {
@@ -728,40 +888,46 @@ AllocNewConnection (XtransConnInfo trans_conn, int fd, CARD32 conn_time)
 #ifndef WIN32
 	fd >= lastfdesc
 #else
-	XFD_SETCOUNT(&AllClients) >= MaxClients
+	NumClientConnections >= MaxClients
 #endif
 	)
 	return NullClient;
     oc = malloc(sizeof(OsCommRec));
     if (!oc)
 	return NullClient;
+    if (!ospoll_add(server_poll, fd, ospoll_trigger_level,
+		    ClientSocketReady, oc))
+    {
+	free(oc);
+	return NullClient;
+    }
     oc->trans_conn = trans_conn;
     oc->fd = fd;
     oc->input = (ConnectionInputPtr)NULL;
     oc->output = (ConnectionOutputPtr)NULL;
     oc->auth_id = None;
     oc->conn_time = conn_time;
+    oc->flags = 0;
     if (!(client = NextAvailableClient((pointer)oc)))
     {
+	ospoll_remove(server_poll, fd);
 	free(oc);
 	return NullClient;
     }
+    oc->client = client;
     oc->local_client = ComputeLocalClient(client);
+#ifdef FD_PASSING
+    oc->fd_passing = ConnectionPassesFds(fd);
+    oc->recv_fd_count = 0;
+    oc->send_fd_count = 0;
+#endif
 #if !defined(WIN32)
     ConnectionTranslation[fd] = client->index;
 #else
     SetConnectionTranslation(fd, client->index);
 #endif
-    if (GrabInProgress)
-    {
-        FD_SET(fd, &SavedAllClients);
-        FD_SET(fd, &SavedAllSockets);
-    }
-    else
-    {
-        FD_SET(fd, &AllClients);
-        FD_SET(fd, &AllSockets);
-    }
+    NumClientConnections++;
+    SetClientPollInterest(client);
 
 #ifdef DEBUG
     ErrorF("AllocNewConnection: client index = %d, socket fd = %d\n",
@@ -776,28 +942,29 @@ AllocNewConnection (XtransConnInfo trans_conn, int fd, CARD32 conn_time)
 
 /*****************
  * EstablishNewConnections
- *    If anyone is waiting on listened sockets, accept them.
- *    Returns a mask with indices of new clients.  Updates AllClients
- *    and AllSockets.
+ *    Accept a new client on the listener that is ready, closure holds
+ *    its file descriptor.  Listened to unless a grab is in progress.
  *****************/
 
 /*ARGSUSED*/
 Bool
 EstablishNewConnections(ClientPtr clientUnused, pointer closure)
 {
-    fd_set  readyconnections;     /* set of listeners that are ready */
-    int curconn;                  /* fd of listener that's ready */
+    int curconn = (int)(intptr_t)closure; /* fd of listener that's ready */
     register int newconn;         /* fd of new client */
     CARD32 connect_time;
     register int i;
     register ClientPtr client;
     register OsCommPtr oc;
-    fd_set tmask;
+    XtransConnInfo trans_conn, new_trans_conn;
+    int status;
 
-    XFD_ANDSET (&tmask, (fd_set*)closure, &WellKnownConnections);
-    XFD_COPYSET(&tmask, &readyconnections);
-    if (!XFD_ANYSET(&readyconnections))
+    for (i = 0; i < ListenTransCount; i++)
+	if (ListenTransFds[i] == curconn)
+	    break;
+    if (i == ListenTransCount)
 	return TRUE;
+    trans_conn = ListenTransConns[i];
     connect_time = GetTimeInMillis();
     /* kill off stragglers */
     for (i=1; i<currentMaxClients; i++)
@@ -811,59 +978,34 @@ EstablishNewConnections(ClientPtr clientUnused, pointer closure)
 		CloseDownClient(client);     
 	}
     }
-#ifndef WIN32
-    for (i = 0; i < howmany(XFD_SETSIZE, NFDBITS); i++)
-    {
-      while (readyconnections.fds_bits[i])
-#else
-      for (i = 0; i < XFD_SETCOUNT(&readyconnections); i++) 
-#endif
-      {
-	XtransConnInfo trans_conn, new_trans_conn;
-	int status;
 
-#ifndef WIN32
-	curconn = mffs (readyconnections.fds_bits[i]) - 1;
-	readyconnections.fds_bits[i] &= ~((fd_mask)1 << curconn);
-	curconn += (i * (sizeof(fd_mask)*8));
-#else
-	curconn = XFD_FD(&readyconnections, i);
-#endif
-
-	if ((trans_conn = lookup_trans_conn (curconn)) == NULL)
-	    continue;
-
-	if ((new_trans_conn = _XSERVTransAccept (trans_conn, &status)) == NULL)
-	    continue;
+    if ((new_trans_conn = _XSERVTransAccept (trans_conn, &status)) == NULL)
+	return TRUE;
 
-	newconn = _XSERVTransGetConnectionNumber (new_trans_conn);
+    newconn = _XSERVTransGetConnectionNumber (new_trans_conn);
 
-	if (newconn < lastfdesc)
-	{
-		int clientid;
+    if (newconn < lastfdesc)
+    {
+	int clientid;
 #if !defined(WIN32)
-  		clientid = ConnectionTranslation[newconn];
+	clientid = ConnectionTranslation[newconn];
 #else
-  		clientid = GetConnectionTranslation(newconn);
+	clientid = GetConnectionTranslation(newconn);
 #endif
-		if(clientid && (client = clients[clientid]))
- 			CloseDownClient(client);
-	}
+	if(clientid && (client = clients[clientid]))
+	    CloseDownClient(client);
+    }
 
-	_XSERVTransSetOption(new_trans_conn, TRANS_NONBLOCKING, 1);
+    _XSERVTransSetOption(new_trans_conn, TRANS_NONBLOCKING, 1);
 
-	if(trans_conn->flags & TRANS_NOXAUTH)
-	    new_trans_conn->flags = new_trans_conn->flags | TRANS_NOXAUTH;
+    if(trans_conn->flags & TRANS_NOXAUTH)
+	new_trans_conn->flags = new_trans_conn->flags | TRANS_NOXAUTH;
 
-	if (!AllocNewConnection (new_trans_conn, newconn, connect_time))
-	{
-	    ErrorConnMax(new_trans_conn);
-	    _XSERVTransClose(new_trans_conn);
-	}
-      }
-#ifndef WIN32
+    if (!AllocNewConnection (new_trans_conn, newconn, connect_time))
+    {
+	ErrorConnMax(new_trans_conn);
+	_XSERVTransClose(new_trans_conn);
     }
-#endif
     return TRUE;
 }
 
@@ -883,16 +1025,28 @@ ErrorConnMax(XtransConnInfo trans_conn)
     struct iovec iov[3];
     char byteOrder = 0;
     int whichbyte = 1;
+#ifndef WIN32
+    struct pollfd pfd;
+#else
     struct timeval waittime;
     fd_set mask;
+#endif
 
     /* if these seems like a lot of trouble to go to, it probably is */
+#ifndef WIN32
+    /* the descriptor may well be past FD_SETSIZE */
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    (void)poll(&pfd, 1, BOTIMEOUT);
+#else
     waittime.tv_sec = BOTIMEOUT / MILLI_PER_SECOND;
     waittime.tv_usec = (BOTIMEOUT % MILLI_PER_SECOND) *
 		       (1000000 / MILLI_PER_SECOND);
     FD_ZERO(&mask);
     FD_SET(fd, &mask);
     (void)Select(fd + 1, &mask, NULL, NULL, &waittime);
+#endif
     /* try to read the byte-order of the connection */
     (void)_XSERVTransRead(trans_conn, &byteOrder, 1);
     if ((byteOrder == 'l') || (byteOrder == 'B'))
@@ -929,6 +1083,7 @@ CloseDownFileDescriptor(OsCommPtr oc)
 {
     int connection = oc->fd;
 
+    ospoll_remove(server_poll, connection);
     if (oc->trans_conn) {
 	_XSERVTransDisconnect(oc->trans_conn);
 	_XSERVTransClose(oc->trans_conn);
@@ -938,89 +1093,58 @@ CloseDownFileDescriptor(OsCommPtr oc)
 #else
     SetConnectionTranslation(connection, 0);
 #endif    
-    FD_CLR(connection, &AllSockets);
-    FD_CLR(connection, &AllClients);
-    FD_CLR(connection, &ClientsWithInput);
-    FD_CLR(connection, &GrabImperviousClients);
-    if (GrabInProgress)
-    {
-	FD_CLR(connection, &SavedAllSockets);
-	FD_CLR(connection, &SavedAllClients);
-	FD_CLR(connection, &SavedClientsWithInput);
-    }
-    FD_CLR(connection, &ClientsWriteBlocked);
-    if (!XFD_ANYSET(&ClientsWriteBlocked))
-    	AnyClientsWriteBlocked = FALSE;
-    FD_CLR(connection, &OutputPending);
+    MarkClientNotReady(oc);
+    ClearOutputPending(oc);
+    oc->flags = 0;
+    NumClientConnections--;
 }
 
 /*****************
  * CheckConnections
  *    Some connection has died, go find which one and shut it down 
- *    The file descriptor has been closed, but is still in AllClients.
- *    If would truly be wonderful if select() would put the bogus
- *    file descriptors in the exception mask, but nooooo.  So we have
- *    to check each and every socket individually.
+ *    The file descriptor has been closed, but the client is still
+ *    around, so check each and every connection individually.
  *****************/
 
 void
 CheckConnections(void)
 {
-#ifndef WIN32
-    fd_mask		mask;
-#endif
-    fd_set		tmask; 
-    int			curclient, curoff;
     int			i;
+#ifdef WIN32
+    fd_set		tmask; 
     struct timeval	notime;
     int r;
-#ifdef WIN32
-    fd_set savedAllClients;
-#endif
 
     notime.tv_sec = 0;
     notime.tv_usec = 0;
+#endif
 
-#ifndef WIN32
-    for (i=0; i<howmany(XFD_SETSIZE, NFDBITS); i++)
+    for (i = 1; i < currentMaxClients; i++)
     {
-	mask = AllClients.fds_bits[i];
-        while (mask)
-    	{
-	    curoff = mffs (mask) - 1;
-	    curclient = curoff + (i * (sizeof(fd_mask)*8));
-            FD_ZERO(&tmask);
-            FD_SET(curclient, &tmask);
-            do {
-                r = Select (curclient + 1, &tmask, NULL, NULL, &notime);
-            } while (r < 0 && (errno == EINTR || errno == EAGAIN));
-            if (r < 0)
-                if (ConnectionTranslation[curclient] > 0)
-                    CloseDownClient(clients[ConnectionTranslation[curclient]]);
-	    mask &= ~((fd_mask)1 << curoff);
-	}
-    }	
+	ClientPtr client = clients[i];
+	OsCommPtr oc;
+
+	if (!client || !(oc = (OsCommPtr)client->osPrivate))
+	    continue;
+#ifndef WIN32
+	if (fcntl(oc->fd, F_GETFD) < 0 && errno == EBADF)
+	    CloseDownClient(client);
 #else
-    XFD_COPYSET(&AllClients, &savedAllClients);
-    for (i = 0; i < XFD_SETCOUNT(&savedAllClients); i++)
-    {
-	curclient = XFD_FD(&savedAllClients, i);
 	FD_ZERO(&tmask);
-	FD_SET(curclient, &tmask);
-        do {
-            r = Select (curclient + 1, &tmask, NULL, NULL, &notime);
-        } while (r < 0 && (errno == EINTR || errno == EAGAIN));
+	FD_SET(oc->fd, &tmask);
+	do {
+	    r = Select (oc->fd + 1, &tmask, NULL, NULL, &notime);
+	} while (r < 0 && (errno == EINTR || errno == EAGAIN));
 	if (r < 0)
-            if (GetConnectionTranslation(curclient) > 0)
-                CloseDownClient(clients[GetConnectionTranslation(curclient)]);
-    }	
+	    CloseDownClient(client);
 #endif
+    }
 }
 
 
 /*****************
  * CloseDownConnection
- *    Delete client from AllClients and free resources 
+ *    Stop waiting for the client and free resources 
  *****************/
 
 void
@@ -1031,7 +1155,7 @@ CloseDownConnection(ClientPtr client)
     if (FlushCallback)
 	CallCallbacks(&FlushCallback, NULL);
 
-    if (oc->output && oc->output->count)
+    if (oc->output && (oc->output->count || oc->output->segments))
 	FlushClient(client, oc, (char *)NULL, 0);
 #ifdef XDMCP
     XdmcpCloseDisplay(oc->fd);
@@ -1047,24 +1171,47 @@ CloseDownConnection(ClientPtr client)
 void
 AddGeneralSocket(int fd)
 {
-    FD_SET(fd, &AllSockets);
-    if (GrabInProgress)
-	FD_SET(fd, &SavedAllSockets);
+#ifndef WIN32
+    if (fd >= FD_SETSIZE)
+    {
+	ErrorF("AddGeneralSocket: descriptor %d does not fit the wakeup "
+	       "mask\n", fd);
+	return;
+    }
+#endif
+    if (FD_ISSET(fd, &GeneralSockets))
+	return;
+    if (!ospoll_add(server_poll, fd, ospoll_trigger_level,
+		    GeneralSocketReady, NULL))
+	return;
+    ospoll_listen(server_poll, fd, X_NOTIFY_READ);
+    FD_SET(fd, &GeneralSockets);
+    NumGeneralSockets++;
+    /* never shrunk, what was ready before a removal still has to fit */
+    if (NumGeneralSockets > SizeReadySockets)
+    {
+	SizeReadySockets = NumGeneralSockets;
+	ReadySockets = xnfrealloc(ReadySockets, SizeReadySockets * sizeof(int));
+    }
 }
 
 void
 AddEnabledDevice(int fd)
 {
-    FD_SET(fd, &EnabledDevices);
     AddGeneralSocket(fd);
+    if (FD_ISSET(fd, &GeneralSockets))
+	FD_SET(fd, &EnabledDevices);
 }
 
 void
 RemoveGeneralSocket(int fd)
 {
-    FD_CLR(fd, &AllSockets);
-    if (GrabInProgress)
-	FD_CLR(fd, &SavedAllSockets);
+    if (!FD_ISSET(fd, &GeneralSockets))
+	return;
+    ospoll_remove(server_poll, fd);
+    FD_CLR(fd, &GeneralSockets);
+    FD_CLR(fd, &EnabledDevices);
+    NumGeneralSockets--;
 }
 
 void
@@ -1078,17 +1225,16 @@ RemoveEnabledDevice(int fd)
  * OnlyListenToOneClient:
  *    Only accept requests from  one client.  Continue to handle new
  *    connections, but don't take any protocol requests from the new
- *    ones.  Note that if GrabInProgress is set, EstablishNewConnections
- *    needs to put new clients into SavedAllSockets and SavedAllClients.
- *    Note also that there is no timeout for this in the protocol.
+ *    ones, or from anyone else who is not impervious to grabs.  Their
+ *    buffered requests wait on ReadyClients.  Note also that there is no
+ *    timeout for this in the protocol.
  *    This routine is "undone" by ListenToAllClients()
  *****************/
 
 int
 OnlyListenToOneClient(ClientPtr client)
 {
-    OsCommPtr oc = (OsCommPtr)client->osPrivate;
-    int rc, connection = oc->fd;
+    int rc;
 
     rc = XaceHook(XACE_SERVER_ACCESS, client, DixGrabAccess);
     if (rc != Success)
@@ -1096,22 +1242,8 @@ OnlyListenToOneClient(ClientPtr client)
 
     if (! GrabInProgress)
     {
-	XFD_COPYSET(&ClientsWithInput, &SavedClientsWithInput);
-	XFD_ANDSET(&ClientsWithInput,
-		       &ClientsWithInput, &GrabImperviousClients);
-	if (FD_ISSET(connection, &SavedClientsWithInput))
-	{
-	    FD_CLR(connection, &SavedClientsWithInput);
-	    FD_SET(connection, &ClientsWithInput);
-	}
-	XFD_UNSET(&SavedClientsWithInput, &GrabImperviousClients);
-	XFD_COPYSET(&AllSockets, &SavedAllSockets);
-	XFD_COPYSET(&AllClients, &SavedAllClients);
-	XFD_UNSET(&AllSockets, &AllClients);
-	XFD_ANDSET(&AllClients, &AllClients, &GrabImperviousClients);
-	FD_SET(connection, &AllClients);
-	XFD_ORSET(&AllSockets, &AllSockets, &AllClients);
 	GrabInProgress = client->index;
+	SetClientsPollInterest();
     }
     return rc;
 }
@@ -1126,84 +1258,41 @@ ListenToAllClients(void)
 {
     if (GrabInProgress)
     {
-	XFD_ORSET(&AllSockets, &AllSockets, &SavedAllSockets);
-	XFD_ORSET(&AllClients, &AllClients, &SavedAllClients);
-	XFD_ORSET(&ClientsWithInput, &ClientsWithInput, &SavedClientsWithInput);
 	GrabInProgress = 0;
+	SetClientsPollInterest();
     }	
 }
 
 /****************
  * IgnoreClient
- *    Removes one client from input masks.
+ *    Stops reading from one client.
  *    Must have cooresponding call to AttendClient.
  ****************/
 
 void
 IgnoreClient (ClientPtr client)
 {
-    OsCommPtr oc = (OsCommPtr)client->osPrivate;
-    int connection = oc->fd;
-
     client->ignoreCount++;
     if (client->ignoreCount > 1)
 	return;
 
     isItTimeToYield = TRUE;
-    if (!GrabInProgress || FD_ISSET(connection, &AllClients))
-    {
-    	if (FD_ISSET (connection, &ClientsWithInput))
-	    FD_SET(connection, &IgnoredClientsWithInput);
-    	else
-	    FD_CLR(connection, &IgnoredClientsWithInput);
-    	FD_CLR(connection, &ClientsWithInput);
-    	FD_CLR(connection, &AllSockets);
-    	FD_CLR(connection, &AllClients);
-	FD_CLR(connection, &LastSelectMask);
-    }
-    else
-    {
-    	if (FD_ISSET (connection, &SavedClientsWithInput))
-	    FD_SET(connection, &IgnoredClientsWithInput);
-    	else
-	    FD_CLR(connection, &IgnoredClientsWithInput);
-	FD_CLR(connection, &SavedClientsWithInput);
-	FD_CLR(connection, &SavedAllSockets);
-	FD_CLR(connection, &SavedAllClients);
-    }
+    SetClientPollInterest(client);
 }
 
 /****************
  * AttendClient
- *    Adds one client back into the input masks.
+ *    Starts reading from one client again.
  ****************/
 
 void
 AttendClient (ClientPtr client)
 {
-    OsCommPtr oc = (OsCommPtr)client->osPrivate;
-    int connection = oc->fd;
-
     client->ignoreCount--;
     if (client->ignoreCount)
 	return;
 
-    if (!GrabInProgress || GrabInProgress == client->index ||
-	FD_ISSET(connection, &GrabImperviousClients))
-    {
-    	FD_SET(connection, &AllClients);
-    	FD_SET(connection, &AllSockets);
-	FD_SET(connection, &LastSelectMask);
-    	if (FD_ISSET (connection, &IgnoredClientsWithInput))
-	    FD_SET(connection, &ClientsWithInput);
-    }
-    else
-    {
-	FD_SET(connection, &SavedAllClients);
-	FD_SET(connection, &SavedAllSockets);
-	if (FD_ISSET(connection, &IgnoredClientsWithInput))
-	    FD_SET(connection, &SavedClientsWithInput);
-    }
+    SetClientPollInterest(client);
 }
 
 /* make client impervious to grabs; assume only executing client calls this */
@@ -1212,9 +1301,9 @@ void
 MakeClientGrabImpervious(ClientPtr client)
 {
     OsCommPtr oc = (OsCommPtr)client->osPrivate;
-    int connection = oc->fd;
 
-    FD_SET(connection, &GrabImperviousClients);
+    oc->flags |= OS_COMM_GRAB_IMPERVIOUS;
+    SetClientPollInterest(client);
 
     if (ServerGrabCallback)
     {
@@ -1231,18 +1320,11 @@ void
 MakeClientGrabPervious(ClientPtr client)
 {
     OsCommPtr oc = (OsCommPtr)client->osPrivate;
-    int connection = oc->fd;
 
-    FD_CLR(connection, &GrabImperviousClients);
+    oc->flags &= ~OS_COMM_GRAB_IMPERVIOUS;
     if (GrabInProgress && (GrabInProgress != client->index))
     {
-	if (FD_ISSET(connection, &ClientsWithInput))
-	{
-	    FD_SET(connection, &SavedClientsWithInput);
-	    FD_CLR(connection, &ClientsWithInput);
-	}
-	FD_CLR(connection, &AllSockets);
-	FD_CLR(connection, &AllClients);
+	SetClientPollInterest(client);
 	isItTimeToYield = TRUE;
     }
 
@@ -1290,8 +1372,7 @@ void ListenOnOpenFD(int fd, int noxauth) {
     ListenTransConns[ListenTransCount] = ciptr;
     ListenTransFds[ListenTransCount] = fd;
 
-    FD_SET(fd, &WellKnownConnections);
-    FD_SET(fd, &AllSockets);
+    AddListener(fd);
     
     /* Increment the count */
     ListenTransCount++;
@@ -72,6 +72,10 @@ SOFTWARE.
 #if !defined(WIN32)
 #include <sys/uio.h>
 #endif
+#ifdef FD_PASSING
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 #include <X11/X.h>
 #include <X11/Xproto.h>
 #include "os.h"
@@ -80,6 +84,7 @@ SOFTWARE.
 #include "opaque.h"
 #include "dixstruct.h"
 #include "misc.h"
+#include "reqstats.h"
 
 CallbackListPtr       ReplyCallback;
 CallbackListPtr       FlushCallback;
@@ -97,6 +102,11 @@ static ConnectionOutputPtr AllocateOutputBuffer(void);
 #endif
 
 static Bool CriticalOutputPending;
+
+/* Clients with output that FlushAllOutput has yet to try to write */
+static struct list PendingOutputClients = {
+    &PendingOutputClients, &PendingOutputClients
+};
 static int timesThisConnection = 0;
 static ConnectionInputPtr FreeInputs = (ConnectionInputPtr)NULL;
 static ConnectionOutputPtr FreeOutputs = (ConnectionOutputPtr)NULL;
@@ -113,6 +123,38 @@ static OsCommPtr AvailableInput = (OsCommPtr)NULL;
 
 #define MAX_TIMES_PER         10
 
+/* WriteToClientNoCopy copies anything smaller than this */
+#define NOCOPY_MIN_SIZE       BUFSIZE
+/* and flushes once this much output is queued by reference */
+#define NOCOPY_FLUSH_SIZE     (256 * 1024)
+/* iovecs gathered per writev by FlushClient */
+#define MAX_OUTPUT_IOV        16
+
+static char padBuffer[3];
+
+/*
+ * Connection buffers come from a pool of power of two size classes,
+ * BUFSIZE up to BUFSIZE << (BUFFER_CLASSES - 1); bigger ones go straight
+ * to malloc.  Freed buffers are kept on a list per class, and a timer
+ * gives back the ones that sat unused for a whole period, so clients
+ * streaming big requests don't go through malloc every time their
+ * buffers grow and shrink.
+ */
+#define BUFFER_CLASSES        9			/* BUFSIZE .. 1MB */
+#define BUFFER_POOL_PERIOD    10000		/* ms between trims */
+#define BUFFER_POOL_MAX       (8 * 1024 * 1024)	/* bytes kept at most */
+
+typedef struct _bufferClass {
+    pointer free;		/* linked through the first word */
+    int nfree;
+    int lowWater;		/* fewest free since the last trim */
+} BufferClassRec, *BufferClassPtr;
+
+static BufferClassRec BufferClasses[BUFFER_CLASSES];
+static OsTimerPtr BufferPoolTimer;
+static unsigned long BufferPoolGeneration;
+static OsBufferStatsRec BufferStats;
+
 /*
  *   A lot of the code in this file manipulates a ConnectionInputPtr:
  *
@@ -143,6 +185,158 @@ static OsCommPtr AvailableInput = (OsCommPtr)NULL;
  *  counts CARD32's.
  */
 
+#ifdef FD_PASSING
+/*
+ * File descriptors passed as SCM_RIGHTS ancillary data on unix domain
+ * connections.  Received ones are queued on the connection in arrival
+ * order, which is the order of the requests they go with, until the
+ * request handler picks them up with ReadFdFromClient.  Outgoing ones
+ * are attached to the next write, so they arrive no later than the
+ * reply written after them.
+ */
+
+static int
+OsReadFromConnection(OsCommPtr oc, char *buf, int size)
+{
+    union {
+	struct cmsghdr hdr;
+	char buf[CMSG_SPACE(sizeof(int) * OS_MAX_CLIENT_FDS)];
+    } control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    int flags = 0;
+    int result, i, n;
+
+    if (!oc->fd_passing)
+	return _XSERVTransRead(oc->trans_conn, buf, size);
+
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+    result = recvmsg(oc->fd, &msg, flags);
+    if (result <= 0)
+	return result;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+	int *fds = (int *) CMSG_DATA(cmsg);
+
+	if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+	    continue;
+
+	n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+	for (i = 0; i < n; i++)
+	{
+	    if (oc->recv_fd_count < OS_MAX_CLIENT_FDS)
+		oc->recv_fds[oc->recv_fd_count++] = fds[i];
+	    else
+		close(fds[i]);
+	}
+    }
+    return result;
+}
+
+static int
+OsWriteToConnection(OsCommPtr oc, struct iovec *iov, int iovcnt)
+{
+    union {
+	struct cmsghdr hdr;
+	char buf[CMSG_SPACE(sizeof(int) * OS_MAX_CLIENT_FDS)];
+    } control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    int result, i;
+
+    if (!oc->send_fd_count)
+	return _XSERVTransWritev(oc->trans_conn, iov, iovcnt);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * oc->send_fd_count);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * oc->send_fd_count);
+    memcpy(CMSG_DATA(cmsg), oc->send_fds, sizeof(int) * oc->send_fd_count);
+
+    result = sendmsg(oc->fd, &msg, 0);
+    if (result > 0)
+    {
+	for (i = 0; i < oc->send_fd_count; i++)
+	    if (oc->send_fd_close[i])
+		close(oc->send_fds[i]);
+	oc->send_fd_count = 0;
+    }
+    return result;
+}
+
+static void
+OsCloseConnectionFds(OsCommPtr oc)
+{
+    while (oc->recv_fd_count)
+	close(oc->recv_fds[--oc->recv_fd_count]);
+    while (oc->send_fd_count)
+    {
+	oc->send_fd_count--;
+	if (oc->send_fd_close[oc->send_fd_count])
+	    close(oc->send_fds[oc->send_fd_count]);
+    }
+}
+#else
+#define OsReadFromConnection(oc, buf, size) \
+    _XSERVTransRead((oc)->trans_conn, buf, size)
+#define OsWriteToConnection(oc, iov, iovcnt) \
+    _XSERVTransWritev((oc)->trans_conn, iov, iovcnt)
+#endif
+
+int
+ReadFdFromClient(ClientPtr client)
+{
+#ifdef FD_PASSING
+    OsCommPtr oc = (OsCommPtr)client->osPrivate;
+    int fd;
+
+    if (!oc || !oc->recv_fd_count)
+	return -1;
+
+    fd = oc->recv_fds[0];
+    oc->recv_fd_count--;
+    memmove(oc->recv_fds, oc->recv_fds + 1, oc->recv_fd_count * sizeof(int));
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+int
+WriteFdToClient(ClientPtr client, int fd, Bool do_close)
+{
+#ifdef FD_PASSING
+    OsCommPtr oc = (OsCommPtr)client->osPrivate;
+
+    if (!oc || !oc->fd_passing || oc->send_fd_count == OS_MAX_CLIENT_FDS)
+	return -1;
+
+    oc->send_fds[oc->send_fd_count] = fd;
+    oc->send_fd_close[oc->send_fd_count] = do_close;
+    oc->send_fd_count++;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 
 /*****************************************************************
  * ReadRequestFromClient
@@ -162,14 +356,212 @@ static OsCommPtr AvailableInput = (OsCommPtr)NULL;
  *    are zero and the following 4 bytes are the request length.
  *
  *    Note: in order to make the server scheduler (WaitForSomething())
- *    "fair", the ClientsWithInput mask is used.  This mask tells which
- *    clients have FULL requests left in their buffers.  Clients with
+ *    "fair", the ReadyClients list is used.  Clients stay on it while
+ *    they have FULL requests left in their buffers.  Clients with
  *    partial requests require a read.  Basically, client buffers
- *    are drained before select() is called again.  But, we can't keep
+ *    are drained before the connections are polled again.  But, we can't keep
  *    reading from a client that is sending buckets of data (or has
  *    a partial request) because others clients need to be scheduled.
  *****************************************************************/
 
+static int
+BufferClass(int size)
+{
+    int c = 0;
+
+    while (c < BUFFER_CLASSES && (BUFSIZE << c) < size)
+	c++;
+    return c;
+}
+
+static void
+PopBuffer(BufferClassPtr bc, int size)
+{
+    char *buf = bc->free;
+
+    bc->free = *(pointer *)buf;
+    bc->nfree--;
+    BufferStats.pooled--;
+    BufferStats.pooledBytes -= size;
+    free(buf);
+    BufferStats.frees++;
+}
+
+static CARD32
+BufferPoolTimeout(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    BufferClassPtr bc;
+    int c;
+
+    /* Whatever stayed in a class for the whole period isn't needed */
+    for (c = 0; c < BUFFER_CLASSES; c++)
+    {
+	bc = &BufferClasses[c];
+	while (bc->lowWater > 0)
+	{
+	    PopBuffer(bc, BUFSIZE << c);
+	    bc->lowWater--;
+	}
+	bc->lowWater = bc->nfree;
+    }
+    if (BufferStats.pooled)
+	return BUFFER_POOL_PERIOD;
+    TimerFree(timer);
+    BufferPoolTimer = NULL;
+    return 0;
+}
+
+static void
+CancelBufferPoolTimer(void)
+{
+    /* TimerInit has already freed it if the server was reset */
+    if (BufferPoolGeneration != serverGeneration)
+	BufferPoolTimer = NULL;
+    TimerFree(BufferPoolTimer);
+    BufferPoolTimer = NULL;
+}
+
+/*
+ * Returns a buffer of at least *size bytes, setting *size to the actual
+ * size, which is what has to be passed back to FreeBuffer.
+ */
+static char *
+AllocBuffer(int *size)
+{
+    int c = BufferClass(*size);
+    BufferClassPtr bc;
+    char *buf;
+
+    BufferStats.requests++;
+    if (c < BUFFER_CLASSES)
+    {
+	bc = &BufferClasses[c];
+	*size = BUFSIZE << c;
+	if ((buf = bc->free))
+	{
+	    bc->free = *(pointer *)buf;
+	    if (--bc->nfree < bc->lowWater)
+		bc->lowWater = bc->nfree;
+	    BufferStats.pooled--;
+	    BufferStats.pooledBytes -= *size;
+	    return buf;
+	}
+    }
+    BufferStats.mallocs++;
+    return malloc(*size);
+}
+
+static void
+FreeBuffer(char *buf, int size)
+{
+    int c = BufferClass(size);
+    BufferClassPtr bc;
+
+    if (c == BUFFER_CLASSES ||
+	BufferStats.pooledBytes + size > BUFFER_POOL_MAX)
+    {
+	free(buf);
+	BufferStats.frees++;
+	return;
+    }
+    bc = &BufferClasses[c];
+    *(pointer *)buf = bc->free;
+    bc->free = buf;
+    bc->nfree++;
+    BufferStats.pooled++;
+    BufferStats.pooledBytes += size;
+
+    if (BufferPoolGeneration != serverGeneration)
+	BufferPoolTimer = NULL;
+    if (!BufferPoolTimer)
+    {
+	BufferPoolGeneration = serverGeneration;
+	BufferPoolTimer = TimerSet(NULL, 0, BUFFER_POOL_PERIOD,
+				   BufferPoolTimeout, NULL);
+    }
+}
+
+/*
+ * Replace the buffer of oci with one of at least size bytes, keeping
+ * the first keep bytes of its contents.
+ */
+static Bool
+ResizeInputBuffer(ConnectionInputPtr oci, int size, int keep)
+{
+    char *ibuf;
+
+    if (!(ibuf = AllocBuffer(&size)))
+	return FALSE;
+    memcpy(ibuf, oci->buffer, keep);
+    FreeBuffer(oci->buffer, oci->size);
+    oci->bufptr = ibuf + (oci->bufptr - oci->buffer);
+    oci->buffer = ibuf;
+    oci->size = size;
+    return TRUE;
+}
+
+static void
+DestroyInputBuffer(ConnectionInputPtr oci)
+{
+    FreeBuffer(oci->buffer, oci->size);
+    free(oci);
+}
+
+/*
+ * Put an idle input buffer on FreeInputs for any client to use, after
+ * trading it for a standard size one if it grew past BUFWATERMARK.
+ */
+static void
+ParkInputBuffer(ConnectionInputPtr oci)
+{
+    oci->bufptr = oci->buffer;
+    oci->bufcnt = 0;
+    oci->lenLastReq = 0;
+    if (oci->size > BUFWATERMARK && !ResizeInputBuffer(oci, BUFSIZE, 0))
+    {
+	DestroyInputBuffer(oci);
+	return;
+    }
+    oci->next = FreeInputs;
+    FreeInputs = oci;
+}
+
+static void
+DestroyOutputBuffer(ConnectionOutputPtr oco)
+{
+    FreeBuffer((char *)oco->buf, oco->size);
+    free(oco);
+}
+
+/* Same as ParkInputBuffer, for FreeOutputs */
+static void
+ParkOutputBuffer(ConnectionOutputPtr oco)
+{
+    int size = BUFSIZE;
+    unsigned char *obuf;
+
+    oco->count = 0;
+    if (oco->size > BUFWATERMARK)
+    {
+	if (!(obuf = (unsigned char *)AllocBuffer(&size)))
+	{
+	    DestroyOutputBuffer(oco);
+	    return;
+	}
+	FreeBuffer((char *)oco->buf, oco->size);
+	oco->buf = obuf;
+	oco->size = size;
+    }
+    oco->next = FreeOutputs;
+    FreeOutputs = oco;
+}
+
+void
+GetOsBufferStats(OsBufferStatsPtr stats)
+{
+    *stats = BufferStats;
+}
+
 static void
 YieldControl(void)
 {
@@ -178,10 +570,10 @@ YieldControl(void)
 }
 
 static void
-YieldControlNoInput(int fd)
+YieldControlNoInput(OsCommPtr oc)
 {
     YieldControl();
-    FD_CLR(fd, &ClientsWithInput);
+    MarkClientNotReady(oc);
 }
 
 static void
@@ -195,7 +587,6 @@ ReadRequestFromClient(ClientPtr client)
 {
     OsCommPtr oc = (OsCommPtr)client->osPrivate;
     ConnectionInputPtr oci = oc->input;
-    int fd = oc->fd;
     unsigned int gotnow, needed;
     int result;
     register xReq *request;
@@ -212,17 +603,7 @@ ReadRequestFromClient(ClientPtr client)
     {
 	if (AvailableInput != oc)
 	{
-	    register ConnectionInputPtr aci = AvailableInput->input;
-	    if (aci->size > BUFWATERMARK)
-	    {
-		free(aci->buffer);
-		free(aci);
-	    }
-	    else
-	    {
-		aci->next = FreeInputs;
-		FreeInputs = aci;
-	    }
+	    ParkInputBuffer(AvailableInput->input);
 	    AvailableInput->input = (ConnectionInputPtr)NULL;
 	}
 	AvailableInput = (OsCommPtr)NULL;
@@ -317,22 +698,14 @@ ReadRequestFromClient(ClientPtr client)
 	    if ((gotnow > 0) && (oci->bufptr != oci->buffer))
 		/* save the data we've already read */
 		memmove(oci->buffer, oci->bufptr, gotnow);
-	    if (needed > oci->size)
-	    {
-		/* make buffer bigger to accomodate request */
-		char *ibuf;
-
-		ibuf = (char *)realloc(oci->buffer, needed);
-		if (!ibuf)
-		{
-		    YieldControlDeath();
-		    return -1;
-		}
-		oci->size = needed;
-		oci->buffer = ibuf;
-	    }
 	    oci->bufptr = oci->buffer;
 	    oci->bufcnt = gotnow;
+	    /* make buffer bigger to accomodate request */
+	    if (needed > oci->size && !ResizeInputBuffer(oci, needed, gotnow))
+	    {
+		YieldControlDeath();
+		return -1;
+	    }
 	}
 	/*  XXX this is a workaround.  This function is sometimes called
 	 *  after the trans_conn has been freed.  In this case trans_conn
@@ -347,8 +720,8 @@ ReadRequestFromClient(ClientPtr client)
 	    YieldControlDeath();
 	    return -1;
 	}
-	    result = _XSERVTransRead(oc->trans_conn, oci->buffer + oci->bufcnt,
-				     oci->size - oci->bufcnt); 
+	    result = OsReadFromConnection(oc, oci->buffer + oci->bufcnt,
+					  oci->size - oci->bufcnt);
 	if (result <= 0)
 	{
 	    if ((result < 0) && ETEST(errno))
@@ -357,7 +730,7 @@ ReadRequestFromClient(ClientPtr client)
 		if (0)
 #endif
 		{
-		    YieldControlNoInput(fd);
+		    YieldControlNoInput(oc);
 		    return 0;
 		}
 	    }
@@ -369,17 +742,7 @@ ReadRequestFromClient(ClientPtr client)
 	/* free up some space after huge requests */
 	if ((oci->size > BUFWATERMARK) &&
 	    (oci->bufcnt < BUFSIZE) && (needed < BUFSIZE))
-	{
-	    char *ibuf;
-
-	    ibuf = (char *)realloc(oci->buffer, BUFSIZE);
-	    if (ibuf)
-	    {
-		oci->size = BUFSIZE;
-		oci->buffer = ibuf;
-		oci->bufptr = ibuf + oci->bufcnt - gotnow;
-	    }
-	}
+	    (void)ResizeInputBuffer(oci, BUFSIZE, oci->bufcnt);
 	if (need_header && gotnow >= needed)
 	{
 	    /* We wanted an xReq, now we've gotten it. */
@@ -399,7 +762,7 @@ ReadRequestFromClient(ClientPtr client)
 	if (gotnow < needed)
 	{
 	    /* Still don't have enough; punt. */
-	    YieldControlNoInput(fd);
+	    YieldControlNoInput(oc);
 	    return 0;
 	}
     }
@@ -451,13 +814,13 @@ ReadRequestFromClient(ClientPtr client)
 		 (gotnow >= sizeof(xBigReq) &&
 		  gotnow >= (get_big_req_len(request, client) << 2))))
 	    )
-	    FD_SET(fd, &ClientsWithInput);
+	    MarkClientReady(oc);
 	else
 	{
 	    if (!SmartScheduleDisable)
-		FD_CLR(fd, &ClientsWithInput);
+		MarkClientNotReady(oc);
 	    else
-		YieldControlNoInput(fd);
+		YieldControlNoInput(oc);
 	}
     }
     else
@@ -465,9 +828,9 @@ ReadRequestFromClient(ClientPtr client)
 	if (!gotnow)
 	    AvailableInput = oc;
 	if (!SmartScheduleDisable)
-	    FD_CLR(fd, &ClientsWithInput);
+	    MarkClientNotReady(oc);
 	else
-	    YieldControlNoInput(fd);
+	    YieldControlNoInput(oc);
     }
     if (SmartScheduleDisable)
     if (++timesThisConnection >= MAX_TIMES_PER)
@@ -502,24 +865,13 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
 {
     OsCommPtr oc = (OsCommPtr)client->osPrivate;
     ConnectionInputPtr oci = oc->input;
-    int fd = oc->fd;
     int gotnow, moveup;
 
     if (AvailableInput)
     {
 	if (AvailableInput != oc)
 	{
-	    ConnectionInputPtr aci = AvailableInput->input;
-	    if (aci->size > BUFWATERMARK)
-	    {
-		free(aci->buffer);
-		free(aci);
-	    }
-	    else
-	    {
-		aci->next = FreeInputs;
-		FreeInputs = aci;
-	    }
+	    ParkInputBuffer(AvailableInput->input);
 	    AvailableInput->input = (ConnectionInputPtr)NULL;
 	}
 	AvailableInput = (OsCommPtr)NULL;
@@ -537,14 +889,13 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
     gotnow = oci->bufcnt + oci->buffer - oci->bufptr;
     if ((gotnow + count) > oci->size)
     {
-	char *ibuf;
-
-	ibuf = (char *)realloc(oci->buffer, gotnow + count);
-	if (!ibuf)
+	/* keep the unread data at the front of the new buffer */
+	if (oci->bufptr != oci->buffer)
+	    memmove(oci->buffer, oci->bufptr, gotnow);
+	oci->bufptr = oci->buffer;
+	oci->bufcnt = gotnow;
+	if (!ResizeInputBuffer(oci, gotnow + count, gotnow))
 	    return FALSE;
-	oci->size = gotnow + count;
-	oci->buffer = ibuf;
-	oci->bufptr = ibuf + oci->bufcnt - gotnow;
     }
     moveup = count - (oci->bufptr - oci->buffer);
     if (moveup > 0)
@@ -559,9 +910,9 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
     gotnow += count;
     if ((gotnow >= sizeof(xReq)) &&
 	(gotnow >= (int)(get_req_len((xReq *)oci->bufptr, client) << 2)))
-	FD_SET(fd, &ClientsWithInput);
+	MarkClientReady(oc);
     else
-	YieldControlNoInput(fd);
+	YieldControlNoInput(oc);
     return TRUE;
 }
 
@@ -576,7 +927,6 @@ ResetCurrentRequest(ClientPtr client)
 {
     OsCommPtr oc = (OsCommPtr)client->osPrivate;
     register ConnectionInputPtr oci = oc->input;
-    int fd = oc->fd;
     register xReq *request;
     int gotnow, needed;
     if (AvailableInput == oc)
@@ -585,7 +935,7 @@ ResetCurrentRequest(ClientPtr client)
     gotnow = oci->bufcnt + oci->buffer - oci->bufptr;
     if (gotnow < sizeof(xReq))
     {
-	YieldControlNoInput(fd);
+	YieldControlNoInput(oc);
     }
     else
     {
@@ -603,23 +953,36 @@ ResetCurrentRequest(ClientPtr client)
 	}
 	if (gotnow >= (needed << 2))
 	{
-	    if (FD_ISSET(fd, &AllClients))
-	    {
-		FD_SET(fd, &ClientsWithInput);
-	    }
-	    else
-	    {
-		FD_SET(fd, &IgnoredClientsWithInput);
-	    }
+	    /* ignored clients stay ready for when they are attended */
+	    MarkClientReady(oc);
 	    YieldControl();
 	}
 	else
-	    YieldControlNoInput(fd);
+	    YieldControlNoInput(oc);
     }
 }
 
 static const int padlength[4] = {0, 3, 2, 1};
 
+void
+MarkOutputPending(OsCommPtr oc)
+{
+    NewOutputPending = TRUE;
+    if (oc->flags & OS_COMM_OUTPUT_PENDING)
+	return;
+    list_add(&oc->pending, &PendingOutputClients);
+    oc->flags |= OS_COMM_OUTPUT_PENDING;
+}
+
+void
+ClearOutputPending(OsCommPtr oc)
+{
+    if (!(oc->flags & OS_COMM_OUTPUT_PENDING))
+	return;
+    list_del(&oc->pending);
+    oc->flags &= ~OS_COMM_OUTPUT_PENDING;
+}
+
  /********************
  * FlushAllOutput()
  *    Flush all clients with output.  However, if some client still
@@ -633,14 +996,9 @@ static const int padlength[4] = {0, 3, 2, 1};
 void
 FlushAllOutput(void)
 {
-    register int index, base;
-    register fd_mask mask; /* raphael */
-    OsCommPtr oc;
+    OsCommPtr oc, tmp;
     register ClientPtr client;
     Bool newoutput = NewOutputPending;
-#if defined(WIN32)
-    fd_set newOutputPending;
-#endif
 
     if (FlushCallback)
 	CallCallbacks(&FlushCallback, NULL);
@@ -651,56 +1009,27 @@ FlushAllOutput(void)
     /*
      * It may be that some client still has critical output pending,
      * but he is not yet ready to receive it anyway, so we will
-     * simply wait for the select to tell us when he's ready to receive.
+     * simply wait for the socket to tell us when he's ready to receive.
      */
     CriticalOutputPending = FALSE;
     NewOutputPending = FALSE;
 
-#ifndef WIN32
-    for (base = 0; base < howmany(XFD_SETSIZE, NFDBITS); base++)
+    list_for_each_entry_safe(oc, tmp, &PendingOutputClients, pending)
     {
-	mask = OutputPending.fds_bits[ base ];
-	OutputPending.fds_bits[ base ] = 0;
-	while (mask)
+	client = oc->client;
+	if (client->clientGone)
 	{
-	    index = ffs(mask) - 1;
-	    mask &= ~lowbit(mask);
-	    if ((index = ConnectionTranslation[(base * (sizeof(fd_mask)*8)) + index]) == 0)
-		continue;
-	    client = clients[index];
-	    if (client->clientGone)
-		continue;
-	    oc = (OsCommPtr)client->osPrivate;
-	    if (FD_ISSET(oc->fd, &ClientsWithInput))
-	    {
-		FD_SET(oc->fd, &OutputPending); /* set the bit again */
-		NewOutputPending = TRUE;
-	    }
-	    else
-		(void)FlushClient(client, oc, (char *)NULL, 0);
+	    ClearOutputPending(oc);
+	    continue;
 	}
+	if ((oc->flags & OS_COMM_READY) && ListeningToClient(client))
+	{
+	    NewOutputPending = TRUE; /* leave it for the next time */
+	    continue;
+	}
+	ClearOutputPending(oc);
+	(void)FlushClient(client, oc, (char *)NULL, 0);
     }
-#else  /* WIN32 */
-    FD_ZERO(&newOutputPending);
-    for (base = 0; base < XFD_SETCOUNT(&OutputPending); base++)
-    {
-	    index = XFD_FD(&OutputPending, base);
-	    if ((index = GetConnectionTranslation(index)) == 0)
-		continue;
-	    client = clients[index];
-	    if (client->clientGone)
-		continue;
-	    oc = (OsCommPtr)client->osPrivate;
-	    if (FD_ISSET(oc->fd, &ClientsWithInput))
-	    {
-		FD_SET(oc->fd, &newOutputPending); /* set the bit again */
-		NewOutputPending = TRUE;
-	    }
-	    else
-		(void)FlushClient(client, oc, (char *)NULL, 0);
-    }
-    XFD_COPYSET(&newOutputPending, &OutputPending);
-#endif /* WIN32 */
 }
 
 void
@@ -716,32 +1045,19 @@ SetCriticalOutputPending(void)
     CriticalOutputPending = TRUE;
 }
 
-/*****************
- * WriteToClient
- *    Copies buf into ClientPtr.buf if it fits (with padding), else
- *    flushes ClientPtr.buf and buf to client.  As of this writing,
- *    every use of WriteToClient is cast to void, and the result
- *    is ignored.  Potentially, this could be used by requests
- *    that are sending several chunks of data and want to break
- *    out of a loop on error.  Thus, we will leave the type of
- *    this routine as int.
- *****************/
-
-int
-WriteToClient (ClientPtr who, int count, const void *__buf)
+/*
+ * Common front half of WriteToClient and WriteToClientNoCopy: make sure
+ * the client has an output buffer and let the ReplyCallback see the data.
+ */
+static ConnectionOutputPtr
+PrepareClientOutput(ClientPtr who, const char *buf, int count, int padBytes)
 {
-    OsCommPtr oc;
-    ConnectionOutputPtr oco;
-    int padBytes;
-    const char *buf = __buf;
+    OsCommPtr oc = who->osPrivate;
+    ConnectionOutputPtr oco = oc->output;
+    ReqStatsPtr stats;
 #ifdef DEBUG_COMMUNICATION
     Bool multicount = FALSE;
-#endif
-    if (!count || !who || who == serverClient || who->clientGone)
-	return 0;
-    oc = who->osPrivate;
-    oco = oc->output;
-#ifdef DEBUG_COMMUNICATION
+
     {
 	char info[128];
 	xError *err;
@@ -795,12 +1111,13 @@ WriteToClient (ClientPtr who, int count, const void *__buf)
 		oc->trans_conn = NULL;
 	    }
 	    MarkClientException(who);
-	    return -1;
+	    return NULL;
 	}
 	oc->output = oco;
     }
 
-    padBytes = padlength[count & 3];
+    if ((stats = ClientRequestStats(who)))
+	stats->bytesOut += count + padBytes;
 
     if(ReplyCallback)
     {
@@ -843,27 +1160,264 @@ WriteToClient (ClientPtr who, int count, const void *__buf)
 	}
     }
 #endif
+    return oco;
+}
+
+/*
+ * Start a flush of the client's output from WriteToClient or
+ * WriteToClientNoCopy, taking it off the pending output list first.
+ */
+static int
+FlushClientNow(ClientPtr who, OsCommPtr oc, const char *buf, int count)
+{
+    ClearOutputPending(oc);
+    if (list_is_empty(&PendingOutputClients)) {
+      CriticalOutputPending = FALSE;
+      NewOutputPending = FALSE;
+    }
+
+    if (FlushCallback)
+	CallCallbacks(&FlushCallback, NULL);
+
+    return FlushClient(who, oc, buf, count);
+}
+
+/*****************
+ * WriteToClient
+ *    Copies buf into ClientPtr.buf if it fits (with padding), else
+ *    flushes ClientPtr.buf and buf to client.  As of this writing,
+ *    every use of WriteToClient is cast to void, and the result
+ *    is ignored.  Potentially, this could be used by requests
+ *    that are sending several chunks of data and want to break
+ *    out of a loop on error.  Thus, we will leave the type of
+ *    this routine as int.
+ *****************/
+
+int
+WriteToClient (ClientPtr who, int count, const void *__buf)
+{
+    OsCommPtr oc;
+    ConnectionOutputPtr oco;
+    int padBytes;
+    const char *buf = __buf;
+
+    if (!count || !who || who == serverClient || who->clientGone)
+	return 0;
+    oc = who->osPrivate;
+    padBytes = padlength[count & 3];
+    if (!(oco = PrepareClientOutput(who, buf, count, padBytes)))
+	return -1;
+
     if (oco->count + count + padBytes > oco->size)
+	return FlushClientNow(who, oc, buf, count);
+
+    MarkOutputPending(oc);
+    memmove((char *)oco->buf + oco->count, buf, count);
+    /* pooled buffers may hold anyone's data, don't send it as padding */
+    memset((char *)oco->buf + oco->count + count, 0, padBytes);
+    oco->count += count + padBytes;
+    return count;
+}
+
+/*****************
+ * WriteToClientNoCopy
+ *    Like WriteToClient, but buf is queued by reference instead of
+ *    being copied into the output buffer, and FlushClient writes it
+ *    straight from where it is.  buf must stay valid and unchanged
+ *    until release(closure) is called, which happens exactly once:
+ *    when the data has been written, when the client goes away, or
+ *    right away if buf was small enough to just be copied.  Passing
+ *    free as release hands a malloced reply over to the os layer.
+ *****************/
+
+int
+WriteToClientNoCopy(ClientPtr who, int count, const void *__buf,
+		    ClientWriteReleaseProcPtr release, pointer closure)
+{
+    OsCommPtr oc;
+    ConnectionOutputPtr oco;
+    ConnectionOutputSegmentPtr seg;
+    int padBytes;
+    int ret;
+    const char *buf = __buf;
+
+    /* Below this size the copy is cheaper than tracking a segment */
+    if (count < NOCOPY_MIN_SIZE || !who || who == serverClient ||
+	who->clientGone)
     {
-	FD_CLR(oc->fd, &OutputPending);
-	if(!XFD_ANYSET(&OutputPending)) {
-	  CriticalOutputPending = FALSE;
-	  NewOutputPending = FALSE;
-	}
+	ret = WriteToClient(who, count, buf);
+	(*release)(closure);
+	return ret;
+    }
+    oc = who->osPrivate;
+    padBytes = padlength[count & 3];
+    if (!(oco = PrepareClientOutput(who, buf, count, padBytes)))
+    {
+	(*release)(closure);
+	return -1;
+    }
 
-	if (FlushCallback)
-	    CallCallbacks(&FlushCallback, NULL);
+    if (!(seg = malloc(sizeof(ConnectionOutputSegment))))
+    {
+	/* Fall back to copying, the data has already been accounted for */
+	if (oco->count + count + padBytes > oco->size)
+	    ret = FlushClientNow(who, oc, buf, count);
+	else
+	{
+	    MarkOutputPending(oc);
+	    memmove((char *)oco->buf + oco->count, buf, count);
+	    memset((char *)oco->buf + oco->count + count, 0, padBytes);
+	    oco->count += count + padBytes;
+	    ret = count;
+	}
+	(*release)(closure);
+	return ret;
+    }
+    seg->next = NULL;
+    seg->offset = oco->count;
+    seg->data = buf;
+    seg->count = count;
+    seg->pad = padBytes;
+    seg->release = release;
+    seg->closure = closure;
+    if (oco->lastSegment)
+	oco->lastSegment->next = seg;
+    else
+	oco->segments = seg;
+    oco->lastSegment = seg;
+    oco->segmentBytes += count + padBytes;
 
-	return FlushClient(who, oc, buf, count);
+    /* Don't let referenced data pile up behind a busy client */
+    if (oco->count + oco->segmentBytes > NOCOPY_FLUSH_SIZE)
+    {
+	if (FlushClientNow(who, oc, NULL, 0) < 0)
+	    return -1;
+	return count;
     }
 
-    NewOutputPending = TRUE;
-    FD_SET(oc->fd, &OutputPending);
-    memmove((char *)oco->buf + oco->count, buf, count);
-    oco->count += count + padBytes;
+    MarkOutputPending(oc);
     return count;
 }
 
+/*
+ * Fill iov with the pending output of oco, the copy buffer interleaved
+ * with the queued segments, and set *complete if all of it fitted.
+ */
+static int
+GatherOutput(ConnectionOutputPtr oco, struct iovec *iov, int max,
+	     Bool *complete)
+{
+    ConnectionOutputSegmentPtr seg;
+    int pos = 0;
+    int i = 0;
+
+    *complete = FALSE;
+    for (seg = oco->segments; seg; seg = seg->next)
+    {
+	if (i + 3 > max)
+	    return i;
+	if (seg->offset > pos)
+	{
+	    iov[i].iov_base = (char *)oco->buf + pos;
+	    iov[i].iov_len = seg->offset - pos;
+	    i++;
+	    pos = seg->offset;
+	}
+	if (seg->count)
+	{
+	    iov[i].iov_base = (char *)seg->data;
+	    iov[i].iov_len = seg->count;
+	    i++;
+	}
+	if (seg->pad)
+	{
+	    iov[i].iov_base = padBuffer;
+	    iov[i].iov_len = seg->pad;
+	    i++;
+	}
+    }
+    if (oco->count > pos)
+    {
+	if (i == max)
+	    return i;
+	iov[i].iov_base = (char *)oco->buf + pos;
+	iov[i].iov_len = oco->count - pos;
+	i++;
+    }
+    *complete = TRUE;
+    return i;
+}
+
+/*
+ * Drop the first written bytes of the pending output of oco, releasing
+ * the segments that are done.  Returns how much of written was beyond
+ * the end of the pending output.
+ */
+static long
+ConsumeOutput(ConnectionOutputPtr oco, long written)
+{
+    ConnectionOutputSegmentPtr seg;
+    long bufDone = 0;
+    long len;
+
+    while (written > 0)
+    {
+	seg = oco->segments;
+	len = (seg ? seg->offset : oco->count) - bufDone;
+	if (len > 0)
+	{
+	    if (len > written)
+		len = written;
+	    bufDone += len;
+	    written -= len;
+	    continue;
+	}
+	if (!seg)
+	    break;
+
+	len = min(written, seg->count);
+	seg->data += len;
+	seg->count -= len;
+	written -= len;
+	oco->segmentBytes -= len;
+	len = min(written, seg->pad);
+	seg->pad -= len;
+	written -= len;
+	oco->segmentBytes -= len;
+	if (seg->count || seg->pad)
+	    break;
+
+	if (!(oco->segments = seg->next))
+	    oco->lastSegment = NULL;
+	(*seg->release)(seg->closure);
+	free(seg);
+    }
+
+    if (bufDone)
+    {
+	oco->count -= bufDone;
+	memmove((char *)oco->buf, (char *)oco->buf + bufDone, oco->count);
+	for (seg = oco->segments; seg; seg = seg->next)
+	    seg->offset -= bufDone;
+    }
+    return written;
+}
+
+static void
+ReleaseOutputSegments(ConnectionOutputPtr oco)
+{
+    ConnectionOutputSegmentPtr seg;
+
+    while ((seg = oco->segments))
+    {
+	oco->segments = seg->next;
+	(*seg->release)(seg->closure);
+	free(seg);
+    }
+    oco->lastSegment = NULL;
+    oco->segmentBytes = 0;
+}
+
  /********************
  * FlushClient()
  *    If the client isn't keeping up with us, then we try to continue
@@ -872,6 +1426,10 @@ WriteToClient (ClientPtr who, int count, const void *__buf)
  *    a permanent error, or we can't allocate any more space, we then
  *    close the connection.
  *
+ *    The buffered output, any segments queued by WriteToClientNoCopy
+ *    and extraBuf are sent in that order with one writev per round;
+ *    segments are never copied, only extraBuf is when the client blocks.
+ *
  **********************/
 
 int
@@ -880,61 +1438,60 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
     ConnectionOutputPtr oco = oc->output;
     int connection = oc->fd;
     XtransConnInfo trans_conn = oc->trans_conn;
-    struct iovec iov[3];
-    static char padBuffer[3];
+    struct iovec iov[MAX_OUTPUT_IOV];
     const char *extraBuf = __extraBuf;
-    long written;
+    long extraWritten;	/* amount of extraBuf and its padding written */
     long padsize;
     long notWritten;
     long todo;
+    long len;
+    Bool complete;
+    int i, j;
 
     if (!oco)
 	return 0;
-    written = 0;
+    extraWritten = 0;
     padsize = padlength[extraCount & 3];
-    notWritten = oco->count + extraCount + padsize;
+    notWritten = oco->count + oco->segmentBytes + extraCount + padsize;
     todo = notWritten;
     while (notWritten) {
-	long before = written;	/* amount of whole thing written */
-	long remain = todo;	/* amount to try this time, <= notWritten */
-	int i = 0;
-	long len;
-	
-	/* You could be very general here and have "in" and "out" iovecs
-	 * and write a loop without using a macro, but what the heck.  This
-	 * translates to:
-	 *
-	 *     how much of this piece is new?
-	 *     if more new then we are trying this time, clamp
-	 *     if nothing new
-	 *         then bump down amount already written, for next piece
-	 *         else put new stuff in iovec, will need all of next piece
-	 *
-	 * Note that todo had better be at least 1 or else we'll end up
-	 * writing 0 iovecs.
-	 */
-#define InsertIOV(pointer, length) \
-	len = (length) - before; \
-	if (len > remain) \
-	    len = remain; \
-	if (len <= 0) { \
-	    before = (-len); \
-	} else { \
-	    iov[i].iov_len = len; \
-	    iov[i].iov_base = (pointer) + before;	\
-	    i++; \
-	    remain -= len; \
-	    before = 0; \
+	/* Leave room for extraBuf and its padding */
+	i = GatherOutput(oco, iov, MAX_OUTPUT_IOV - 2, &complete);
+	if (complete)
+	{
+	    if (extraWritten < extraCount)
+	    {
+		iov[i].iov_base = (char *)extraBuf + extraWritten;
+		iov[i].iov_len = extraCount - extraWritten;
+		i++;
+	    }
+	    if (extraWritten < extraCount + padsize)
+	    {
+		len = max(extraWritten - extraCount, 0);
+		iov[i].iov_base = padBuffer + len;
+		iov[i].iov_len = padsize - len;
+		i++;
+	    }
 	}
 
-	InsertIOV ((char *)oco->buf, oco->count)
-	InsertIOV ((char *)extraBuf, extraCount)
-	InsertIOV (padBuffer, padsize)
+	/* Clamp to todo, which is less than everything after EMSGSIZE.
+	 * todo had better be at least 1 or else we'll end up writing 0
+	 * iovecs. */
+	for (j = 0, len = 0; j < i; j++)
+	{
+	    if (len + (long)iov[j].iov_len >= todo)
+	    {
+		iov[j].iov_len = todo - len;
+		i = j + 1;
+		break;
+	    }
+	    len += iov[j].iov_len;
+	}
 
 	errno = 0;
-	if (trans_conn && (len = _XSERVTransWritev(trans_conn, iov, i)) >= 0)
+	if (trans_conn && (len = OsWriteToConnection(oc, iov, i)) >= 0)
 	{
-	    written += len;
+	    extraWritten += ConsumeOutput(oco, len);
 	    notWritten -= len;
 	    todo = notWritten;
 	}
@@ -949,54 +1506,51 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
 	{
 	    /* If we've arrived here, then the client is stuffed to the gills
 	       and not ready to accept more.  Make a note of it and buffer
-	       the rest. */
-	    FD_SET(connection, &ClientsWriteBlocked);
-	    AnyClientsWriteBlocked = TRUE;
+	       the rest.  Queued segments stay where they are. */
+	    oc->flags |= OS_COMM_WRITE_BLOCKED;
+	    if (server_poll)
+		ospoll_listen(server_poll, connection, X_NOTIFY_WRITE);
 
-	    if (written < oco->count)
-	    {
-		if (written > 0)
-		{
-		    oco->count -= written;
-		    memmove((char *)oco->buf,
-			    (char *)oco->buf + written,
-			  oco->count);
-		    written = 0;
-		}
-	    }
-	    else
-	    {
-		written -= oco->count;
-		oco->count = 0;
-	    }
-
-	    if (notWritten > oco->size)
+	    len = extraCount + padsize - extraWritten;
+	    if (oco->count + len > oco->size)
 	    {
 		unsigned char *obuf;
+		int size = oco->count + len + BUFSIZE;
 
-		obuf = (unsigned char *)realloc(oco->buf,
-						 notWritten + BUFSIZE);
+		obuf = (unsigned char *)AllocBuffer(&size);
 		if (!obuf)
 		{
 		    _XSERVTransDisconnect(oc->trans_conn);
 		    _XSERVTransClose(oc->trans_conn);
 		    oc->trans_conn = NULL;
 		    MarkClientException(who);
+		    ReleaseOutputSegments(oco);
 		    oco->count = 0;
 		    return -1;
 		}
-		oco->size = notWritten + BUFSIZE;
+		memcpy(obuf, oco->buf, oco->count);
+		FreeBuffer((char *)oco->buf, oco->size);
+		oco->size = size;
 		oco->buf = obuf;
 	    }
 
-	    /* If the amount written extended into the padBuffer, then the
-	       difference "extraCount - written" may be less than 0 */
-	    if ((len = extraCount - written) > 0)
-		memmove ((char *)oco->buf + oco->count,
-			 extraBuf + written,
-		       len);
-
-	    oco->count = notWritten; /* this will include the pad */
+	    if ((len = extraCount - extraWritten) > 0)
+	    {
+		memmove((char *)oco->buf + oco->count,
+			extraBuf + extraWritten,
+			len);
+		oco->count += len;
+		extraWritten += len;
+	    }
+	    /* If the amount written extended into the padding, then only
+	       the rest of it is still to go */
+	    if ((len = extraCount + padsize - extraWritten) > 0)
+	    {
+		memmove((char *)oco->buf + oco->count,
+			padBuffer,
+			len);
+		oco->count += len;
+	    }
 	    /* return only the amount explicitly requested */
 	    return extraCount;
 	}
@@ -1015,6 +1569,7 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
 		oc->trans_conn = NULL;
 	    }
 	    MarkClientException(who);
+	    ReleaseOutputSegments(oco);
 	    oco->count = 0;
 	    return -1;
 	}
@@ -1023,22 +1578,13 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
     /* everything was flushed out */
     oco->count = 0;
     /* check to see if this client was write blocked */
-    if (AnyClientsWriteBlocked)
-    {
-	FD_CLR(oc->fd, &ClientsWriteBlocked);
- 	if (! XFD_ANYSET(&ClientsWriteBlocked))
-	    AnyClientsWriteBlocked = FALSE;
-    }
-    if (oco->size > BUFWATERMARK)
-    {
-	free(oco->buf);
-	free(oco);
-    }
-    else
+    if (oc->flags & OS_COMM_WRITE_BLOCKED)
     {
-	oco->next = FreeOutputs;
-	FreeOutputs = oco;
+	oc->flags &= ~OS_COMM_WRITE_BLOCKED;
+	if (server_poll)
+	    ospoll_mute(server_poll, oc->fd, X_NOTIFY_WRITE);
     }
+    ParkOutputBuffer(oco);
     oc->output = (ConnectionOutputPtr)NULL;
     return extraCount; /* return only the amount explicitly requested */
 }
@@ -1048,16 +1594,18 @@ AllocateInputBuffer(void)
 {
     ConnectionInputPtr oci;
 
+    int size = BUFSIZE;
+
     oci = malloc(sizeof(ConnectionInput));
     if (!oci)
 	return NULL;
-    oci->buffer = malloc(BUFSIZE);
+    oci->buffer = AllocBuffer(&size);
     if (!oci->buffer)
     {
 	free(oci);
 	return NULL;
     }
-    oci->size = BUFSIZE;
+    oci->size = size;
     oci->bufptr = oci->buffer;
     oci->bufcnt = 0;
     oci->lenLastReq = 0;
@@ -1070,17 +1618,22 @@ AllocateOutputBuffer(void)
 {
     ConnectionOutputPtr oco;
 
+    int size = BUFSIZE;
+
     oco = malloc(sizeof(ConnectionOutput));
     if (!oco)
 	return NULL;
-    oco->buf = calloc(1, BUFSIZE);
+    oco->buf = (unsigned char *)AllocBuffer(&size);
     if (!oco->buf)
     {
 	free(oco);
 	return NULL;
     }
-    oco->size = BUFSIZE;
+    oco->size = size;
     oco->count = 0;
+    oco->segments = NULL;
+    oco->lastSegment = NULL;
+    oco->segmentBytes = 0;
     return oco;
 }
 
@@ -1092,35 +1645,23 @@ FreeOsBuffers(OsCommPtr oc)
 
     if (AvailableInput == oc)
 	AvailableInput = (OsCommPtr)NULL;
+#ifdef FD_PASSING
+    OsCloseConnectionFds(oc);
+#endif
     if ((oci = oc->input))
     {
 	if (FreeInputs)
-	{
-	    free(oci->buffer);
-	    free(oci);
-	}
+	    DestroyInputBuffer(oci);
 	else
-	{
-	    FreeInputs = oci;
-	    oci->next = (ConnectionInputPtr)NULL;
-	    oci->bufptr = oci->buffer;
-	    oci->bufcnt = 0;
-	    oci->lenLastReq = 0;
-	}
+	    ParkInputBuffer(oci);
     }
     if ((oco = oc->output))
     {
+	ReleaseOutputSegments(oco);
 	if (FreeOutputs)
-	{
-	    free(oco->buf);
-	    free(oco);
-	}
+	    DestroyOutputBuffer(oco);
 	else
-	{
-	    FreeOutputs = oco;
-	    oco->next = (ConnectionOutputPtr)NULL;
-	    oco->count = 0;
-	}
+	    ParkOutputBuffer(oco);
     }
 }
 
@@ -1130,16 +1671,23 @@ ResetOsBuffers(void)
     ConnectionInputPtr oci;
     ConnectionOutputPtr oco;
 
+    int c;
+
     while ((oci = FreeInputs))
     {
 	FreeInputs = oci->next;
-	free(oci->buffer);
-	free(oci);
+	DestroyInputBuffer(oci);
     }
     while ((oco = FreeOutputs))
     {
 	FreeOutputs = oco->next;
-	free(oco->buf);
-	free(oco);
+	DestroyOutputBuffer(oco);
+    }
+    for (c = 0; c < BUFFER_CLASSES; c++)
+    {
+	while (BufferClasses[c].free)
+	    PopBuffer(&BufferClasses[c], BUFSIZE << c);
+	BufferClasses[c].lowWater = 0;
     }
+    CancelBufferPoolTimer();
 }
@@ -103,6 +103,18 @@ SOFTWARE.
 /* MAXSELECT is the number of fds that select() can handle */
 #define MAXSELECT (sizeof(fd_set) * NBBY)
 
+/* Descriptors left to the server itself next to -maxclients clients:
+ * stdio, the log, listeners, XDMCP and input devices */
+#define RESERVED_FDS 64
+
+/* Largest -maxclients.  With only the select backend every client
+ * descriptor has to fit in an fd_set next to the reserved ones. */
+#if defined(WIN32) || !defined(HAVE_EPOLL_CREATE1)
+#define MAXLIMITCLIENTS min(MAXCLIENTS, MAXSELECT / 2)
+#else
+#define MAXLIMITCLIENTS MAXCLIENTS
+#endif
+
 #ifndef HAS_GETDTABLESIZE
 #if !defined(SVR4) && !defined(SYSV)
 #define HAS_GETDTABLESIZE
@@ -110,6 +122,7 @@ SOFTWARE.
 #endif
 
 #include <stddef.h>
+#include "list.h"
 
 #if defined(XDMCP) || defined(HASXDMAUTH)
 typedef Bool (*ValidatorFunc)(ARRAY8Ptr Auth, ARRAY8Ptr Data, int packet_type);
@@ -128,11 +141,29 @@ typedef struct _connectionInput {
     unsigned int ignoreBytes;   /* bytes to ignore before the next request */
 } ConnectionInput, *ConnectionInputPtr;
 
+/*
+ * Caller-owned data queued by WriteToClientNoCopy.  It is sent after the
+ * first "offset" bytes of the copy buffer and before the rest, and is
+ * handed back through release once it has been written.
+ */
+typedef struct _connectionOutputSegment {
+    struct _connectionOutputSegment *next;
+    int offset;                 /* bytes of buf that precede this segment */
+    const char *data;           /* first byte not yet written */
+    int count;                  /* data bytes not yet written */
+    int pad;                    /* pad bytes not yet written */
+    ClientWriteReleaseProcPtr release;
+    pointer closure;
+} ConnectionOutputSegment, *ConnectionOutputSegmentPtr;
+
 typedef struct _connectionOutput {
     struct _connectionOutput *next;
     int size;
     unsigned char *buf;
     int count;
+    ConnectionOutputSegmentPtr segments;    /* in stream order */
+    ConnectionOutputSegmentPtr lastSegment;
+    long segmentBytes;          /* total count + pad of segments */
 } ConnectionOutput, *ConnectionOutputPtr;
 
 struct _osComm;
@@ -165,6 +196,15 @@ typedef void (*OsCloseFunc)(ClientPtr);
 
 typedef int (*OsFlushFunc)(ClientPtr who, struct _osComm * oc, char* extraBuf, int extraCount);
 
+/* Most file descriptors queued on a connection in each direction */
+#define OS_MAX_CLIENT_FDS 16
+
+/* OsCommRec.flags */
+#define OS_COMM_READY		0x1	/* on ReadyClients */
+#define OS_COMM_OUTPUT_PENDING	0x2	/* on the pending output list */
+#define OS_COMM_WRITE_BLOCKED	0x4	/* waiting for the socket to drain */
+#define OS_COMM_GRAB_IMPERVIOUS	0x8	/* served during server grabs */
+
 typedef struct _osComm {
     int fd;
     ConnectionInputPtr input;
@@ -173,6 +213,18 @@ typedef struct _osComm {
     CARD32 conn_time;		/* timestamp if not established, else 0  */
     struct _XtransConnInfo *trans_conn; /* transport connection object */
     Bool local_client;
+    ClientPtr client;
+    int flags;			/* OS_COMM_* */
+    struct list ready;		/* ReadyClients entry */
+    struct list pending;	/* pending output entry */
+#ifdef FD_PASSING
+    Bool fd_passing;		/* unix domain socket */
+    int recv_fd_count;
+    int recv_fds[OS_MAX_CLIENT_FDS];	/* received, not yet read */
+    int send_fd_count;
+    int send_fds[OS_MAX_CLIENT_FDS];	/* to go with the next write */
+    Bool send_fd_close[OS_MAX_CLIENT_FDS];
+#endif
 } OsCommRec, *OsCommPtr;
 
 extern int FlushClient(
@@ -187,16 +239,29 @@ extern void FreeOsBuffers(
 );
 
 #include "dix.h"
+#include "ospoll.h"
+
+/* every listener, client, device and general socket */
+extern struct ospoll *server_poll;
 
-extern fd_set AllSockets;
-extern fd_set AllClients;
 extern fd_set LastSelectMask;
-extern fd_set WellKnownConnections;
 extern fd_set EnabledDevices;
-extern fd_set ClientsWithInput;
-extern fd_set ClientsWriteBlocked;
-extern fd_set OutputPending;
-extern fd_set IgnoredClientsWithInput;
+extern Bool AnyDevicesReadable;
+extern int NumClientConnections;
+
+/* Clients with a full request buffered or a readable connection,
+ * including the ones that are ignored or shut out by a grab for now */
+extern struct list ReadyClients;
+
+extern Bool ListeningToClient(ClientPtr /* client */);
+extern void MarkClientReady(OsCommPtr /* oc */);
+extern void MarkClientNotReady(OsCommPtr /* oc */);
+extern Bool AnyClientsReady(void);
+extern void ResetReadySockets(void);
+
+/* in io.c */
+extern void MarkOutputPending(OsCommPtr /* oc */);
+extern void ClearOutputPending(OsCommPtr /* oc */);
 
 #ifndef WIN32
 extern int *ConnectionTranslation;
@@ -207,7 +272,6 @@ extern void ClearConnectionTranslation(void);
 #endif
  
 extern Bool NewOutputPending;
-extern Bool AnyClientsWriteBlocked;
 
 extern WorkQueuePtr workQueue;
 
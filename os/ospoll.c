@@ -0,0 +1,461 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <X11/X.h>
+#include <X11/Xos.h>
+#include <X11/Xpoll.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+#endif
+
+#include "misc.h"
+#include "ospoll.h"
+
+/* Most descriptors reported by one wait, the rest come with the next */
+#define OSPOLL_MAX_EVENTS	256
+
+typedef struct _OsPollFd {
+    unsigned char	registered;	/* fd was handed to ospoll_add */
+    unsigned char	trigger;	/* enum ospoll_trigger */
+    unsigned char	xevents;	/* X_NOTIFY_* interest */
+    unsigned char	kernel;		/* backend currently watches fd */
+    ospoll_callback	callback;
+    void		*data;
+} OsPollFdRec, *OsPollFdPtr;
+
+typedef struct _OsPollBackend {
+    const char	*name;
+    Bool	(*init)(struct ospoll *ospoll);
+    void	(*fini)(struct ospoll *ospoll);
+    Bool	(*add)(struct ospoll *ospoll, int fd);
+    void	(*update)(struct ospoll *ospoll, int fd);
+    int		(*wait)(struct ospoll *ospoll, int timeout);
+} OsPollBackendRec, *OsPollBackendPtr;
+
+struct ospoll {
+    const OsPollBackendRec *backend;
+    OsPollFdPtr		fds;		/* indexed by file descriptor */
+    int			size;		/* entries allocated in fds */
+#ifdef HAVE_EPOLL_CREATE1
+    int			epoll_fd;
+    struct epoll_event	events[OSPOLL_MAX_EVENTS];
+#endif
+    fd_set		read_fds;
+    fd_set		write_fds;
+    int			maxfd;
+};
+
+static Bool
+OsPollGrow(struct ospoll *ospoll, int fd)
+{
+    OsPollFdPtr fds;
+    int size;
+
+    if (fd < ospoll->size)
+	return TRUE;
+
+    size = ospoll->size ? ospoll->size : 64;
+    while (size <= fd)
+	size <<= 1;
+    fds = realloc(ospoll->fds, size * sizeof(OsPollFdRec));
+    if (!fds)
+	return FALSE;
+    memset(fds + ospoll->size, 0, (size - ospoll->size) * sizeof(OsPollFdRec));
+    ospoll->fds = fds;
+    ospoll->size = size;
+    return TRUE;
+}
+
+/*
+ * Hand a ready descriptor to its callback.  An earlier callback of the
+ * same wait may have removed or muted it since the kernel reported it.
+ */
+static Bool
+OsPollNotify(struct ospoll *ospoll, int fd, int xevents)
+{
+    OsPollFdPtr pfd;
+
+    if (fd < 0 || fd >= ospoll->size)
+	return FALSE;
+    pfd = &ospoll->fds[fd];
+    if (!pfd->registered)
+	return FALSE;
+    xevents &= pfd->xevents | X_NOTIFY_ERROR;
+    if (!xevents)
+	return FALSE;
+    (*pfd->callback)(fd, xevents, pfd->data);
+    return TRUE;
+}
+
+/*
+ * epoll backend.  Descriptors without any interest are taken out of the
+ * kernel set entirely: epoll always reports EPOLLHUP/EPOLLERR, and a
+ * muted (ignored) client that hangs up would otherwise wake us up over
+ * and over again.
+ */
+
+#ifdef HAVE_EPOLL_CREATE1
+
+static Bool
+epoll_init(struct ospoll *ospoll)
+{
+    ospoll->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (ospoll->epoll_fd < 0)
+	return FALSE;
+    return TRUE;
+}
+
+static void
+epoll_fini(struct ospoll *ospoll)
+{
+    close(ospoll->epoll_fd);
+}
+
+static Bool
+epoll_add(struct ospoll *ospoll, int fd)
+{
+    return TRUE;
+}
+
+static void
+epoll_update(struct ospoll *ospoll, int fd)
+{
+    OsPollFdPtr pfd = &ospoll->fds[fd];
+    struct epoll_event ev;
+
+    if (!pfd->xevents)
+    {
+	if (pfd->kernel)
+	    (void) epoll_ctl(ospoll->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	pfd->kernel = FALSE;
+	return;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    if (pfd->xevents & X_NOTIFY_READ)
+	ev.events |= EPOLLIN;
+    if (pfd->xevents & X_NOTIFY_WRITE)
+	ev.events |= EPOLLOUT;
+    if (pfd->trigger == ospoll_trigger_edge)
+	ev.events |= EPOLLET;
+    ev.data.fd = fd;
+
+    /* The kernel drops closed descriptors on its own, so our idea of
+     * what it is watching can be stale when a number gets reused. */
+    if (pfd->kernel)
+    {
+	if (epoll_ctl(ospoll->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+	    errno == ENOENT)
+	    (void) epoll_ctl(ospoll->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    else
+    {
+	if (epoll_ctl(ospoll->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0 &&
+	    errno == EEXIST)
+	    (void) epoll_ctl(ospoll->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    pfd->kernel = TRUE;
+}
+
+static int
+epoll_wait_ready(struct ospoll *ospoll, int timeout)
+{
+    int i, n, nready = 0;
+
+    n = epoll_wait(ospoll->epoll_fd, ospoll->events, OSPOLL_MAX_EVENTS,
+		   timeout);
+    if (n < 0)
+	return n;
+    for (i = 0; i < n; i++)
+    {
+	uint32_t events = ospoll->events[i].events;
+	int xevents = 0;
+
+	if (events & EPOLLIN)
+	    xevents |= X_NOTIFY_READ;
+	if (events & EPOLLOUT)
+	    xevents |= X_NOTIFY_WRITE;
+	if (events & (EPOLLERR | EPOLLHUP))
+	    xevents |= X_NOTIFY_ERROR | X_NOTIFY_READ | X_NOTIFY_WRITE;
+	if (OsPollNotify(ospoll, ospoll->events[i].data.fd, xevents))
+	    nready++;
+    }
+    return nready;
+}
+
+#endif /* HAVE_EPOLL_CREATE1 */
+
+/*
+ * select backend.  Edge triggering is not available here, such
+ * descriptors are simply reported for as long as they are ready.
+ */
+
+static Bool
+select_init(struct ospoll *ospoll)
+{
+    FD_ZERO(&ospoll->read_fds);
+    FD_ZERO(&ospoll->write_fds);
+    ospoll->maxfd = -1;
+    return TRUE;
+}
+
+static void
+select_fini(struct ospoll *ospoll)
+{
+}
+
+static Bool
+select_add(struct ospoll *ospoll, int fd)
+{
+#ifndef WIN32
+    return fd < FD_SETSIZE;
+#else
+    return TRUE;	/* winsock sets hold socket handles, not bits */
+#endif
+}
+
+static void
+select_update(struct ospoll *ospoll, int fd)
+{
+    OsPollFdPtr pfd = &ospoll->fds[fd];
+
+    if (pfd->xevents & X_NOTIFY_READ)
+	FD_SET(fd, &ospoll->read_fds);
+    else
+	FD_CLR(fd, &ospoll->read_fds);
+    if (pfd->xevents & X_NOTIFY_WRITE)
+	FD_SET(fd, &ospoll->write_fds);
+    else
+	FD_CLR(fd, &ospoll->write_fds);
+
+    pfd->kernel = pfd->xevents != 0;
+    if (pfd->kernel && fd > ospoll->maxfd)
+	ospoll->maxfd = fd;
+    else if (!pfd->kernel && fd == ospoll->maxfd)
+	while (ospoll->maxfd >= 0 && !ospoll->fds[ospoll->maxfd].kernel)
+	    ospoll->maxfd--;
+}
+
+static int
+select_wait_ready(struct ospoll *ospoll, int timeout)
+{
+    fd_set readable, writable;
+    struct timeval waittime, *wt = NULL;
+    int n, nready = 0;
+#ifndef WIN32
+    int fd;
+#else
+    int i;
+#endif
+
+    if (timeout >= 0)
+    {
+	waittime.tv_sec = timeout / MILLI_PER_SECOND;
+	waittime.tv_usec = (timeout % MILLI_PER_SECOND) *
+			   (1000000 / MILLI_PER_SECOND);
+	wt = &waittime;
+    }
+
+    XFD_COPYSET(&ospoll->read_fds, &readable);
+    XFD_COPYSET(&ospoll->write_fds, &writable);
+    n = Select(ospoll->maxfd + 1, &readable, &writable, NULL, wt);
+    if (n < 0)
+	return n;
+#ifndef WIN32
+    for (fd = 0; n > 0 && fd <= ospoll->maxfd; fd++)
+    {
+	int xevents = 0;
+
+	if (FD_ISSET(fd, &readable))
+	    xevents |= X_NOTIFY_READ;
+	if (FD_ISSET(fd, &writable))
+	    xevents |= X_NOTIFY_WRITE;
+	if (!xevents)
+	    continue;
+	n--;
+	if (OsPollNotify(ospoll, fd, xevents))
+	    nready++;
+    }
+#else
+    for (i = 0; i < XFD_SETCOUNT(&readable); i++)
+    {
+	int fd = XFD_FD(&readable, i);
+	int xevents = X_NOTIFY_READ;
+
+	if (FD_ISSET(fd, &writable))
+	    xevents |= X_NOTIFY_WRITE;
+	if (OsPollNotify(ospoll, fd, xevents))
+	    nready++;
+    }
+    for (i = 0; i < XFD_SETCOUNT(&writable); i++)
+    {
+	int fd = XFD_FD(&writable, i);
+
+	if (!FD_ISSET(fd, &readable) &&
+	    OsPollNotify(ospoll, fd, X_NOTIFY_WRITE))
+	    nready++;
+    }
+#endif
+    return nready;
+}
+
+static const OsPollBackendRec ospoll_backends[] = {
+#ifdef HAVE_EPOLL_CREATE1
+    { "epoll", epoll_init, epoll_fini, epoll_add, epoll_update,
+      epoll_wait_ready },
+#endif
+    { "select", select_init, select_fini, select_add, select_update,
+      select_wait_ready },
+};
+
+#define NUM_BACKENDS (sizeof(ospoll_backends) / sizeof(ospoll_backends[0]))
+
+struct ospoll *
+ospoll_create(const char *backend)
+{
+    struct ospoll *ospoll;
+    int i;
+
+    ospoll = calloc(1, sizeof(struct ospoll));
+    if (!ospoll)
+	return NULL;
+
+    for (i = 0; i < NUM_BACKENDS; i++)
+    {
+	if (backend && strcmp(backend, ospoll_backends[i].name) != 0)
+	    continue;
+	if ((*ospoll_backends[i].init)(ospoll))
+	{
+	    ospoll->backend = &ospoll_backends[i];
+	    return ospoll;
+	}
+    }
+
+    /* The requested backend is unusable here, take the best one left */
+    if (backend)
+    {
+	free(ospoll);
+	return ospoll_create(NULL);
+    }
+
+    free(ospoll);
+    return NULL;
+}
+
+void
+ospoll_destroy(struct ospoll *ospoll)
+{
+    if (!ospoll)
+	return;
+    (*ospoll->backend->fini)(ospoll);
+    free(ospoll->fds);
+    free(ospoll);
+}
+
+const char *
+ospoll_backend_name(struct ospoll *ospoll)
+{
+    return ospoll->backend->name;
+}
+
+Bool
+ospoll_add(struct ospoll *ospoll, int fd, enum ospoll_trigger trigger,
+	   ospoll_callback callback, void *data)
+{
+    OsPollFdPtr pfd;
+
+    if (fd < 0 || !OsPollGrow(ospoll, fd))
+	return FALSE;
+    if (!(*ospoll->backend->add)(ospoll, fd))
+	return FALSE;
+
+    pfd = &ospoll->fds[fd];
+    pfd->callback = callback;
+    pfd->data = data;
+    if (pfd->registered && pfd->trigger == trigger)
+	return TRUE;
+    pfd->registered = TRUE;
+    pfd->trigger = trigger;
+    if (pfd->xevents)
+	(*ospoll->backend->update)(ospoll, fd);
+    return TRUE;
+}
+
+void
+ospoll_remove(struct ospoll *ospoll, int fd)
+{
+    OsPollFdPtr pfd;
+
+    if (fd < 0 || fd >= ospoll->size || !ospoll->fds[fd].registered)
+	return;
+
+    pfd = &ospoll->fds[fd];
+    pfd->xevents = X_NOTIFY_NONE;
+    (*ospoll->backend->update)(ospoll, fd);
+    pfd->registered = FALSE;
+}
+
+void
+ospoll_listen(struct ospoll *ospoll, int fd, int xevents)
+{
+    OsPollFdPtr pfd;
+
+    if (fd < 0 || fd >= ospoll->size || !ospoll->fds[fd].registered)
+	return;
+
+    pfd = &ospoll->fds[fd];
+    xevents &= X_NOTIFY_READ | X_NOTIFY_WRITE;
+    if ((pfd->xevents | xevents) == pfd->xevents)
+	return;
+    pfd->xevents |= xevents;
+    (*ospoll->backend->update)(ospoll, fd);
+}
+
+void
+ospoll_mute(struct ospoll *ospoll, int fd, int xevents)
+{
+    OsPollFdPtr pfd;
+
+    if (fd < 0 || fd >= ospoll->size || !ospoll->fds[fd].registered)
+	return;
+
+    pfd = &ospoll->fds[fd];
+    if (!(pfd->xevents & xevents))
+	return;
+    pfd->xevents &= ~xevents;
+    (*ospoll->backend->update)(ospoll, fd);
+}
+
+int
+ospoll_wait(struct ospoll *ospoll, int timeout)
+{
+    return (*ospoll->backend->wait)(ospoll, timeout);
+}
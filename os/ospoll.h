@@ -0,0 +1,91 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _OSPOLL_H_
+#define _OSPOLL_H_
+
+/*
+ * Pluggable file descriptor multiplexer used by WaitForSomething.
+ *
+ * Each descriptor is registered once with ospoll_add, together with the
+ * function to call when it becomes ready, and then has its interest set
+ * adjusted with ospoll_listen/ospoll_mute.  ospoll_wait calls back only
+ * for the descriptors that are ready, so the cost of a wakeup is
+ * proportional to their number rather than to the highest descriptor
+ * number.  An epoll backend is used when available, select is the
+ * portable fallback and only takes descriptors below FD_SETSIZE.
+ */
+
+#define X_NOTIFY_NONE	0x0
+#define X_NOTIFY_READ	0x1
+#define X_NOTIFY_WRITE	0x2
+#define X_NOTIFY_ERROR	0x4	/* only ever reported, never listened for */
+
+enum ospoll_trigger {
+    ospoll_trigger_level,	/* report while the condition holds */
+    ospoll_trigger_edge		/* report once per state change */
+};
+
+struct ospoll;
+
+/* xevents holds the X_NOTIFY_* bits that are ready.  The callback may
+ * add, remove, listen to or mute any descriptor, itself included. */
+typedef void (*ospoll_callback)(int /* fd */,
+				int /* xevents */,
+				void * /* data */);
+
+/* Returns NULL if no backend could be initialized.  A NULL or unknown
+ * backend name selects the best one available. */
+extern struct ospoll *ospoll_create(const char * /* backend */);
+
+extern void ospoll_destroy(struct ospoll * /* ospoll */);
+
+extern const char *ospoll_backend_name(struct ospoll * /* ospoll */);
+
+/* Registering a descriptor again replaces its trigger and callback but
+ * keeps its interest set. */
+extern Bool ospoll_add(struct ospoll * /* ospoll */,
+		       int /* fd */,
+		       enum ospoll_trigger /* trigger */,
+		       ospoll_callback /* callback */,
+		       void * /* data */);
+
+extern void ospoll_remove(struct ospoll * /* ospoll */,
+			  int /* fd */);
+
+extern void ospoll_listen(struct ospoll * /* ospoll */,
+			  int /* fd */,
+			  int /* xevents */);
+
+extern void ospoll_mute(struct ospoll * /* ospoll */,
+			int /* fd */,
+			int /* xevents */);
+
+/* Waits for at least one descriptor to become ready and calls back for
+ * each ready one.  Returns the number of callbacks made, 0 on timeout,
+ * or -1 with errno set.  timeout is in milliseconds, -1 blocks
+ * indefinitely. */
+extern int ospoll_wait(struct ospoll * /* ospoll */,
+		       int /* timeout */);
+
+#endif /* _OSPOLL_H_ */
@@ -117,6 +117,7 @@ __stdcall unsigned long GetTickCount(void);
 #include "opaque.h"
 
 #include "dixstruct.h"
+#include "reqstats.h"
 
 #include "xkbsrv.h"
 
@@ -441,6 +442,35 @@ GetTimeInMillis(void)
 }
 #endif
 
+CARD64
+GetTimeInMicros(void)
+{
+#ifdef MONOTONIC_CLOCK
+    struct timespec tp;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &tp) == 0)
+	return (CARD64)tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
+#endif
+    return (CARD64)GetTimeInMillis() * 1000;
+}
+
+/*
+ * CPU time used by the calling thread in microseconds, for the
+ * scheduler's per client accounting.  Falls back to elapsed time where
+ * there is no thread CPU clock.
+ */
+CARD64
+GetCPUTimeInMicros(void)
+{
+#if defined(MONOTONIC_CLOCK) && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec tp;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp) == 0)
+	return (CARD64)tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
+#endif
+    return (CARD64)GetTimeInMillis() * 1000;
+}
+
 void
 AdjustWaitForDelay (pointer waitTime, unsigned long newdelay)
 {
@@ -484,6 +514,8 @@ void UseMsg(void)
 #ifdef DPMSExtension
     ErrorF("-dpms                  disables VESA DPMS monitor control\n");
 #endif
+    ErrorF("-damagelimit n         coarsen DAMAGE regions above n rectangles\n");
+    ErrorF("-deferdamage           report DAMAGE once per dispatch cycle\n");
     ErrorF("-deferglyphs [none|all|16] defer loading of [no|all|16-bit] glyphs\n");
     ErrorF("-f #                   bell base (0-100)\n");
     ErrorF("-fc string             cursor font\n");
@@ -511,6 +543,10 @@ void UseMsg(void)
     ErrorF("-r                     turns off auto-repeat\n");
     ErrorF("r                      turns on auto-repeat \n");
     ErrorF("-render [default|mono|gray|color] set render color alloc policy\n");
+#ifdef RENDER_THREADS
+    ErrorF("-renderthreads n       render large operations with n threads\n");
+    ErrorF("-renderthreshold n     split operations of at least n pixels\n");
+#endif
     ErrorF("-retro                 start with classic stipple and cursor\n");
     ErrorF("-s #                   screen-saver timeout (minutes)\n");
     ErrorF("-seat string           seat to run on\n");
@@ -524,12 +560,18 @@ void UseMsg(void)
     ErrorF("-wm                    WhenMapped default backing-store\n");
     ErrorF("-wr                    create root window with white background\n");
     ErrorF("-maxbigreqsize         set maximal bigrequest size \n");
+    ErrorF("-maxclients n          allow n clients (a power of two, 64 to %d)\n",
+	   (int) MAXLIMITCLIENTS);
 #ifdef PANORAMIX
     ErrorF("+xinerama              Enable XINERAMA extension\n");
     ErrorF("-xinerama              Disable XINERAMA extension\n");
 #endif
     ErrorF("-dumbSched             Disable smart scheduling, enable old behavior\n");
+    ErrorF("-reqstats int          Keep request statistics, log them every int secs\n");
     ErrorF("-schedInterval int     Set scheduler interval in msec\n");
+    ErrorF("-schedPolicy priority|fair Select how ready clients are scheduled\n");
+    ErrorF("-schedWeight cmd=n     Give clients run as cmd n fair shares (default %d)\n",
+	   SMART_DEFAULT_WEIGHT);
     ErrorF("-sigstop               Enable SIGSTOP based startup\n");
     ErrorF("+extension name        Enable extension\n");
     ErrorF("-extension name        Disable extension\n");
@@ -669,6 +711,15 @@ ProcessCommandLine(int argc, char *argv[])
 	else if ( strcmp( argv[i], "-dpms") == 0)
 	    DPMSDisabledSwitch = TRUE;
 #endif
+	else if ( strcmp( argv[i], "-damagelimit") == 0)
+	{
+	    if (++i < argc && atoi(argv[i]) >= 0)
+		DamageExtRegionLimit = atoi(argv[i]);
+	    else
+		UseMsg();
+	}
+	else if ( strcmp( argv[i], "-deferdamage") == 0)
+	    DamageExtDeferReports = TRUE;
 	else if ( strcmp( argv[i], "-deferglyphs") == 0)
 	{
 	    if(++i >= argc || !ParseGlyphCachingMode(argv[i]))
@@ -868,6 +919,19 @@ ProcessCommandLine(int argc, char *argv[])
                  UseMsg();
              }
          }
+	else if ( strcmp( argv[i], "-maxclients") == 0)
+	{
+	    if (++i < argc)
+	    {
+		LimitClients = atoi(argv[i]);
+		if (LimitClients < 64 || LimitClients > MAXLIMITCLIENTS ||
+		    (LimitClients & (LimitClients - 1)) != 0)
+		    FatalError("maxclients must be a power of two, 64 to %d\n",
+			       (int) MAXLIMITCLIENTS);
+	    }
+	    else
+		UseMsg();
+	}
 #ifdef PANORAMIX
 	else if ( strcmp( argv[i], "+xinerama") == 0){
 	    noPanoramiXExtension = FALSE;
@@ -898,6 +962,13 @@ ProcessCommandLine(int argc, char *argv[])
 	{
 	    SmartScheduleDisable = TRUE;
 	}
+	else if ( strcmp( argv[i], "-reqstats") == 0)
+	{
+	    if (++i < argc && (RequestStatsInterval = atoi(argv[i])) >= 0)
+		RequestStatsEnabled = TRUE;
+	    else
+		UseMsg();
+	}
 	else if ( strcmp( argv[i], "-schedInterval") == 0)
 	{
 	    if (++i < argc)
@@ -908,6 +979,20 @@ ProcessCommandLine(int argc, char *argv[])
 	    else
 		UseMsg();
 	}
+	else if ( strcmp( argv[i], "-schedPolicy") == 0)
+	{
+	    if (++i < argc && strcmp(argv[i], "priority") == 0)
+		SmartSchedulePolicy = SMART_POLICY_PRIORITY;
+	    else if (i < argc && strcmp(argv[i], "fair") == 0)
+		SmartSchedulePolicy = SMART_POLICY_FAIR;
+	    else
+		UseMsg();
+	}
+	else if ( strcmp( argv[i], "-schedWeight") == 0)
+	{
+	    if (++i >= argc || !SmartScheduleSetWeight(argv[i]))
+		UseMsg();
+	}
 	else if ( strcmp( argv[i], "-schedMax") == 0)
 	{
 	    if (++i < argc)
@@ -931,6 +1016,22 @@ ProcessCommandLine(int argc, char *argv[])
 	    else
 		UseMsg ();
 	}
+#ifdef RENDER_THREADS
+	else if ( strcmp( argv[i], "-renderthreads") == 0)
+	{
+	    if (++i < argc && atoi(argv[i]) > 0)
+		RenderThreads = atoi(argv[i]);
+	    else
+		UseMsg();
+	}
+	else if ( strcmp( argv[i], "-renderthreshold") == 0)
+	{
+	    if (++i < argc && atoi(argv[i]) > 0)
+		RenderThreadPixels = atoi(argv[i]);
+	    else
+		UseMsg();
+	}
+#endif
 	else if ( strcmp( argv[i], "-sigstop") == 0)
 	{
 	    RunFromSigStopParent = TRUE;
@@ -588,6 +588,12 @@ XdmcpInit(void)
     	timeOutRtx = 0;
     	DisplayNumber = (CARD16) atoi(display);
     	get_xdmcp_sock();
+	if (xdmcpSocket >= 0)
+	    AddGeneralSocket(xdmcpSocket);
+#if defined(IPv6) && defined(AF_INET6)
+	if (xdmcpSocket6 >= 0)
+	    AddGeneralSocket(xdmcpSocket6);
+#endif
     	send_packet();
     }
 }
@@ -648,16 +654,10 @@ XdmcpBlockHandler(
     struct timeval  **wt,
     pointer	    pReadmask)
 {
-    fd_set *LastSelectMask = (fd_set*)pReadmask;
     CARD32 millisToGo;
 
     if (state == XDM_OFF)
 	return;
-    FD_SET(xdmcpSocket, LastSelectMask);
-#if defined(IPv6) && defined(AF_INET6)
-    if (xdmcpSocket6 >= 0)
-	FD_SET(xdmcpSocket6, LastSelectMask);
-#endif
     if (timeOutTime == 0)
 	return;
     millisToGo = timeOutTime - GetTimeInMillis();
@@ -680,7 +680,6 @@ XdmcpWakeupHandler(
     pointer pReadmask)
 {
     fd_set* LastSelectMask = (fd_set*)pReadmask;
-    fd_set   devicesReadable;
 
     if (state == XDM_OFF)
 	return;
@@ -698,15 +697,14 @@ XdmcpWakeupHandler(
 	    FD_CLR(xdmcpSocket6, LastSelectMask);
 	} 
 #endif
-	XFD_ANDSET(&devicesReadable, LastSelectMask, &EnabledDevices);
-	if (XFD_ANYSET(&devicesReadable))
+	if (AnyDevicesReadable)
 	{
 	    if (state == XDM_AWAIT_USER_INPUT)
 		restart();
 	    else if (state == XDM_RUN_SESSION)
 		keepaliveDormancy = defaultKeepaliveDormancy;
 	}
-	if (XFD_ANYSET(&AllClients) && state == XDM_RUN_SESSION)
+	if (NumClientConnections && state == XDM_RUN_SESSION)
 	    timeOutTime = GetTimeInMillis() +  keepaliveDormancy * 1000;
     }
     else if (timeOutTime && (int) (GetTimeInMillis() - timeOutTime) >= 0)
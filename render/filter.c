@@ -345,6 +345,7 @@ SetPicturePictFilter (PicturePtr pPicture, PictFilterPtr pFilter,
     for (i = 0; i < nparams; i++)
 	pPicture->filter_params[i] = params[i];
     pPicture->filter = pFilter->id;
+    pPicture->serialNumber |= GC_CHANGE_SERIAL_BIT;
 
     if (pPicture->pDrawable)
     {
@@ -26,7 +26,6 @@
 #include <dix-config.h>
 #endif
 
-#include "xsha1.h"
 
 #include "misc.h"
 #include "scrnintstr.h"
@@ -176,27 +175,107 @@ FindGlyphRef (GlyphHashPtr	hash,
     return gr;
 }
 
+/*
+ * Glyphs are shared between glyph sets by content, using a 128 bit
+ * non-cryptographic hash of the glyph info and image.  It works like
+ * xxHash64: four 64 bit lanes each consume 8 bytes per 32 byte stripe,
+ * and the lanes are then folded into two separately avalanched halves.
+ * The remaining bytes of the glyph's hash field are a collision counter
+ * (see FindGlyphByContents); the hash is never trusted without comparing
+ * the images, the one already in the glyph's picture included.
+ */
+#define GLYPH_PRIME1	0x9E3779B185EBCA87ULL
+#define GLYPH_PRIME2	0xC2B2AE3D27D4EB4FULL
+#define GLYPH_PRIME3	0x165667B19E3779F9ULL
+#define GLYPH_PRIME4	0x85EBCA77C2B2AE63ULL
+#define GLYPH_PRIME5	0x27D4EB2F165667C5ULL
+
+#define GLYPH_HASH_BYTES    16	/* followed by the collision counter */
+
+static inline uint64_t
+GlyphRotate (uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+GlyphRead64 (const CARD8 *p)
+{
+    uint64_t	v;
+
+    memcpy (&v, p, sizeof (v));
+    return v;
+}
+
+static inline uint64_t
+GlyphRound (uint64_t acc, uint64_t input)
+{
+    acc += input * GLYPH_PRIME2;
+    acc = GlyphRotate (acc, 31);
+    return acc * GLYPH_PRIME1;
+}
+
+static inline uint64_t
+GlyphAvalanche (uint64_t h)
+{
+    h ^= h >> 33;
+    h *= GLYPH_PRIME2;
+    h ^= h >> 29;
+    h *= GLYPH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
 int
 HashGlyph (xGlyphInfo    *gi,
 	   CARD8	 *bits,
 	   unsigned long size,
 	   unsigned char sha1[20])
 {
-    void *ctx = x_sha1_init();
-    int success;
-
-    if (!ctx)
-	return BadAlloc;
-
-    success = x_sha1_update(ctx, gi, sizeof(xGlyphInfo));
-    if (!success)
-	return BadAlloc;
-    success = x_sha1_update(ctx, bits, size);
-    if (!success)
-	return BadAlloc;
-    success = x_sha1_final(ctx, sha1);
-    if (!success)
-	return BadAlloc;
+    uint64_t	v1, v2, v3, v4, h1, h2;
+    uint64_t	total = size;
+    CARD8	tail[32];
+    CARD32	collision = 0;
+
+    /* The 12 bytes of glyph info seed the lanes */
+    v1 = GLYPH_PRIME1 + GLYPH_PRIME2 +
+	 ((uint64_t) gi->width | (uint64_t) gi->height << 16 |
+	  (uint64_t) (CARD16) gi->x << 32 | (uint64_t) (CARD16) gi->y << 48);
+    v2 = GLYPH_PRIME2 +
+	 ((uint64_t) (CARD16) gi->xOff | (uint64_t) (CARD16) gi->yOff << 16);
+    v3 = 0;
+    v4 = -GLYPH_PRIME1;
+
+    while (size >= 32)
+    {
+	v1 = GlyphRound (v1, GlyphRead64 (bits));
+	v2 = GlyphRound (v2, GlyphRead64 (bits + 8));
+	v3 = GlyphRound (v3, GlyphRead64 (bits + 16));
+	v4 = GlyphRound (v4, GlyphRead64 (bits + 24));
+	bits += 32;
+	size -= 32;
+    }
+    /* The length is mixed in below, so zero padding the tail is fine */
+    if (size)
+    {
+	memset (tail, 0, sizeof (tail));
+	memcpy (tail, bits, size);
+	v1 = GlyphRound (v1, GlyphRead64 (tail));
+	v2 = GlyphRound (v2, GlyphRead64 (tail + 8));
+	v3 = GlyphRound (v3, GlyphRead64 (tail + 16));
+	v4 = GlyphRound (v4, GlyphRead64 (tail + 24));
+    }
+
+    h1 = GlyphRotate (v1, 1) + GlyphRotate (v2, 7) +
+	 GlyphRotate (v3, 12) + GlyphRotate (v4, 18);
+    h2 = (v1 ^ GlyphRotate (v3, 29)) * GLYPH_PRIME4 +
+	 (v2 ^ GlyphRotate (v4, 37)) * GLYPH_PRIME5;
+    h1 = GlyphAvalanche (h1 + total * GLYPH_PRIME5);
+    h2 = GlyphAvalanche (h2 ^ (total * GLYPH_PRIME3) ^ h1);
+
+    memcpy (sha1, &h1, sizeof (h1));
+    memcpy (sha1 + 8, &h2, sizeof (h2));
+    memcpy (sha1 + GLYPH_HASH_BYTES, &collision, sizeof (collision));
     return Success;
 }
 
@@ -218,6 +297,121 @@ FindGlyphByHash (unsigned char sha1[20], int format)
 	return NULL;
 }
 
+static unsigned long
+GlyphBitsSize (xGlyphInfo *gi, int format)
+{
+    return gi->height * PixmapBytePad (gi->width, glyphDepths[format]);
+}
+
+/*
+ * Glyphs keep no copy of their image, so read back what AddGlyphs
+ * uploaded to the picture on the first screen that has one, laid out
+ * like the image in the request.
+ */
+static Bool
+GlyphGetImage (GlyphPtr glyph, int format, CARD8 *bits)
+{
+    DrawablePtr	pDrawable;
+    int		i;
+
+    for (i = 0; i < screenInfo.numScreens; i++)
+    {
+	if (!GlyphPicture (glyph)[i] ||
+	    !(pDrawable = GlyphPicture (glyph)[i]->pDrawable))
+	    continue;
+	memset (bits, 0, GlyphBitsSize (&glyph->info, format));
+	(*pDrawable->pScreen->GetImage) (pDrawable, 0, 0,
+					 glyph->info.width, glyph->info.height,
+					 ZPixmap, ~0, (char *) bits);
+	return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Compares the glyph with the image from a request.  Only the bits of
+ * each row inside the glyph count, the padding may hold anything.  When
+ * in doubt, say no: that costs a duplicate glyph, not a wrong one.
+ */
+static Bool
+GlyphMatches (GlyphPtr glyph, xGlyphInfo *gi, CARD8 *bits, int format)
+{
+    unsigned long   size = GlyphBitsSize (gi, format);
+    int		    stride, row, y;
+    CARD8	    *image;
+    Bool	    match;
+
+    if (memcmp (&glyph->info, gi, sizeof (xGlyphInfo)) != 0)
+	return FALSE;
+    if (!size)
+	return TRUE;
+    image = malloc (size);
+    if (!image)
+	return FALSE;
+    match = GlyphGetImage (glyph, format, image);
+    if (match)
+    {
+	stride = PixmapBytePad (gi->width, glyphDepths[format]);
+	row = (gi->width * BitsPerPixel (glyphDepths[format]) + 7) / 8;
+	for (y = 0; match && y < gi->height; y++)
+	    match = memcmp (image + y * stride, bits + y * stride, row) == 0;
+    }
+    free (image);
+    return match;
+}
+
+/* Compares two realized glyphs */
+static Bool
+GlyphsMatch (GlyphPtr a, GlyphPtr b, int format)
+{
+    unsigned long   size = GlyphBitsSize (&b->info, format);
+    CARD8	    *image;
+    Bool	    match;
+
+    if (!size)
+	return GlyphMatches (a, &b->info, NULL, format);
+    image = malloc (size);
+    if (!image)
+	return FALSE;
+    match = GlyphGetImage (b, format, image) &&
+	    GlyphMatches (a, &b->info, image, format);
+    free (image);
+    return match;
+}
+
+static void
+NextGlyphCollision (unsigned char sha1[20])
+{
+    CARD32  collision;
+
+    memcpy (&collision, sha1 + GLYPH_HASH_BYTES, sizeof (collision));
+    collision++;
+    memcpy (sha1 + GLYPH_HASH_BYTES, &collision, sizeof (collision));
+}
+
+/*
+ * Look up a glyph by the hash from HashGlyph, checking that the image
+ * really is the same.  Should two different glyphs hash alike, the
+ * collision counter in sha1 is advanced until either the matching glyph
+ * or an unused value is found, so sha1 always ends up naming this image.
+ */
+GlyphPtr
+FindGlyphByContents (unsigned char  sha1[20],
+		     xGlyphInfo	    *gi,
+		     CARD8	    *bits,
+		     int	    format)
+{
+    GlyphPtr	glyph;
+
+    for (;;)
+    {
+	glyph = FindGlyphByHash (sha1, format);
+	if (!glyph || GlyphMatches (glyph, gi, bits, format))
+	    return glyph;
+	NextGlyphCollision (sha1);
+    }
+}
+
 #ifdef CHECK_DUPLICATES
 void
 DuplicateRef (GlyphPtr glyph, char *where)
@@ -311,9 +505,17 @@ AddGlyph (GlyphSetPtr glyphSet, GlyphPtr glyph, Glyph id)
 
     CheckDuplicates (&globalGlyphs[glyphSet->fdepth], "AddGlyph top global");
     /* Locate existing matching glyph */
-    signature = *(CARD32 *) glyph->sha1;
-    gr = FindGlyphRef (&globalGlyphs[glyphSet->fdepth], signature,
-		       TRUE, glyph->sha1);
+    for (;;)
+    {
+	signature = *(CARD32 *) glyph->sha1;
+	gr = FindGlyphRef (&globalGlyphs[glyphSet->fdepth], signature,
+			   TRUE, glyph->sha1);
+	/* Another glyph of this request may have claimed the hash first */
+	if (!gr->glyph || gr->glyph == DeletedGlyph || gr->glyph == glyph ||
+	    GlyphsMatch (gr->glyph, glyph, glyphSet->fdepth))
+	    break;
+	NextGlyphCollision (glyph->sha1);
+    }
     if (gr->glyph && gr->glyph != DeletedGlyph && gr->glyph != glyph)
     {
 	FreeGlyphPicture(glyph);
@@ -532,7 +734,7 @@ FreeGlyphSet (pointer	value,
     return Success;
 }
 
-static void
+void
 GlyphExtents (int		nlist,
 		GlyphListPtr	list,
 		GlyphPtr	*glyphs,
@@ -42,7 +42,7 @@
 typedef struct _Glyph {
     CARD32	    refcnt;
     PrivateRec	*devPrivates;
-    unsigned char   sha1[20];
+    unsigned char   sha1[20]; /* content hash from HashGlyph, not SHA1 */
     CARD32	    size; /* info + bitmap */
     xGlyphInfo	    info;
     /* per-screen pixmaps follow */
@@ -108,6 +108,18 @@ FindGlyphRef (GlyphHashPtr	hash,
 extern _X_EXPORT GlyphPtr
 FindGlyphByHash (unsigned char sha1[20], int format);
 
+extern _X_EXPORT GlyphPtr
+FindGlyphByContents (unsigned char  sha1[20],
+		     xGlyphInfo	    *gi,
+		     CARD8	    *bits,
+		     int	    format);
+
+extern _X_EXPORT void
+GlyphExtents (int		nlist,
+	      GlyphListPtr	list,
+	      GlyphPtr		*glyphs,
+	      BoxPtr		extents);
+
 extern _X_EXPORT int
 HashGlyph (xGlyphInfo    *gi,
 	   CARD8	 *bits,
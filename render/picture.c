@@ -49,6 +49,7 @@ RESTYPE		PictureType;
 RESTYPE		PictFormatType;
 RESTYPE		GlyphSetType;
 int		PictureCmapPolicy = PictureCmapPolicyDefault;
+CallbackListPtr	DestroyPictureCallback;
 
 Bool
 PictureDestroyWindow (WindowPtr pWindow)
@@ -1461,6 +1462,8 @@ FreePicture (pointer	value,
 
     if (--pPicture->refcnt == 0)
     {
+	CallCallbacks(&DestroyPictureCallback, pPicture);
+
 	free(pPicture->transform);
 
 	if (pPicture->pSourcePict)
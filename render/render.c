@@ -1105,8 +1105,8 @@ ProcRenderAddGlyphs (ClientPtr client)
 	if (err)
 	    goto bail;
 
-	glyph_new->glyph = FindGlyphByHash (glyph_new->sha1,
-					    glyphSet->fdepth);
+	glyph_new->glyph = FindGlyphByContents (glyph_new->sha1, &gi[i], bits,
+						glyphSet->fdepth);
 
 	if (glyph_new->glyph && glyph_new->glyph != DeletedGlyph)
 	{
@@ -0,0 +1,379 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "scrnintstr.h"
+#include "pixmapstr.h"
+#include "privates.h"
+#include "damage.h"
+
+/*
+ * Checks that deferred damage reports cover the same region as immediate
+ * ones, then compares the two for a client filling a terminal's worth of
+ * character cells per frame, the way a compositing manager would watch
+ * it: a deferred damage sends one report (DamageNotify event) per frame
+ * at every report level, covering everything drawn in the frame.  Built
+ * with BENCHMARK defined (damage-bench), it reports the events, region
+ * operations and time per frame for each level in both modes.
+ */
+
+#define CELL_WIDTH	8
+#define CELL_HEIGHT	16
+#define COLUMNS		80
+#define ROWS		25
+#define FILLS_PER_FRAME	500
+#define FRAMES		8
+#define BENCH_FRAMES	2000
+
+static ScreenRec screen;
+static int reports;
+static RegionRec reported;
+
+static void
+count_report(DamagePtr pDamage, RegionPtr pRegion, void *closure)
+{
+    reports++;
+    RegionCopy(&reported, pRegion);
+}
+
+#ifdef BENCHMARK
+/*
+ * damage-bench is linked with the region set operations wrapped, so it
+ * can count the ones damage does.
+ */
+static int region_ops;
+
+extern pixman_bool_t __real_pixman_region_union(RegionPtr, RegionPtr, RegionPtr);
+extern pixman_bool_t __real_pixman_region_intersect(RegionPtr, RegionPtr, RegionPtr);
+extern pixman_bool_t __real_pixman_region_subtract(RegionPtr, RegionPtr, RegionPtr);
+extern Bool __real_RegionUnionBands(RegionPtr, RegionPtr, RegionPtr);
+extern Bool __real_RegionIntersectBox(RegionPtr, RegionPtr, BoxPtr);
+
+pixman_bool_t
+__wrap_pixman_region_union(RegionPtr newReg, RegionPtr reg1, RegionPtr reg2)
+{
+    region_ops++;
+    return __real_pixman_region_union(newReg, reg1, reg2);
+}
+
+pixman_bool_t
+__wrap_pixman_region_intersect(RegionPtr newReg, RegionPtr reg1, RegionPtr reg2)
+{
+    region_ops++;
+    return __real_pixman_region_intersect(newReg, reg1, reg2);
+}
+
+pixman_bool_t
+__wrap_pixman_region_subtract(RegionPtr regD, RegionPtr regM, RegionPtr regS)
+{
+    region_ops++;
+    return __real_pixman_region_subtract(regD, regM, regS);
+}
+
+Bool
+__wrap_RegionUnionBands(RegionPtr newReg, RegionPtr reg1, RegionPtr reg2)
+{
+    region_ops++;
+    return __real_RegionUnionBands(newReg, reg1, reg2);
+}
+
+Bool
+__wrap_RegionIntersectBox(RegionPtr newReg, RegionPtr reg, BoxPtr box)
+{
+    region_ops++;
+    return __real_RegionIntersectBox(newReg, reg, box);
+}
+#endif
+
+static PixmapPtr
+damage_init(void)
+{
+    PixmapPtr pPixmap;
+
+    serverGeneration = 1;
+    screenInfo.numScreens = 1;
+    screenInfo.screens[0] = &screen;
+    dixResetPrivates();
+    assert(dixAllocatePrivates(&screen.devPrivates, PRIVATE_SCREEN));
+    assert(DamageSetup(&screen));
+    RegionNull(&reported);
+
+    pPixmap = dixAllocateObjectWithPrivates(PixmapRec, PRIVATE_PIXMAP);
+    assert(pPixmap);
+    pPixmap->drawable.type = DRAWABLE_PIXMAP;
+    pPixmap->drawable.pScreen = &screen;
+    pPixmap->drawable.depth = 24;
+    pPixmap->drawable.bitsPerPixel = 32;
+    pPixmap->drawable.width = COLUMNS * CELL_WIDTH;
+    pPixmap->drawable.height = ROWS * CELL_HEIGHT;
+    return pPixmap;
+}
+
+/* One frame of a terminal redrawing scattered cells */
+static void
+draw_frame(PixmapPtr pPixmap, int frame)
+{
+    RegionRec region;
+    BoxRec box;
+    int i, cell;
+
+    for (i = 0; i < FILLS_PER_FRAME; i++) {
+        cell = (frame * 7919 + i * 104729) % (COLUMNS * ROWS);
+        box.x1 = (cell % COLUMNS) * CELL_WIDTH;
+        box.y1 = (cell / COLUMNS) * CELL_HEIGHT;
+        box.x2 = box.x1 + CELL_WIDTH;
+        box.y2 = box.y1 + CELL_HEIGHT;
+        RegionInit(&region, &box, 1);
+        DamageRegionAppend(&pPixmap->drawable, &region);
+        DamageRegionProcessPending(&pPixmap->drawable);
+        RegionUninit(&region);
+    }
+}
+
+static DamagePtr
+create_damage(PixmapPtr pPixmap, DamageReportLevel level, Bool deferred)
+{
+    DamagePtr pDamage;
+
+    pDamage = DamageCreate(count_report, NULL, level, FALSE, &screen, NULL);
+    assert(pDamage);
+    DamageSetReportAfterOp(pDamage, TRUE);
+    DamageSetReportDeferred(pDamage, deferred);
+    DamageRegister(&pPixmap->drawable, pDamage);
+    return pDamage;
+}
+
+static void
+deferred_test(PixmapPtr pPixmap)
+{
+    DamagePtr immediate, deferred;
+
+    immediate = create_damage(pPixmap, DamageReportNone, FALSE);
+    deferred = create_damage(pPixmap, DamageReportDeltaRegion, TRUE);
+
+    reports = 0;
+    draw_frame(pPixmap, 0);
+    assert(reports == 0);
+    DamageFlushDeferred();
+    assert(reports == 1);
+    assert(RegionEqual(DamageRegion(immediate), DamageRegion(deferred)));
+
+    /* Looking at the region reports whatever is outstanding */
+    draw_frame(pPixmap, 1);
+    assert(RegionEqual(DamageRegion(immediate), DamageRegion(deferred)));
+    assert(reports == 2);
+    DamageFlushDeferred();
+    assert(reports == 2);
+
+    DamageUnregister(&pPixmap->drawable, immediate);
+    DamageUnregister(&pPixmap->drawable, deferred);
+    DamageDestroy(immediate);
+    DamageDestroy(deferred);
+}
+
+static int markers;
+
+static void
+count_marker(DrawablePtr pDrawable, DamagePtr pDamage, RegionPtr pOldDamage,
+             RegionPtr pRegion, void *closure)
+{
+    markers++;
+}
+
+/* A marker installed later stops the damage from being deferred */
+static void
+marker_test(PixmapPtr pPixmap)
+{
+    DamagePtr pDamage;
+
+    pDamage = create_damage(pPixmap, DamageReportRawRegion, TRUE);
+    reports = markers = 0;
+    draw_frame(pPixmap, 0);
+    assert(reports == 0);
+
+    /* What was deferred so far is reported when the marker goes in */
+    DamageSetPostRenderingFunctions(pDamage, NULL, count_marker);
+    assert(reports == 1);
+
+    reports = 0;
+    draw_frame(pPixmap, 1);
+    assert(markers == FILLS_PER_FRAME);
+    assert(reports == FILLS_PER_FRAME);
+    DamageFlushDeferred();
+    assert(reports == FILLS_PER_FRAME);
+
+    DamageUnregister(&pPixmap->drawable, pDamage);
+    DamageDestroy(pDamage);
+}
+
+static void
+limit_test(PixmapPtr pPixmap)
+{
+    DamagePtr pDamage;
+    BoxPtr extents;
+
+    pDamage = create_damage(pPixmap, DamageReportNone, FALSE);
+    DamageSetRegionLimit(pDamage, DamageRegionTiles, 16);
+
+    /* The bottom row of cells ends part way through a row of tiles */
+    draw_frame(pPixmap, 0);
+    assert(RegionNumRects(DamageRegion(pDamage)) <= 16);
+    extents = RegionExtents(DamageRegion(pDamage));
+    assert(extents->x1 >= 0 && extents->y1 >= 0);
+    assert(extents->x2 <= pPixmap->drawable.width);
+    assert(extents->y2 == pPixmap->drawable.height);
+
+    DamageUnregister(&pPixmap->drawable, pDamage);
+    DamageDestroy(pDamage);
+}
+
+/* An operation which falls back to the GC ops drops what it appended */
+static void
+drop_test(PixmapPtr pPixmap)
+{
+    DamagePtr pDamage;
+    RegionRec region;
+    BoxRec box = { 0, 0, CELL_WIDTH, CELL_HEIGHT };
+
+    pDamage = create_damage(pPixmap, DamageReportDeltaRegion, FALSE);
+    reports = 0;
+    RegionInit(&region, &box, 1);
+    DamageRegionAppend(&pPixmap->drawable, &region);
+    DamageRegionDropPending(&pPixmap->drawable);
+    DamageRegionProcessPending(&pPixmap->drawable);
+    assert(reports == 0);
+    assert(!RegionNotEmpty(DamageRegion(pDamage)));
+
+    DamageRegionAppend(&pPixmap->drawable, &region);
+    DamageRegionProcessPending(&pPixmap->drawable);
+    assert(reports == 1);
+    assert(RegionEqual(DamageRegion(pDamage), &region));
+    RegionUninit(&region);
+
+    DamageUnregister(&pPixmap->drawable, pDamage);
+    DamageDestroy(pDamage);
+}
+
+static void
+frames_test(PixmapPtr pPixmap, DamageReportLevel level)
+{
+    DamagePtr pDamage, reference;
+    int frame, deferred;
+
+    for (deferred = 0; deferred < 2; deferred++) {
+        reference = create_damage(pPixmap, DamageReportNone, FALSE);
+        pDamage = create_damage(pPixmap, level, deferred);
+        for (frame = 0; frame < FRAMES; frame++) {
+            reports = 0;
+            draw_frame(pPixmap, frame);
+            DamageFlushDeferred();
+            assert(RegionEqual(DamageRegion(pDamage), DamageRegion(reference)));
+
+            if (deferred) {
+                /* One report per frame, holding the whole frame */
+                assert(reports == 1);
+                assert(RegionEqual(&reported, DamageRegion(reference)));
+            } else if (level == DamageReportNonEmpty) {
+                assert(reports == 1);
+            } else if (level == DamageReportBoundingBox) {
+                assert(reports >= 1 && reports <= FILLS_PER_FRAME);
+            } else {
+                /* Every fill in a frame hits a different cell */
+                assert(reports == FILLS_PER_FRAME);
+            }
+
+            /* The compositing manager repaints and subtracts */
+            DamageEmpty(pDamage);
+            DamageEmpty(reference);
+        }
+        DamageUnregister(&pPixmap->drawable, pDamage);
+        DamageUnregister(&pPixmap->drawable, reference);
+        DamageDestroy(pDamage);
+        DamageDestroy(reference);
+    }
+}
+
+#ifdef BENCHMARK
+static void
+damage_bench(PixmapPtr pPixmap, DamageReportLevel level, const char *name)
+{
+    DamagePtr pDamage;
+    CARD64 start, usec;
+    int frame, deferred;
+
+    for (deferred = 0; deferred < 2; deferred++) {
+        pDamage = create_damage(pPixmap, level, deferred);
+        reports = region_ops = 0;
+        start = GetTimeInMicros();
+        for (frame = 0; frame < BENCH_FRAMES; frame++) {
+            draw_frame(pPixmap, frame);
+            DamageFlushDeferred();
+            /* The compositing manager repaints and subtracts */
+            DamageEmpty(pDamage);
+        }
+        usec = GetTimeInMicros() - start;
+        printf("%-14s %-9s %16.1f %16.1f %16.1f\n", name,
+               deferred ? "deferred" : "immediate",
+               (double) reports / BENCH_FRAMES,
+               (double) region_ops / BENCH_FRAMES,
+               (double) usec / BENCH_FRAMES);
+        DamageUnregister(&pPixmap->drawable, pDamage);
+        DamageDestroy(pDamage);
+    }
+}
+#endif
+
+int
+main(int argc, char** argv)
+{
+    PixmapPtr pPixmap = damage_init();
+
+    deferred_test(pPixmap);
+    marker_test(pPixmap);
+    limit_test(pPixmap);
+    drop_test(pPixmap);
+
+    frames_test(pPixmap, DamageReportRawRegion);
+    frames_test(pPixmap, DamageReportDeltaRegion);
+    frames_test(pPixmap, DamageReportBoundingBox);
+    frames_test(pPixmap, DamageReportNonEmpty);
+
+#ifdef BENCHMARK
+    printf("%-14s %-9s %16s %16s %16s\n", "level", "mode",
+           "events/frame", "region ops/frame", "usec/frame");
+    damage_bench(pPixmap, DamageReportRawRegion, "raw");
+    damage_bench(pPixmap, DamageReportDeltaRegion, "delta");
+    damage_bench(pPixmap, DamageReportBoundingBox, "bounding box");
+    damage_bench(pPixmap, DamageReportNonEmpty, "non-empty");
+#endif
+
+    return 0;
+}
@@ -0,0 +1,573 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fb.h"
+#include "picturestr.h"
+#include "fbpict.h"
+#include "mipict.h"
+#include "micmap.h"
+#include "xsha1.h"
+
+/*
+ * Checks the fb glyph atlas, and that fbGlyphs draws the same pixels as
+ * miGlyphs on a real fb screen, for a8 and component alpha argb glyphs,
+ * with and without a mask format.  Also checks HashGlyph, and that glyphs
+ * are only shared when their images match.
+ *
+ * Built with -DBENCHMARK, this also compares drawing text runs the way
+ * miGlyphs does (a fresh mask and a pixman image per glyph) with the
+ * atlas path used by fbGlyphs.  The per-request Picture, scratch GC and
+ * damage overhead of miGlyphs is not included, so the "before" numbers
+ * are a lower bound.  It then compares the throughput of HashGlyph with
+ * the SHA1 that AddGlyphs used to compute for every uploaded glyph.
+ */
+
+#define GLYPH_WIDTH	8
+#define GLYPH_HEIGHT	13
+#define GLYPH_STRIDE	8
+#define NUM_GLYPHS	256
+#define RUN_LENGTH	80
+#define BENCH_RUNS	20000
+#define HASH_ROUNDS	2000
+#define SCREEN_WIDTH	256
+#define SCREEN_HEIGHT	64
+#define TEXT_WIDTH	200
+#define TEXT_HEIGHT	40
+#define TEXT_GLYPHS	24
+
+static uint8_t glyph_bits[NUM_GLYPHS][GLYPH_HEIGHT * GLYPH_STRIDE];
+static pixman_image_t *glyph_images[NUM_GLYPHS];
+static FbGlyphAtlasEntryRec entries[NUM_GLYPHS];
+
+static void
+glyphs_init(void)
+{
+    unsigned int seed = 1;
+    int i, j;
+
+    for (i = 0; i < NUM_GLYPHS; i++) {
+        for (j = 0; j < GLYPH_HEIGHT * GLYPH_STRIDE; j++) {
+            seed = seed * 1103515245 + 12345;
+            glyph_bits[i][j] = seed >> 24;
+        }
+        glyph_images[i] = pixman_image_create_bits(PIXMAN_a8,
+                                                   GLYPH_WIDTH, GLYPH_HEIGHT,
+                                                   (uint32_t *) glyph_bits[i],
+                                                   GLYPH_STRIDE);
+        assert(glyph_images[i]);
+    }
+}
+
+static void
+atlas_test(void)
+{
+    FbGlyphAtlasRec atlas;
+    FbGlyphAtlasEntryRec entry, big;
+    pixman_image_t *image;
+    uint8_t *bits;
+    int stride, i, x, y, row;
+
+    fbGlyphAtlasInit(&atlas, PIXMAN_a8);
+    memset(&entry, 0, sizeof(entry));
+    assert(!fbGlyphAtlasLookup(&atlas, &entry, &x, &y));
+
+    image = fbGlyphAtlasAdd(&atlas, &entry, glyph_images[3], 0, 0,
+                            GLYPH_WIDTH, GLYPH_HEIGHT, &x, &y);
+    assert(image);
+    assert(fbGlyphAtlasLookup(&atlas, &entry, &x, &y) == image);
+
+    /* The copy in the atlas matches the glyph */
+    bits = (uint8_t *) pixman_image_get_data(image);
+    stride = pixman_image_get_stride(image);
+    for (row = 0; row < GLYPH_HEIGHT; row++)
+        assert(memcmp(bits + (y + row) * stride + x,
+                      glyph_bits[3] + row * GLYPH_STRIDE, GLYPH_WIDTH) == 0);
+
+    /* Oversized glyphs are left alone */
+    memset(&big, 0, sizeof(big));
+    assert(!fbGlyphAtlasAdd(&atlas, &big, glyph_images[0], 0, 0,
+                            FB_GLYPH_ATLAS_MAX + 1, 1, &x, &y));
+    assert(!fbGlyphAtlasLookup(&atlas, &big, &x, &y));
+
+    /* Filling every page recycles the first one, dropping the glyph */
+    for (i = 0; atlas.recycled == 0; i++) {
+        memset(&big, 0, sizeof(big));
+        assert(fbGlyphAtlasAdd(&atlas, &big, glyph_images[0], 0, 0,
+                               GLYPH_WIDTH, GLYPH_HEIGHT, &x, &y));
+    }
+    assert(i > FB_GLYPH_ATLAS_PAGES);
+    assert(!fbGlyphAtlasLookup(&atlas, &entry, &x, &y));
+    assert(fbGlyphAtlasLookup(&atlas, &big, &x, &y));
+
+    fbGlyphAtlasFini(&atlas);
+}
+
+static int
+run_glyph(int run, int i)
+{
+    return (run * 7 + i * 13) % NUM_GLYPHS;
+}
+
+static void
+draw_per_glyph(pixman_image_t *src, pixman_image_t *dst, int run)
+{
+    pixman_image_t *mask, *glyph;
+    int i, g;
+
+    mask = pixman_image_create_bits(PIXMAN_a8, RUN_LENGTH * GLYPH_WIDTH,
+                                    GLYPH_HEIGHT, NULL, 0);
+    for (i = 0; i < RUN_LENGTH; i++) {
+        g = run_glyph(run, i);
+        glyph = pixman_image_create_bits(PIXMAN_a8, GLYPH_WIDTH, GLYPH_HEIGHT,
+                                         (uint32_t *) glyph_bits[g],
+                                         GLYPH_STRIDE);
+        pixman_image_composite(PIXMAN_OP_ADD, glyph, NULL, mask,
+                               0, 0, 0, 0, i * GLYPH_WIDTH, 0,
+                               GLYPH_WIDTH, GLYPH_HEIGHT);
+        pixman_image_unref(glyph);
+    }
+    pixman_image_composite(PIXMAN_OP_OVER, src, mask, dst, 0, 0, 0, 0, 0, 0,
+                           RUN_LENGTH * GLYPH_WIDTH, GLYPH_HEIGHT);
+    pixman_image_unref(mask);
+}
+
+static void
+draw_atlas(FbGlyphAtlasPtr atlas, uint8_t *mask_bits,
+           pixman_image_t *src, pixman_image_t *dst, int run)
+{
+    pixman_image_t *mask, *image;
+    int stride = RUN_LENGTH * GLYPH_WIDTH;
+    int i, g, x, y;
+
+    memset(mask_bits, 0, stride * GLYPH_HEIGHT);
+    mask = pixman_image_create_bits(PIXMAN_a8, RUN_LENGTH * GLYPH_WIDTH,
+                                    GLYPH_HEIGHT, (uint32_t *) mask_bits,
+                                    stride);
+    for (i = 0; i < RUN_LENGTH; i++) {
+        g = run_glyph(run, i);
+        image = fbGlyphAtlasLookup(atlas, &entries[g], &x, &y);
+        if (!image)
+            image = fbGlyphAtlasAdd(atlas, &entries[g], glyph_images[g], 0, 0,
+                                    GLYPH_WIDTH, GLYPH_HEIGHT, &x, &y);
+        pixman_image_composite(PIXMAN_OP_ADD, image, NULL, mask,
+                               x, y, 0, 0, i * GLYPH_WIDTH, 0,
+                               GLYPH_WIDTH, GLYPH_HEIGHT);
+    }
+    pixman_image_composite(PIXMAN_OP_OVER, src, mask, dst, 0, 0, 0, 0, 0, 0,
+                           RUN_LENGTH * GLYPH_WIDTH, GLYPH_HEIGHT);
+    pixman_image_unref(mask);
+}
+
+static void
+draw_test(void)
+{
+    pixman_color_t white = { 0xffff, 0xffff, 0xffff, 0xffff };
+    pixman_image_t *src, *dst, *check;
+    FbGlyphAtlasRec atlas;
+    uint8_t *mask_bits;
+
+    src = pixman_image_create_solid_fill(&white);
+    dst = pixman_image_create_bits(PIXMAN_x8r8g8b8, RUN_LENGTH * GLYPH_WIDTH,
+                                   GLYPH_HEIGHT, NULL, 0);
+    check = pixman_image_create_bits(PIXMAN_x8r8g8b8, RUN_LENGTH * GLYPH_WIDTH,
+                                     GLYPH_HEIGHT, NULL, 0);
+    mask_bits = malloc(RUN_LENGTH * GLYPH_WIDTH * GLYPH_HEIGHT);
+    assert(src && dst && check && mask_bits);
+    memset(entries, 0, sizeof(entries));
+    fbGlyphAtlasInit(&atlas, PIXMAN_a8);
+
+    /* Both paths draw the same pixels */
+    draw_per_glyph(src, dst, 1);
+    draw_atlas(&atlas, mask_bits, src, check, 1);
+    assert(memcmp(pixman_image_get_data(dst), pixman_image_get_data(check),
+                  pixman_image_get_stride(dst) * GLYPH_HEIGHT) == 0);
+
+    /* Again, now that the glyphs come out of the atlas */
+    draw_per_glyph(src, dst, 1);
+    draw_atlas(&atlas, mask_bits, src, check, 1);
+    assert(memcmp(pixman_image_get_data(dst), pixman_image_get_data(check),
+                  pixman_image_get_stride(dst) * GLYPH_HEIGHT) == 0);
+
+    fbGlyphAtlasFini(&atlas);
+    free(mask_bits);
+    pixman_image_unref(check);
+    pixman_image_unref(dst);
+    pixman_image_unref(src);
+}
+
+static CARD32 screen_bits[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+static PixmapFormatRec screen_formats[] = {
+    { 1, 1, BITMAP_SCANLINE_PAD },
+    { 8, 8, BITMAP_SCANLINE_PAD },
+    { 24, 32, BITMAP_SCANLINE_PAD },
+    { 32, 32, BITMAP_SCANLINE_PAD },
+};
+
+static Bool
+screen_init(int index, ScreenPtr pScreen, int argc, char **argv)
+{
+    return miSetVisualTypesAndMasks(24, 1 << TrueColor, 8, TrueColor,
+                                    0xff0000, 0x00ff00, 0x0000ff) &&
+           miSetPixmapDepths() &&
+           fbScreenInit(pScreen, screen_bits, SCREEN_WIDTH, SCREEN_HEIGHT,
+                        96, 96, SCREEN_WIDTH, 32) &&
+           fbPictureInit(pScreen, 0, 0);
+}
+
+static ScreenPtr
+screen_setup(int argc, char **argv)
+{
+    serverGeneration = 1;
+    screenInfo.imageByteOrder = IMAGE_BYTE_ORDER;
+    screenInfo.bitmapScanlineUnit = BITMAP_SCANLINE_UNIT;
+    screenInfo.bitmapScanlinePad = BITMAP_SCANLINE_PAD;
+    screenInfo.bitmapBitOrder = BITMAP_BIT_ORDER;
+    screenInfo.numPixmapFormats = sizeof(screen_formats) /
+                                  sizeof(screen_formats[0]);
+    memcpy(screenInfo.formats, screen_formats, sizeof(screen_formats));
+    dixResetPrivates();
+
+    assert(AddScreen(screen_init, argc, argv) == 0);
+    assert(CreateGCperDepth(0));
+    assert(CreateDefaultStipple(0));
+    return screenInfo.screens[0];
+}
+
+/*
+ * A glyph holding glyph_bits[g], realized the way AddGlyphs does it.
+ * argb glyphs take their alpha from glyph_bits[g] and their colour partly
+ * from the next glyph, and are component alpha like those of AddGlyphs.
+ */
+static GlyphPtr
+screen_glyph(ScreenPtr pScreen, PictFormatPtr format, int g)
+{
+    xGlyphInfo gi = { GLYPH_WIDTH, GLYPH_HEIGHT, g % 3, 10,
+                      GLYPH_WIDTH - 2, 0 };
+    Bool argb = format->depth == 32;
+    XID component_alpha = argb;
+    GlyphPtr glyph;
+    PixmapPtr pixmap;
+    CARD32 *pixels, a, r;
+    int error, row, col, i;
+
+    glyph = AllocateGlyph(&gi, argb ? GlyphFormat32 : GlyphFormat8);
+    pixmap = (*pScreen->CreatePixmap)(pScreen, GLYPH_WIDTH, GLYPH_HEIGHT,
+                                      format->depth,
+                                      CREATE_PIXMAP_USAGE_GLYPH_PICTURE);
+    assert(glyph && pixmap);
+    for (row = 0; row < GLYPH_HEIGHT; row++) {
+        if (!argb) {
+            memcpy((uint8_t *) pixmap->devPrivate.ptr + row * pixmap->devKind,
+                   glyph_bits[g] + row * GLYPH_STRIDE, GLYPH_WIDTH);
+            continue;
+        }
+        pixels = (CARD32 *) ((uint8_t *) pixmap->devPrivate.ptr +
+                             row * pixmap->devKind);
+        for (col = 0; col < GLYPH_WIDTH; col++) {
+            i = row * GLYPH_STRIDE + col;
+            a = glyph_bits[g][i];
+            r = a * glyph_bits[(g + 1) % NUM_GLYPHS][i] / 255;
+            pixels[col] = a << 24 | r << 16 | (a / 2) << 8 | (a - r);
+        }
+    }
+    GlyphPicture(glyph)[0] = CreatePicture(0, &pixmap->drawable, format,
+                                           argb ? CPComponentAlpha : 0,
+                                           &component_alpha, serverClient,
+                                           &error);
+    assert(GlyphPicture(glyph)[0]);
+    (*pScreen->DestroyPixmap)(pixmap);
+    return glyph;
+}
+
+/* A destination with a background for OVER to blend with */
+static PicturePtr
+screen_dest(ScreenPtr pScreen, PictFormatPtr format)
+{
+    PicturePtr picture;
+    PixmapPtr pixmap;
+    uint8_t *bits;
+    int error, i;
+
+    pixmap = (*pScreen->CreatePixmap)(pScreen, TEXT_WIDTH, TEXT_HEIGHT, 24, 0);
+    assert(pixmap);
+    bits = pixmap->devPrivate.ptr;
+    for (i = 0; i < pixmap->devKind * TEXT_HEIGHT; i++)
+        bits[i] = i * 7;
+    picture = CreatePicture(0, &pixmap->drawable, format, 0, 0,
+                            serverClient, &error);
+    assert(picture);
+    (*pScreen->DestroyPixmap)(pixmap);
+    return picture;
+}
+
+/*
+ * Glyphs are shared by content: a hash match is checked against the
+ * image in the glyph's picture, and a different image that hashes alike
+ * moves on to the next collision counter.
+ */
+static void
+contents_test(ScreenPtr pScreen, PictFormatPtr a8)
+{
+    xGlyphInfo gi = { GLYPH_WIDTH, GLYPH_HEIGHT, 5 % 3, 10,
+                      GLYPH_WIDTH - 2, 0 };
+    GlyphSetPtr set = AllocateGlyphSet(GlyphFormat8, a8);
+    GlyphPtr glyph = screen_glyph(pScreen, a8, 5);
+    unsigned char sha1[20];
+    CARD32 collision;
+
+    assert(set);
+    HashGlyph(&gi, glyph_bits[5], sizeof(glyph_bits[5]), glyph->sha1);
+    AddGlyph(set, glyph, 1);
+
+    memcpy(sha1, glyph->sha1, sizeof(sha1));
+    assert(FindGlyphByContents(sha1, &gi, glyph_bits[5], GlyphFormat8) ==
+           glyph);
+    assert(memcmp(sha1, glyph->sha1, sizeof(sha1)) == 0);
+
+    assert(!FindGlyphByContents(sha1, &gi, glyph_bits[6], GlyphFormat8));
+    memcpy(&collision, sha1 + 16, sizeof(collision));
+    assert(collision == 1);
+
+    gi.xOff++;
+    memcpy(sha1, glyph->sha1, sizeof(sha1));
+    assert(!FindGlyphByContents(sha1, &gi, glyph_bits[5], GlyphFormat8));
+
+    FreeGlyphSet(set, 0);
+}
+
+static void
+fb_glyphs_test(int argc, char **argv)
+{
+    xRenderColor color = { 0xffff, 0x8000, 0x4000, 0xc000 };
+    ScreenPtr pScreen = screen_setup(argc, argv);
+    PictFormatPtr a8 = PictureMatchFormat(pScreen, 8, PICT_a8);
+    PictFormatPtr argb = PictureMatchFormat(pScreen, 32, PICT_a8r8g8b8);
+    PictFormatPtr rgb = PictureMatchFormat(pScreen, 24, PICT_x8r8g8b8);
+    PictFormatPtr formats[] = { a8, argb };
+    PictFormatPtr mask;
+    GlyphPtr glyphs[2][TEXT_GLYPHS];
+    GlyphListRec lists[2];
+    PicturePtr src, atlas, per_glyph;
+    PixmapPtr a, b;
+    int error, i, f, m;
+
+    assert(a8 && argb && rgb);
+    src = CreateSolidPicture(0, &color, &error);
+    assert(src);
+    for (f = 0; f < 2; f++)
+        for (i = 0; i < TEXT_GLYPHS; i++)
+            glyphs[f][i] = screen_glyph(pScreen, formats[f], run_glyph(1, i));
+
+    /*
+     * Two lines of glyphs which overlap their neighbours; the second
+     * runs off the right edge of the destination.
+     */
+    lists[0].xOff = 4;
+    lists[0].yOff = 12;
+    lists[0].len = TEXT_GLYPHS / 2;
+    lists[1].xOff = 60;
+    lists[1].yOff = 16;
+    lists[1].len = TEXT_GLYPHS - TEXT_GLYPHS / 2;
+
+    /* Each glyph format, through a mask of the same format and without */
+    for (m = 0; m < 4; m++) {
+        f = m / 2;
+        mask = m % 2 ? NULL : formats[f];
+        lists[0].format = lists[1].format = formats[f];
+        atlas = screen_dest(pScreen, rgb);
+        per_glyph = screen_dest(pScreen, rgb);
+
+        /* The second pass draws out of the atlas */
+        for (i = 0; i < 2; i++) {
+            fbGlyphs(PictOpOver, src, atlas, mask, 0, 0, 2, lists,
+                     glyphs[f]);
+            miGlyphs(PictOpOver, src, per_glyph, mask, 0, 0, 2, lists,
+                     glyphs[f]);
+        }
+
+        a = (PixmapPtr) atlas->pDrawable;
+        b = (PixmapPtr) per_glyph->pDrawable;
+        assert(memcmp(a->devPrivate.ptr, b->devPrivate.ptr,
+                      a->devKind * TEXT_HEIGHT) == 0);
+
+        FreePicture(atlas, 0);
+        FreePicture(per_glyph, 0);
+    }
+
+    for (f = 0; f < 2; f++) {
+        for (i = 0; i < TEXT_GLYPHS; i++) {
+            FreePicture(GlyphPicture(glyphs[f][i])[0], 0);
+            dixFreeObjectWithPrivates(glyphs[f][i], PRIVATE_GLYPH);
+        }
+    }
+    FreePicture(src, 0);
+
+    contents_test(pScreen, a8);
+}
+
+#ifdef BENCHMARK
+static void
+glyphs_bench(void)
+{
+    pixman_color_t white = { 0xffff, 0xffff, 0xffff, 0xffff };
+    pixman_image_t *src, *dst;
+    FbGlyphAtlasRec atlas;
+    uint8_t *mask_bits;
+    CARD64 start, before, after;
+    int run;
+
+    src = pixman_image_create_solid_fill(&white);
+    dst = pixman_image_create_bits(PIXMAN_x8r8g8b8, RUN_LENGTH * GLYPH_WIDTH,
+                                   GLYPH_HEIGHT, NULL, 0);
+    mask_bits = malloc(RUN_LENGTH * GLYPH_WIDTH * GLYPH_HEIGHT);
+    assert(src && dst && mask_bits);
+    memset(entries, 0, sizeof(entries));
+    fbGlyphAtlasInit(&atlas, PIXMAN_a8);
+
+    start = GetTimeInMicros();
+    for (run = 0; run < BENCH_RUNS; run++)
+        draw_per_glyph(src, dst, run);
+    before = GetTimeInMicros() - start;
+
+    start = GetTimeInMicros();
+    for (run = 0; run < BENCH_RUNS; run++)
+        draw_atlas(&atlas, mask_bits, src, dst, run);
+    after = GetTimeInMicros() - start;
+
+    printf("%-20s %14s\n", "path", "glyphs/second");
+    printf("%-20s %14.0f\n", "per-glyph images",
+           (double) BENCH_RUNS * RUN_LENGTH * 1000000.0 / (before ? before : 1));
+    printf("%-20s %14.0f\n", "atlas",
+           (double) BENCH_RUNS * RUN_LENGTH * 1000000.0 / (after ? after : 1));
+
+    fbGlyphAtlasFini(&atlas);
+    free(mask_bits);
+    pixman_image_unref(dst);
+    pixman_image_unref(src);
+}
+#endif
+
+static void
+hash_test(void)
+{
+    xGlyphInfo gi = { GLYPH_WIDTH, GLYPH_HEIGHT, 0, 10, GLYPH_WIDTH, 0 };
+    unsigned char a[20], b[20];
+    uint8_t bits[GLYPH_HEIGHT * GLYPH_STRIDE];
+    int i, j;
+
+    /* Same glyph, same hash */
+    assert(HashGlyph(&gi, glyph_bits[0], sizeof(bits), a) == Success);
+    assert(HashGlyph(&gi, glyph_bits[0], sizeof(bits), b) == Success);
+    assert(memcmp(a, b, sizeof(a)) == 0);
+
+    /* The collision counter starts out at zero */
+    assert(a[16] == 0 && a[17] == 0 && a[18] == 0 && a[19] == 0);
+
+    /* Every bit of the image and of the info matters */
+    memcpy(bits, glyph_bits[0], sizeof(bits));
+    for (i = 0; i < sizeof(bits) * 8; i++) {
+        bits[i / 8] ^= 1 << (i % 8);
+        HashGlyph(&gi, bits, sizeof(bits), b);
+        assert(memcmp(a, b, 16) != 0);
+        bits[i / 8] ^= 1 << (i % 8);
+    }
+    gi.xOff++;
+    HashGlyph(&gi, glyph_bits[0], sizeof(bits), b);
+    assert(memcmp(a, b, 16) != 0);
+    gi.xOff--;
+
+    /* Trailing zeros are not lost to the padding of the last block */
+    memset(bits, 0, sizeof(bits));
+    HashGlyph(&gi, bits, 5, a);
+    HashGlyph(&gi, bits, 6, b);
+    assert(memcmp(a, b, 16) != 0);
+
+    /* No collisions among the test glyphs */
+    for (i = 0; i < NUM_GLYPHS; i++) {
+        HashGlyph(&gi, glyph_bits[i], sizeof(bits), a);
+        for (j = 0; j < i; j++) {
+            HashGlyph(&gi, glyph_bits[j], sizeof(bits), b);
+            assert(memcmp(a, b, 16) != 0);
+        }
+    }
+}
+
+#ifdef BENCHMARK
+static void
+hash_bench(void)
+{
+    xGlyphInfo gi = { GLYPH_WIDTH, GLYPH_HEIGHT, 0, 10, GLYPH_WIDTH, 0 };
+    unsigned char sha1[20];
+    CARD64 start, before, after;
+    void *ctx;
+    int round, i;
+
+    start = GetTimeInMicros();
+    for (round = 0; round < HASH_ROUNDS; round++) {
+        for (i = 0; i < NUM_GLYPHS; i++) {
+            ctx = x_sha1_init();
+            x_sha1_update(ctx, &gi, sizeof(gi));
+            x_sha1_update(ctx, glyph_bits[i], sizeof(glyph_bits[i]));
+            x_sha1_final(ctx, sha1);
+        }
+    }
+    before = GetTimeInMicros() - start;
+
+    start = GetTimeInMicros();
+    for (round = 0; round < HASH_ROUNDS; round++)
+        for (i = 0; i < NUM_GLYPHS; i++)
+            HashGlyph(&gi, glyph_bits[i], sizeof(glyph_bits[i]), sha1);
+    after = GetTimeInMicros() - start;
+
+    printf("%-20s %14s\n", "hash", "glyphs/second");
+    printf("%-20s %14.0f\n", "SHA1",
+           (double) HASH_ROUNDS * NUM_GLYPHS * 1000000.0 / (before ? before : 1));
+    printf("%-20s %14.0f\n", "HashGlyph",
+           (double) HASH_ROUNDS * NUM_GLYPHS * 1000000.0 / (after ? after : 1));
+}
+#endif
+
+int
+main(int argc, char** argv)
+{
+    glyphs_init();
+    atlas_test();
+    draw_test();
+    fb_glyphs_test(argc, argv);
+    hash_test();
+#ifdef BENCHMARK
+    glyphs_bench();
+    hash_bench();
+#endif
+
+    return 0;
+}
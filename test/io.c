@@ -0,0 +1,155 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <X11/Xproto.h>
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "osdep.h"
+
+/*
+ * Streams large requests from two clients through the connection input
+ * buffers, the way clients doing big PutImage or AddGlyphs requests do.
+ * Each client's buffer grows for its request and is traded back for a
+ * small one when the other client reads, which used to be a realloc
+ * either way.  Checks that the buffer pool serves all of that once it is
+ * warm.  Built with BENCHMARK defined (io-bench), it reports the mallocs
+ * per request and what a request costs.
+ */
+
+#define CLIENTS		2
+#define BENCH_REQUESTS	(1 << 16)
+
+static const int request_sizes[] = { 16384, 65536, 262140 };
+#define NUM_SIZES	(sizeof(request_sizes) / sizeof(request_sizes[0]))
+
+static ClientRec test_clients[CLIENTS];
+static OsCommRec test_comms[CLIENTS];
+static char request[262140];
+
+static void
+init_clients(void)
+{
+    int i;
+
+    for (i = 0; i < CLIENTS; i++) {
+        test_comms[i].fd = i;
+        test_clients[i].index = i + 1;
+        test_clients[i].osPrivate = &test_comms[i];
+    }
+}
+
+/* Queue a request of size bytes on the client and read it back */
+static void
+stream_request(ClientPtr client, int size, int tag)
+{
+    xReq *req = (xReq *)request;
+    int result;
+
+    req->reqType = X_PutImage;
+    req->data = tag;
+    req->length = size >> 2;
+    request[size - 1] = tag;
+
+    result = InsertFakeRequest(client, request, size);
+    assert(result);
+    result = ReadRequestFromClient(client);
+    assert(result == size);
+    assert(client->req_len == size >> 2);
+    assert(((xReq *)client->requestBuffer)->data == tag);
+    assert(((char *)client->requestBuffer)[size - 1] == tag);
+}
+
+static void
+stream(int requests)
+{
+    int i;
+
+    for (i = 0; i < requests; i++)
+        stream_request(&test_clients[i % CLIENTS],
+                       request_sizes[(i / CLIENTS) % NUM_SIZES], i & 0x7f);
+}
+
+static void
+io_test(void)
+{
+    OsBufferStatsRec before, after;
+
+    init_clients();
+
+    /* Fill the pool with every size the stream uses */
+    stream(CLIENTS * NUM_SIZES * 2);
+    GetOsBufferStats(&before);
+    assert(before.mallocs > 0);
+    assert(before.pooled > 0);
+
+    stream(CLIENTS * NUM_SIZES * 10);
+    GetOsBufferStats(&after);
+    assert(after.requests > before.requests);
+    assert(after.mallocs == before.mallocs);
+    assert(after.frees == before.frees);
+    assert(after.pooledBytes <= 8 * 1024 * 1024);
+}
+
+#ifdef BENCHMARK
+static void
+io_bench(void)
+{
+    OsBufferStatsRec before, after;
+    CARD64 start, elapsed;
+
+    GetOsBufferStats(&before);
+    start = GetTimeInMicros();
+    stream(BENCH_REQUESTS);
+    elapsed = GetTimeInMicros() - start;
+    GetOsBufferStats(&after);
+
+    /* Without the pool, every buffer handed out was a malloc or realloc */
+    printf("%-24s %14s %14s %14s\n", "input buffers",
+           "buffers/req", "mallocs/req", "usec/req");
+    printf("%-24s %14.3f %14.3f %14.3f\n", "16KB to 256KB requests",
+           (double) (after.requests - before.requests) / BENCH_REQUESTS,
+           (double) (after.mallocs - before.mallocs) / BENCH_REQUESTS,
+           (double) elapsed / BENCH_REQUESTS);
+}
+#endif
+
+int
+main(int argc, char** argv)
+{
+    io_test();
+#ifdef BENCHMARK
+    io_bench();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,341 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "misc.h"
+#include "os.h"
+#include "windowstr.h"
+#include "inputstr.h"
+#include "input.h"
+#include "scrnintstr.h"
+
+/*
+ * Checks XYToWindow against a plain walk of the window tree while
+ * pointer motion is replayed over a synthetic desktop: many top-level
+ * frames, each holding a client window full of toolkit widgets, some of
+ * them input shaped.  Windows are raised, moved and unmapped in between
+ * through the dix entry points to exercise index invalidation, and each
+ * move also picks under a stationary pointer from the screen hook, the
+ * way WindowsRestructured does.  Built with -DBENCHMARK, this also times
+ * both.
+ */
+
+#define SCREEN_WIDTH	1920
+#define SCREEN_HEIGHT	1200
+#define NUM_FRAMES	400
+#define WIDGET_COLS	8
+#define WIDGET_ROWS	6
+#define MOTIONS		20000
+#define BENCH_MOTIONS	200000
+
+static ScreenRec screen;
+static WindowRec root;
+static WindowOptRec rootOptional;
+static WindowPtr frames[NUM_FRAMES];
+static SpriteRec sprite;
+
+/* The stationary pointer and what the MoveWindow hook found under it */
+static int pointerX, pointerY;
+static WindowPtr restructured;
+
+static unsigned int seed = 1;
+
+static int
+rnd(int n)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % n;
+}
+
+static void
+place_window(WindowPtr pWin, int x, int y)
+{
+    WindowPtr pChild;
+
+    pWin->origin.x = x;
+    pWin->origin.y = y;
+    pWin->drawable.x = pWin->parent->drawable.x + x;
+    pWin->drawable.y = pWin->parent->drawable.y + y;
+    for (pChild = pWin->firstChild; pChild; pChild = pChild->nextSib)
+        place_window(pChild, pChild->origin.x, pChild->origin.y);
+}
+
+/* Creates a mapped window at the top of pParent's stack */
+static WindowPtr
+add_window(WindowPtr pParent, int x, int y, int w, int h, int bw)
+{
+    WindowPtr pWin = calloc(1, sizeof(WindowRec));
+
+    assert(pWin);
+    pWin->parent = pParent;
+    pWin->drawable.pScreen = &screen;
+    pWin->drawable.class = InputOutput;
+    pWin->drawable.width = w;
+    pWin->drawable.height = h;
+    pWin->borderWidth = bw;
+    pWin->cursorIsNone = TRUE;
+    pWin->mapped = TRUE;
+    pWin->nextSib = pParent->firstChild;
+    if (pParent->firstChild)
+        pParent->firstChild->prevSib = pWin;
+    else
+        pParent->lastChild = pWin;
+    pParent->firstChild = pWin;
+    place_window(pWin, x + bw, y + bw);
+    return pWin;
+}
+
+static void
+shape_input(WindowPtr pWin)
+{
+    BoxRec box;
+
+    /* Only the left half takes input */
+    box.x1 = 0;
+    box.y1 = 0;
+    box.x2 = pWin->drawable.width / 2;
+    box.y2 = pWin->drawable.height;
+    pWin->optional = calloc(1, sizeof(WindowOptRec));
+    assert(pWin->optional);
+    pWin->optional->inputShape = RegionCreate(&box, 1);
+}
+
+/* Like miMoveWindow, which ends up in WindowsRestructured */
+static void
+move_window(WindowPtr pWin, int x, int y, WindowPtr pSib, VTKind kind)
+{
+    int bw = wBorderWidth(pWin);
+
+    place_window(pWin, x + bw, y + bw);
+    restructured = XYToWindow(&sprite, pointerX, pointerY);
+}
+
+static void
+desktop_init(void)
+{
+    WindowPtr client;
+    int i, col, row, w, h, cw, ch;
+
+    screen.MoveWindow = move_window;
+    root.drawable.pScreen = &screen;
+    root.drawable.class = InputOutput;
+    root.drawable.width = SCREEN_WIDTH;
+    root.drawable.height = SCREEN_HEIGHT;
+    root.mapped = TRUE;
+    root.cursorIsNone = TRUE;
+    root.optional = &rootOptional;
+
+    for (i = 0; i < NUM_FRAMES; i++) {
+        w = 200 + rnd(600);
+        h = 150 + rnd(450);
+        frames[i] = add_window(&root, rnd(SCREEN_WIDTH - w / 2) - w / 4,
+                               rnd(SCREEN_HEIGHT - h / 2) - h / 4, w, h,
+                               rnd(3));
+        client = add_window(frames[i], 4, 24, w - 8, h - 28, 0);
+        cw = client->drawable.width / WIDGET_COLS;
+        ch = client->drawable.height / WIDGET_ROWS;
+        for (row = 0; row < WIDGET_ROWS; row++)
+            for (col = 0; col < WIDGET_COLS; col++)
+                if (rnd(8))
+                    add_window(client, col * cw + 1, row * ch + 1,
+                               cw - 2, ch - 2, 0);
+        if (!rnd(10))
+            shape_input(client->firstChild);
+        if (!rnd(20))
+            frames[i]->mapped = FALSE;
+    }
+
+    sprite.spriteTraceSize = 1;
+    sprite.spriteTrace = calloc(1, sizeof(WindowPtr));
+    assert(sprite.spriteTrace);
+    sprite.spriteTrace[0] = &root;
+}
+
+static Bool
+contains(WindowPtr pWin, int x, int y)
+{
+    int bw = wBorderWidth(pWin);
+    BoxRec box;
+
+    if (!pWin->mapped ||
+        x < pWin->drawable.x - bw ||
+        x >= pWin->drawable.x + (int) pWin->drawable.width + bw ||
+        y < pWin->drawable.y - bw ||
+        y >= pWin->drawable.y + (int) pWin->drawable.height + bw)
+        return FALSE;
+    return !wInputShape(pWin) ||
+           RegionContainsPoint(wInputShape(pWin), x - pWin->drawable.x,
+                               y - pWin->drawable.y, &box);
+}
+
+/* The reference: every sibling in turn, the way XYToWindow used to */
+static int
+walk_tree(int x, int y, WindowPtr *trace)
+{
+    WindowPtr pWin = root.firstChild;
+    int depth = 1;
+
+    trace[0] = &root;
+    while (pWin) {
+        if (contains(pWin, x, y)) {
+            trace[depth++] = pWin;
+            pWin = pWin->firstChild;
+        } else
+            pWin = pWin->nextSib;
+    }
+    return depth;
+}
+
+static void
+raise_window(WindowPtr pWin)
+{
+    XID vlist[1] = { Above };
+
+    assert(ConfigureWindow(pWin, CWStackMode, vlist, serverClient) ==
+           Success);
+}
+
+static void
+move_window_test(WindowPtr pWin)
+{
+    WindowPtr trace[16];
+    XID vlist[2];
+    int bw = wBorderWidth(pWin), depth;
+
+    /* Keep the pointer on the old or the new top left corner, so the
+     * window moves off or onto it */
+    vlist[0] = pWin->origin.x - bw + rnd(101) - 50;
+    vlist[1] = pWin->origin.y - bw + rnd(101) - 50;
+    if (rnd(2)) {
+        pointerX = pWin->drawable.x - bw;
+        pointerY = pWin->drawable.y - bw;
+    } else {
+        pointerX = root.drawable.x + (INT16) vlist[0];
+        pointerY = root.drawable.y + (INT16) vlist[1];
+    }
+    pointerX = max(0, min(SCREEN_WIDTH - 1, pointerX));
+    pointerY = max(0, min(SCREEN_HEIGHT - 1, pointerY));
+
+    restructured = NULL;
+    assert(ConfigureWindow(pWin, CWX | CWY, vlist, serverClient) == Success);
+    if (restructured) {
+        depth = walk_tree(pointerX, pointerY, trace);
+        assert(restructured == trace[depth - 1]);
+    }
+}
+
+static void
+change_desktop(void)
+{
+    WindowPtr pWin = frames[rnd(NUM_FRAMES)];
+
+    switch (rnd(3)) {
+    case 0:
+        raise_window(pWin);
+        break;
+    case 1:
+        move_window_test(pWin);
+        break;
+    case 2:
+        if (pWin->mapped)
+            UnmapWindow(pWin, FALSE);
+        else
+            MapWindow(pWin, serverClient);
+        break;
+    }
+}
+
+static void
+motion_test(void)
+{
+    WindowPtr trace[16];
+    int i, depth, x = SCREEN_WIDTH / 2, y = SCREEN_HEIGHT / 2;
+
+    for (i = 0; i < MOTIONS; i++) {
+        /* Mostly short moves, with the odd jump across the screen */
+        if (rnd(50)) {
+            x = max(0, min(SCREEN_WIDTH - 1, x + rnd(41) - 20));
+            y = max(0, min(SCREEN_HEIGHT - 1, y + rnd(41) - 20));
+        } else {
+            x = rnd(SCREEN_WIDTH);
+            y = rnd(SCREEN_HEIGHT);
+        }
+        if (!rnd(100))
+            change_desktop();
+
+        depth = walk_tree(x, y, trace);
+        assert(XYToWindow(&sprite, x, y) == trace[depth - 1]);
+        assert(sprite.spriteTraceGood == depth);
+        assert(!memcmp(sprite.spriteTrace, trace, depth * sizeof(WindowPtr)));
+    }
+}
+
+#ifdef BENCHMARK
+static void
+pick_bench(void)
+{
+    WindowPtr trace[16];
+    CARD64 start, linear, indexed;
+    int i;
+
+    seed = 1;
+    start = GetTimeInMicros();
+    for (i = 0; i < BENCH_MOTIONS; i++)
+        walk_tree(rnd(SCREEN_WIDTH), rnd(SCREEN_HEIGHT), trace);
+    linear = GetTimeInMicros() - start;
+
+    seed = 1;
+    start = GetTimeInMicros();
+    for (i = 0; i < BENCH_MOTIONS; i++)
+        XYToWindow(&sprite, rnd(SCREEN_WIDTH), rnd(SCREEN_HEIGHT));
+    indexed = GetTimeInMicros() - start;
+
+    printf("%d frames\n%-22s %14s\n", NUM_FRAMES, "pick", "motions/second");
+    printf("%-22s %14.0f\n", "linear walk",
+           (double) BENCH_MOTIONS * 1000000.0 / (linear ? linear : 1));
+    printf("%-22s %14.0f\n", "XYToWindow",
+           (double) BENCH_MOTIONS * 1000000.0 / (indexed ? indexed : 1));
+}
+#endif
+
+int
+main(int argc, char** argv)
+{
+    desktop_init();
+    motion_test();
+#ifdef BENCHMARK
+    pick_bench();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,419 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "misc.h"
+#include "os.h"
+#include "gc.h"
+#include "regionstr.h"
+
+/*
+ * Checks the dix region fast paths against pixman's general region
+ * operations on clip lists like the ones mivaltree computes for a busy
+ * desktop: a stack of overlapping windows where each window is clipped
+ * by everything stacked above it.  Built with -DBENCHMARK, this also
+ * times both.
+ */
+
+#define SCREEN_WIDTH	1920
+#define SCREEN_HEIGHT	1200
+#define NUM_WINDOWS	64
+#define NUM_CLIPS	32
+#define BENCH_ROUNDS	2000
+
+static BoxRec windows[NUM_WINDOWS];
+static RegionRec clips[NUM_WINDOWS];
+static BoxRec boxes[NUM_CLIPS];
+
+static unsigned int seed = 1;
+
+static int
+rnd(int n)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % n;
+}
+
+static void
+random_box(BoxPtr box, int min_w, int min_h)
+{
+    box->x1 = rnd(SCREEN_WIDTH - min_w);
+    box->y1 = rnd(SCREEN_HEIGHT - min_h);
+    box->x2 = min(box->x1 + min_w + rnd(SCREEN_WIDTH / 2), SCREEN_WIDTH);
+    box->y2 = min(box->y1 + min_h + rnd(SCREEN_HEIGHT / 2), SCREEN_HEIGHT);
+}
+
+/* Window 0 is the top of the stack.  Setup uses pixman directly so it
+ * doesn't depend on the code under test. */
+static void
+desktop_init(void)
+{
+    RegionRec covered, win;
+    int i, total = 0;
+
+    InitRegions();
+    RegionNull(&covered);
+    for (i = 0; i < NUM_WINDOWS; i++) {
+        random_box(&windows[i], 200, 150);
+        RegionInit(&win, &windows[i], 0);
+        RegionNull(&clips[i]);
+        pixman_region_subtract(&clips[i], &win, &covered);
+        pixman_region_union(&covered, &covered, &win);
+        RegionUninit(&win);
+        total += RegionNumRects(&clips[i]);
+    }
+    RegionUninit(&covered);
+
+    for (i = 0; i < NUM_CLIPS; i++)
+        random_box(&boxes[i], 16, 16);
+
+    printf("%d windows, %d clip rectangles\n", NUM_WINDOWS, total);
+}
+
+static void
+check_equal(RegionPtr fast, RegionPtr ref)
+{
+    assert(pixman_region_selfcheck(fast));
+    assert(pixman_region_equal(fast, ref));
+}
+
+static void
+intersect_test(void)
+{
+    RegionRec box, fast, ref, tmp;
+    int i, j;
+
+    for (i = 0; i < NUM_WINDOWS; i++) {
+        for (j = 0; j < NUM_CLIPS + 1; j++) {
+            RegionInit(&box, j < NUM_CLIPS ? &boxes[j] : &windows[i], 0);
+            RegionNull(&fast);
+            RegionNull(&ref);
+            RegionNull(&tmp);
+
+            pixman_region_intersect(&ref, &clips[i], &box);
+            RegionIntersect(&fast, &clips[i], &box);
+            check_equal(&fast, &ref);
+            RegionIntersect(&fast, &box, &clips[i]);
+            check_equal(&fast, &ref);
+
+            /* In place, on either operand */
+            RegionCopy(&tmp, &clips[i]);
+            RegionIntersect(&tmp, &tmp, &box);
+            check_equal(&tmp, &ref);
+            RegionIntersect(&box, &clips[i], &box);
+            check_equal(&box, &ref);
+
+            RegionUninit(&box);
+            RegionUninit(&fast);
+            RegionUninit(&ref);
+            RegionUninit(&tmp);
+        }
+    }
+}
+
+static void
+split(RegionPtr clip, int y, RegionPtr top, RegionPtr bottom)
+{
+    BoxRec upper = { MINSHORT, MINSHORT, MAXSHORT, y };
+    BoxRec lower = { MINSHORT, y, MAXSHORT, MAXSHORT };
+    RegionRec box;
+
+    RegionNull(top);
+    RegionNull(bottom);
+    RegionInit(&box, &upper, 0);
+    pixman_region_intersect(top, clip, &box);
+    RegionReset(&box, &lower);
+    pixman_region_intersect(bottom, clip, &box);
+    RegionUninit(&box);
+}
+
+static void
+union_test(void)
+{
+    RegionRec top, bottom, fast;
+    BoxPtr extents;
+    int i, y;
+
+    for (i = 0; i < NUM_WINDOWS; i++) {
+        if (!RegionNotEmpty(&clips[i]))
+            continue;
+        extents = RegionExtents(&clips[i]);
+        for (y = extents->y1 + 1; y < extents->y2; y += 7) {
+            split(&clips[i], y, &top, &bottom);
+            RegionNull(&fast);
+
+            /* Rejoining the halves must coalesce back to the original */
+            RegionUnion(&fast, &top, &bottom);
+            check_equal(&fast, &clips[i]);
+            RegionUnion(&fast, &bottom, &top);
+            check_equal(&fast, &clips[i]);
+            RegionUnion(&bottom, &top, &bottom);
+            check_equal(&bottom, &clips[i]);
+
+            /* Overlapping regions still take the general path */
+            pixman_region_union(&bottom, &top, &clips[(i + 1) % NUM_WINDOWS]);
+            RegionUnion(&top, &top, &clips[(i + 1) % NUM_WINDOWS]);
+            check_equal(&top, &bottom);
+
+            RegionUninit(&top);
+            RegionUninit(&bottom);
+            RegionUninit(&fast);
+        }
+    }
+}
+
+/* The lower region's first band has fewer boxes than the upper region's
+ * last band, so only some of those boxes line up with it. */
+static void
+band_union_test(void)
+{
+    static BoxRec upper[] = {
+        { 0, 0, 10, 5 }, { 20, 0, 30, 5 },
+    };
+    static BoxRec lower[] = {
+        { 0, 5, 10, 6 },
+        { 20, 6, 30, 7 }, { 40, 6, 50, 7 },
+    };
+    RegionRec top, bottom, fast, ref;
+
+    RegionInitBoxes(&top, upper, sizeof (upper) / sizeof (upper[0]));
+    RegionInitBoxes(&bottom, lower, sizeof (lower) / sizeof (lower[0]));
+    RegionNull(&fast);
+    RegionNull(&ref);
+
+    pixman_region_union(&ref, &top, &bottom);
+    RegionUnion(&fast, &top, &bottom);
+    check_equal(&fast, &ref);
+    RegionUnion(&fast, &bottom, &top);
+    check_equal(&fast, &ref);
+    RegionUnion(&top, &top, &bottom);
+    check_equal(&top, &ref);
+
+    RegionUninit(&top);
+    RegionUninit(&bottom);
+    RegionUninit(&fast);
+    RegionUninit(&ref);
+}
+
+static void
+validate_test(void)
+{
+    xRectangle *rects;
+    RegionPtr sorted, shuffled;
+    BoxPtr pbox;
+    int i, j, n;
+
+    for (i = 0; i < NUM_WINDOWS; i++) {
+        n = RegionNumRects(&clips[i]);
+        if (n < 2)
+            continue;
+        rects = malloc(n * sizeof(xRectangle));
+        assert(rects);
+        pbox = RegionRects(&clips[i]);
+        for (j = 0; j < n; j++) {
+            rects[j].x = pbox[j].x1;
+            rects[j].y = pbox[j].y1;
+            rects[j].width = pbox[j].x2 - pbox[j].x1;
+            rects[j].height = pbox[j].y2 - pbox[j].y1;
+        }
+        sorted = RegionFromRects(n, rects, CT_UNSORTED);
+        check_equal(sorted, &clips[i]);
+
+        for (j = n; --j > 0;) {
+            int k = rnd(j + 1);
+            xRectangle t = rects[j];
+
+            rects[j] = rects[k];
+            rects[k] = t;
+        }
+        shuffled = RegionFromRects(n, rects, CT_UNSORTED);
+        check_equal(shuffled, &clips[i]);
+
+        RegionDestroy(sorted);
+        RegionDestroy(shuffled);
+        free(rects);
+    }
+}
+
+#ifdef BENCHMARK
+typedef Bool (*RegionOpProcPtr)(RegionPtr, RegionPtr, RegionPtr);
+
+static Bool
+pixman_intersect(RegionPtr dst, RegionPtr a, RegionPtr b)
+{
+    return pixman_region_intersect(dst, a, b);
+}
+
+static Bool
+pixman_union(RegionPtr dst, RegionPtr a, RegionPtr b)
+{
+    return pixman_region_union(dst, a, b);
+}
+
+static Bool
+dix_intersect(RegionPtr dst, RegionPtr a, RegionPtr b)
+{
+    return RegionIntersect(dst, a, b);
+}
+
+static Bool
+dix_union(RegionPtr dst, RegionPtr a, RegionPtr b)
+{
+    return RegionUnion(dst, a, b);
+}
+
+static CARD64
+time_intersect(RegionOpProcPtr op)
+{
+    RegionRec box, dst;
+    CARD64 start;
+    int round, i;
+
+    RegionNull(&dst);
+    start = GetTimeInMicros();
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        for (i = 0; i < NUM_WINDOWS; i++) {
+            RegionInit(&box, &boxes[(round + i) % NUM_CLIPS], 0);
+            (*op)(&dst, &clips[i], &box);
+        }
+    }
+    start = GetTimeInMicros() - start;
+    RegionUninit(&dst);
+    return start;
+}
+
+static CARD64
+time_union(RegionOpProcPtr op, RegionPtr tops, RegionPtr bottoms)
+{
+    RegionRec dst;
+    CARD64 start;
+    int round, i;
+
+    RegionNull(&dst);
+    start = GetTimeInMicros();
+    for (round = 0; round < BENCH_ROUNDS; round++)
+        for (i = 0; i < NUM_WINDOWS; i++)
+            (*op)(&dst, &tops[i], &bottoms[i]);
+    start = GetTimeInMicros() - start;
+    RegionUninit(&dst);
+    return start;
+}
+
+static CARD64
+time_validate(Bool shuffle)
+{
+    RegionRec reg;
+    BoxPtr pbox;
+    CARD64 start, total = 0;
+    Bool overlap;
+    int round, i, j, n;
+
+    for (round = 0; round < BENCH_ROUNDS / 10; round++) {
+        for (i = 0; i < NUM_WINDOWS; i++) {
+            /* Rebuild an unvalidated region, as damage and exposure
+             * accumulation do with RegionAppend */
+            n = RegionNumRects(&clips[i]);
+            RegionNull(&reg);
+            if (!n || !RegionRectAlloc(&reg, n))
+                continue;
+            pbox = RegionBoxptr(&reg);
+            memcpy(pbox, RegionRects(&clips[i]), n * sizeof(BoxRec));
+            if (shuffle) {
+                for (j = n; --j > 0;) {
+                    int k = rnd(j + 1);
+                    BoxRec t = pbox[j];
+
+                    pbox[j] = pbox[k];
+                    pbox[k] = t;
+                }
+            }
+            reg.data->numRects = n;
+            reg.extents.x1 = reg.extents.x2 = 0;
+
+            start = GetTimeInMicros();
+            RegionValidate(&reg, &overlap);
+            total += GetTimeInMicros() - start;
+            RegionUninit(&reg);
+        }
+    }
+    return total;
+}
+
+static void
+print_rate(const char *name, int ops, CARD64 usec)
+{
+    printf("%-24s %14.0f\n", name, (double) ops * 1000000.0 / (usec ? usec : 1));
+}
+
+static void
+region_bench(void)
+{
+    RegionRec tops[NUM_WINDOWS], bottoms[NUM_WINDOWS];
+    BoxPtr extents;
+    int i, ops = BENCH_ROUNDS * NUM_WINDOWS;
+
+    for (i = 0; i < NUM_WINDOWS; i++) {
+        extents = RegionExtents(&clips[i]);
+        split(&clips[i], (extents->y1 + extents->y2) / 2, &tops[i], &bottoms[i]);
+    }
+
+    printf("%-24s %14s\n", "operation", "ops/second");
+    print_rate("intersect (pixman)", ops, time_intersect(pixman_intersect));
+    print_rate("intersect (dix)", ops, time_intersect(dix_intersect));
+    print_rate("band union (pixman)", ops,
+               time_union(pixman_union, tops, bottoms));
+    print_rate("band union (dix)", ops,
+               time_union(dix_union, tops, bottoms));
+    print_rate("validate (shuffled)", ops / 10, time_validate(TRUE));
+    print_rate("validate (sorted)", ops / 10, time_validate(FALSE));
+
+    for (i = 0; i < NUM_WINDOWS; i++) {
+        RegionUninit(&tops[i]);
+        RegionUninit(&bottoms[i]);
+    }
+}
+#endif
+
+int
+main(int argc, char** argv)
+{
+    desktop_init();
+    intersect_test();
+    union_test();
+    band_union_test();
+    validate_test();
+#ifdef BENCHMARK
+    region_bench();
+#endif
+
+    return 0;
+}
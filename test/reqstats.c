@@ -0,0 +1,168 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <X11/Xproto.h>
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "reqstats.h"
+
+/*
+ * Checks the request statistics Dispatch keeps with -reqstats.  Built with
+ * BENCHMARK defined (reqstats-bench), it then reports what recording a
+ * request costs: the clock read and RecordRequestStats that Dispatch adds
+ * around every request handler.
+ */
+
+#define BENCH_REQUESTS	(1 << 22)
+
+static ClientPtr test_client;
+
+static void
+stats_test(void)
+{
+    ReqStatsPtr stats;
+    int i;
+
+    /* Nothing is kept without -reqstats */
+    InitRequestStats();
+    test_client = dixAllocateObjectWithPrivates(ClientRec, PRIVATE_CLIENT);
+    assert(test_client);
+    assert(!ClientRequestStats(test_client));
+    RecordRequestStats(test_client, X_GetInputFocus, 0, 3, 4, 32);
+    dixFreeObjectWithPrivates(test_client, PRIVATE_CLIENT);
+
+    RequestStatsEnabled = TRUE;
+    InitRequestStats();
+    test_client = dixAllocateObjectWithPrivates(ClientRec, PRIVATE_CLIENT);
+    assert(test_client);
+    assert(ClientRequestStats(test_client));
+
+    assert(!GetRequestStats(X_GetInputFocus, 0));
+    assert(!GetRequestStats(-1, 0));
+    assert(!GetRequestStats(256, 0));
+
+    /* 99 quick requests and a slow one */
+    for (i = 0; i < 99; i++)
+        RecordRequestStats(test_client, X_GetInputFocus, 0, 3, 4, 32);
+    RecordRequestStats(test_client, X_GetInputFocus, 0, 1000, 4, 32);
+
+    stats = GetRequestStats(X_GetInputFocus, 0);
+    assert(stats);
+    assert(stats->count == 100);
+    assert(stats->time == 99 * 3 + 1000);
+    assert(stats->bytesIn == 400);
+    assert(stats->bytesOut == 3200);
+    assert(RequestStatsPercentile(stats, 50) == 4);
+    assert(RequestStatsPercentile(stats, 99) == 4);
+    assert(RequestStatsPercentile(stats, 100) == 1024);
+
+    /* Core requests ignore the minor opcode */
+    RecordRequestStats(test_client, X_NoOperation, 17, 0, 4, 0);
+    stats = GetRequestStats(X_NoOperation, 0);
+    assert(stats && stats->count == 1);
+    assert(RequestStatsPercentile(stats, 50) == 1);
+
+    /* Extension requests are counted per minor opcode */
+    RecordRequestStats(test_client, EXTENSION_BASE + 2, 7, 10, 8, 0);
+    assert(GetRequestStats(EXTENSION_BASE + 2, 7)->count == 1);
+    assert(!GetRequestStats(EXTENSION_BASE + 2, 6));
+    assert(!GetRequestStats(EXTENSION_BASE + 3, 7));
+
+    /* The client gets the totals, but its output is counted as written */
+    stats = ClientRequestStats(test_client);
+    assert(stats->count == 102);
+    assert(stats->time == 99 * 3 + 1000 + 10);
+    assert(stats->bytesIn == 412);
+    assert(stats->bytesOut == 0);
+
+    /* Latencies beyond the last bucket land in it */
+    RecordRequestStats(test_client, X_Bell, 0, 0xffffffff, 8, 0);
+    assert(RequestStatsPercentile(GetRequestStats(X_Bell, 0), 100) ==
+           (CARD32) 1 << (REQ_STATS_BUCKETS - 1));
+}
+
+#ifdef BENCHMARK
+static volatile int handled;
+
+static int
+noop_request(ClientPtr client)
+{
+    handled++;
+    return Success;
+}
+
+static int (*request_vector[1])(ClientPtr) = { noop_request };
+
+static void
+reqstats_bench(void)
+{
+    CARD64 start, plain, recorded, req_start, req_end;
+    int i;
+
+    start = GetTimeInMicros();
+    for (i = 0; i < BENCH_REQUESTS; i++)
+        (*request_vector[0])(test_client);
+    plain = GetTimeInMicros() - start;
+
+    start = GetTimeInMicros();
+    req_start = start;
+    for (i = 0; i < BENCH_REQUESTS; i++) {
+        (*request_vector[0])(test_client);
+        req_end = GetTimeInMicros();
+        RecordRequestStats(test_client, X_NoOperation, 0,
+                           req_end - req_start, 4, 0);
+        req_start = req_end;
+    }
+    recorded = GetTimeInMicros() - start;
+
+    printf("%-24s %14s\n", "dispatch", "ns/request");
+    printf("%-24s %14.1f\n", "handler only",
+           plain * 1000.0 / BENCH_REQUESTS);
+    printf("%-24s %14.1f\n", "handler and stats",
+           recorded * 1000.0 / BENCH_REQUESTS);
+    printf("Recording costs under 1%% of requests taking more than %.1f usec\n",
+           (double) (recorded > plain ? recorded - plain : 0) * 100.0 /
+           BENCH_REQUESTS);
+}
+#endif
+
+int
+main(int argc, char** argv)
+{
+    stats_test();
+#ifdef BENCHMARK
+    reqstats_bench();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright © 2026 X.Org Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "misc.h"
+#include "resource.h"
+#include "dixstruct.h"
+
+/*
+ * Checks the resource table behaviour the rest of the server depends on.
+ * Built with BENCHMARK defined (resource-bench), it then reports the cost
+ * of a lookup as the number of resources grows.
+ */
+
+#define MAX_BENCH_RESOURCES	(1 << 18)
+#define BENCH_LOOKUPS		(1 << 20)
+
+static ClientRec server_client, test_client;
+static RESTYPE RT_TEST, RT_TEST2;
+
+static int freed;
+static pointer freed_values[8];
+
+static int
+test_delete(pointer value, XID id)
+{
+    if (freed < sizeof(freed_values) / sizeof(freed_values[0]))
+        freed_values[freed] = value;
+    freed++;
+    return Success;
+}
+
+static void
+count_resource(pointer value, XID id, pointer cdata)
+{
+    (*(int*)cdata)++;
+}
+
+static void
+free_resource_and_next(pointer value, XID id, pointer cdata)
+{
+    (*(int*)cdata)++;
+    /* frees the resource being visited and the one after it */
+    FreeResource(id, RT_NONE);
+    FreeResource(id - 1, RT_NONE);
+}
+
+static XID
+test_id(int n)
+{
+    return test_client.clientAsMask | n;
+}
+
+static void
+resource_init(void)
+{
+    clients = calloc(LimitClients, sizeof(ClientPtr));
+    assert(clients);
+
+    serverClient = &server_client;
+    server_client.index = 0;
+    clients[0] = serverClient;
+    assert(InitClientResources(serverClient));
+
+    test_client.index = 1;
+    test_client.clientAsMask = (Mask)1 << CLIENTOFFSET;
+    clients[1] = &test_client;
+    currentMaxClients = 2;
+    assert(InitClientResources(&test_client));
+
+    RT_TEST = CreateNewResourceType(test_delete, "TEST");
+    RT_TEST2 = CreateNewResourceType(test_delete, "TEST2");
+    assert(RT_TEST && RT_TEST2);
+}
+
+static void
+resource_same_id(void)
+{
+    XID id = test_id(42);
+    pointer value;
+
+    assert(AddResource(id, RT_TEST, (pointer)1));
+    assert(AddResource(id, RT_TEST2, (pointer)2));
+    assert(AddResource(id, RT_TEST, (pointer)3));
+
+    /* the newest resource of a type wins, also once it is cached */
+    assert(dixLookupResourceByType(&value, id, RT_TEST, NULL, 0) == Success);
+    assert(value == (pointer)3);
+    assert(dixLookupResourceByType(&value, id, RT_TEST, NULL, 0) == Success);
+    assert(value == (pointer)3);
+    assert(dixLookupResourceByClass(&value, id, RC_ANY, NULL, 0) == Success);
+    assert(value == (pointer)3);
+
+    assert(ChangeResourceValue(id, RT_TEST2, (pointer)4));
+    assert(dixLookupResourceByType(&value, id, RT_TEST2, NULL, 0) == Success);
+    assert(value == (pointer)4);
+
+    /* a freed resource must not be found through the lookup cache */
+    FreeResourceByType(id, RT_TEST, FALSE);
+    assert(freed == 1 && freed_values[0] == (pointer)3);
+    assert(dixLookupResourceByType(&value, id, RT_TEST, NULL, 0) == Success);
+    assert(value == (pointer)1);
+
+    /* the remaining resources are freed newest first */
+    freed = 0;
+    FreeResource(id, RT_NONE);
+    assert(freed == 2);
+    assert(freed_values[0] == (pointer)4 && freed_values[1] == (pointer)1);
+    assert(dixLookupResourceByType(&value, id, RT_TEST, NULL, 0) != Success);
+    assert(dixLookupResourceByClass(&value, id, RC_ANY, NULL, 0) != Success);
+    freed = 0;
+}
+
+static void
+resource_growth(void)
+{
+    pointer value;
+    int i, count;
+    const int n = 100000;
+
+    for (i = 0; i < n; i++)
+        assert(AddResource(test_id(i), RT_TEST, (pointer)(long)i));
+
+    /* free every other one, leaving deleted slots behind */
+    for (i = 0; i < n; i += 2)
+        FreeResource(test_id(i), RT_NONE);
+    assert(freed == n / 2);
+
+    for (i = 0; i < n; i++) {
+        int rc = dixLookupResourceByType(&value, test_id(i), RT_TEST, NULL, 0);
+        assert((i & 1) ? (rc == Success && value == (pointer)(long)i) :
+                         rc != Success);
+    }
+
+    /* churn through the deleted slots, which must not fill up the table */
+    for (i = 0; i < 10 * n; i++) {
+        XID id = test_id(n + (i % 1000));
+        assert(AddResource(id, RT_TEST2, NULL));
+        FreeResource(id, RT_NONE);
+    }
+
+    count = 0;
+    FindClientResourcesByType(&test_client, RT_TEST, count_resource, &count);
+    assert(count == n / 2);
+    count = 0;
+    FindClientResourcesByType(&test_client, RT_TEST2, count_resource, &count);
+    assert(count == 0);
+
+    freed = 0;
+    FreeClientResources(&test_client);
+    assert(freed == n / 2);
+    freed = 0;
+    assert(InitClientResources(&test_client));
+}
+
+static void
+resource_iteration(void)
+{
+    RESTYPE RT_LATE;
+    pointer value;
+    int i, count;
+    const int n = 1000;
+
+    for (i = 0; i < n; i++)
+        assert(AddResource(test_id(i), RT_TEST, (pointer)(long)i));
+
+    /* a type created after the client, which needs a new type list */
+    RT_LATE = CreateNewResourceType(test_delete, "LATE");
+    assert(RT_LATE);
+    assert(AddResource(test_id(n), RT_LATE, NULL));
+    assert(dixLookupResourceByType(&value, test_id(n), RT_LATE, NULL, 0) ==
+           Success);
+    count = 0;
+    FindClientResourcesByType(&test_client, RT_LATE, count_resource, &count);
+    assert(count == 1);
+    count = 0;
+    FindClientResourcesByType(&test_client, 0, count_resource, &count);
+    assert(count == n + 1);
+
+    /* newest first, so every visit frees two resources not yet seen */
+    count = 0;
+    FindClientResourcesByType(&test_client, RT_TEST, free_resource_and_next,
+                              &count);
+    assert(count == n / 2);
+    assert(freed == n);
+
+    freed = 0;
+    FreeClientResources(&test_client);
+    assert(freed == 1);
+    freed = 0;
+    assert(InitClientResources(&test_client));
+}
+
+#ifdef BENCHMARK
+static void
+resource_bench(void)
+{
+    pointer value;
+    CARD64 start, random_time, repeat_time;
+    CARD32 seed = 1;
+    int i, n, have = 0;
+
+    printf("%10s %14s %14s\n", "resources", "ns/lookup", "ns/repeated");
+    for (n = 64; n <= MAX_BENCH_RESOURCES; n *= 4) {
+        for (; have < n; have++)
+            assert(AddResource(test_id(have), RT_TEST, (pointer)(long)have));
+
+        start = GetTimeInMicros();
+        for (i = 0; i < BENCH_LOOKUPS; i++) {
+            seed = seed * 1103515245 + 12345;
+            dixLookupResourceByType(&value, test_id((seed >> 8) % n),
+                                    RT_TEST, NULL, 0);
+        }
+        random_time = GetTimeInMicros() - start;
+
+        start = GetTimeInMicros();
+        for (i = 0; i < BENCH_LOOKUPS; i++)
+            dixLookupResourceByType(&value, test_id(n / 2), RT_TEST, NULL, 0);
+        repeat_time = GetTimeInMicros() - start;
+        assert(value == (pointer)(long)(n / 2));
+
+        printf("%10d %14.1f %14.1f\n", n,
+               random_time * 1000.0 / BENCH_LOOKUPS,
+               repeat_time * 1000.0 / BENCH_LOOKUPS);
+    }
+
+    start = GetTimeInMicros();
+    FreeClientResources(&test_client);
+    printf("FreeClientResources of %d resources: %.1f ms\n", have,
+           (GetTimeInMicros() - start) / 1000.0);
+    assert(freed == have);
+    freed = 0;
+}
+#endif
+
+int
+main(int argc, char** argv)
+{
+    resource_init();
+    resource_same_id();
+    resource_growth();
+    resource_iteration();
+#ifdef BENCHMARK
+    resource_bench();
+#endif
+
+    return 0;
+}
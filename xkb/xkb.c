@@ -1403,8 +1403,7 @@ char		*desc,*start;
 	swaps(&rep->totalActs);
     }
     WriteToClient(client, (i=SIZEOF(xkbGetMapReply)), (char *)rep);
-    WriteToClient(client, len, start);
-    free((char *)start);
+    WriteToClientNoCopy(client, len, start, free, start);
     return Success;
 }
 